@@ -0,0 +1,472 @@
+/**
+ * bench_native.cpp - Google Benchmark suite for the native hot paths
+ *
+ * Covers everything a frame touches before it reaches pybind11: the
+ * frame pool, the delivery ring, colour conversion per resolution preset,
+ * full decode+convert from a recording, the shared decode pool and the
+ * recorder. The Python-side costs (GIL hand-off, to_numpy, callbacks,
+ * controller sends) are measured by the pytest-benchmark suite next to
+ * this file.
+ */
+
+#include <benchmark/benchmark.h>
+
+extern "C" {
+#include <libavutil/frame.h>
+}
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <chiaki/log.h>
+#include <chiaki/video.h>
+
+#include "audio_ring.h"
+#include "change_detector.h"
+#include "color_convert.h"
+#include "flight_recorder.h"
+#include "frame_pool.h"
+#include "latency_probe.h"
+#include "log_sink.h"
+#include "media_recorder.h"
+#include "probe_set.h"
+#include "session_metrics.h"
+#include "shared_frames.h"
+#include "spsc_ring.h"
+#include "stream_recording.h"
+#include "thread_pool.h"
+#include "video_decoder.h"
+
+namespace {
+
+struct Preset {
+    const char* name;
+    int width;
+    int height;
+};
+
+// Matches ChiakiVideoResolutionPreset
+const Preset PRESETS[] = {
+    {"360p", 640, 360},
+    {"540p", 960, 540},
+    {"720p", 1280, 720},
+    {"1080p", 1920, 1080},
+};
+
+const char* FORMAT_NAMES[] = {"BGR", "RGB", "GRAY"};
+
+void preset_args(benchmark::internal::Benchmark* bench) {
+    for (int preset = 0; preset < 4; preset++) {
+        for (int format = 0; format < 3; format++) {
+            bench->Args({preset, format});
+        }
+    }
+}
+
+void model_input_args(benchmark::internal::Benchmark* bench) {
+    for (int preset = 0; preset < 4; preset++) {
+        bench->Args({preset, 0});
+        bench->Args({preset, 1});
+    }
+}
+
+// Allocates a YUV420P picture with a gradient
+AVFrame* make_test_picture(int width, int height) {
+    AVFrame* frame = av_frame_alloc();
+    frame->format = AV_PIX_FMT_YUV420P;
+    frame->width = width;
+    frame->height = height;
+    av_frame_get_buffer(frame, 64);
+
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            frame->data[0][y * frame->linesize[0] + x] = static_cast<uint8_t>(x + y);
+        }
+    }
+    for (int plane = 1; plane < 3; plane++) {
+        for (int y = 0; y < height / 2; y++) {
+            memset(frame->data[plane] + y * frame->linesize[plane], 128 + plane * y % 64, width / 2);
+        }
+    }
+    return frame;
+}
+
+} // namespace
+
+static void BM_FramePoolAcquire(benchmark::State& state) {
+    FramePool pool(VideoDecoder::DEFAULT_POOL_SLABS);
+    const size_t size = static_cast<size_t>(state.range(0));
+
+    for (auto _ : state) {
+        FrameBufferRef buffer = pool.acquire(size);
+        benchmark::DoNotOptimize(buffer.data());
+    }
+    state.counters["misses"] = static_cast<double>(pool.misses());
+}
+BENCHMARK(BM_FramePoolAcquire)->Arg(640 * 360 * 3)->Arg(1920 * 1080 * 3);
+
+// Producer pushes a pooled frame, consumer thread pops it and acknowledges:
+// one iteration is a full cross-thread hand-off through the delivery ring
+static void BM_FrameRingHandoff(benchmark::State& state) {
+    SpscRing<VideoFrame> ring(8, OverflowPolicy::DROP_OLDEST);
+    FramePool pool(VideoDecoder::DEFAULT_POOL_SLABS);
+    std::atomic<uint64_t> acked{0};
+    std::atomic<bool> done{false};
+
+    std::thread consumer([&] {
+        VideoFrame frame;
+        while (!done.load(std::memory_order_relaxed)) {
+            if (ring.try_pop(frame)) {
+                acked.fetch_add(1, std::memory_order_release);
+            }
+        }
+    });
+
+    uint64_t sent = 0;
+    for (auto _ : state) {
+        VideoFrame frame(pool.acquire(1920 * 1080 * 3), 1920 * 1080 * 3, 1920, 1080, PixelFormat::BGR);
+        ring.push(std::move(frame));
+        sent++;
+        while (acked.load(std::memory_order_acquire) != sent) {
+        }
+    }
+
+    done = true;
+    consumer.join();
+}
+BENCHMARK(BM_FrameRingHandoff)->UseRealTime();
+
+static void BM_ConvertFrame(benchmark::State& state) {
+    const Preset& preset = PRESETS[state.range(0)];
+    const auto format = static_cast<PixelFormat>(state.range(1));
+    state.SetLabel(std::string(preset.name) + "/" + FORMAT_NAMES[state.range(1)]);
+
+    size_t delivered = 0;
+    VideoDecoder decoder(format, [&delivered](VideoFrame&&) { delivered++; });
+    AVFrame* picture = make_test_picture(preset.width, preset.height);
+
+    for (auto _ : state) {
+        decoder.convert_frame(picture, 0);
+    }
+
+    av_frame_free(&picture);
+    state.SetItemsProcessed(static_cast<int64_t>(delivered));
+    state.SetBytesProcessed(static_cast<int64_t>(delivered) * preset.width * preset.height *
+                            pixel_format_channels(format));
+}
+BENCHMARK(BM_ConvertFrame)->Apply(preset_args)->Unit(benchmark::kMicrosecond);
+
+// Model-input path: full picture box-downscaled to a 224x224 float32 CHW
+// tensor, or a 1:1 centre crop as uint8 BGR
+static void BM_ConvertToModelInput(benchmark::State& state) {
+    const Preset& preset = PRESETS[state.range(0)];
+    const bool tensor = state.range(1) != 0;
+
+    OutputSpec spec;
+    if (tensor) {
+        spec.width = 224;
+        spec.height = 224;
+        spec.format = PixelFormat::RGB_F32_CHW;
+        spec.resample = Resample::BOX;
+    } else {
+        spec.roi_x = (preset.width - 224) / 2;
+        spec.roi_y = (preset.height - 224) / 2;
+        spec.roi_width = 224;
+        spec.roi_height = 224;
+    }
+    state.SetLabel(std::string(preset.name) + (tensor ? "/224_f32_chw/" : "/crop224_bgr/") +
+                   FrameConverter::kernel_name());
+
+    size_t delivered = 0;
+    VideoDecoder decoder(spec, [&delivered](VideoFrame&&) { delivered++; });
+    AVFrame* picture = make_test_picture(preset.width, preset.height);
+
+    for (auto _ : state) {
+        decoder.convert_frame(picture, 0);
+    }
+
+    av_frame_free(&picture);
+    state.SetItemsProcessed(static_cast<int64_t>(delivered));
+}
+BENCHMARK(BM_ConvertToModelInput)->Apply(model_input_args)->Unit(benchmark::kMicrosecond);
+
+// Decodes a recorded stream end to end; items are decoded pictures
+static void BM_DecodeConvert(benchmark::State& state) {
+    const Preset& preset = PRESETS[state.range(0)];
+    const auto format = static_cast<PixelFormat>(state.range(1));
+    state.SetLabel(std::string(preset.name) + "/" + FORMAT_NAMES[state.range(1)]);
+
+    const char* directory = std::getenv("PY_CHIAKI_NG_BENCH_RECORDINGS");
+    if (!directory) {
+        state.SkipWithError("PY_CHIAKI_NG_BENCH_RECORDINGS not set");
+        return;
+    }
+    const std::string path = std::string(directory) + "/" + preset.name + ".pcngrec";
+
+    std::unique_ptr<StreamRecording> recording;
+    try {
+        recording = std::make_unique<StreamRecording>(path);
+    } catch (const std::exception& e) {
+        state.SkipWithError(e.what());
+        return;
+    }
+
+    ChiakiLog log;
+    chiaki_log_init(&log, CHIAKI_LOG_ERROR, nullptr, nullptr);
+
+    size_t delivered = 0;
+    VideoDecoder decoder(format, [&delivered](VideoFrame&&) { delivered++; });
+    if (decoder.init(&log, static_cast<ChiakiCodec>(recording->codec())) != CHIAKI_ERR_SUCCESS) {
+        state.SkipWithError("decoder init failed");
+        return;
+    }
+
+    std::vector<uint8_t> sample;
+    for (auto _ : state) {
+        for (const RecordView& record : recording->records()) {
+            if (record.kind != RecordKind::VIDEO_SAMPLE) {
+                continue;
+            }
+            sample.assign(record.payload, record.payload + record.size);
+            sample.resize(record.size + CHIAKI_VIDEO_BUFFER_PADDING_SIZE, 0);
+            decoder.push_sample(sample.data(), record.size, record.frames_lost, record.frame_recovered);
+        }
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(delivered));
+}
+BENCHMARK(BM_DecodeConvert)->Apply(preset_args)->Unit(benchmark::kMillisecond);
+
+// Many sessions posting small tasks through their strands on one pool
+static void BM_StrandThroughput(benchmark::State& state) {
+    const int sessions = static_cast<int>(state.range(0));
+    constexpr int TASKS_PER_SESSION = 256;
+
+    auto pool = std::make_shared<WorkStealingPool>();
+    std::vector<std::unique_ptr<Strand>> strands;
+    for (int i = 0; i < sessions; i++) {
+        strands.push_back(std::make_unique<Strand>(pool));
+    }
+
+    std::atomic<int64_t> completed{0};
+    for (auto _ : state) {
+        const int64_t target = completed.load() + int64_t{sessions} * TASKS_PER_SESSION;
+        for (int task = 0; task < TASKS_PER_SESSION; task++) {
+            for (auto& strand : strands) {
+                strand->post([&completed] { completed.fetch_add(1, std::memory_order_relaxed); });
+            }
+        }
+        while (completed.load(std::memory_order_relaxed) < target) {
+            std::this_thread::yield();
+        }
+    }
+    state.SetItemsProcessed(completed.load());
+    state.counters["steals"] = static_cast<double>(pool->steals());
+}
+BENCHMARK(BM_StrandThroughput)->Arg(1)->Arg(8)->Arg(32)->UseRealTime();
+
+static void BM_RecorderWriteSample(benchmark::State& state) {
+    const std::string path = "bench_recorder.pcngrec";
+    std::vector<uint8_t> payload(static_cast<size_t>(state.range(0)), 0x5a);
+
+    {
+        StreamRecorder recorder(path, 0);
+        int64_t timestamp_ns = 0;
+        for (auto _ : state) {
+            recorder.write_sample(payload.data(), payload.size(), 0, false, timestamp_ns += 16666667);
+        }
+    }
+    std::remove(path.c_str());
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_RecorderWriteSample)->Arg(4 * 1024)->Arg(64 * 1024);
+
+// What remuxing costs the video thread: the keyframe check and a copy
+// into the writer's queue, with a keyframe every second at 60 fps
+static void BM_MediaRecorderWriteVideo(benchmark::State& state) {
+    const std::string path = "bench_recorder.mkv";
+    std::vector<uint8_t> keyframe(static_cast<size_t>(state.range(0)), 0x5a);
+    std::vector<uint8_t> picture(keyframe.size(), 0x5a);
+    const uint8_t idr[] = {0, 0, 0, 1, 0x65, 0x88};
+    const uint8_t trail[] = {0, 0, 0, 1, 0x41, 0x9a};
+    std::copy(idr, idr + sizeof(idr), keyframe.begin());
+    std::copy(trail, trail + sizeof(trail), picture.begin());
+
+    std::vector<std::string> segments;
+    {
+        MediaRecorder recorder(path, MediaRecorderConfig());
+        int64_t timestamp_ns = 0;
+        uint64_t n = 0;
+        for (auto _ : state) {
+            const std::vector<uint8_t>& sample = n++ % 60 == 0 ? keyframe : picture;
+            recorder.write_video(sample.data(), sample.size(), timestamp_ns += 16666667);
+        }
+        recorder.stop();
+        state.counters["dropped"] = static_cast<double>(recorder.stats().dropped);
+        segments = recorder.segments();
+    }
+    for (const std::string& segment : segments) {
+        std::remove(segment.c_str());
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_MediaRecorderWriteVideo)->Arg(4 * 1024)->Arg(64 * 1024)->Unit(benchmark::kMicrosecond);
+
+// The flight recorder's cost on the video thread once its ring is full
+// and every sample reclaims space: a copy plus a group eviction per GOP
+static void BM_FlightRecorderAddSample(benchmark::State& state) {
+    std::vector<uint8_t> keyframe(static_cast<size_t>(state.range(0)), 0x5a);
+    std::vector<uint8_t> picture(keyframe.size(), 0x5a);
+    const uint8_t idr[] = {0, 0, 0, 1, 0x65, 0x88};
+    const uint8_t trail[] = {0, 0, 0, 1, 0x41, 0x9a};
+    std::copy(idr, idr + sizeof(idr), keyframe.begin());
+    std::copy(trail, trail + sizeof(trail), picture.begin());
+
+    FlightRecorder recorder(0, size_t{16} << 20, 0);
+    int64_t timestamp_ns = 0;
+    uint64_t n = 0;
+    for (auto _ : state) {
+        const std::vector<uint8_t>& sample = n++ % 60 == 0 ? keyframe : picture;
+        recorder.add_sample(sample.data(), sample.size(), 0, false, timestamp_ns += 16666667);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_FlightRecorderAddSample)->Arg(4 * 1024)->Arg(64 * 1024);
+
+// Every stage of every frame records a latency, from several threads at once
+static void BM_LatencyHistogramRecord(benchmark::State& state) {
+    static LatencyHistogram histogram;
+    int64_t value = 1000;
+    for (auto _ : state) {
+        histogram.record(value);
+        value = (value * 1103515245 + 12345) & ((int64_t{1} << 30) - 1);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LatencyHistogramRecord)->Threads(1)->Threads(4);
+
+// One 10 ms Opus packet worth of stereo PCM into the mirrored ring
+static void BM_AudioRingWrite(benchmark::State& state) {
+    AudioRing ring(48000, 2, 48000 * 10);
+    std::vector<float> pcm(480 * 2, 0.25f);
+    int64_t arrival_ns = 1;
+    for (auto _ : state) {
+        ring.write(pcm.data(), 480, arrival_ns += 10000000);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * pcm.size() * sizeof(float)));
+}
+BENCHMARK(BM_AudioRingWrite);
+
+// Publishing a decoded 720p BGR frame costs one copy into shared memory
+static void BM_SharedFramePublish(benchmark::State& state) {
+    const int width = 1280;
+    const int height = 720;
+    const size_t size = static_cast<size_t>(width) * height * 3;
+    std::vector<uint8_t> pixels(size, 0x80);
+    VideoFrame frame(pixels.data(), size, width, height, PixelFormat::BGR);
+    SharedFrameWriter writer("py_chiaki_ng_bench", 4, size);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(writer.publish(frame));
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * size));
+}
+BENCHMARK(BM_SharedFramePublish);
+
+// Runs on every decoded picture ahead of conversion, so it has to stay a
+// small fraction of BM_ConvertFrame's cost at the same size
+static void BM_ChangeDetect1080p(benchmark::State& state) {
+    const int width = 1920;
+    const int height = 1080;
+    std::vector<uint8_t> luma(static_cast<size_t>(width) * height);
+    for (size_t i = 0; i < luma.size(); i++) {
+        luma[i] = static_cast<uint8_t>(i * 31 % 251);
+    }
+    ChangeDetector detector;
+    ChangeSpec spec;
+    spec.threshold = 1.0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(detector.measure(luma.data(), width, width, height, spec));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ChangeDetect1080p)->Unit(benchmark::kMicrosecond);
+
+// A typical HUD check batch on a 720p BGR frame: a few pixels, two
+// regions and one 32x32 icon searched in a 96x64 area
+static void BM_ProbeSet720p(benchmark::State& state) {
+    const int width = 1280;
+    const int height = 720;
+    std::vector<uint8_t> pixels(static_cast<size_t>(width) * height * 3);
+    for (size_t i = 0; i < pixels.size(); i++) {
+        pixels[i] = static_cast<uint8_t>(i * 31 % 251);
+    }
+    VideoFrame frame(pixels.data(), pixels.size(), width, height, PixelFormat::BGR);
+    std::vector<uint8_t> icon(32 * 32);
+    for (size_t i = 0; i < icon.size(); i++) {
+        icon[i] = static_cast<uint8_t>(i * 7 % 255);
+    }
+    ProbeSet probes;
+    for (int i = 0; i < 8; i++) {
+        probes.add_pixel("pixel" + std::to_string(i), 100 + i * 100, 50, {255, 0, 0}, 16, 1);
+    }
+    probes.add_mean("bar", 40, 660, 400, 20, 0);
+    probes.add_variance("panel", 900, 500, 300, 150, -1);
+    probes.add_template("icon", icon.data(), 32, 32, 1100, 40, 96, 64, true);
+    std::vector<float> results(probes.size());
+    for (auto _ : state) {
+        probes.evaluate(frame, results.data());
+        benchmark::DoNotOptimize(results.data());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ProbeSet720p)->Unit(benchmark::kMicrosecond);
+
+// What a latency probe adds to every decoded 1080p picture: a 200x200
+// region measured, with a measurement running half the time
+static void BM_LatencyProbe1080p(benchmark::State& state) {
+    const int width = 1920;
+    const int height = 1080;
+    std::vector<uint8_t> frames[2] = {std::vector<uint8_t>(static_cast<size_t>(width) * height, 40),
+                                      std::vector<uint8_t>(static_cast<size_t>(width) * height, 40)};
+    for (int y = 400; y < 600; y++) {
+        std::fill(frames[1].begin() + y * width + 800, frames[1].begin() + y * width + 1000, 220);
+    }
+    ChangeSpec spec;
+    spec.roi_x = 800;
+    spec.roi_y = 400;
+    spec.roi_width = 200;
+    spec.roi_height = 200;
+    spec.grid_width = 16;
+    spec.grid_height = 16;
+    LatencyHistogram histogram;
+    LatencyProbe probe(spec, 1000000000, histogram);
+    int64_t now_ns = 0;
+    uint64_t n = 0;
+    for (auto _ : state) {
+        now_ns += 16666667;
+        if (n % 2 == 0) {
+            probe.on_input(now_ns);
+        }
+        probe.on_picture(frames[n++ % 2].data(), width, width, height, now_ns);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LatencyProbe1080p)->Unit(benchmark::kMicrosecond);
+
+// chiaki logs from its network and video threads; a push must stay cheap
+// with debug logging on, whether or not the ring has room
+static void BM_LogSinkPush(benchmark::State& state) {
+    static LogSink sink(nullptr);
+    const char* message = "Takion packet ack seq 12345, received 1400 bytes";
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(sink.push(CHIAKI_LOG_DEBUG, 1, message));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LogSinkPush)->Threads(1)->Threads(4);
@@ -0,0 +1,64 @@
+"""
+Fixtures for the binding benchmarks
+
+Synthetic recordings drive the sample and event paths without a console;
+decode benchmarks need real streams recorded with Session.start_recording(),
+found through PY_CHIAKI_NG_BENCH_RECORDINGS (see CMakeLists.txt here).
+"""
+
+import os
+import struct
+
+import pytest
+
+import py_chiaki_ng
+
+# Record kinds and layout from src/stream_recording.h
+_VIDEO_SAMPLE = 1
+_EVENT = 2
+_HEADER = b"PCNGREC1" + struct.pack("<IIQ", 1, 1, 0)
+
+RESOLUTION_PRESETS = ["360p", "540p", "720p", "1080p"]
+
+
+def _record(kind, payload, timestamp_ns):
+    header = struct.pack("<IIqiB3x", kind, len(payload), timestamp_ns, 0, 0)
+    return header + payload + bytes(-len(payload) % 8)
+
+
+def write_recording(path, samples=0, events=0, sample_size=32 * 1024, interval_ns=1_000_000):
+    """Write a recording of dummy NAL samples and CONNECTED events"""
+    with open(path, "wb") as f:
+        f.write(_HEADER)
+        payload = b"\x00\x00\x00\x01\x41" + bytes(sample_size - 5)
+        event = struct.pack("<II", int(py_chiaki_ng.EventType.CONNECTED), 0)
+        for i in range(max(samples, events)):
+            if i < samples:
+                f.write(_record(_VIDEO_SAMPLE, payload, i * interval_ns))
+            if i < events:
+                f.write(_record(_EVENT, event, i * interval_ns))
+    return str(path)
+
+
+@pytest.fixture(autouse=True)
+def _require_bindings():
+    if not hasattr(py_chiaki_ng, "ReplaySession"):
+        pytest.skip("C++ bindings not built")
+
+
+@pytest.fixture
+def sample_recording(tmp_path):
+    return write_recording(tmp_path / "samples.pcngrec", samples=2000)
+
+
+@pytest.fixture
+def event_recording(tmp_path):
+    return write_recording(tmp_path / "events.pcngrec", events=2000)
+
+
+@pytest.fixture
+def recordings_dir():
+    directory = os.environ.get("PY_CHIAKI_NG_BENCH_RECORDINGS")
+    if not directory:
+        pytest.skip("PY_CHIAKI_NG_BENCH_RECORDINGS not set")
+    return directory
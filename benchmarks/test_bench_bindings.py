@@ -0,0 +1,151 @@
+"""
+pytest-benchmark suite for the Python-facing hot paths
+
+Run separately from the unit tests and keep the JSON for comparisons:
+
+    pytest benchmarks --benchmark-json=bench_python.json
+    pytest-benchmark compare bench_python.json other.json
+
+Per-item costs for batch benchmarks are stored in each entry's extra_info.
+"""
+
+import os
+import statistics
+import time
+
+import pytest
+
+import py_chiaki_ng
+
+from conftest import RESOLUTION_PRESETS
+
+pytest.importorskip("pytest_benchmark")
+
+
+def _replay_all(path, setup):
+    """Replay a recording as fast as possible; returns the session after join"""
+    replay = py_chiaki_ng.ReplaySession(path, realtime=False)
+    replay.initialize()
+    setup(replay)
+    replay.start()
+    replay.join()
+    return replay
+
+
+def _per_item(benchmark, items):
+    benchmark.extra_info["items"] = items
+    benchmark.extra_info["ns_per_item"] = benchmark.stats.stats.mean * 1e9 / max(items, 1)
+
+
+def test_to_numpy(benchmark):
+    """Zero-copy VideoFrame -> numpy view of a 1080p BGR frame"""
+    pytest.importorskip("numpy")
+    frame = py_chiaki_ng.create_video_frame(bytes(1920 * 1080 * 3), 1920, 1080)
+    view = benchmark(frame.to_numpy)
+    assert view.shape == (1080, 1920, 3)
+
+
+@pytest.mark.parametrize("pixel_format", ["BGR", "RGB_F32_CHW"])
+def test_convert_yuv420(benchmark, pixel_format):
+    """1080p I420 -> 224x224 model input through the native kernels"""
+    pytest.importorskip("numpy")
+    picture = bytes(1920 * 1080 * 3 // 2)
+    spec = py_chiaki_ng.OutputSpec(
+        width=224, height=224, resample=py_chiaki_ng.Resample.BOX,
+        pixel_format=getattr(py_chiaki_ng.PixelFormat, pixel_format))
+    frame = benchmark(py_chiaki_ng.convert_yuv420, picture, 1920, 1080, spec)
+    benchmark.extra_info["kernel"] = py_chiaki_ng.COLOR_CONVERT_KERNEL
+    assert frame.width == 224
+
+
+def test_sample_callback_delivery(benchmark, sample_recording):
+    """Raw sample -> Python video callback, including the GIL hand-off"""
+    delivered = []
+
+    def setup(replay):
+        replay.set_video_callback(lambda data, size, lost, recovered: delivered.append(size) or True)
+
+    benchmark.pedantic(_replay_all, args=(sample_recording, setup), rounds=5)
+    _per_item(benchmark, len(delivered) // 5)
+
+
+def test_frame_queue_latency(benchmark, tmp_path):
+    """Sample arrival -> next_frame() return while the consumer is blocked"""
+    from conftest import write_recording
+
+    path = write_recording(tmp_path / "paced.pcngrec", samples=500, sample_size=4096)
+    replay = py_chiaki_ng.ReplaySession(path, realtime=True, loop=True)
+    replay.initialize()
+    replay.enable_frame_queue(4)
+    replay.start()
+
+    latencies = []
+
+    def pop():
+        frame = replay.next_frame(timeout=1)
+        latencies.append(time.monotonic_ns() - frame.timestamp_ns)
+
+    try:
+        benchmark.pedantic(pop, rounds=500, warmup_rounds=10)
+    finally:
+        replay.stop()
+        replay.join()
+
+    latencies.sort()
+    benchmark.extra_info["latency_ns_median"] = statistics.median(latencies)
+    benchmark.extra_info["latency_ns_p99"] = latencies[int(len(latencies) * 0.99)]
+
+
+def test_event_dispatch(benchmark, event_recording):
+    """Event -> Python event callback with the typed event conversion"""
+    received = []
+
+    def setup(replay):
+        replay.set_event_callback(received.append)
+
+    benchmark.pedantic(_replay_all, args=(event_recording, setup), rounds=5)
+    _per_item(benchmark, len(received) // 5)
+
+
+def test_event_queue_drain(benchmark, event_recording):
+    """Queued events drained with next_event(timeout=0)"""
+    replay = _replay_all(event_recording, lambda r: r.enable_event_queue(4096))
+
+    def drain():
+        count = 0
+        while replay.next_event(timeout=0) is not None:
+            count += 1
+        return count
+
+    count = benchmark.pedantic(drain, rounds=1, iterations=1)
+    assert count > 0
+    _per_item(benchmark, count)
+
+
+def test_controller_state_send(benchmark):
+    """ControllerState -> chiaki_session_set_controller_state"""
+    session = py_chiaki_ng.Session()
+    if not session.initialize("127.0.0.1", "0" * 16):
+        pytest.skip("chiaki session could not be initialized")
+
+    state = py_chiaki_ng.ControllerState()
+    state.left_x = 1000
+    assert benchmark(session.send_controller_state, state)
+
+
+@pytest.mark.parametrize("preset", RESOLUTION_PRESETS)
+@pytest.mark.parametrize("pixel_format", ["BGR", "GRAY"])
+def test_decode_convert(benchmark, recordings_dir, preset, pixel_format):
+    """Recorded stream -> decoded, colour-converted VideoFrames"""
+    path = os.path.join(recordings_dir, f"{preset}.pcngrec")
+    if not os.path.exists(path):
+        pytest.skip(f"no recording for {preset}")
+
+    def setup(replay):
+        replay.enable_decoding(getattr(py_chiaki_ng.PixelFormat, pixel_format))
+
+    replay = benchmark.pedantic(_replay_all, args=(path, setup), rounds=3)
+    decoded = replay.stats()["frames_decoded"]
+    benchmark.extra_info["preset"] = preset
+    _per_item(benchmark, decoded)
+    benchmark.extra_info["fps"] = decoded / benchmark.stats.stats.mean
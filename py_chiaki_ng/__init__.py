@@ -29,9 +29,35 @@ try:
     from py_chiaki_ng_core import (
         # Core classes
         Session,
+        SessionPool,
+        ReplaySession,
         ControllerState,
         VideoFrame,
         VideoProfile,
+        ConnectVideoProfile,
+        SessionConfig,
+        OutputSpec,
+        DecodePolicy,
+        ChangeDetection,
+        ChangeDetector,
+        ProbeSet,
+        AudioBuffer,
+        SharedFrameWriter,
+        SharedFrameReader,
+        SharedFrame,
+        
+        # Events
+        Event,
+        QuitEvent,
+        RumbleEvent,
+        TriggerEffectsEvent,
+        LedColorEvent,
+        PlayerIndexEvent,
+        HapticIntensityEvent,
+        TriggerIntensityEvent,
+        MotionResetEvent,
+        KeyboardTextEvent,
+        LoginPinRequestEvent,
         
         # Enums
         ErrorCode,
@@ -42,14 +68,31 @@ try:
         ControllerButton,
         VideoResolutionPreset,
         VideoFPSPreset,
+        PixelFormat,
+        OverflowPolicy,
+        InputField,
+        Resample,
+        ColorMatrix,
+        DecodeProfile,
+        LogLevel,
         
         # Utility functions
         quit_reason_string,
         quit_reason_is_error,
         create_video_frame,
+        convert_yuv420,
+        configure_logging,
+        flush_logs,
+        log_stats,
         
         # Constants
         VIDEO_BUFFER_PADDING_SIZE,
+        INPUT_DTYPE,
+        CONTROLLER_LAYOUT,
+        COLOR_CONVERT_KERNEL,
+        CHANGE_DETECT_KERNEL,
+        PROBE_KERNEL,
+        LOG_ALL,
     )
 except ImportError as e:
     # If C++ bindings aren't built yet, provide helpful error message
@@ -75,9 +118,35 @@ except ImportError as e:
 __all__ = [
     # Core classes
     "Session",
+    "SessionPool",
+    "ReplaySession",
     "ControllerState", 
     "VideoFrame",
     "VideoProfile",
+    "ConnectVideoProfile",
+    "SessionConfig",
+    "OutputSpec",
+    "DecodePolicy",
+    "ChangeDetection",
+    "ChangeDetector",
+    "ProbeSet",
+    "AudioBuffer",
+    "SharedFrameWriter",
+    "SharedFrameReader",
+    "SharedFrame",
+    
+    # Events
+    "Event",
+    "QuitEvent",
+    "RumbleEvent",
+    "TriggerEffectsEvent",
+    "LedColorEvent",
+    "PlayerIndexEvent",
+    "HapticIntensityEvent",
+    "TriggerIntensityEvent",
+    "MotionResetEvent",
+    "KeyboardTextEvent",
+    "LoginPinRequestEvent",
     
     # Enums
     "ErrorCode",
@@ -88,9 +157,28 @@ __all__ = [
     "ControllerButton",
     "VideoResolutionPreset",
     "VideoFPSPreset",
+    "PixelFormat",
+    "OverflowPolicy",
+    "InputField",
+    "Resample",
+    "ColorMatrix",
+    "DecodeProfile",
+    "LogLevel",
     
     # Utility functions
     "quit_reason_string",
     "quit_reason_is_error", 
     "create_video_frame",
+    "convert_yuv420",
+    "configure_logging",
+    "flush_logs",
+    "log_stats",
+    
+    # Constants
+    "INPUT_DTYPE",
+    "CONTROLLER_LAYOUT",
+    "COLOR_CONVERT_KERNEL",
+    "CHANGE_DETECT_KERNEL",
+    "PROBE_KERNEL",
+    "LOG_ALL",
 ]
@@ -0,0 +1,119 @@
+"""
+asyncio integration for py-chiaki-ng
+
+The C++ session signals an eventfd (a pipe on non-Linux POSIX systems) when
+frames or events land in its queues, so awaiting them costs nothing while
+idle and never needs ``call_soon_threadsafe`` per frame. Many sessions can
+share one event loop.
+
+Usage:
+    >>> session = Session()
+    >>> session.initialize(host, regist_key)
+    >>> session.enable_decoding()
+    >>> session.enable_frame_queue()
+    >>> session.enable_event_queue()
+    >>> asession = AsyncSession(session)
+    >>> session.start()
+    >>> async for frame in asession.frames():
+    ...     await asession.send_controller_state(policy(frame.to_numpy()))
+"""
+
+import asyncio
+import os
+from typing import Any, AsyncIterator, Optional
+
+# Poll interval used only where the platform offers no wakeup fd (Windows)
+_FALLBACK_POLL_SECONDS = 0.05
+
+
+class AsyncSession:
+    """
+    Awaitable view of a ``Session``.
+
+    Frames come from the frame queue (``enable_frame_queue()``) or, for
+    ``latest_frame()``, from the mailbox (``enable_mailbox()``); events come
+    from the event queue (``enable_event_queue()``). Attribute access not
+    defined here is forwarded to the wrapped session.
+
+    Each queue supports one awaiting consumer at a time.
+    """
+
+    def __init__(self, session: Any):
+        self._session = session
+        self._frame_fd = session.frame_notify_fd()
+        self._event_fd = session.event_notify_fd()
+        self._last_sequence: Optional[int] = None
+
+    def __getattr__(self, name: str) -> Any:
+        return getattr(self._session, name)
+
+    @property
+    def session(self) -> Any:
+        return self._session
+
+    async def next_frame(self) -> Any:
+        """Wait for the next queued VideoFrame"""
+        while True:
+            frame = self._session.next_frame(timeout=0)
+            if frame is not None:
+                return frame
+            await self._wait(self._frame_fd, self._session.arm_frame_notify)
+
+    async def latest_frame(self) -> Any:
+        """Wait for a mailbox frame newer than the last one returned"""
+        while True:
+            frame = self._session.latest_frame()
+            if frame is not None and frame.sequence != self._last_sequence:
+                self._last_sequence = frame.sequence
+                return frame
+            await self._wait(self._frame_fd, self._session.arm_frame_notify)
+
+    async def frames(self) -> AsyncIterator[Any]:
+        """Iterate over queued frames as they arrive"""
+        while True:
+            yield await self.next_frame()
+
+    async def next_event(self) -> Any:
+        """Wait for the next queued event"""
+        while True:
+            event = self._session.next_event(timeout=0)
+            if event is not None:
+                return event
+            await self._wait(self._event_fd, self._session.arm_event_notify)
+
+    async def events(self) -> AsyncIterator[Any]:
+        """Iterate over queued events as they arrive"""
+        while True:
+            yield await self.next_event()
+
+    async def send_controller_state(self, state: Any) -> bool:
+        """Send controller input; only updates chiaki's state, never blocks the loop"""
+        return bool(self._session.send_controller_state(state))
+
+    async def _wait(self, fd: int, arm: Any) -> None:
+        if fd < 0:
+            await asyncio.sleep(_FALLBACK_POLL_SECONDS)
+            return
+
+        # Arming re-checks the queue, closing the race with a push that
+        # happened after our last non-blocking pop
+        if arm():
+            return
+
+        loop = asyncio.get_running_loop()
+        ready = loop.create_future()
+
+        def on_readable() -> None:
+            if not ready.done():
+                ready.set_result(None)
+
+        loop.add_reader(fd, on_readable)
+        try:
+            await ready
+        finally:
+            loop.remove_reader(fd)
+
+        try:
+            os.read(fd, 8)
+        except BlockingIOError:
+            pass
@@ -28,6 +28,7 @@ class GameplayAutomator:
         self.host = host
         self.regist_key = regist_key
         self.session = None
+        self.async_session = None
         self.controller = None
         self.running = False
         self.latest_frame = None
@@ -35,18 +36,25 @@ class GameplayAutomator:
     def initialize(self):
         """Initialize the Remote Play session"""
         try:
-            from py_chiaki_ng import Session, ControllerState
+            from py_chiaki_ng import Session, ControllerState, PixelFormat
+            from py_chiaki_ng.aio import AsyncSession
             
             self.session = Session()
             self.controller = ControllerState()
             
             # Set up session callbacks
-            self.session.set_video_callback(self._on_video_frame)
             self.session.set_event_callback(self._on_event)
             
             # Initialize connection
             if not self.session.initialize(self.host, self.regist_key):
                 raise RuntimeError("Failed to initialize session")
+            
+            # Decode natively and keep only the newest frame: stale frames
+            # only add latency for a reactive agent
+            if not self.session.enable_decoding(PixelFormat.BGR):
+                raise RuntimeError("Failed to enable video decoding")
+            self.session.enable_mailbox()
+            self.async_session = AsyncSession(self.session)
                 
             print(f"✅ Session initialized for {self.host}")
             return True
@@ -58,38 +66,15 @@ class GameplayAutomator:
             print(f"❌ Initialization failed: {e}")
             return False
     
-    def _on_video_frame(self, frame_data, size, frames_lost, frame_recovered):
-        """Callback for video frames from PlayStation"""
-        try:
-            if not CV2_AVAILABLE:
-                return True  # Accept frame but can't process
-                
-            # Convert frame data to numpy array for OpenCV
-            # Note: This is simplified - real implementation would need
-            # proper H.264 decoding via FFmpeg
-            frame_array = np.frombuffer(frame_data, dtype=np.uint8)
-            
-            # Store latest frame for processing
-            self.latest_frame = frame_array
-            
-            # Process frame in background to avoid blocking
-            asyncio.create_task(self._process_frame_async(frame_array))
-            
-            return True  # Accept the frame
-            
-        except Exception as e:
-            print(f"❌ Error processing video frame: {e}")
-            return False
-    
-    def _on_event(self, event_type, event_data):
+    def _on_event(self, event):
         """Callback for session events"""
         from py_chiaki_ng import EventType, QuitReason
         
-        if event_type == EventType.CONNECTED:
+        if event.type == EventType.CONNECTED:
             print("🔗 Connected to PlayStation")
             
-        elif event_type == EventType.QUIT:
-            reason = event_data.get('reason', 'unknown')
+        elif event.type == EventType.QUIT:
+            reason = event.reason
             print(f"🔌 Session ended: {reason}")
             self.running = False
             
@@ -104,10 +89,9 @@ class GameplayAutomator:
                 
             # Placeholder for computer vision processing
             # In a real implementation, you would:
-            # 1. Decode H.264 frame to RGB/BGR
-            # 2. Analyze game state (health bars, enemies, items, etc.)
-            # 3. Make decisions based on analysis
-            # 4. Send appropriate controller inputs
+            # 1. Analyze game state (health bars, enemies, items, etc.)
+            # 2. Make decisions based on analysis
+            # 3. Send appropriate controller inputs
             
             # Example: Detect if we should press X button
             should_press_x = await self._analyze_game_state(frame_data)
@@ -143,14 +127,14 @@ class GameplayAutomator:
         try:
             # Press button
             setattr(self.controller, button_name, True)
-            self.session.send_controller_state(self.controller)
+            await self.async_session.send_controller_state(self.controller)
             
             # Wait
             await asyncio.sleep(duration)
             
             # Release button
             setattr(self.controller, button_name, False) 
-            self.session.send_controller_state(self.controller)
+            await self.async_session.send_controller_state(self.controller)
             
             print(f"🎮 Pressed {button_name} button")
             
@@ -193,9 +177,10 @@ class GameplayAutomator:
         
         while self.running:
             try:
-                # Main automation logic would go here
-                # For now, just wait and let callbacks handle everything
-                await asyncio.sleep(1.0)
+                # Wakes as soon as the decoder publishes a newer frame
+                frame = await self.async_session.latest_frame()
+                self.latest_frame = frame.to_numpy()
+                await self._process_frame_async(self.latest_frame)
                 
             except KeyboardInterrupt:
                 print("\n⏹️  Stopping automation...")
@@ -241,7 +226,6 @@ def main():
         print("   1. Update host and regist_key with your PlayStation details")
         print("   2. Uncomment the automation.start() and run_automation_loop() calls")
         print("   3. Implement your computer vision logic in _analyze_game_state()")
-        print("   4. Add proper H.264 video decoding")
         
     except Exception as e:
         print(f"❌ Error in demo: {e}")
@@ -33,6 +33,22 @@ ext_modules = [
             "src/controller_binding.cpp",
             "src/video_binding.cpp",
             "src/events_binding.cpp",
+            "src/log_binding.cpp",
+            "src/audio_binding.cpp",
+            "src/video_decoder.cpp",
+            "src/thread_pool.cpp",
+            "src/stream_recording.cpp",
+            "src/input_scheduler.cpp",
+            "src/color_convert.cpp",
+            "src/session_metrics.cpp",
+            "src/log_sink.cpp",
+            "src/audio_decoder.cpp",
+            "src/shared_frames.cpp",
+            "src/change_detector.cpp",
+            "src/probe_set.cpp",
+            "src/media_recorder.cpp",
+            "src/latency_probe.cpp",
+            "src/flight_recorder.cpp",
         ]),
         include_dirs=[
             # Add pybind11 includes
@@ -0,0 +1,52 @@
+/**
+ * annexb.h - Minimal H.264/HEVC Annex B scanning for encoded samples
+ *
+ * Just enough NAL parsing for the components that handle samples without
+ * decoding them (MediaRecorder, FlightRecorder): find the first slice and
+ * tell keyframes apart. Scans stop at the first slice header, so a check
+ * costs a few bytes of the sample, not all of it.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace annexb {
+
+// Offset just past the next start code at or after `from`, or size
+inline size_t next_nal(const uint8_t* buf, size_t size, size_t from) {
+    for (size_t i = from; i + 3 <= size; i++) {
+        if (buf[i] == 0 && buf[i + 1] == 0 && buf[i + 2] == 1) {
+            return i + 3;
+        }
+    }
+    return size;
+}
+
+inline int nal_type(bool hevc, uint8_t header) {
+    return hevc ? (header >> 1) & 0x3f : header & 0x1f;
+}
+
+inline bool is_slice(bool hevc, int type) {
+    return hevc ? type < 32 : (type >= 1 && type <= 5);
+}
+
+// Type of the first slice NAL, or -1
+inline int first_slice_type(bool hevc, const uint8_t* buf, size_t size) {
+    for (size_t at = next_nal(buf, size, 0); at < size; at = next_nal(buf, size, at)) {
+        const int type = nal_type(hevc, buf[at]);
+        if (is_slice(hevc, type)) {
+            return type;
+        }
+    }
+    return -1;
+}
+
+// IDR for H.264; any IRAP picture (BLA, IDR, CRA) for HEVC
+inline bool is_keyframe(bool hevc, const uint8_t* buf, size_t size) {
+    const int type = first_slice_type(hevc, buf, size);
+    return hevc ? (type >= 16 && type <= 23) : type == 5;
+}
+
+} // namespace annexb
@@ -0,0 +1,134 @@
+/**
+ * audio_binding.cpp - Audio capture Python bindings
+ *
+ * AudioBuffer is the AudioRing a Session decodes its audio into (see
+ * Session.enable_audio()). Windows come back as float32 (frames, channels)
+ * numpy views straight into the ring with the AudioBuffer as their base.
+ */
+
+#include <pybind11/pybind11.h>
+#include <pybind11/numpy.h>
+#include <pybind11/stl.h>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+
+#include "audio_ring.h"
+
+namespace py = pybind11;
+
+namespace {
+
+int64_t steady_now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// (array, timestamp_ns); the array views the ring unless copy is set
+py::tuple window_to_python(py::object owner, const AudioRing& ring, const AudioRing::Window& window, bool copy) {
+    const py::ssize_t channels = ring.channels();
+    const py::ssize_t item = sizeof(float);
+    const std::vector<py::ssize_t> shape = {static_cast<py::ssize_t>(window.frames), channels};
+    const std::vector<py::ssize_t> strides = {channels * item, item};
+    py::array view(py::dtype::of<float>(), shape, strides, window.data, owner);
+    if (copy) {
+        view = py::array(view.attr("copy")());
+    } else {
+        // Read-only: the ring is the only writer
+        view.attr("flags").attr("writeable") = false;
+    }
+    return py::make_tuple(view, window.timestamp_ns);
+}
+
+// Blocks (GIL released, Ctrl-C honoured) until `frames` are available
+bool wait_available(AudioRing& ring, size_t frames, std::optional<double> timeout) {
+    using Clock = std::chrono::steady_clock;
+    const auto slice = std::chrono::milliseconds(50);
+    const bool forever = !timeout || *timeout < 0;
+    const auto deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(forever ? 0.0 : *timeout));
+
+    while (ring.available() < frames) {
+        const auto now = Clock::now();
+        if (!forever && now >= deadline) {
+            return false;
+        }
+        {
+            py::gil_scoped_release release;
+            const auto wait = forever ? slice : std::min<Clock::duration>(slice, deadline - now);
+            ring.notifier().wait_for([&ring, frames] { return ring.available() >= frames; }, wait);
+        }
+        if (PyErr_CheckSignals() != 0) {
+            throw py::error_already_set();
+        }
+    }
+    return true;
+}
+
+void check_window(const AudioRing& ring, size_t frames) {
+    if (frames == 0 || frames > ring.capacity()) {
+        throw std::invalid_argument("frames must be between 1 and the buffer capacity");
+    }
+}
+
+} // namespace
+
+void init_audio_binding(py::module& m) {
+    py::class_<AudioRing, std::shared_ptr<AudioRing>>(m, "AudioBuffer",
+        "Ring of decoded float32 PCM frames; windows are zero-copy numpy views")
+        .def(py::init([](int sample_rate, int channels, double seconds) {
+            if (sample_rate <= 0 || channels <= 0 || seconds <= 0) {
+                throw std::invalid_argument("sample_rate, channels and seconds must be positive");
+            }
+            return std::make_shared<AudioRing>(sample_rate, channels,
+                                               static_cast<size_t>(seconds * sample_rate));
+        }), py::arg("sample_rate") = 48000, py::arg("channels") = 2, py::arg("seconds") = 10.0)
+        .def_property_readonly("sample_rate", &AudioRing::sample_rate)
+        .def_property_readonly("channels", &AudioRing::channels)
+        .def_property_readonly("capacity", &AudioRing::capacity, "Frames the ring holds")
+        .def_property_readonly("available", &AudioRing::available, "Unread frames")
+        .def_property_readonly("position", &AudioRing::position, "Frames written since the stream started")
+        .def_property_readonly("overruns", &AudioRing::overruns,
+                               "Frames overwritten before read() reached them")
+        .def_property_readonly("silence_frames", &AudioRing::silence_frames,
+                               "Silent frames inserted for audio that arrived late")
+        .def("read", [](py::object self, size_t frames, std::optional<double> timeout, bool copy) -> py::object {
+            auto& ring = self.cast<AudioRing&>();
+            check_window(ring, frames);
+            AudioRing::Window window;
+            if (!wait_available(ring, frames, timeout) || !ring.read(frames, window)) {
+                return py::none();
+            }
+            return window_to_python(self, ring, window, copy);
+        }, "Take the next `frames` unread frames as (array, timestamp_ns), waiting up to timeout "
+           "(None waits forever); None on timeout. The view stays valid until the ring wraps "
+           "past it; pass copy=True to keep the samples longer",
+           py::arg("frames"), py::arg("timeout") = py::none(), py::arg("copy") = false)
+        .def("latest", [](py::object self, size_t frames, bool copy) -> py::object {
+            auto& ring = self.cast<AudioRing&>();
+            check_window(ring, frames);
+            AudioRing::Window window;
+            if (!ring.latest(frames, window)) {
+                return py::none();
+            }
+            return window_to_python(self, ring, window, copy);
+        }, "The most recent `frames` frames as (array, timestamp_ns) without consuming them; "
+           "None until that many were written",
+           py::arg("frames"), py::arg("copy") = false)
+        .def("timestamp_at", &AudioRing::timestamp_at,
+             "time.monotonic_ns() time of a stream position, on the clock VideoFrame.timestamp_ns uses",
+             py::arg("position"))
+        .def("write", [](AudioRing& ring, py::array_t<float, py::array::c_style | py::array::forcecast> pcm,
+                         std::optional<int64_t> timestamp_ns) {
+            if (pcm.ndim() != 2 || pcm.shape(1) != ring.channels()) {
+                throw std::invalid_argument("pcm must be a (frames, channels) array");
+            }
+            ring.write(pcm.data(), static_cast<size_t>(pcm.shape(0)), timestamp_ns.value_or(steady_now_ns()));
+        }, "Append frames that arrived at timestamp_ns (default now); only for buffers no Session "
+           "writes into",
+           py::arg("pcm"), py::arg("timestamp_ns") = py::none());
+}
@@ -0,0 +1,175 @@
+/**
+ * audio_decoder.cpp - Native Opus decode into an AudioRing
+ */
+
+#include "audio_decoder.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace {
+
+// One sample of a decoded frame as float in [-1, 1]; false for sample
+// formats Opus decoders don't produce
+bool read_sample(const AVFrame* frame, int channels, int channel, int index, float& out) {
+    switch (frame->format) {
+        case AV_SAMPLE_FMT_FLTP:
+            out = reinterpret_cast<const float*>(frame->extended_data[channel])[index];
+            return true;
+        case AV_SAMPLE_FMT_FLT:
+            out = reinterpret_cast<const float*>(frame->extended_data[0])[index * channels + channel];
+            return true;
+        case AV_SAMPLE_FMT_S16P:
+            out = reinterpret_cast<const int16_t*>(frame->extended_data[channel])[index] / 32768.0f;
+            return true;
+        case AV_SAMPLE_FMT_S16:
+            out = reinterpret_cast<const int16_t*>(frame->extended_data[0])[index * channels + channel] / 32768.0f;
+            return true;
+        default:
+            return false;
+    }
+}
+
+int frame_channels(const AVFrame* frame) {
+#if LIBAVUTIL_VERSION_INT >= AV_VERSION_INT(57, 28, 100)
+    return frame->ch_layout.nb_channels;
+#else
+    return frame->channels;
+#endif
+}
+
+} // namespace
+
+AudioDecoder::AudioDecoder(std::shared_ptr<AudioRing> ring) : ring_(std::move(ring)) {}
+
+AudioDecoder::~AudioDecoder() {
+    close();
+}
+
+ChiakiAudioSink AudioDecoder::sink() {
+    ChiakiAudioSink sink;
+    memset(&sink, 0, sizeof(sink));
+    sink.user = this;
+    sink.header_cb = header_callback;
+    sink.frame_cb = frame_callback;
+    return sink;
+}
+
+bool AudioDecoder::on_header(int channels, int sample_rate) {
+    close();
+    return open(channels > 0 ? channels : CHANNELS, sample_rate > 0 ? sample_rate : SAMPLE_RATE);
+}
+
+bool AudioDecoder::on_packet(const uint8_t* data, size_t size, int64_t arrival_ns) {
+    packets_.fetch_add(1, std::memory_order_relaxed);
+    if (packet_tap_) {
+        packet_tap_(data, size, arrival_ns);
+    }
+    if (!codec_context_ && !open(CHANNELS, SAMPLE_RATE)) {
+        decode_errors_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    // libavcodec may read past the end of the packet
+    padded_.resize(size + AV_INPUT_BUFFER_PADDING_SIZE);
+    memcpy(padded_.data(), data, size);
+    memset(padded_.data() + size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+    packet_->data = padded_.data();
+    packet_->size = static_cast<int>(size);
+
+    const int ret = avcodec_send_packet(codec_context_, packet_);
+    packet_->data = nullptr;
+    packet_->size = 0;
+    if (ret < 0) {
+        decode_errors_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    return drain_frames(arrival_ns);
+}
+
+AudioDecoder::Stats AudioDecoder::stats() const {
+    Stats result;
+    result.packets = packets_.load(std::memory_order_relaxed);
+    result.decode_errors = decode_errors_.load(std::memory_order_relaxed);
+    result.frames = frames_.load(std::memory_order_relaxed);
+    return result;
+}
+
+bool AudioDecoder::open(int channels, int sample_rate) {
+    const AVCodec* codec = avcodec_find_decoder(AV_CODEC_ID_OPUS);
+    if (!codec) {
+        return false;
+    }
+    codec_context_ = avcodec_alloc_context3(codec);
+    frame_ = av_frame_alloc();
+    packet_ = av_packet_alloc();
+    if (!codec_context_ || !frame_ || !packet_) {
+        close();
+        return false;
+    }
+    codec_context_->sample_rate = sample_rate;
+    codec_context_->request_sample_fmt = AV_SAMPLE_FMT_FLT;
+#if LIBAVUTIL_VERSION_INT >= AV_VERSION_INT(57, 28, 100)
+    av_channel_layout_default(&codec_context_->ch_layout, channels);
+#else
+    codec_context_->channels = channels;
+#endif
+    if (avcodec_open2(codec_context_, codec, nullptr) < 0) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void AudioDecoder::close() {
+    if (codec_context_) {
+        avcodec_free_context(&codec_context_);
+    }
+    if (frame_) {
+        av_frame_free(&frame_);
+    }
+    if (packet_) {
+        av_packet_free(&packet_);
+    }
+}
+
+// Interleaves every frame the packet produced into the ring as stereo
+bool AudioDecoder::drain_frames(int64_t arrival_ns) {
+    bool ok = true;
+    for (;;) {
+        const int ret = avcodec_receive_frame(codec_context_, frame_);
+        if (ret < 0) {
+            break; // EAGAIN: needs the next packet
+        }
+        const int channels = frame_channels(frame_);
+        const int samples = frame_->nb_samples;
+        interleaved_.resize(static_cast<size_t>(samples) * CHANNELS);
+        bool converted = channels > 0;
+        for (int i = 0; converted && i < samples; i++) {
+            for (int c = 0; c < CHANNELS; c++) {
+                converted = read_sample(frame_, channels, std::min(c, channels - 1), i,
+                                        interleaved_[static_cast<size_t>(i) * CHANNELS + c]);
+            }
+        }
+        if (converted) {
+            ring_->write(interleaved_.data(), static_cast<size_t>(samples), arrival_ns);
+            frames_.fetch_add(static_cast<uint64_t>(samples), std::memory_order_relaxed);
+        } else {
+            decode_errors_.fetch_add(1, std::memory_order_relaxed);
+            ok = false;
+        }
+        av_frame_unref(frame_);
+    }
+    return ok;
+}
+
+void AudioDecoder::header_callback(ChiakiAudioHeader* header, void* user) {
+    static_cast<AudioDecoder*>(user)->on_header(header->channels, static_cast<int>(header->rate));
+}
+
+void AudioDecoder::frame_callback(uint8_t* buf, size_t buf_size, void* user) {
+    const int64_t arrival_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    static_cast<AudioDecoder*>(user)->on_packet(buf, buf_size, arrival_ns);
+}
@@ -0,0 +1,85 @@
+/**
+ * audio_decoder.h - Native Opus decode into an AudioRing
+ *
+ * chiaki hands the session's audio sink one Opus packet at a time on its
+ * audio thread. AudioDecoder decodes each packet with libavcodec right
+ * there (a 10 ms packet is tens of microseconds of work) and appends the
+ * PCM to an AudioRing, which never waits on its reader, so the audio
+ * thread is never held up by Python.
+ *
+ * Output is always 48 kHz stereo float32: mono streams are duplicated to
+ * both channels and extra channels are dropped.
+ */
+
+#pragma once
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+#include <chiaki/audio.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "audio_ring.h"
+
+class AudioDecoder {
+public:
+    static constexpr int SAMPLE_RATE = 48000;
+    static constexpr int CHANNELS = 2;
+
+    // Sees every Opus packet, as received, before it is decoded
+    using PacketTap = std::function<void(const uint8_t* data, size_t size, int64_t arrival_ns)>;
+
+    explicit AudioDecoder(std::shared_ptr<AudioRing> ring);
+    ~AudioDecoder();
+
+    AudioDecoder(const AudioDecoder&) = delete;
+    AudioDecoder& operator=(const AudioDecoder&) = delete;
+
+    // Sink for chiaki_session_set_audio_sink(); the decoder must outlive
+    // the session's audio thread
+    ChiakiAudioSink sink();
+
+    // Audio thread only. The stream header (re)opens the codec; packets
+    // arriving before one are decoded as stereo.
+    bool on_header(int channels, int sample_rate);
+    bool on_packet(const uint8_t* data, size_t size, int64_t arrival_ns);
+
+    // Set before the session starts; called on the audio thread
+    void set_packet_tap(PacketTap tap) { packet_tap_ = std::move(tap); }
+
+    struct Stats {
+        uint64_t packets = 0;
+        uint64_t decode_errors = 0;
+        uint64_t frames = 0;  // PCM frames written to the ring
+    };
+    Stats stats() const;
+
+    const std::shared_ptr<AudioRing>& ring() const { return ring_; }
+
+private:
+    bool open(int channels, int sample_rate);
+    void close();
+    bool drain_frames(int64_t arrival_ns);
+
+    static void header_callback(ChiakiAudioHeader* header, void* user);
+    static void frame_callback(uint8_t* buf, size_t buf_size, void* user);
+
+    std::shared_ptr<AudioRing> ring_;
+    PacketTap packet_tap_;
+    AVCodecContext* codec_context_ = nullptr;
+    AVFrame* frame_ = nullptr;
+    AVPacket* packet_ = nullptr;
+    std::vector<uint8_t> padded_;
+    std::vector<float> interleaved_;
+
+    std::atomic<uint64_t> packets_{0};
+    std::atomic<uint64_t> decode_errors_{0};
+    std::atomic<uint64_t> frames_{0};
+};
@@ -0,0 +1,219 @@
+/**
+ * audio_ring.h - Mirrored PCM ring between the chiaki audio thread and Python
+ *
+ * Decoded audio is kept as interleaved float32 frames. Every frame is
+ * stored twice, at its slot and one capacity further on, so any window of
+ * up to `capacity` frames is contiguous in memory and Python gets it as a
+ * numpy view without copying or stitching around the wrap point.
+ *
+ * One producer writes and never waits: a reader that falls a full ring
+ * behind is moved forward and the skipped frames are counted as overrun.
+ * A view handed out by read() is only stable until the writer laps it,
+ * i.e. for `capacity - behind` more frames.
+ *
+ * Positions map to the steady clock video frames are stamped with through
+ * one anchor (position, time). The producer sets it at the first write
+ * and keeps the clock linear by filling silence when audio arrives more
+ * than GAP_NS late; audio arriving that much early (clock drift) moves the
+ * anchor instead.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+#include "notifier.h"
+
+class AudioRing {
+public:
+    static constexpr int64_t GAP_NS = 100000000;  // 100 ms
+
+    AudioRing(int sample_rate, int channels, size_t capacity_frames)
+        : sample_rate_(sample_rate), channels_(channels), capacity_(std::max<size_t>(capacity_frames, 1)),
+          samples_(new float[capacity_ * channels_ * 2]()) {}
+
+    AudioRing(const AudioRing&) = delete;
+    AudioRing& operator=(const AudioRing&) = delete;
+
+    int sample_rate() const { return sample_rate_; }
+    int channels() const { return channels_; }
+    size_t capacity() const { return capacity_; }
+
+    // Producer side: `frames` interleaved frames that arrived at arrival_ns
+    // (steady clock)
+    void write(const float* pcm, size_t frames, int64_t arrival_ns) {
+        const uint64_t pos = write_pos_.load(std::memory_order_relaxed);
+        if (!anchored_) {
+            store_anchor(pos, arrival_ns);
+            anchored_ = true;
+        } else {
+            const int64_t lag = arrival_ns - time_at(pos, anchor_pos_, anchor_ns_);
+            if (lag > GAP_NS) {
+                const uint64_t missing = static_cast<uint64_t>(lag) * sample_rate_ / 1000000000;
+                silence_frames_.fetch_add(missing, std::memory_order_relaxed);
+                append(nullptr, static_cast<size_t>(missing));
+            } else if (lag < -GAP_NS) {
+                store_anchor(pos, arrival_ns);
+            }
+        }
+        append(pcm, frames);
+        notifier_.notify();
+    }
+
+    // A window of frames; data points into the ring
+    struct Window {
+        const float* data = nullptr;
+        size_t frames = 0;
+        uint64_t position = 0;      // of the first frame since the stream started
+        int64_t timestamp_ns = 0;   // steady clock time of the first frame
+    };
+
+    // Consumer side, one reader at a time: takes the next `frames` unread
+    // frames (at most capacity). Returns false, leaving them unread, if
+    // fewer are there.
+    bool read(size_t frames, Window& out) {
+        if (frames == 0 || frames > capacity_) {
+            return false;
+        }
+        const uint64_t written = write_pos_.load(std::memory_order_acquire);
+        uint64_t pos = read_pos_.load(std::memory_order_relaxed);
+        if (written - pos > capacity_) {
+            overruns_.fetch_add(written - capacity_ - pos, std::memory_order_relaxed);
+            pos = written - capacity_;
+        }
+        if (written - pos < frames) {
+            read_pos_.store(pos, std::memory_order_relaxed);
+            return false;
+        }
+        out = window(pos, frames);
+        read_pos_.store(pos + frames, std::memory_order_relaxed);
+        return true;
+    }
+
+    // The most recent `frames` frames, without consuming anything
+    bool latest(size_t frames, Window& out) const {
+        const uint64_t written = write_pos_.load(std::memory_order_acquire);
+        if (frames == 0 || frames > capacity_ || written < frames) {
+            return false;
+        }
+        out = window(written - frames, frames);
+        return true;
+    }
+
+    // Unread frames, capped at capacity (older ones are overrun)
+    size_t available() const {
+        const uint64_t written = write_pos_.load(std::memory_order_acquire);
+        return static_cast<size_t>(std::min<uint64_t>(written - read_pos_.load(std::memory_order_relaxed),
+                                                      capacity_));
+    }
+
+    uint64_t position() const { return write_pos_.load(std::memory_order_acquire); }
+    uint64_t overruns() const { return overruns_.load(std::memory_order_relaxed); }
+    uint64_t silence_frames() const { return silence_frames_.load(std::memory_order_relaxed); }
+
+    // Steady clock time of a stream position (0 before the first write)
+    int64_t timestamp_at(uint64_t position) const {
+        uint64_t anchor_pos;
+        int64_t anchor_ns;
+        load_anchor(anchor_pos, anchor_ns);
+        return anchor_ns ? time_at(position, anchor_pos, anchor_ns) : 0;
+    }
+
+    Notifier& notifier() { return notifier_; }
+
+private:
+    int64_t time_at(uint64_t position, uint64_t anchor_pos, int64_t anchor_ns) const {
+        const int64_t offset = static_cast<int64_t>(position - anchor_pos);
+        return anchor_ns + offset * 1000000000 / sample_rate_;
+    }
+
+    Window window(uint64_t position, size_t frames) const {
+        Window result;
+        result.data = samples_.get() + (position % capacity_) * channels_;
+        result.frames = frames;
+        result.position = position;
+        result.timestamp_ns = timestamp_at(position);
+        return result;
+    }
+
+    // Writes each frame at its slot and its mirror; nullptr writes silence
+    void append(const float* pcm, size_t frames) {
+        uint64_t pos = write_pos_.load(std::memory_order_relaxed);
+        if (frames > capacity_) {
+            // Only the last capacity frames can survive
+            if (pcm) {
+                pcm += (frames - capacity_) * channels_;
+            }
+            pos += frames - capacity_;
+            frames = capacity_;
+        }
+        size_t done = 0;
+        while (done < frames) {
+            const size_t slot = (pos + done) % capacity_;
+            const size_t run = std::min(frames - done, capacity_ - slot);
+            const size_t count = run * channels_;
+            float* primary = samples_.get() + slot * channels_;
+            float* mirror = primary + capacity_ * channels_;
+            if (pcm) {
+                memcpy(primary, pcm + done * channels_, count * sizeof(float));
+                memcpy(mirror, pcm + done * channels_, count * sizeof(float));
+            } else {
+                std::fill(primary, primary + count, 0.0f);
+                std::fill(mirror, mirror + count, 0.0f);
+            }
+            done += run;
+        }
+        write_pos_.store(pos + frames, std::memory_order_release);
+    }
+
+    // Seqlock: odd sequence while the producer updates the pair
+    void store_anchor(uint64_t position, int64_t time_ns) {
+        const uint32_t seq = anchor_seq_.load(std::memory_order_relaxed);
+        anchor_seq_.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        anchor_pos_atomic_.store(position, std::memory_order_relaxed);
+        anchor_ns_atomic_.store(time_ns, std::memory_order_relaxed);
+        anchor_seq_.store(seq + 2, std::memory_order_release);
+        anchor_pos_ = position;
+        anchor_ns_ = time_ns;
+    }
+
+    void load_anchor(uint64_t& position, int64_t& time_ns) const {
+        for (;;) {
+            const uint32_t seq = anchor_seq_.load(std::memory_order_acquire);
+            position = anchor_pos_atomic_.load(std::memory_order_relaxed);
+            time_ns = anchor_ns_atomic_.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (!(seq & 1) && seq == anchor_seq_.load(std::memory_order_relaxed)) {
+                return;
+            }
+        }
+    }
+
+    const int sample_rate_;
+    const int channels_;
+    const size_t capacity_;
+    std::unique_ptr<float[]> samples_;  // 2 * capacity frames
+
+    alignas(64) std::atomic<uint64_t> write_pos_{0};
+    std::atomic<uint64_t> silence_frames_{0};
+    // Producer's own copy of the anchor
+    bool anchored_ = false;
+    uint64_t anchor_pos_ = 0;
+    int64_t anchor_ns_ = 0;
+
+    std::atomic<uint32_t> anchor_seq_{0};
+    std::atomic<uint64_t> anchor_pos_atomic_{0};
+    std::atomic<int64_t> anchor_ns_atomic_{0};
+
+    // Only read() moves it; atomic so available() may run on any thread
+    alignas(64) std::atomic<uint64_t> read_pos_{0};
+    std::atomic<uint64_t> overruns_{0};
+
+    Notifier notifier_;
+};
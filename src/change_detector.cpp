@@ -0,0 +1,207 @@
+/**
+ * change_detector.cpp - Cheap "did the picture change" test on decoded luma
+ */
+
+#include "change_detector.h"
+
+#include <algorithm>
+#include <bitset>
+#include <stdexcept>
+
+#if defined(__SSE2__) || defined(__x86_64__) || defined(_M_X64)
+#define PY_CHIAKI_NG_SSE2_KERNEL 1
+#include <emmintrin.h>
+#elif defined(__aarch64__)
+#define PY_CHIAKI_NG_NEON_KERNEL 1
+#include <arm_neon.h>
+#endif
+
+namespace {
+
+// Rows averaged per cell; more only adds memory traffic on noise
+constexpr int ROWS_PER_CELL = 4;
+constexpr int HASH_SIDE = 8;
+
+// Sum of n bytes
+uint32_t span_sum(const uint8_t* p, int n) {
+    uint32_t total = 0;
+    int i = 0;
+#if defined(PY_CHIAKI_NG_SSE2_KERNEL)
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc = zero;
+    for (; i + 16 <= n; i += 16) {
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i)), zero));
+    }
+    total = static_cast<uint32_t>(_mm_cvtsi128_si32(acc) + _mm_cvtsi128_si32(_mm_unpackhi_epi64(acc, acc)));
+#elif defined(PY_CHIAKI_NG_NEON_KERNEL)
+    uint32x4_t acc = vdupq_n_u32(0);
+    for (; i + 16 <= n; i += 16) {
+        acc = vpadalq_u16(acc, vpaddlq_u8(vld1q_u8(p + i)));
+    }
+    total = vaddvq_u32(acc);
+#endif
+    for (; i < n; i++) {
+        total += p[i];
+    }
+    return total;
+}
+
+// Bytes where |a - b| > tolerance
+uint32_t count_changed(const uint8_t* a, const uint8_t* b, size_t n, uint8_t tolerance) {
+    uint32_t total = 0;
+    size_t i = 0;
+#if defined(PY_CHIAKI_NG_SSE2_KERNEL)
+    const __m128i limit = _mm_set1_epi8(static_cast<char>(tolerance));
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= n; i += 16) {
+        const __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        const __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        const __m128i diff = _mm_or_si128(_mm_subs_epu8(va, vb), _mm_subs_epu8(vb, va));
+        // Lanes within tolerance saturate to 0
+        const __m128i over = _mm_cmpeq_epi8(_mm_subs_epu8(diff, limit), zero);
+        total += 16 - static_cast<uint32_t>(std::bitset<16>(static_cast<unsigned>(_mm_movemask_epi8(over))).count());
+    }
+#elif defined(PY_CHIAKI_NG_NEON_KERNEL)
+    const uint8x16_t limit = vdupq_n_u8(tolerance);
+    uint16x8_t acc = vdupq_n_u16(0);
+    for (; i + 16 <= n; i += 16) {
+        const uint8x16_t over = vcgtq_u8(vabdq_u8(vld1q_u8(a + i), vld1q_u8(b + i)), limit);
+        acc = vpadalq_u8(acc, vshrq_n_u8(over, 7));
+    }
+    total = vaddvq_u16(acc);
+#endif
+    for (; i < n; i++) {
+        const int diff = a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+        total += diff > tolerance ? 1 : 0;
+    }
+    return total;
+}
+
+// Clamps a start/extent pair to [0, limit); a 0 extent reaches the end
+void clamp_axis(int start, int extent, int limit, int& out_start, int& out_extent) {
+    out_start = std::min(std::max(start, 0), limit);
+    const int end = extent > 0 ? std::min(start + extent, limit) : limit;
+    out_extent = std::max(end - out_start, 0);
+}
+
+// 8x8 average hash of a grid_w x grid_h thumbnail, row-major bits
+uint64_t average_hash(const std::vector<uint8_t>& thumbnail, int grid_w, int grid_h) {
+    uint32_t blocks[HASH_SIDE * HASH_SIDE];
+    uint64_t total = 0;
+    for (int by = 0; by < HASH_SIDE; by++) {
+        const int y0 = by * grid_h / HASH_SIDE;
+        const int y1 = std::max((by + 1) * grid_h / HASH_SIDE, y0 + 1);
+        for (int bx = 0; bx < HASH_SIDE; bx++) {
+            const int x0 = bx * grid_w / HASH_SIDE;
+            const int x1 = std::max((bx + 1) * grid_w / HASH_SIDE, x0 + 1);
+            uint32_t sum = 0;
+            for (int y = y0; y < y1; y++) {
+                for (int x = x0; x < x1; x++) {
+                    sum += thumbnail[static_cast<size_t>(y) * grid_w + x];
+                }
+            }
+            blocks[by * HASH_SIDE + bx] = sum / static_cast<uint32_t>((y1 - y0) * (x1 - x0));
+            total += blocks[by * HASH_SIDE + bx];
+        }
+    }
+    const uint64_t mean = total / (HASH_SIDE * HASH_SIDE);
+    uint64_t hash = 0;
+    for (int i = 0; i < HASH_SIDE * HASH_SIDE; i++) {
+        if (blocks[i] > mean) {
+            hash |= uint64_t{1} << i;
+        }
+    }
+    return hash;
+}
+
+} // namespace
+
+void ChangeSpec::validate() const {
+    if (threshold < 0.0 || threshold >= 100.0) {
+        throw std::invalid_argument("threshold must be a percentage in [0, 100)");
+    }
+    if (cell_threshold < 0 || cell_threshold > 254) {
+        throw std::invalid_argument("cell_threshold must be 0-254 luma levels");
+    }
+    if (roi_x < 0 || roi_y < 0 || roi_width < 0 || roi_height < 0) {
+        throw std::invalid_argument("roi values must not be negative");
+    }
+    if (grid_width < HASH_SIDE || grid_height < HASH_SIDE || grid_width > 256 || grid_height > 256) {
+        throw std::invalid_argument("grid must be 8-256 cells per axis");
+    }
+}
+
+const char* ChangeDetector::kernel_name() {
+#if defined(PY_CHIAKI_NG_SSE2_KERNEL)
+    return "sse2";
+#elif defined(PY_CHIAKI_NG_NEON_KERNEL)
+    return "neon";
+#else
+    return "scalar";
+#endif
+}
+
+void ChangeDetector::reset() {
+    reference_.clear();
+    reference_width_ = 0;
+    reference_height_ = 0;
+    unchanged_run_ = 0;
+}
+
+ChangeDetector::Result ChangeDetector::measure(const uint8_t* luma, int stride, int width, int height,
+                                               const ChangeSpec& spec) {
+    Result result;
+    int x0, y0, roi_w, roi_h;
+    clamp_axis(spec.roi_x, spec.roi_width, width, x0, roi_w);
+    clamp_axis(spec.roi_y, spec.roi_height, height, y0, roi_h);
+    if (roi_w == 0 || roi_h == 0) {
+        // Nothing to compare: let everything through
+        result.score = 100.0f;
+        return result;
+    }
+    const int grid_w = std::min(spec.grid_width, roi_w);
+    const int grid_h = std::min(spec.grid_height, roi_h);
+
+    thumbnail_.resize(static_cast<size_t>(grid_w) * grid_h);
+    sums_.resize(static_cast<size_t>(grid_w));
+    for (int gy = 0; gy < grid_h; gy++) {
+        const int cell_y0 = y0 + gy * roi_h / grid_h;
+        const int cell_h = y0 + (gy + 1) * roi_h / grid_h - cell_y0;
+        const int rows = std::min(cell_h, ROWS_PER_CELL);
+        std::fill(sums_.begin(), sums_.end(), 0u);
+        for (int r = 0; r < rows; r++) {
+            // Evenly spaced rows through the cell
+            const int y = cell_y0 + (2 * r + 1) * cell_h / (2 * rows);
+            const uint8_t* row = luma + static_cast<ptrdiff_t>(y) * stride;
+            for (int gx = 0; gx < grid_w; gx++) {
+                const int cell_x0 = x0 + gx * roi_w / grid_w;
+                const int cell_x1 = x0 + (gx + 1) * roi_w / grid_w;
+                sums_[gx] += span_sum(row + cell_x0, cell_x1 - cell_x0);
+            }
+        }
+        uint8_t* out = thumbnail_.data() + static_cast<size_t>(gy) * grid_w;
+        for (int gx = 0; gx < grid_w; gx++) {
+            const int cell_w = (gx + 1) * roi_w / grid_w - gx * roi_w / grid_w;
+            out[gx] = static_cast<uint8_t>(sums_[gx] / static_cast<uint32_t>(rows * cell_w));
+        }
+    }
+    result.hash = average_hash(thumbnail_, grid_w, grid_h);
+
+    if (reference_width_ != grid_w || reference_height_ != grid_h) {
+        result.score = 100.0f;
+    } else {
+        const uint32_t changed = count_changed(thumbnail_.data(), reference_.data(), thumbnail_.size(),
+                                               static_cast<uint8_t>(spec.cell_threshold));
+        result.score = 100.0f * static_cast<float>(changed) / static_cast<float>(thumbnail_.size());
+    }
+    result.changed = result.score > spec.threshold || (spec.max_skip > 0 && unchanged_run_ >= spec.max_skip);
+    if (result.changed) {
+        reference_.swap(thumbnail_);
+        reference_width_ = grid_w;
+        reference_height_ = grid_h;
+        unchanged_run_ = 0;
+    } else {
+        unchanged_run_++;
+    }
+    return result;
+}
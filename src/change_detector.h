@@ -0,0 +1,82 @@
+/**
+ * change_detector.h - Cheap "did the picture change" test on decoded luma
+ *
+ * Static menus and loading screens decode into long runs of identical
+ * pictures. ChangeDetector boils the luma plane (or a region of it) down
+ * to a small grid of cell averages and compares that thumbnail to the
+ * one of the last frame it let through. The score is the percentage of
+ * cells whose average moved by more than cell_threshold levels; averaging
+ * keeps encoder noise far below that. Comparing against the last
+ * delivered frame rather than the previous picture means a slow fade
+ * still trips the threshold eventually.
+ *
+ * Only four evenly spaced rows of each cell are read, so a change counts
+ * only where it crosses a sampled row and moves that cell's average far
+ * enough. At the default 36 rows a 1080p cell is 30 rows tall, and a
+ * cursor a few pixels high can sit between sampled rows and go unseen.
+ * Watch small features through a roi with a grid fine enough that cells
+ * are at most four rows tall; then every row is read.
+ *
+ * Each measurement also yields a 64-bit average hash (8x8 cells above or
+ * below their mean) for matching screens in Python.
+ *
+ * Row sums and the cell comparison run on SSE2 or NEON where available.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct ChangeSpec {
+    // Percentage of cells that must change for the frame to count as
+    // changed; 0 passes any change at all
+    double threshold = 0.0;
+    // Luma levels (0-255) a cell's average must move by to count
+    int cell_threshold = 8;
+
+    // Region in source pixels; a 0 extent reaches to the frame edge
+    int roi_x = 0;
+    int roi_y = 0;
+    int roi_width = 0;
+    int roi_height = 0;
+
+    // Thumbnail cells across and down (capped at the region's size)
+    int grid_width = 64;
+    int grid_height = 36;
+
+    // Let a frame through after this many unchanged ones; 0 never does
+    uint32_t max_skip = 0;
+
+    // Throws std::invalid_argument for thresholds out of range, a negative
+    // ROI or a grid outside 8-256 cells per axis
+    void validate() const;
+};
+
+class ChangeDetector {
+public:
+    struct Result {
+        bool changed = true;
+        float score = 0.0f;  // % of cells changed since the last changed frame; 100 for the first
+        uint64_t hash = 0;
+    };
+
+    // Measures one 8-bit luma plane against the reference, which becomes
+    // this picture when it counts as changed. One thread at a time.
+    Result measure(const uint8_t* luma, int stride, int width, int height, const ChangeSpec& spec);
+
+    // Forget the reference; the next picture counts as changed
+    void reset();
+
+    // "sse2", "neon" or "scalar"
+    static const char* kernel_name();
+
+private:
+    std::vector<uint32_t> sums_;
+    std::vector<uint8_t> thumbnail_;
+    std::vector<uint8_t> reference_;
+    int reference_width_ = 0;
+    int reference_height_ = 0;
+    uint32_t unchanged_run_ = 0;
+};
@@ -0,0 +1,547 @@
+/**
+ * color_convert.cpp - YUV 4:2:0 to model-ready frames in one pass
+ */
+
+#include "color_convert.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define PY_CHIAKI_NG_AVX2_KERNEL 1
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#define PY_CHIAKI_NG_NEON_KERNEL 1
+#include <arm_neon.h>
+#endif
+
+#if defined(__GNUC__) || defined(__clang__) || defined(_MSC_VER)
+#define PY_CHIAKI_NG_RESTRICT __restrict
+#else
+#define PY_CHIAKI_NG_RESTRICT
+#endif
+
+namespace {
+
+constexpr int SHIFT = 14;
+constexpr int32_t ROUND = 1 << (SHIFT - 1);
+
+// Indexed by [matrix][full_range]
+constexpr YuvCoefficients COEFFICIENTS[3][2] = {
+    {{16, 19077, 26149, -6419, -13320, 33050}, {0, 16384, 22970, -5638, -11700, 29032}},
+    {{16, 19077, 29372, -3494, -8731, 34610}, {0, 16384, 25802, -3069, -7670, 30402}},
+    {{16, 19077, 27503, -3069, -10657, 35091}, {0, 16384, 24160, -2696, -9361, 30825}},
+};
+
+// Converted row: packed 3-byte pixels (BGR order when bgr is set), or
+// separate R, G and B rows when packed is null
+struct RowOutput {
+    uint8_t* packed;
+    bool bgr;
+    uint8_t* r;
+    uint8_t* g;
+    uint8_t* b;
+};
+
+using RowKernel = void (*)(const YuvRow& in, const RowOutput& out, int count,
+                           const YuvCoefficients& k);
+
+// out = in * scale + bias, for the float formats
+using NormalizeKernel = void (*)(const uint8_t* in, float* out, int count, float scale, float bias);
+
+inline uint8_t clamp_u8(int32_t value) {
+    return static_cast<uint8_t>(value < 0 ? 0 : (value > 255 ? 255 : value));
+}
+
+// Also finishes the tails the vector kernels leave, from pixel begin on
+void yuv_to_rgb_row_scalar(const YuvRow& in, const RowOutput& out, int begin, int count,
+                           const YuvCoefficients& k) {
+    for (int i = begin; i < count; i++) {
+        const int c = in.half_chroma ? i >> 1 : i;
+        const int32_t luma = (in.y[i] - k.y_offset) * k.y + ROUND;
+        const int32_t cb = in.u[c] - 128;
+        const int32_t cr = in.v[c] - 128;
+        const uint8_t r = clamp_u8((luma + cr * k.v_r) >> SHIFT);
+        const uint8_t g = clamp_u8((luma + cb * k.u_g + cr * k.v_g) >> SHIFT);
+        const uint8_t b = clamp_u8((luma + cb * k.u_b) >> SHIFT);
+        if (out.packed) {
+            uint8_t* pixel = out.packed + 3 * i;
+            pixel[0] = out.bgr ? b : r;
+            pixel[1] = g;
+            pixel[2] = out.bgr ? r : b;
+        } else {
+            out.r[i] = r;
+            out.g[i] = g;
+            out.b[i] = b;
+        }
+    }
+}
+
+void normalize_row_scalar(const uint8_t* in, float* out, int begin, int count, float scale, float bias) {
+    for (int i = begin; i < count; i++) {
+        out[i] = in[i] * scale + bias;
+    }
+}
+
+void normalize_row_plain(const uint8_t* in, float* out, int count, float scale, float bias) {
+    normalize_row_scalar(in, out, 0, count, scale, bias);
+}
+
+void yuv_to_rgb_row_plain(const YuvRow& in, const RowOutput& out, int count,
+                          const YuvCoefficients& k) {
+    yuv_to_rgb_row_scalar(in, out, 0, count, k);
+}
+
+#if defined(PY_CHIAKI_NG_AVX2_KERNEL)
+
+// pshufb masks spreading three 16-byte channel vectors over 48 packed
+// bytes: [output vector][channel][byte]
+struct InterleaveMasks {
+    uint8_t bytes[3][3][16];
+};
+
+constexpr InterleaveMasks make_interleave_masks() {
+    InterleaveMasks masks{};
+    for (int vec = 0; vec < 3; vec++) {
+        for (int channel = 0; channel < 3; channel++) {
+            for (int byte = 0; byte < 16; byte++) {
+                const int n = 16 * vec + byte;
+                masks.bytes[vec][channel][byte] = n % 3 == channel ? static_cast<uint8_t>(n / 3) : 0x80;
+            }
+        }
+    }
+    return masks;
+}
+
+constexpr InterleaveMasks INTERLEAVE_MASKS = make_interleave_masks();
+
+__attribute__((target("avx2")))
+inline __m128i load_mask(const uint8_t* mask) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(mask));
+}
+
+__attribute__((target("avx2")))
+inline void store_packed48_avx2(uint8_t* dst, __m128i c0, __m128i c1, __m128i c2) {
+    for (int vec = 0; vec < 3; vec++) {
+        const auto& masks = INTERLEAVE_MASKS.bytes[vec];
+        const __m128i bytes = _mm_or_si128(
+            _mm_or_si128(_mm_shuffle_epi8(c0, load_mask(masks[0])),
+                         _mm_shuffle_epi8(c1, load_mask(masks[1]))),
+            _mm_shuffle_epi8(c2, load_mask(masks[2])));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 16 * vec), bytes);
+    }
+}
+
+// Two int32x8 vectors -> 16 saturated bytes in order
+__attribute__((target("avx2")))
+inline __m128i narrow16_avx2(__m256i lo, __m256i hi) {
+    const __m256i words = _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi), 0xD8);
+    const __m256i bytes = _mm256_permute4x64_epi64(_mm256_packus_epi16(words, words), 0xD8);
+    return _mm256_castsi256_si128(bytes);
+}
+
+__attribute__((target("avx2")))
+inline __m128i load_chroma16_avx2(const uint8_t* src, int i, bool half) {
+    if (half) {
+        const __m128i samples = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + i / 2));
+        return _mm_unpacklo_epi8(samples, samples);
+    }
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+}
+
+struct Rgb8x32 {
+    __m256i r;
+    __m256i g;
+    __m256i b;
+};
+
+// Eight pixels, widened to int32 lanes
+__attribute__((target("avx2")))
+inline Rgb8x32 convert8_avx2(__m128i y8, __m128i u8, __m128i v8, const YuvCoefficients& k) {
+    const __m256i luma = _mm256_add_epi32(
+        _mm256_mullo_epi32(_mm256_sub_epi32(_mm256_cvtepu8_epi32(y8), _mm256_set1_epi32(k.y_offset)),
+                           _mm256_set1_epi32(k.y)),
+        _mm256_set1_epi32(ROUND));
+    const __m256i chroma_offset = _mm256_set1_epi32(128);
+    const __m256i cb = _mm256_sub_epi32(_mm256_cvtepu8_epi32(u8), chroma_offset);
+    const __m256i cr = _mm256_sub_epi32(_mm256_cvtepu8_epi32(v8), chroma_offset);
+
+    Rgb8x32 rgb;
+    rgb.r = _mm256_srai_epi32(_mm256_add_epi32(luma, _mm256_mullo_epi32(cr, _mm256_set1_epi32(k.v_r))), SHIFT);
+    rgb.g = _mm256_srai_epi32(
+        _mm256_add_epi32(luma, _mm256_add_epi32(_mm256_mullo_epi32(cb, _mm256_set1_epi32(k.u_g)),
+                                                _mm256_mullo_epi32(cr, _mm256_set1_epi32(k.v_g)))),
+        SHIFT);
+    rgb.b = _mm256_srai_epi32(_mm256_add_epi32(luma, _mm256_mullo_epi32(cb, _mm256_set1_epi32(k.u_b))), SHIFT);
+    return rgb;
+}
+
+__attribute__((target("avx2")))
+void yuv_to_rgb_row_avx2(const YuvRow& in, const RowOutput& out, int count,
+                         const YuvCoefficients& k) {
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        const __m128i y16 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in.y + i));
+        const __m128i u16 = load_chroma16_avx2(in.u, i, in.half_chroma);
+        const __m128i v16 = load_chroma16_avx2(in.v, i, in.half_chroma);
+
+        const Rgb8x32 lo = convert8_avx2(y16, u16, v16, k);
+        const Rgb8x32 hi = convert8_avx2(_mm_srli_si128(y16, 8), _mm_srli_si128(u16, 8),
+                                         _mm_srli_si128(v16, 8), k);
+        const __m128i r = narrow16_avx2(lo.r, hi.r);
+        const __m128i g = narrow16_avx2(lo.g, hi.g);
+        const __m128i b = narrow16_avx2(lo.b, hi.b);
+
+        if (out.packed) {
+            store_packed48_avx2(out.packed + 3 * i, out.bgr ? b : r, g, out.bgr ? r : b);
+        } else {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out.r + i), r);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out.g + i), g);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out.b + i), b);
+        }
+    }
+    yuv_to_rgb_row_scalar(in, out, i, count, k);
+}
+
+__attribute__((target("avx2")))
+void normalize_row_avx2(const uint8_t* in, float* out, int count, float scale, float bias) {
+    const __m256 scale8 = _mm256_set1_ps(scale);
+    const __m256 bias8 = _mm256_set1_ps(bias);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256i values = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(in + i)));
+        _mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(values), scale8), bias8));
+    }
+    normalize_row_scalar(in, out, i, count, scale, bias);
+}
+
+#elif defined(PY_CHIAKI_NG_NEON_KERNEL)
+
+struct Rgb8x8 {
+    uint8x8_t r;
+    uint8x8_t g;
+    uint8x8_t b;
+};
+
+inline uint8x8_t narrow8_neon(int32x4_t lo, int32x4_t hi) {
+    return vqmovn_u16(vcombine_u16(vqmovun_s32(lo), vqmovun_s32(hi)));
+}
+
+// Eight pixels, widened to two int32x4 halves
+inline Rgb8x8 convert8_neon(uint8x8_t y8, uint8x8_t u8, uint8x8_t v8, const YuvCoefficients& k) {
+    const int16x8_t luma16 = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(y8)),
+                                       vdupq_n_s16(static_cast<int16_t>(k.y_offset)));
+    const int16x8_t cb16 = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(u8)), vdupq_n_s16(128));
+    const int16x8_t cr16 = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(v8)), vdupq_n_s16(128));
+    const int32x4_t round = vdupq_n_s32(ROUND);
+
+    int32x4_t red[2], green[2], blue[2];
+    for (int half = 0; half < 2; half++) {
+        const int32x4_t luma = vmlaq_n_s32(round, vmovl_s16(half ? vget_high_s16(luma16) : vget_low_s16(luma16)), k.y);
+        const int32x4_t cb = vmovl_s16(half ? vget_high_s16(cb16) : vget_low_s16(cb16));
+        const int32x4_t cr = vmovl_s16(half ? vget_high_s16(cr16) : vget_low_s16(cr16));
+        red[half] = vshrq_n_s32(vmlaq_n_s32(luma, cr, k.v_r), SHIFT);
+        green[half] = vshrq_n_s32(vmlaq_n_s32(vmlaq_n_s32(luma, cb, k.u_g), cr, k.v_g), SHIFT);
+        blue[half] = vshrq_n_s32(vmlaq_n_s32(luma, cb, k.u_b), SHIFT);
+    }
+    return {narrow8_neon(red[0], red[1]), narrow8_neon(green[0], green[1]), narrow8_neon(blue[0], blue[1])};
+}
+
+inline uint8x16_t load_chroma16_neon(const uint8_t* src, int i, bool half) {
+    if (half) {
+        const uint8x8_t samples = vld1_u8(src + i / 2);
+        const uint8x8x2_t doubled = vzip_u8(samples, samples);
+        return vcombine_u8(doubled.val[0], doubled.val[1]);
+    }
+    return vld1q_u8(src + i);
+}
+
+void yuv_to_rgb_row_neon(const YuvRow& in, const RowOutput& out, int count,
+                         const YuvCoefficients& k) {
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        const uint8x16_t y16 = vld1q_u8(in.y + i);
+        const uint8x16_t u16 = load_chroma16_neon(in.u, i, in.half_chroma);
+        const uint8x16_t v16 = load_chroma16_neon(in.v, i, in.half_chroma);
+
+        const Rgb8x8 lo = convert8_neon(vget_low_u8(y16), vget_low_u8(u16), vget_low_u8(v16), k);
+        const Rgb8x8 hi = convert8_neon(vget_high_u8(y16), vget_high_u8(u16), vget_high_u8(v16), k);
+        const uint8x16_t r = vcombine_u8(lo.r, hi.r);
+        const uint8x16_t g = vcombine_u8(lo.g, hi.g);
+        const uint8x16_t b = vcombine_u8(lo.b, hi.b);
+
+        if (out.packed) {
+            uint8x16x3_t pixels;
+            pixels.val[0] = out.bgr ? b : r;
+            pixels.val[1] = g;
+            pixels.val[2] = out.bgr ? r : b;
+            vst3q_u8(out.packed + 3 * i, pixels);
+        } else {
+            vst1q_u8(out.r + i, r);
+            vst1q_u8(out.g + i, g);
+            vst1q_u8(out.b + i, b);
+        }
+    }
+    yuv_to_rgb_row_scalar(in, out, i, count, k);
+}
+
+void normalize_row_neon(const uint8_t* in, float* out, int count, float scale, float bias) {
+    const float32x4_t bias4 = vdupq_n_f32(bias);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const uint16x8_t values = vmovl_u8(vld1_u8(in + i));
+        const float32x4_t lo = vcvtq_f32_u32(vmovl_u16(vget_low_u16(values)));
+        const float32x4_t hi = vcvtq_f32_u32(vmovl_u16(vget_high_u16(values)));
+        vst1q_f32(out + i, vmlaq_n_f32(bias4, lo, scale));
+        vst1q_f32(out + i + 4, vmlaq_n_f32(bias4, hi, scale));
+    }
+    normalize_row_scalar(in, out, i, count, scale, bias);
+}
+
+#endif
+
+struct Kernel {
+    RowKernel convert;
+    NormalizeKernel normalize;
+    const char* name;
+};
+
+const Kernel& row_kernel() {
+    static const Kernel kernel = [] {
+#if defined(PY_CHIAKI_NG_AVX2_KERNEL)
+        if (__builtin_cpu_supports("avx2")) {
+            return Kernel{yuv_to_rgb_row_avx2, normalize_row_avx2, "avx2"};
+        }
+#elif defined(PY_CHIAKI_NG_NEON_KERNEL)
+        return Kernel{yuv_to_rgb_row_neon, normalize_row_neon, "neon"};
+#endif
+        return Kernel{yuv_to_rgb_row_plain, normalize_row_plain, "scalar"};
+    }();
+    return kernel;
+}
+
+inline int64_t floor_div(int64_t num, int64_t den) {
+    return num >= 0 ? num / den : -((-num + den - 1) / den);
+}
+
+// Maps each output index along one axis to its source taps. NEAREST takes
+// the pixel under the output pixel's centre; BOX the two pixels straddling it.
+void build_axis(int roi_start, int roi_extent, int out_extent, bool box,
+                std::vector<int32_t>& tap0, std::vector<int32_t>& tap1,
+                std::vector<int32_t>& chroma) {
+    tap0.resize(out_extent);
+    tap1.resize(out_extent);
+    chroma.resize(out_extent);
+
+    const int64_t den = 2 * static_cast<int64_t>(out_extent);
+    const int last = roi_start + roi_extent - 1;
+    for (int o = 0; o < out_extent; o++) {
+        const int64_t twice_centre = (2 * static_cast<int64_t>(o) + 1) * roi_extent;
+        const int centre = roi_start + static_cast<int>(twice_centre / den);
+        int first = centre;
+        int second = centre;
+        if (box) {
+            first = std::clamp(roi_start + static_cast<int>(floor_div(twice_centre - out_extent, den)),
+                               roi_start, last);
+            second = std::min(first + 1, last);
+        }
+        tap0[o] = first;
+        tap1[o] = second;
+        chroma[o] = centre / 2;
+    }
+}
+
+} // namespace
+
+void OutputSpec::validate() const {
+    if (width < 0 || height < 0) {
+        throw std::invalid_argument("output size must not be negative");
+    }
+    if (roi_x < 0 || roi_y < 0 || roi_width < 0 || roi_height < 0) {
+        throw std::invalid_argument("roi must not be negative");
+    }
+    if (format == PixelFormat::ENCODED) {
+        throw std::invalid_argument("ENCODED is not a decode target");
+    }
+    for (float value : stddev) {
+        if (!(value > 0.0f)) {
+            throw std::invalid_argument("std must be positive");
+        }
+    }
+}
+
+bool FrameConverter::Geometry::operator==(const Geometry& other) const {
+    return roi_x == other.roi_x && roi_y == other.roi_y &&
+           roi_width == other.roi_width && roi_height == other.roi_height &&
+           width == other.width && height == other.height;
+}
+
+FrameConverter::Geometry FrameConverter::resolve(const OutputSpec& spec, int src_width, int src_height) {
+    Geometry geometry;
+    if (spec.roi_x >= src_width || spec.roi_y >= src_height) {
+        return geometry;
+    }
+    geometry.roi_x = spec.roi_x;
+    geometry.roi_y = spec.roi_y;
+    const int max_width = src_width - spec.roi_x;
+    const int max_height = src_height - spec.roi_y;
+    geometry.roi_width = spec.roi_width > 0 ? std::min(spec.roi_width, max_width) : max_width;
+    geometry.roi_height = spec.roi_height > 0 ? std::min(spec.roi_height, max_height) : max_height;
+    geometry.width = spec.width > 0 ? spec.width : geometry.roi_width;
+    geometry.height = spec.height > 0 ? spec.height : geometry.roi_height;
+    return geometry;
+}
+
+size_t FrameConverter::output_size(PixelFormat format, int width, int height) {
+    return static_cast<size_t>(width) * height * pixel_format_channels(format) *
+           pixel_format_sample_size(format);
+}
+
+const char* FrameConverter::kernel_name() {
+    return row_kernel().name;
+}
+
+void FrameConverter::build_maps(const OutputSpec& spec, const Geometry& geometry, bool nv12) {
+    const bool box = spec.resample == Resample::BOX;
+    build_axis(geometry.roi_x, geometry.roi_width, geometry.width, box, luma_x0_, luma_x1_, chroma_x_);
+    build_axis(geometry.roi_y, geometry.roi_height, geometry.height, box, luma_y0_, luma_y1_, chroma_y_);
+    if (nv12) {
+        for (int32_t& x : chroma_x_) {
+            x *= 2;
+        }
+    }
+
+    const size_t width = static_cast<size_t>(geometry.width);
+    for (auto* row : {&row_y_, &row_u_, &row_v_, &row_r_, &row_g_, &row_b_}) {
+        row->resize(width);
+    }
+
+    geometry_ = geometry;
+    resample_ = spec.resample;
+    nv12_ = nv12;
+    luma_in_place_ = !box && geometry.width == geometry.roi_width;
+    chroma_in_place_ = luma_in_place_ && geometry.roi_x % 2 == 0;
+    maps_valid_ = true;
+}
+
+YuvRow FrameConverter::gather_row(const YuvPicture& src, int out_y, bool chroma) {
+    // Plain pointers: stores through uint8_t* would otherwise force the
+    // vectors' data pointers to be reloaded on every iteration
+    const int width = geometry_.width;
+    const uint8_t* luma0 = src.planes[0] + static_cast<ptrdiff_t>(luma_y0_[out_y]) * src.strides[0];
+    const int32_t* PY_CHIAKI_NG_RESTRICT x0 = luma_x0_.data();
+    uint8_t* PY_CHIAKI_NG_RESTRICT row_y = row_y_.data();
+
+    YuvRow row = {row_y, row_u_.data(), row_v_.data(), false};
+    if (luma_in_place_) {
+        row.y = luma0 + geometry_.roi_x;
+    } else if (resample_ == Resample::BOX) {
+        const uint8_t* luma1 = src.planes[0] + static_cast<ptrdiff_t>(luma_y1_[out_y]) * src.strides[0];
+        const int32_t* PY_CHIAKI_NG_RESTRICT x1 = luma_x1_.data();
+        for (int x = 0; x < width; x++) {
+            row_y[x] = static_cast<uint8_t>((luma0[x0[x]] + luma0[x1[x]] + luma1[x0[x]] + luma1[x1[x]] + 2) >> 2);
+        }
+    } else {
+        for (int x = 0; x < width; x++) {
+            row_y[x] = luma0[x0[x]];
+        }
+    }
+
+    if (!chroma) {
+        return row;
+    }
+    const ptrdiff_t chroma_row = chroma_y_[out_y];
+    const int32_t* PY_CHIAKI_NG_RESTRICT cx = chroma_x_.data();
+    uint8_t* PY_CHIAKI_NG_RESTRICT row_u = row_u_.data();
+    uint8_t* PY_CHIAKI_NG_RESTRICT row_v = row_v_.data();
+    if (src.nv12) {
+        const uint8_t* uv = src.planes[1] + chroma_row * src.strides[1];
+        if (chroma_in_place_) {
+            // Deinterleave at half resolution; the kernel doubles it up
+            const uint8_t* pairs = uv + geometry_.roi_x;
+            const int samples = (width + 1) / 2;
+            for (int x = 0; x < samples; x++) {
+                row_u[x] = pairs[2 * x];
+                row_v[x] = pairs[2 * x + 1];
+            }
+            row.half_chroma = true;
+        } else {
+            for (int x = 0; x < width; x++) {
+                row_u[x] = uv[cx[x]];
+                row_v[x] = uv[cx[x] + 1];
+            }
+        }
+    } else {
+        const uint8_t* u = src.planes[1] + chroma_row * src.strides[1];
+        const uint8_t* v = src.planes[2] + chroma_row * src.strides[2];
+        if (chroma_in_place_) {
+            row.u = u + geometry_.roi_x / 2;
+            row.v = v + geometry_.roi_x / 2;
+            row.half_chroma = true;
+        } else {
+            for (int x = 0; x < width; x++) {
+                row_u[x] = u[cx[x]];
+                row_v[x] = v[cx[x]];
+            }
+        }
+    }
+    return row;
+}
+
+void FrameConverter::convert(const YuvPicture& src, const OutputSpec& spec,
+                             const Geometry& geometry, uint8_t* dst) {
+    if (geometry.empty()) {
+        return;
+    }
+    if (!maps_valid_ || !(geometry == geometry_) || spec.resample != resample_ || src.nv12 != nv12_) {
+        build_maps(spec, geometry, src.nv12);
+    }
+
+    const YuvCoefficients& k = COEFFICIENTS[static_cast<int>(src.matrix)][src.full_range ? 1 : 0];
+    const Kernel& kernel = row_kernel();
+    const size_t width = static_cast<size_t>(geometry.width);
+    const size_t plane = width * geometry.height;
+    const PixelFormat format = spec.format;
+    const bool gray = format == PixelFormat::GRAY;
+    const bool planar = pixel_format_is_float(format);
+
+    // Float planes in output order: channel c reads RGB row channel_rows[c]
+    const bool bgr = format == PixelFormat::BGR || format == PixelFormat::BGR_F32_CHW;
+    const uint8_t* channel_rows[3] = {
+        bgr ? row_b_.data() : row_r_.data(),
+        row_g_.data(),
+        bgr ? row_r_.data() : row_b_.data(),
+    };
+    float scale[3];
+    float bias[3];
+    for (int c = 0; c < 3; c++) {
+        scale[c] = 1.0f / (255.0f * spec.stddev[c]);
+        bias[c] = -spec.mean[c] / spec.stddev[c];
+    }
+
+    for (int out_y = 0; out_y < geometry.height; out_y++) {
+        const YuvRow row = gather_row(src, out_y, !gray);
+
+        if (gray) {
+            // Luma alone, expanded to full range like swscale's GRAY8
+            uint8_t* PY_CHIAKI_NG_RESTRICT out = dst + out_y * width;
+            const uint8_t* PY_CHIAKI_NG_RESTRICT luma = row.y;
+            for (size_t x = 0; x < width; x++) {
+                out[x] = clamp_u8(((luma[x] - k.y_offset) * k.y + ROUND) >> SHIFT);
+            }
+            continue;
+        }
+
+        if (!planar) {
+            kernel.convert(row, {dst + out_y * width * 3, bgr, nullptr, nullptr, nullptr}, geometry.width, k);
+            continue;
+        }
+
+        kernel.convert(row, {nullptr, false, row_r_.data(), row_g_.data(), row_b_.data()}, geometry.width, k);
+        float* planes = reinterpret_cast<float*>(dst);
+        for (int c = 0; c < 3; c++) {
+            kernel.normalize(channel_rows[c], planes + c * plane + out_y * width, geometry.width, scale[c], bias[c]);
+        }
+    }
+}
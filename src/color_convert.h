@@ -0,0 +1,146 @@
+/**
+ * color_convert.h - YUV 4:2:0 to model-ready frames in one pass
+ *
+ * FrameConverter crops, resamples and colour converts a decoded picture
+ * straight into the layout an OutputSpec asks for, so a model gets e.g.
+ * a 224x224 float32 CHW tensor without a full-size BGR copy and a
+ * cv2.resize in Python.
+ *
+ * Each output row is built in three steps: Y/U/V samples are gathered
+ * through column maps precomputed for the current geometry, the colour
+ * matrix runs over the row in an AVX2 or NEON kernel (scalar fallback,
+ * picked once at runtime), and the result is stored in the target layout.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "video_frame.h"
+
+enum class Resample {
+    NEAREST,  // one source pixel per output pixel
+    BOX,      // 2x2 luma average; cheap anti-aliasing for 2x+ downscales
+};
+
+struct OutputSpec {
+    // Output size; 0 keeps the ROI's size along that axis
+    int width = 0;
+    int height = 0;
+
+    // Crop in source pixels; a 0 extent reaches to the frame edge. The
+    // ROI is clamped to each frame, so it survives resolution changes.
+    int roi_x = 0;
+    int roi_y = 0;
+    int roi_width = 0;
+    int roi_height = 0;
+
+    PixelFormat format = PixelFormat::BGR;
+    Resample resample = Resample::NEAREST;
+
+    // Float formats only, per output channel: (value / 255 - mean) / stddev
+    std::array<float, 3> mean = {0.0f, 0.0f, 0.0f};
+    std::array<float, 3> stddev = {1.0f, 1.0f, 1.0f};
+
+    // Throws std::invalid_argument for negative sizes, ENCODED or stddev <= 0
+    void validate() const;
+};
+
+// YUV -> RGB matrix. BT.2020 is converted as is, without tone mapping.
+enum class ColorMatrix {
+    BT601,
+    BT709,
+    BT2020,
+};
+
+// Borrowed 8-bit 4:2:0 picture. NV12 keeps interleaved UV in planes[1].
+struct YuvPicture {
+    const uint8_t* planes[3] = {nullptr, nullptr, nullptr};
+    int strides[3] = {0, 0, 0};
+    int width = 0;
+    int height = 0;
+    bool nv12 = false;
+    bool full_range = false;
+    ColorMatrix matrix = ColorMatrix::BT601;
+};
+
+// One row of samples to convert. With half_chroma, u/v hold one sample
+// per two pixels (a 1:1 row of a 4:2:0 picture); otherwise one per pixel.
+struct YuvRow {
+    const uint8_t* y;
+    const uint8_t* u;
+    const uint8_t* v;
+    bool half_chroma;
+};
+
+// Fixed-point colour matrix, 14 fractional bits
+struct YuvCoefficients {
+    int32_t y_offset;
+    int32_t y;
+    int32_t v_r;
+    int32_t u_g;
+    int32_t v_g;
+    int32_t u_b;
+};
+
+class FrameConverter {
+public:
+    struct Geometry {
+        int roi_x = 0;
+        int roi_y = 0;
+        int roi_width = 0;
+        int roi_height = 0;
+        int width = 0;
+        int height = 0;
+
+        bool empty() const { return width <= 0 || height <= 0; }
+        bool operator==(const Geometry& other) const;
+    };
+
+    // Where spec lands on a src_width x src_height frame; empty if the
+    // ROI lies entirely outside it
+    static Geometry resolve(const OutputSpec& spec, int src_width, int src_height);
+
+    // Bytes needed for a converted frame
+    static size_t output_size(PixelFormat format, int width, int height);
+
+    // Writes output_size(spec.format, geometry.width, geometry.height)
+    // bytes to dst; geometry must come from resolve() for this picture
+    void convert(const YuvPicture& src, const OutputSpec& spec, const Geometry& geometry, uint8_t* dst);
+
+    // "avx2", "neon" or "scalar"
+    static const char* kernel_name();
+
+private:
+    void build_maps(const OutputSpec& spec, const Geometry& geometry, bool nv12);
+    YuvRow gather_row(const YuvPicture& src, int out_y, bool chroma);
+
+    Geometry geometry_;
+    Resample resample_ = Resample::NEAREST;
+    bool nv12_ = false;
+    bool maps_valid_ = false;
+    // 1:1 NEAREST rows are read in place; with an even ROI start so is
+    // I420 chroma, at half resolution
+    bool luma_in_place_ = false;
+    bool chroma_in_place_ = false;
+
+    // Per output column: luma taps (x0 == x1 for NEAREST) and chroma offset
+    std::vector<int32_t> luma_x0_;
+    std::vector<int32_t> luma_x1_;
+    std::vector<int32_t> chroma_x_;
+    // Per output row, same for rows
+    std::vector<int32_t> luma_y0_;
+    std::vector<int32_t> luma_y1_;
+    std::vector<int32_t> chroma_y_;
+
+    // One gathered row of Y/U/V and the converted R/G/B planes
+    std::vector<uint8_t> row_y_;
+    std::vector<uint8_t> row_u_;
+    std::vector<uint8_t> row_v_;
+    std::vector<uint8_t> row_r_;
+    std::vector<uint8_t> row_g_;
+    std::vector<uint8_t> row_b_;
+};
@@ -7,10 +7,35 @@
 
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
+#include <pybind11/numpy.h>
 #include <chiaki/controller.h>
+#include <stdexcept>
+#include <vector>
+
+#include "controller_layout.h"
 
 namespace py = pybind11;
 
+using LayoutArray = py::array_t<float, py::array::c_style | py::array::forcecast>;
+
+// Checks for one layout vector, or an (N, 17) matrix when batch; returns N
+static size_t layout_rows(const LayoutArray& values, bool batch) {
+    const bool row = values.ndim() == 1 && values.shape(0) == CONTROLLER_LAYOUT_SIZE;
+    const bool matrix = values.ndim() == 2 && values.shape(1) == CONTROLLER_LAYOUT_SIZE;
+    if (batch ? !matrix : !row) {
+        throw std::invalid_argument(batch
+            ? "expected an (N, 17) controller layout matrix (see CONTROLLER_LAYOUT)"
+            : "expected a length-17 controller layout vector (see CONTROLLER_LAYOUT)");
+    }
+    return batch ? static_cast<size_t>(values.shape(0)) : 1;
+}
+
+static ChiakiControllerState idle_controller_state() {
+    ChiakiControllerState state;
+    chiaki_controller_state_set_idle(&state);
+    return state;
+}
+
 void init_controller_binding(py::module& m) {
     // Controller touch structure
     py::class_<ChiakiControllerTouch>(m, "ControllerTouch")
@@ -42,6 +67,42 @@ void init_controller_binding(py::module& m) {
         .def("set_idle", [](ChiakiControllerState& self) {
             chiaki_controller_state_set_idle(&self);
         }, "Reset controller to idle state")
+        // Packed layout: the whole state in one call (see CONTROLLER_LAYOUT)
+        .def("to_array", [](const ChiakiControllerState& self, bool normalized) {
+            LayoutArray out(CONTROLLER_LAYOUT_SIZE);
+            controller_state_to_layout(self, out.mutable_data(), normalized);
+            return out;
+        }, "Pack into a float32 vector laid out as CONTROLLER_LAYOUT",
+           py::arg("normalized") = false)
+        .def_static("from_array", [](const LayoutArray& values, bool normalized) {
+            layout_rows(values, false);
+            ChiakiControllerState state = idle_controller_state();
+            controller_state_from_layout(state, values.data(), normalized);
+            return state;
+        }, "Create a state from a CONTROLLER_LAYOUT vector",
+           py::arg("values"), py::arg("normalized") = false)
+        .def("apply", [](ChiakiControllerState& self, const LayoutArray& values, bool normalized) {
+            layout_rows(values, false);
+            controller_state_from_layout(self, values.data(), normalized);
+        }, "Overwrite this state in place from a CONTROLLER_LAYOUT vector",
+           py::arg("values"), py::arg("normalized") = false)
+        .def_static("from_batch", [](const LayoutArray& matrix, bool normalized) {
+            const size_t rows = layout_rows(matrix, true);
+            std::vector<ChiakiControllerState> states(rows, idle_controller_state());
+            for (size_t i = 0; i < rows; i++) {
+                controller_state_from_layout(states[i], matrix.data() + i * CONTROLLER_LAYOUT_SIZE, normalized);
+            }
+            return states;
+        }, "Convert an (N, 17) action matrix into N states",
+           py::arg("matrix"), py::arg("normalized") = false)
+        .def_static("to_batch", [](const std::vector<ChiakiControllerState>& states, bool normalized) {
+            LayoutArray out({states.size(), CONTROLLER_LAYOUT_SIZE});
+            for (size_t i = 0; i < states.size(); i++) {
+                controller_state_to_layout(states[i], out.mutable_data() + i * CONTROLLER_LAYOUT_SIZE, normalized);
+            }
+            return out;
+        }, "Pack N states into an (N, 17) float32 matrix",
+           py::arg("states"), py::arg("normalized") = false)
         .def("start_touch", [](ChiakiControllerState& self, uint16_t x, uint16_t y) {
             return chiaki_controller_state_start_touch(&self, x, y);
         }, "Start a touch at the given coordinates")
@@ -208,6 +269,12 @@ void init_controller_binding(py::module& m) {
                 }
             });
 
+    py::tuple layout_fields(CONTROLLER_LAYOUT_SIZE);
+    for (size_t i = 0; i < CONTROLLER_LAYOUT_SIZE; i++) {
+        layout_fields[i] = py::str(CONTROLLER_LAYOUT_FIELDS[i]);
+    }
+    m.attr("CONTROLLER_LAYOUT") = layout_fields;
+    
     // Controller button enum
     py::enum_<ChiakiControllerButton>(m, "ControllerButton")
         .value("CROSS", CHIAKI_CONTROLLER_BUTTON_CROSS)
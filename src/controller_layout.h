@@ -0,0 +1,106 @@
+/**
+ * controller_layout.h - Packed float32 layout of ChiakiControllerState
+ *
+ * One fixed vector per state so an RL action (or a whole batch of them)
+ * crosses into C++ in a single call:
+ *
+ *   [0]      buttons bitmask (ControllerButton values OR'd together)
+ *   [1..2]   l2_state, r2_state
+ *   [3..6]   left_x, left_y, right_x, right_y
+ *   [7..9]   gyro_x, gyro_y, gyro_z
+ *   [10..12] accel_x, accel_y, accel_z
+ *   [13..16] orient_x, orient_y, orient_z, orient_w
+ *
+ * Triggers and sticks are raw chiaki units (0..255 and -32768..32767),
+ * or [0, 1] and [-1, 1] when normalized. Out-of-range values are clamped.
+ * Touches are not part of the layout.
+ */
+
+#pragma once
+
+#include <chiaki/controller.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+constexpr size_t CONTROLLER_LAYOUT_SIZE = 17;
+
+constexpr const char* CONTROLLER_LAYOUT_FIELDS[CONTROLLER_LAYOUT_SIZE] = {
+    "buttons", "l2_state", "r2_state",
+    "left_x", "left_y", "right_x", "right_y",
+    "gyro_x", "gyro_y", "gyro_z",
+    "accel_x", "accel_y", "accel_z",
+    "orient_x", "orient_y", "orient_z", "orient_w",
+};
+
+namespace controller_layout {
+
+constexpr float TRIGGER_SCALE = 255.0f;
+constexpr float STICK_SCALE = 32767.0f;
+
+// NaN from a misbehaving policy becomes neutral rather than undefined
+inline float finite_or_zero(float value) {
+    return std::isnan(value) ? 0.0f : value;
+}
+
+inline uint8_t to_trigger(float value, bool normalized) {
+    value = finite_or_zero(value);
+    const float raw = normalized ? value * TRIGGER_SCALE : value;
+    return static_cast<uint8_t>(std::lround(std::clamp(raw, 0.0f, 255.0f)));
+}
+
+inline int16_t to_stick(float value, bool normalized) {
+    value = finite_or_zero(value);
+    const float raw = normalized ? value * STICK_SCALE : value;
+    return static_cast<int16_t>(std::lround(std::clamp(raw, -32768.0f, 32767.0f)));
+}
+
+} // namespace controller_layout
+
+inline void controller_state_to_layout(const ChiakiControllerState& state, float* out, bool normalized) {
+    using namespace controller_layout;
+    const float trigger_scale = normalized ? 1.0f / TRIGGER_SCALE : 1.0f;
+    const float stick_scale = normalized ? 1.0f / STICK_SCALE : 1.0f;
+
+    out[0] = static_cast<float>(state.buttons);
+    out[1] = state.l2_state * trigger_scale;
+    out[2] = state.r2_state * trigger_scale;
+    out[3] = state.left_x * stick_scale;
+    out[4] = state.left_y * stick_scale;
+    out[5] = state.right_x * stick_scale;
+    out[6] = state.right_y * stick_scale;
+    out[7] = state.gyro_x;
+    out[8] = state.gyro_y;
+    out[9] = state.gyro_z;
+    out[10] = state.accel_x;
+    out[11] = state.accel_y;
+    out[12] = state.accel_z;
+    out[13] = state.orient_x;
+    out[14] = state.orient_y;
+    out[15] = state.orient_z;
+    out[16] = state.orient_w;
+}
+
+inline void controller_state_from_layout(ChiakiControllerState& state, const float* in, bool normalized) {
+    using namespace controller_layout;
+    // float32 holds every bitmask up to 2^24 exactly, well past the last button
+    state.buttons = static_cast<uint32_t>(std::lround(std::clamp(finite_or_zero(in[0]), 0.0f, 16777215.0f)));
+    state.l2_state = to_trigger(in[1], normalized);
+    state.r2_state = to_trigger(in[2], normalized);
+    state.left_x = to_stick(in[3], normalized);
+    state.left_y = to_stick(in[4], normalized);
+    state.right_x = to_stick(in[5], normalized);
+    state.right_y = to_stick(in[6], normalized);
+    state.gyro_x = in[7];
+    state.gyro_y = in[8];
+    state.gyro_z = in[9];
+    state.accel_x = in[10];
+    state.accel_y = in[11];
+    state.accel_z = in[12];
+    state.orient_x = in[13];
+    state.orient_y = in[14];
+    state.orient_z = in[15];
+    state.orient_w = in[16];
+}
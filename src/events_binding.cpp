@@ -9,8 +9,106 @@
 #include <pybind11/stl.h>
 #include <chiaki/session.h>
 
+#include <string>
+
+#include "session_event.h"
+
 namespace py = pybind11;
 
+// One C++ type per Python event class; they only differ in the
+// properties bound on them, so a SessionEvent converts with a plain copy
+struct QuitEvent : SessionEvent {};
+struct RumbleEvent : SessionEvent {};
+struct TriggerEffectsEvent : SessionEvent {};
+struct LedColorEvent : SessionEvent {};
+struct PlayerIndexEvent : SessionEvent {};
+struct HapticIntensityEvent : SessionEvent {};
+struct TriggerIntensityEvent : SessionEvent {};
+struct MotionResetEvent : SessionEvent {};
+struct KeyboardTextEvent : SessionEvent {};
+struct LoginPinRequestEvent : SessionEvent {};
+
+template <typename T>
+static py::object typed_event(const SessionEvent& event) {
+    T typed;
+    static_cast<SessionEvent&>(typed) = event;
+    return py::cast(std::move(typed));
+}
+
+py::object session_event_to_python(const SessionEvent& event) {
+    switch (event.type) {
+        case CHIAKI_EVENT_QUIT:
+            return typed_event<QuitEvent>(event);
+        case CHIAKI_EVENT_RUMBLE:
+            return typed_event<RumbleEvent>(event);
+        case CHIAKI_EVENT_TRIGGER_EFFECTS:
+            return typed_event<TriggerEffectsEvent>(event);
+        case CHIAKI_EVENT_LED_COLOR:
+            return typed_event<LedColorEvent>(event);
+        case CHIAKI_EVENT_PLAYER_INDEX:
+            return typed_event<PlayerIndexEvent>(event);
+        case CHIAKI_EVENT_HAPTIC_INTENSITY:
+            return typed_event<HapticIntensityEvent>(event);
+        case CHIAKI_EVENT_TRIGGER_INTENSITY:
+            return typed_event<TriggerIntensityEvent>(event);
+        case CHIAKI_EVENT_MOTION_RESET:
+            return typed_event<MotionResetEvent>(event);
+        case CHIAKI_EVENT_KEYBOARD_TEXT_CHANGE:
+            return typed_event<KeyboardTextEvent>(event);
+        case CHIAKI_EVENT_LOGIN_PIN_REQUEST:
+            return typed_event<LoginPinRequestEvent>(event);
+        default:
+            return py::cast(event);
+    }
+}
+
+static py::bytes trigger_effect(const uint8_t (&effect)[10]) {
+    return py::bytes(reinterpret_cast<const char*>(effect), sizeof(effect));
+}
+
+// The dict form older event callbacks received, plus the new payloads
+static py::dict session_event_to_dict(const SessionEvent& event) {
+    py::dict data;
+    data["type"] = static_cast<int>(event.type);
+    switch (event.type) {
+        case CHIAKI_EVENT_QUIT:
+            data["reason"] = static_cast<int>(event.quit_reason);
+            if (event.text[0]) {
+                data["reason_str"] = std::string(event.text);
+            }
+            break;
+        case CHIAKI_EVENT_RUMBLE:
+            data["left"] = event.rumble_left;
+            data["right"] = event.rumble_right;
+            break;
+        case CHIAKI_EVENT_TRIGGER_EFFECTS:
+            data["type_left"] = event.trigger_effects.type_left;
+            data["type_right"] = event.trigger_effects.type_right;
+            data["left"] = trigger_effect(event.trigger_effects.left);
+            data["right"] = trigger_effect(event.trigger_effects.right);
+            break;
+        case CHIAKI_EVENT_LED_COLOR:
+            data["color"] = py::make_tuple(event.led_color[0], event.led_color[1], event.led_color[2]);
+            break;
+        case CHIAKI_EVENT_PLAYER_INDEX:
+            data["index"] = event.player_index;
+            break;
+        case CHIAKI_EVENT_HAPTIC_INTENSITY:
+        case CHIAKI_EVENT_TRIGGER_INTENSITY:
+            data["intensity"] = event.intensity;
+            break;
+        case CHIAKI_EVENT_KEYBOARD_TEXT_CHANGE:
+            data["text"] = std::string(event.text);
+            break;
+        case CHIAKI_EVENT_LOGIN_PIN_REQUEST:
+            data["pin_incorrect"] = event.pin_incorrect;
+            break;
+        default:
+            break;
+    }
+    return data;
+}
+
 void init_events_binding(py::module& m) {
     // Event types
     py::enum_<ChiakiEventType>(m, "EventType")
@@ -50,6 +148,63 @@ void init_events_binding(py::module& m) {
         .value("PSN_REGIST_FAILED", CHIAKI_QUIT_REASON_PSN_REGIST_FAILED)
         .export_values();
     
+    // Typed events delivered by Session.set_event_callback() and
+    // next_event(); every class has type, timestamp_ns and to_dict()
+    py::class_<SessionEvent>(m, "Event")
+        .def_property_readonly("type", [](const SessionEvent& event) { return event.type; })
+        .def_readonly("timestamp_ns", &SessionEvent::timestamp_ns,
+                      "When chiaki raised the event, on the time.monotonic_ns() clock")
+        .def("to_dict", &session_event_to_dict, "Event as a dict with an int 'type' and its payload")
+        .def("__repr__", [](py::object self) {
+            const SessionEvent& event = self.cast<const SessionEvent&>();
+            return "<" + self.attr("__class__").attr("__name__").cast<std::string>() +
+                   " timestamp_ns=" + std::to_string(event.timestamp_ns) + ">";
+        });
+    
+    py::class_<QuitEvent, SessionEvent>(m, "QuitEvent")
+        .def_property_readonly("reason", [](const QuitEvent& event) { return event.quit_reason; })
+        .def_property_readonly("reason_str", [](const QuitEvent& event) { return std::string(event.text); });
+    
+    py::class_<RumbleEvent, SessionEvent>(m, "RumbleEvent")
+        .def_readonly("left", &RumbleEvent::rumble_left)
+        .def_readonly("right", &RumbleEvent::rumble_right);
+    
+    py::class_<TriggerEffectsEvent, SessionEvent>(m, "TriggerEffectsEvent")
+        .def_property_readonly("type_left", [](const TriggerEffectsEvent& event) {
+            return event.trigger_effects.type_left;
+        })
+        .def_property_readonly("type_right", [](const TriggerEffectsEvent& event) {
+            return event.trigger_effects.type_right;
+        })
+        .def_property_readonly("left", [](const TriggerEffectsEvent& event) {
+            return trigger_effect(event.trigger_effects.left);
+        }, "10 raw effect parameter bytes")
+        .def_property_readonly("right", [](const TriggerEffectsEvent& event) {
+            return trigger_effect(event.trigger_effects.right);
+        }, "10 raw effect parameter bytes");
+    
+    py::class_<LedColorEvent, SessionEvent>(m, "LedColorEvent")
+        .def_property_readonly("color", [](const LedColorEvent& event) {
+            return py::make_tuple(event.led_color[0], event.led_color[1], event.led_color[2]);
+        }, "(r, g, b)");
+    
+    py::class_<PlayerIndexEvent, SessionEvent>(m, "PlayerIndexEvent")
+        .def_readonly("index", &PlayerIndexEvent::player_index);
+    
+    py::class_<HapticIntensityEvent, SessionEvent>(m, "HapticIntensityEvent")
+        .def_readonly("intensity", &HapticIntensityEvent::intensity, "0 off, 1 weak, 2 medium, 3 strong");
+    
+    py::class_<TriggerIntensityEvent, SessionEvent>(m, "TriggerIntensityEvent")
+        .def_readonly("intensity", &TriggerIntensityEvent::intensity, "0 off, 1 weak, 2 medium, 3 strong");
+    
+    py::class_<MotionResetEvent, SessionEvent>(m, "MotionResetEvent");
+    
+    py::class_<KeyboardTextEvent, SessionEvent>(m, "KeyboardTextEvent")
+        .def_property_readonly("text", [](const KeyboardTextEvent& event) { return std::string(event.text); });
+    
+    py::class_<LoginPinRequestEvent, SessionEvent>(m, "LoginPinRequestEvent")
+        .def_readonly("pin_incorrect", &LoginPinRequestEvent::pin_incorrect);
+    
     // Utility functions
     m.def("quit_reason_string", [](ChiakiQuitReason reason) {
         const char* str = chiaki_quit_reason_string(reason);
@@ -0,0 +1,190 @@
+/**
+ * flight_recorder.cpp - The last seconds of a session, kept in memory
+ */
+
+#include "flight_recorder.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#include "annexb.h"
+#include "stream_recording.h"
+
+FlightRecorder::FlightRecorder(uint32_t codec, size_t capacity, int64_t max_ns)
+    : codec_(codec), hevc_(codec != 0), max_ns_(max_ns) {  // 0 is CHIAKI_CODEC_H264
+    if (capacity < MIN_CAPACITY) {
+        throw std::invalid_argument("Flight recorder capacity must be at least 64 KiB");
+    }
+    if (max_ns < 0) {
+        throw std::invalid_argument("Flight recorder duration must not be negative");
+    }
+    ring_.resize(capacity);
+    stats_.capacity = capacity;
+}
+
+void FlightRecorder::add_sample(const uint8_t* buf, size_t buf_size, int32_t frames_lost,
+                                bool frame_recovered, int64_t timestamp_ns) {
+    const bool keyframe = annexb::is_keyframe(hevc_, buf, buf_size);
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.samples++;
+    if (!append(static_cast<uint32_t>(RecordKind::VIDEO_SAMPLE), timestamp_ns, frames_lost, frame_recovered,
+                buf, buf_size, nullptr, 0, keyframe)) {
+        stats_.dropped++;
+    }
+}
+
+void FlightRecorder::add_event(uint32_t type, uint32_t quit_reason, const std::string& reason_str,
+                               int64_t timestamp_ns) {
+    const RecordedEvent event = {type, quit_reason};
+    std::lock_guard<std::mutex> lock(mutex_);
+    append(static_cast<uint32_t>(RecordKind::EVENT), timestamp_ns, 0, false, &event, sizeof(event),
+           reason_str.data(), reason_str.size(), false);
+}
+
+void FlightRecorder::add_controller_state(const float* layout, int64_t timestamp_ns) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    append(static_cast<uint32_t>(RecordKind::CONTROLLER_STATE), timestamp_ns, 0, false, layout,
+           RECORDED_CONTROLLER_STATE_SIZE, nullptr, 0, false);
+}
+
+bool FlightRecorder::append(uint32_t kind, int64_t timestamp_ns, int32_t frames_lost, bool frame_recovered,
+                            const void* head, size_t head_size, const void* tail, size_t tail_size,
+                            bool keyframe) {
+    const bool sample = kind == static_cast<uint32_t>(RecordKind::VIDEO_SAMPLE);
+    const size_t payload = head_size + tail_size;
+    const size_t total = sizeof(RecordHeader) + payload + record_padding(payload);
+    if (total > ring_.size()) {
+        if (sample) {
+            // The pictures after this one would reference it
+            evict_to(head_);
+            keyframes_.clear();
+            have_keyframe_ = false;
+        }
+        return false;
+    }
+    if (sample && !keyframe && !have_keyframe_) {
+        return false;
+    }
+
+    // Groups whose successor is already max_ns old go first
+    if (sample && keyframe && max_ns_ > 0) {
+        while (keyframes_.size() >= 2 && timestamp_ns - keyframes_[1].timestamp_ns >= max_ns_) {
+            keyframes_.pop_front();
+            evict_to(keyframes_.front().offset);
+        }
+    }
+    while (head_ + total - tail_ > ring_.size()) {
+        evict_group();
+    }
+    if (sample && !keyframe && !have_keyframe_) {
+        return false; // Its own group was just reclaimed
+    }
+    if (keyframe) {
+        keyframes_.push_back({head_, timestamp_ns});
+        have_keyframe_ = true;
+    }
+
+    static const uint8_t zeros[RECORD_ALIGN] = {};
+    RecordHeader header = {};
+    header.kind = kind;
+    header.size = static_cast<uint32_t>(payload);
+    header.timestamp_ns = timestamp_ns;
+    header.frames_lost = frames_lost;
+    header.frame_recovered = frame_recovered ? 1 : 0;
+    uint64_t at = head_;
+    copy_in(at, &header, sizeof(header));
+    at += sizeof(header);
+    copy_in(at, head, head_size);
+    at += head_size;
+    copy_in(at, tail, tail_size);
+    at += tail_size;
+    copy_in(at, zeros, record_padding(payload));
+    head_ += total;
+    last_timestamp_ns_ = timestamp_ns;
+    stats_.records++;
+    return true;
+}
+
+void FlightRecorder::evict_group() {
+    if (!keyframes_.empty() && keyframes_.front().offset == tail_) {
+        keyframes_.pop_front();
+    }
+    if (!keyframes_.empty()) {
+        evict_to(keyframes_.front().offset);
+    } else {
+        evict_to(head_);
+        have_keyframe_ = false;
+    }
+}
+
+void FlightRecorder::evict_to(uint64_t offset) {
+    while (tail_ < offset) {
+        RecordHeader header;
+        copy_out(tail_, reinterpret_cast<uint8_t*>(&header), sizeof(header));
+        tail_ += sizeof(header) + header.size + record_padding(header.size);
+        stats_.records--;
+        stats_.evicted++;
+    }
+}
+
+void FlightRecorder::copy_in(uint64_t offset, const void* data, size_t size) {
+    if (size == 0) {
+        return;
+    }
+    const size_t at = static_cast<size_t>(offset % ring_.size());
+    const size_t first = std::min(size, ring_.size() - at);
+    memcpy(ring_.data() + at, data, first);
+    memcpy(ring_.data(), static_cast<const uint8_t*>(data) + first, size - first);
+}
+
+void FlightRecorder::copy_out(uint64_t offset, uint8_t* out, size_t size) const {
+    const size_t at = static_cast<size_t>(offset % ring_.size());
+    const size_t first = std::min(size, ring_.size() - at);
+    memcpy(out, ring_.data() + at, first);
+    memcpy(out + first, ring_.data(), size - first);
+}
+
+size_t FlightRecorder::dump(const std::string& path) {
+    std::vector<uint8_t> records;
+    size_t count;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        records.resize(static_cast<size_t>(head_ - tail_));
+        copy_out(tail_, records.data(), records.size());
+        count = stats_.records;
+    }
+
+    FILE* file = std::fopen(path.c_str(), "wb");
+    if (!file) {
+        throw std::runtime_error("Cannot create flight recording: " + path);
+    }
+    RecordingHeader header = {};
+    memcpy(header.magic, RECORDING_MAGIC, sizeof(header.magic));
+    header.version = RECORDING_VERSION_CONTROLLER;
+    header.codec = codec_;
+    bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1;
+    ok = ok && (records.empty() || std::fwrite(records.data(), 1, records.size(), file) == records.size());
+    ok = std::fclose(file) == 0 && ok;
+    if (!ok) {
+        std::remove(path.c_str());
+        throw std::runtime_error("Writing flight recording failed: " + path);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.dumps++;
+    return count;
+}
+
+FlightRecorder::Stats FlightRecorder::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats result = stats_;
+    result.used = static_cast<size_t>(head_ - tail_);
+    if (result.records > 0) {
+        RecordHeader oldest;
+        copy_out(tail_, reinterpret_cast<uint8_t*>(&oldest), sizeof(oldest));
+        result.duration_ns = last_timestamp_ns_ - oldest.timestamp_ns;
+    }
+    return result;
+}
@@ -0,0 +1,91 @@
+/**
+ * flight_recorder.h - The last seconds of a session, kept in memory
+ *
+ * Recording every session is too costly when only the minutes before a
+ * failure matter. A FlightRecorder keeps the most recent encoded samples,
+ * events and controller states in one fixed ring, laid out exactly as
+ * PCNGREC1 records (see stream_recording.h), so a dump is the recording
+ * header plus a copy of the ring and plays back in ReplaySession.
+ *
+ * The ring is allocated once and never grows. Space is reclaimed a whole
+ * group of pictures at a time, so the oldest retained sample is always a
+ * keyframe and a dump decodes from its first frame. Samples arriving
+ * while no keyframe is held (at start, or after a sample larger than the
+ * ring) are dropped until the next one. With max_ns set, groups older
+ * than that are let go early too; at least max_ns is kept when it fits.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class FlightRecorder {
+public:
+    // codec is the ChiakiCodec written into dumps. Throws
+    // std::invalid_argument for a capacity under MIN_CAPACITY.
+    FlightRecorder(uint32_t codec, size_t capacity, int64_t max_ns);
+
+    static constexpr size_t MIN_CAPACITY = 64 * 1024;
+
+    // All safe from any thread
+    void add_sample(const uint8_t* buf, size_t buf_size, int32_t frames_lost, bool frame_recovered,
+                    int64_t timestamp_ns);
+    void add_event(uint32_t type, uint32_t quit_reason, const std::string& reason_str, int64_t timestamp_ns);
+    // CONTROLLER_LAYOUT_SIZE floats in raw units
+    void add_controller_state(const float* layout, int64_t timestamp_ns);
+
+    // Writes what the ring holds as a version 2 PCNGREC1 recording (it
+    // has controller states) and returns the number of records. The ring
+    // is copied under the lock and written after it, so streaming carries
+    // on meanwhile. Throws std::runtime_error if the file can't be written.
+    size_t dump(const std::string& path);
+
+    struct Stats {
+        size_t capacity = 0;
+        size_t used = 0;            // bytes of records held
+        size_t records = 0;         // records held
+        int64_t duration_ns = 0;    // first to last record held
+        uint64_t samples = 0;       // samples added
+        uint64_t dropped = 0;       // samples dropped waiting for a keyframe
+        uint64_t evicted = 0;       // records reclaimed for space or age
+        uint64_t dumps = 0;
+    };
+    Stats stats() const;
+
+    size_t capacity() const { return ring_.size(); }
+    int64_t max_ns() const { return max_ns_; }
+
+private:
+    struct Keyframe {
+        uint64_t offset;  // logical ring offset of its record
+        int64_t timestamp_ns;
+    };
+
+    // Appends one record; false if it can't be held. Under mutex_.
+    bool append(uint32_t kind, int64_t timestamp_ns, int32_t frames_lost, bool frame_recovered,
+                const void* head, size_t head_size, const void* tail, size_t tail_size, bool keyframe);
+    // Drops records up to the next keyframe, or all of them
+    void evict_group();
+    // Drops the records before a logical offset, counting them
+    void evict_to(uint64_t offset);
+    void copy_in(uint64_t offset, const void* data, size_t size);
+    void copy_out(uint64_t offset, uint8_t* out, size_t size) const;
+
+    const uint32_t codec_;
+    const bool hevc_;
+    const int64_t max_ns_;
+
+    mutable std::mutex mutex_;
+    std::vector<uint8_t> ring_;
+    uint64_t head_ = 0;  // logical offset of the next record
+    uint64_t tail_ = 0;  // logical offset of the oldest record held
+    std::deque<Keyframe> keyframes_;  // keyframe samples held, oldest first
+    bool have_keyframe_ = false;      // samples may be held
+    int64_t last_timestamp_ns_ = 0;
+    Stats stats_;
+};
@@ -0,0 +1,201 @@
+/**
+ * frame_pool.h - Refcounted, pooled pixel buffers for VideoFrame
+ *
+ * Decoded pictures are written straight into slabs taken from a FramePool.
+ * A slab is owned through FrameBufferRef handles (intrusive refcount, no
+ * per-frame heap allocation) and goes back to its pool once the last
+ * handle is dropped, typically when Python releases the VideoFrame or the
+ * numpy views exported from it.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+class FramePool;
+
+// Single pixel slab; only ever handled through FrameBufferRef
+class FrameBuffer {
+public:
+    static constexpr size_t ALIGNMENT = 64;
+
+    uint8_t* data() { return data_; }
+    size_t capacity() const { return capacity_; }
+
+private:
+    friend class FramePool;
+    friend class FrameBufferRef;
+
+    struct PoolState;
+
+    FrameBuffer(size_t capacity, std::weak_ptr<PoolState> owner)
+        : capacity_(capacity), owner_(std::move(owner)) {
+        data_ = static_cast<uint8_t*>(::operator new(capacity, std::align_val_t(ALIGNMENT)));
+    }
+
+    ~FrameBuffer() {
+        ::operator delete(data_, std::align_val_t(ALIGNMENT));
+    }
+
+    void release();
+
+    uint8_t* data_;
+    size_t capacity_;
+    std::atomic<int> refs_{0};
+    std::weak_ptr<PoolState> owner_;
+};
+
+struct FrameBuffer::PoolState {
+    std::mutex mutex;
+    std::vector<FrameBuffer*> free_list;
+    size_t slab_count;
+    size_t slab_size = 0;
+    size_t in_flight = 0;
+    uint64_t misses = 0;
+
+    ~PoolState() {
+        for (FrameBuffer* buffer : free_list) {
+            delete buffer;
+        }
+    }
+};
+
+// Shared handle to a FrameBuffer
+class FrameBufferRef {
+public:
+    FrameBufferRef() = default;
+
+    explicit FrameBufferRef(FrameBuffer* buffer) : buffer_(buffer) {
+        if (buffer_) {
+            buffer_->refs_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    FrameBufferRef(const FrameBufferRef& other) : FrameBufferRef(other.buffer_) {}
+
+    FrameBufferRef(FrameBufferRef&& other) noexcept : buffer_(other.buffer_) {
+        other.buffer_ = nullptr;
+    }
+
+    FrameBufferRef& operator=(FrameBufferRef other) noexcept {
+        std::swap(buffer_, other.buffer_);
+        return *this;
+    }
+
+    ~FrameBufferRef() { reset(); }
+
+    void reset() {
+        if (buffer_ && buffer_->refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            buffer_->release();
+        }
+        buffer_ = nullptr;
+    }
+
+    uint8_t* data() const { return buffer_ ? buffer_->data() : nullptr; }
+    size_t capacity() const { return buffer_ ? buffer_->capacity() : 0; }
+    explicit operator bool() const { return buffer_ != nullptr; }
+
+    // Standalone slab that is freed rather than recycled
+    static FrameBufferRef allocate(size_t size) {
+        return FrameBufferRef(new FrameBuffer(size, {}));
+    }
+
+private:
+    FrameBuffer* buffer_ = nullptr;
+};
+
+// Fixed number of equally sized slabs. When every slab is in flight, a
+// transient buffer is handed out instead and counted as a miss.
+class FramePool {
+public:
+    explicit FramePool(size_t slab_count)
+        : state_(std::make_shared<FrameBuffer::PoolState>()) {
+        state_->slab_count = slab_count;
+    }
+
+    FrameBufferRef acquire(size_t size) {
+        FrameBuffer* buffer = nullptr;
+        size_t slab_size;
+        {
+            std::lock_guard<std::mutex> lock(state_->mutex);
+            if (size > state_->slab_size) {
+                // Resolution went up: old slabs are too small, drop them
+                for (FrameBuffer* stale : state_->free_list) {
+                    delete stale;
+                }
+                state_->free_list.clear();
+                state_->slab_size = round_up(size);
+            }
+
+            if (!state_->free_list.empty()) {
+                buffer = state_->free_list.back();
+                state_->free_list.pop_back();
+            } else if (state_->in_flight >= state_->slab_count) {
+                state_->misses++;
+            }
+            state_->in_flight++;
+            slab_size = state_->slab_size;
+        }
+
+        if (!buffer) {
+            buffer = new FrameBuffer(slab_size, state_);
+        }
+        return FrameBufferRef(buffer);
+    }
+
+    void set_slab_count(size_t slab_count) {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        state_->slab_count = slab_count;
+        while (state_->free_list.size() > slab_count) {
+            delete state_->free_list.back();
+            state_->free_list.pop_back();
+        }
+    }
+
+    size_t slab_count() const {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        return state_->slab_count;
+    }
+
+    size_t slab_size() const {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        return state_->slab_size;
+    }
+
+    size_t free_count() const {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        return state_->free_list.size();
+    }
+
+    // Acquires made while every slab was already in flight
+    uint64_t misses() const {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        return state_->misses;
+    }
+
+private:
+    static size_t round_up(size_t size) {
+        return (size + FrameBuffer::ALIGNMENT - 1) & ~(FrameBuffer::ALIGNMENT - 1);
+    }
+
+    std::shared_ptr<FrameBuffer::PoolState> state_;
+};
+
+inline void FrameBuffer::release() {
+    if (auto owner = owner_.lock()) {
+        std::lock_guard<std::mutex> lock(owner->mutex);
+        owner->in_flight--;
+        if (capacity_ == owner->slab_size && owner->free_list.size() < owner->slab_count) {
+            owner->free_list.push_back(this);
+            return;
+        }
+    }
+    delete this;
+}
@@ -0,0 +1,203 @@
+/**
+ * input_scheduler.cpp - Deadline-driven controller input playback
+ */
+
+#include "input_scheduler.h"
+
+#include <algorithm>
+#include <iterator>
+
+namespace {
+// Sleep this far ahead of a deadline, then spin: condition variable
+// wakeups are only accurate to ~100us on a loaded Linux box
+constexpr int64_t SPIN_WINDOW_NS = 500000;
+}
+
+void InputEvent::apply_to(ChiakiControllerState& state) const {
+    if (fields & INPUT_FIELD_BUTTONS) {
+        state.buttons = values.buttons;
+    }
+    if (fields & INPUT_FIELD_L2) {
+        state.l2_state = values.l2_state;
+    }
+    if (fields & INPUT_FIELD_R2) {
+        state.r2_state = values.r2_state;
+    }
+    if (fields & INPUT_FIELD_LEFT_X) {
+        state.left_x = values.left_x;
+    }
+    if (fields & INPUT_FIELD_LEFT_Y) {
+        state.left_y = values.left_y;
+    }
+    if (fields & INPUT_FIELD_RIGHT_X) {
+        state.right_x = values.right_x;
+    }
+    if (fields & INPUT_FIELD_RIGHT_Y) {
+        state.right_y = values.right_y;
+    }
+    if (fields & INPUT_FIELD_MOTION) {
+        state.gyro_x = values.gyro_x;
+        state.gyro_y = values.gyro_y;
+        state.gyro_z = values.gyro_z;
+        state.accel_x = values.accel_x;
+        state.accel_y = values.accel_y;
+        state.accel_z = values.accel_z;
+        state.orient_x = values.orient_x;
+        state.orient_y = values.orient_y;
+        state.orient_z = values.orient_z;
+        state.orient_w = values.orient_w;
+    }
+}
+
+InputScheduler::InputScheduler(Sink sink, double rate_hz)
+    : sink_(std::move(sink)) {
+    chiaki_controller_state_set_idle(&current_);
+    set_rate(rate_hz);
+    thread_ = std::thread(&InputScheduler::run, this);
+}
+
+InputScheduler::~InputScheduler() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    thread_.join();
+}
+
+int64_t InputScheduler::now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void InputScheduler::schedule(std::vector<InputEvent> events, bool replace) {
+    std::stable_sort(events.begin(), events.end(), [](const InputEvent& a, const InputEvent& b) {
+        return a.deadline_ns < b.deadline_ns;
+    });
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (replace) {
+            queue_.clear();
+        }
+        // Equal deadlines keep submission order: earlier batches first
+        std::deque<InputEvent> merged;
+        std::merge(queue_.begin(), queue_.end(), events.begin(), events.end(),
+                   std::back_inserter(merged), [](const InputEvent& a, const InputEvent& b) {
+                       return a.deadline_ns < b.deadline_ns;
+                   });
+        queue_.swap(merged);
+        stats_.scheduled += events.size();
+    }
+    wake_.notify_all();
+}
+
+void InputScheduler::cancel() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queue_.clear();
+    }
+    wake_.notify_all();
+    idle_.notify_all();
+}
+
+void InputScheduler::set_current_state(const ChiakiControllerState& state) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    current_ = state;
+    sent_buttons_ = state.buttons;
+}
+
+bool InputScheduler::wait_idle(std::chrono::nanoseconds timeout) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return idle_.wait_for(lock, timeout, [this] { return queue_.empty() && !sending_; });
+}
+
+void InputScheduler::set_rate(double rate_hz) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    interval_ns_ = rate_hz > 0 ? static_cast<int64_t>(1e9 / rate_hz) : 0;
+}
+
+double InputScheduler::rate() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return interval_ns_ > 0 ? 1e9 / static_cast<double>(interval_ns_) : 0.0;
+}
+
+InputScheduler::Stats InputScheduler::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats result = stats_;
+    result.pending = queue_.size();
+    return result;
+}
+
+// True if applying event would flip back a button bit that changed since
+// the last send, which would make that press or release invisible
+bool InputScheduler::undoes_unsent_buttons(const InputEvent& event) const {
+    if (!(event.fields & INPUT_FIELD_BUTTONS)) {
+        return false;
+    }
+    const uint32_t unsent = current_.buttons ^ sent_buttons_;
+    const uint32_t flips = current_.buttons ^ event.values.buttons;
+    return (unsent & flips) != 0;
+}
+
+void InputScheduler::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        wake_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+        if (stopping_) {
+            return;
+        }
+
+        // Earliest moment we may send: the next deadline, held back by the rate limit
+        const int64_t target = std::max(queue_.front().deadline_ns, last_send_ns_ + interval_ns_);
+        int64_t now = now_ns();
+        if (now < target - SPIN_WINDOW_NS) {
+            const auto deadline = std::chrono::steady_clock::time_point(
+                std::chrono::nanoseconds(target - SPIN_WINDOW_NS));
+            wake_.wait_until(lock, deadline);
+            continue; // Queue may have changed; recompute the target
+        }
+        if (now < target) {
+            lock.unlock();
+            while ((now = now_ns()) < target) {
+                std::this_thread::yield();
+            }
+            lock.lock();
+            if (queue_.empty() || queue_.front().deadline_ns > now) {
+                continue; // Cancelled or replaced while spinning
+            }
+        }
+
+        // Fold every due event into one state
+        size_t folded = 0;
+        while (!queue_.empty() && queue_.front().deadline_ns <= now) {
+            const InputEvent& event = queue_.front();
+            if (folded > 0 && undoes_unsent_buttons(event)) {
+                break;
+            }
+            event.apply_to(current_);
+            stats_.max_late_ns = std::max(stats_.max_late_ns, now - event.deadline_ns);
+            queue_.pop_front();
+            folded++;
+        }
+        if (!queue_.empty() && queue_.front().deadline_ns <= now) {
+            stats_.deferred++;
+        }
+        stats_.applied += folded;
+        stats_.coalesced += folded - 1;
+        stats_.sends++;
+        sent_buttons_ = current_.buttons;
+        last_send_ns_ = now;
+
+        const ChiakiControllerState state = current_;
+        sending_ = true;
+        lock.unlock();
+        sink_(state);
+        lock.lock();
+        sending_ = false;
+
+        if (queue_.empty()) {
+            idle_.notify_all();
+        }
+    }
+}
@@ -0,0 +1,109 @@
+/**
+ * input_scheduler.h - Deadline-driven controller input playback
+ *
+ * Takes a batch of timestamped controller deltas in one call and applies
+ * them on a dedicated thread at their monotonic deadlines, so a macro or
+ * combo is one Python call instead of a loop of setters and sleeps.
+ *
+ * The thread sleeps until shortly before a deadline and spins the rest of
+ * the way. Entries due together are coalesced into one send, and sends
+ * are limited to the configured rate. A coalesced send never hides a
+ * button press: an entry that would undo an unsent button change waits
+ * for the next send slot instead.
+ */
+
+#pragma once
+
+#include <chiaki/controller.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Which ControllerState fields an InputEvent sets
+enum InputField : uint32_t {
+    INPUT_FIELD_BUTTONS = 1 << 0,
+    INPUT_FIELD_L2 = 1 << 1,
+    INPUT_FIELD_R2 = 1 << 2,
+    INPUT_FIELD_LEFT_X = 1 << 3,
+    INPUT_FIELD_LEFT_Y = 1 << 4,
+    INPUT_FIELD_RIGHT_X = 1 << 5,
+    INPUT_FIELD_RIGHT_Y = 1 << 6,
+    INPUT_FIELD_MOTION = 1 << 7,  // gyro, accel and orientation together
+    INPUT_FIELD_ALL = (1 << 8) - 1,
+};
+
+struct InputEvent {
+    int64_t deadline_ns = 0;  // steady clock, same as time.monotonic_ns()
+    uint32_t fields = 0;
+    ChiakiControllerState values = {};
+
+    // Copies the selected fields onto state
+    void apply_to(ChiakiControllerState& state) const;
+};
+
+class InputScheduler {
+public:
+    using Sink = std::function<bool(const ChiakiControllerState&)>;
+
+    static constexpr double DEFAULT_RATE_HZ = 250.0;
+
+    // rate_hz <= 0 disables rate limiting
+    InputScheduler(Sink sink, double rate_hz);
+    ~InputScheduler();
+
+    InputScheduler(const InputScheduler&) = delete;
+    InputScheduler& operator=(const InputScheduler&) = delete;
+
+    // Queues events (any order); replace drops everything still pending
+    void schedule(std::vector<InputEvent> events, bool replace);
+    void cancel();
+
+    // Keeps scheduled deltas applying on top of externally sent states
+    void set_current_state(const ChiakiControllerState& state);
+
+    // Waits until every scheduled event has been sent
+    bool wait_idle(std::chrono::nanoseconds timeout);
+
+    void set_rate(double rate_hz);
+    double rate() const;
+
+    struct Stats {
+        uint64_t scheduled = 0;
+        uint64_t applied = 0;
+        uint64_t sends = 0;
+        uint64_t coalesced = 0;   // events merged into another event's send
+        uint64_t deferred = 0;    // events pushed to the next send slot
+        int64_t max_late_ns = 0;  // worst send time past an event's deadline
+        size_t pending = 0;
+    };
+    Stats stats() const;
+
+    static int64_t now_ns();
+
+private:
+    void run();
+    bool undoes_unsent_buttons(const InputEvent& event) const;
+
+    Sink sink_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable idle_;
+    std::deque<InputEvent> queue_;  // sorted by deadline
+    bool stopping_ = false;
+    bool sending_ = false;
+
+    int64_t interval_ns_ = 0;
+    int64_t last_send_ns_ = 0;
+    ChiakiControllerState current_ = {};
+    uint32_t sent_buttons_ = 0;
+    Stats stats_;
+
+    std::thread thread_;
+};
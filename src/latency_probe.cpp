@@ -0,0 +1,73 @@
+/**
+ * latency_probe.cpp - Input-to-photon latency from controller sends to screen
+ */
+
+#include "latency_probe.h"
+
+#include <stdexcept>
+
+namespace {
+
+// A forced "changed" every max_skip pictures would read as a response
+ChangeSpec without_max_skip(ChangeSpec spec) {
+    spec.validate();
+    spec.max_skip = 0;
+    return spec;
+}
+
+} // namespace
+
+LatencyProbe::LatencyProbe(const ChangeSpec& spec, int64_t timeout_ns, LatencyHistogram& histogram)
+    : spec_(without_max_skip(spec)), timeout_ns_(timeout_ns), histogram_(histogram) {
+    if (timeout_ns <= 0) {
+        throw std::invalid_argument("timeout must be positive");
+    }
+}
+
+void LatencyProbe::on_input(int64_t sent_ns) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    expire(sent_ns);
+    if (pending_) {
+        stats_.ignored++;
+        return;
+    }
+    pending_ = true;
+    sent_ns_ = sent_ns;
+    stats_.inputs++;
+}
+
+void LatencyProbe::on_picture(const uint8_t* luma, int stride, int width, int height, int64_t decoded_ns) {
+    const ChangeDetector::Result change = detector_.measure(luma, stride, width, height, spec_);
+    if (!primed_) {
+        // The first picture only becomes the reference
+        primed_ = true;
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    expire(decoded_ns);
+    if (!change.changed) {
+        return;
+    }
+    if (!pending_ || decoded_ns < sent_ns_) {
+        stats_.unprompted++;
+        return;
+    }
+    pending_ = false;
+    const int64_t latency_ns = decoded_ns - sent_ns_;
+    histogram_.record(latency_ns);
+    stats_.matched++;
+    stats_.last_ns = latency_ns;
+}
+
+LatencyProbe::Stats LatencyProbe::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void LatencyProbe::expire(int64_t now_ns) {
+    if (pending_ && now_ns - sent_ns_ > timeout_ns_) {
+        pending_ = false;
+        stats_.timeouts++;
+    }
+}
@@ -0,0 +1,71 @@
+/**
+ * latency_probe.h - Input-to-photon latency from controller sends to screen
+ *
+ * A LatencyProbe pairs controller states going out with the first decoded
+ * picture whose watched region visibly changed afterwards. The region is
+ * judged exactly as change detection judges frames (a ChangeDetector on
+ * the luma plane, see change_detector.h), so pick one that only moves in
+ * response to input: a cursor, a menu highlight, the crosshair.
+ *
+ * One measurement runs at a time. A send starts it; sends while it runs
+ * are counted as ignored, so a held or repeated input is timed from its
+ * first send. The first changed picture ends it and its send-to-decoded
+ * time goes into the histogram; no change within timeout_ns counts as a
+ * timeout. Changes with no measurement running are counted as
+ * unprompted, which flags a region that moves by itself.
+ *
+ * The end point is when libavcodec returned the picture, so the number
+ * covers console, encoder, network and decode, but not the client's own
+ * presentation.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+
+#include "change_detector.h"
+#include "session_metrics.h"
+
+class LatencyProbe {
+public:
+    // Throws std::invalid_argument for an invalid spec or a timeout <= 0.
+    // Results are recorded into `histogram`, which must outlive the probe.
+    LatencyProbe(const ChangeSpec& spec, int64_t timeout_ns, LatencyHistogram& histogram);
+
+    // A controller state that differs from the last one went out at
+    // sent_ns. Safe from any thread.
+    void on_input(int64_t sent_ns);
+
+    // One decoded picture's luma plane; decode thread only
+    void on_picture(const uint8_t* luma, int stride, int width, int height, int64_t decoded_ns);
+
+    struct Stats {
+        uint64_t inputs = 0;      // sends that started a measurement
+        uint64_t matched = 0;     // measurements ended by a change
+        uint64_t timeouts = 0;    // measurements with no change in time
+        uint64_t ignored = 0;     // sends while a measurement ran
+        uint64_t unprompted = 0;  // changes with no measurement running
+        int64_t last_ns = 0;      // latest matched latency; 0 before any
+    };
+    Stats stats() const;
+
+    const ChangeSpec& spec() const { return spec_; }
+    int64_t timeout_ns() const { return timeout_ns_; }
+
+private:
+    // Ends a measurement that ran out of time by now_ns; under mutex_
+    void expire(int64_t now_ns);
+
+    const ChangeSpec spec_;
+    const int64_t timeout_ns_;
+    LatencyHistogram& histogram_;
+
+    ChangeDetector detector_;  // decode thread only
+    bool primed_ = false;      // decode thread only; the detector has a reference
+
+    mutable std::mutex mutex_;
+    bool pending_ = false;
+    int64_t sent_ns_ = 0;
+    Stats stats_;
+};
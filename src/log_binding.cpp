@@ -0,0 +1,162 @@
+/**
+ * log_binding.cpp - chiaki log pipeline Python bindings
+ *
+ * Owns the process-wide LogSink every session logs into and the handler
+ * that forwards its batches to Python's logging module.
+ */
+
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+#include <chiaki/log.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <optional>
+
+#include "log_sink.h"
+
+namespace py = pybind11;
+
+namespace {
+
+// Logger receiving chiaki messages; only touched with the GIL held and
+// never freed, so the drain thread cannot outlive it
+py::object* python_logger = nullptr;
+
+std::atomic<uint32_t> default_level_mask{CHIAKI_LOG_ALL};
+std::atomic<bool> sink_started{false};
+
+int python_log_level(ChiakiLogLevel level) {
+    switch (level) {
+        case CHIAKI_LOG_ERROR: return 40;
+        case CHIAKI_LOG_WARNING: return 30;
+        case CHIAKI_LOG_INFO: return 20;
+        case CHIAKI_LOG_VERBOSE: return 15;
+        default: return 10;
+    }
+}
+
+py::object& logger_object() {
+    if (!python_logger) {
+        python_logger = new py::object(py::module_::import("logging").attr("getLogger")("py_chiaki_ng.chiaki"));
+    }
+    return *python_logger;
+}
+
+// Runs on the drain thread: one GIL acquisition per batch, and levels the
+// logger would discard are skipped before any Python object is built
+void forward_to_logging(const LogEntry* entries, size_t count) {
+    if (!Py_IsInitialized()) {
+        return;
+    }
+    py::gil_scoped_acquire gil;
+    try {
+        py::object& logger = logger_object();
+        if (logger.attr("disabled").cast<bool>()) {
+            return;
+        }
+        const int threshold = logger.attr("getEffectiveLevel")().cast<int>();
+        const py::object name = logger.attr("name");
+        const py::object make_record = logger.attr("makeRecord");
+        const py::object handle = logger.attr("handle");
+        for (size_t i = 0; i < count; i++) {
+            const LogEntry& entry = entries[i];
+            const int level = python_log_level(entry.level);
+            if (level < threshold) {
+                continue;
+            }
+            size_t length = entry.length;
+            while (length > 0 && entry.text[length - 1] == '\n') {
+                length--;
+            }
+            py::object message = py::reinterpret_steal<py::object>(
+                PyUnicode_DecodeUTF8(entry.text, static_cast<Py_ssize_t>(length), "replace"));
+            if (!message) {
+                throw py::error_already_set();
+            }
+            py::dict extra;
+            extra["chiaki_session"] = entry.source;
+            extra["chiaki_truncated"] = entry.truncated;
+            py::object record = make_record(name, level, "chiaki", 0, message, py::tuple(), py::none(),
+                                            py::none(), extra);
+            record.attr("created") = static_cast<double>(entry.time_ns) / 1e9;
+            record.attr("msecs") = static_cast<double>(entry.time_ns % 1000000000) / 1e6;
+            handle(record);
+        }
+    } catch (py::error_already_set& e) {
+        e.discard_as_unraisable("py_chiaki_ng log handler");
+    }
+}
+
+} // namespace
+
+// Shared by every Session (session_binding.cpp); created on first use
+std::shared_ptr<LogSink> shared_log_sink() {
+    static const std::shared_ptr<LogSink> sink = [] {
+        sink_started.store(true);
+        return std::make_shared<LogSink>(forward_to_logging);
+    }();
+    return sink;
+}
+
+// Level mask a new Session's log starts with
+uint32_t default_log_level_mask() {
+    return default_level_mask.load(std::memory_order_relaxed);
+}
+
+void init_log_binding(py::module& m) {
+    py::enum_<ChiakiLogLevel>(m, "LogLevel", py::arithmetic())
+        .value("DEBUG", CHIAKI_LOG_DEBUG)
+        .value("VERBOSE", CHIAKI_LOG_VERBOSE)
+        .value("INFO", CHIAKI_LOG_INFO)
+        .value("WARNING", CHIAKI_LOG_WARNING)
+        .value("ERROR", CHIAKI_LOG_ERROR)
+        .export_values();
+
+    m.attr("LOG_ALL") = static_cast<uint32_t>(CHIAKI_LOG_ALL);
+
+    m.def("configure_logging", [](std::optional<py::object> logger, std::optional<uint32_t> default_level) {
+        if (logger && !logger->is_none()) {
+            py::object target = py::isinstance<py::str>(*logger)
+                ? py::module_::import("logging").attr("getLogger")(*logger)
+                : *logger;
+            if (python_logger) {
+                *python_logger = target;
+            } else {
+                python_logger = new py::object(target);
+            }
+        }
+        if (default_level) {
+            default_level_mask.store(*default_level & CHIAKI_LOG_ALL, std::memory_order_relaxed);
+        }
+    }, "Route chiaki logs to a logging.Logger (or logger name) and set the LogLevel mask new "
+       "sessions start with; chiaki levels map to DEBUG, 15 (VERBOSE), INFO, WARNING and ERROR",
+       py::arg("logger") = py::none(), py::arg("default_level") = py::none());
+
+    m.def("flush_logs", [](double timeout) {
+        return shared_log_sink()->flush(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::duration<double>(timeout)));
+    }, "Wait until every chiaki message logged so far reached Python logging",
+       py::arg("timeout") = 1.0, py::call_guard<py::gil_scoped_release>());
+
+    m.def("log_stats", []() {
+        const LogSink::Stats stats = shared_log_sink()->stats();
+        py::dict result;
+        result["written"] = stats.written;
+        result["dropped"] = stats.dropped;
+        result["truncated"] = stats.truncated;
+        result["delivered"] = stats.delivered;
+        result["batches"] = stats.batches;
+        return result;
+    }, "Counters of the chiaki log pipeline across all sessions");
+
+    // Drain and stop the log thread while the interpreter can still run
+    // handlers; sessions still logging afterwards only count drops
+    py::module_::import("atexit").attr("register")(py::cpp_function([]() {
+        if (sink_started.load()) {
+            py::gil_scoped_release release;
+            shared_log_sink()->stop();
+        }
+    }));
+}
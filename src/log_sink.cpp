@@ -0,0 +1,206 @@
+/**
+ * log_sink.cpp - Non-blocking chiaki log pipeline
+ */
+
+#include "log_sink.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+size_t round_up_pow2(size_t value) {
+    size_t result = 1;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+
+int64_t system_now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+std::atomic<uint32_t> next_log_id{1};
+
+} // namespace
+
+LogRing::LogRing(size_t capacity)
+    : capacity_(round_up_pow2(std::max<size_t>(capacity, 2))), mask_(capacity_ - 1),
+      cells_(new Cell[capacity_]) {
+    for (size_t i = 0; i < capacity_; i++) {
+        cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+bool LogRing::try_push(ChiakiLogLevel level, uint32_t source, const char* msg, size_t length,
+                       int64_t time_ns) {
+    size_t pos = head_.load(std::memory_order_relaxed);
+    Cell* cell;
+    for (;;) {
+        cell = &cells_[pos & mask_];
+        const size_t seq = cell->sequence.load(std::memory_order_acquire);
+        const intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+        if (diff == 0) {
+            if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return false; // Full
+        } else {
+            pos = head_.load(std::memory_order_relaxed);
+        }
+    }
+
+    LogEntry& entry = cell->entry;
+    const size_t copied = std::min(length, LogEntry::TEXT_SIZE - 1);
+    if (copied) {
+        memcpy(entry.text, msg, copied);
+    }
+    entry.text[copied] = '\0';
+    entry.length = static_cast<uint16_t>(copied);
+    entry.truncated = copied < length;
+    entry.time_ns = time_ns;
+    entry.source = source;
+    entry.level = level;
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+bool LogRing::try_pop(LogEntry& out) {
+    Cell& cell = cells_[tail_ & mask_];
+    if (cell.sequence.load(std::memory_order_acquire) != tail_ + 1) {
+        return false; // Empty, or the next producer has not finished writing
+    }
+    const LogEntry& entry = cell.entry;
+    out.time_ns = entry.time_ns;
+    out.source = entry.source;
+    out.level = entry.level;
+    out.length = entry.length;
+    out.truncated = entry.truncated;
+    memcpy(out.text, entry.text, entry.length + 1u);
+    cell.sequence.store(tail_ + capacity_, std::memory_order_release);
+    tail_++;
+    return true;
+}
+
+LogSink::LogSink(Handler handler, size_t capacity)
+    : handler_(std::move(handler)), ring_(capacity), thread_([this] { run(); }) {}
+
+LogSink::~LogSink() {
+    stop();
+}
+
+bool LogSink::push(ChiakiLogLevel level, uint32_t source, const char* msg) {
+    const size_t length = msg ? strlen(msg) : 0;
+    if (!ring_.try_push(level, source, msg, length, system_now_ns())) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    if (length >= LogEntry::TEXT_SIZE) {
+        truncated_.fetch_add(1, std::memory_order_relaxed);
+    }
+    written_.fetch_add(1, std::memory_order_release);
+    return true;
+}
+
+bool LogSink::flush(std::chrono::nanoseconds timeout) {
+    const uint64_t target = written_.load(std::memory_order_acquire);
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (stopping_) {
+        return delivered_.load(std::memory_order_acquire) >= target;
+    }
+    wake_requested_ = true;
+    wake_.notify_one();
+    return drained_.wait_for(lock, timeout, [&] {
+        return delivered_.load(std::memory_order_acquire) >= target || stopping_;
+    }) && delivered_.load(std::memory_order_acquire) >= target;
+}
+
+void LogSink::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_) {
+            return;
+        }
+        stopping_ = true;
+    }
+    wake_.notify_one();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    drained_.notify_all();
+}
+
+LogSink::Stats LogSink::stats() const {
+    Stats result;
+    result.written = written_.load(std::memory_order_relaxed);
+    result.dropped = dropped_.load(std::memory_order_relaxed);
+    result.truncated = truncated_.load(std::memory_order_relaxed);
+    result.delivered = delivered_.load(std::memory_order_relaxed);
+    result.batches = batches_.load(std::memory_order_relaxed);
+    return result;
+}
+
+void LogSink::run() {
+    std::vector<LogEntry> batch(BATCH_SIZE);
+    for (;;) {
+        while (drain(batch) == BATCH_SIZE) {
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            drained_.notify_all();
+        }
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (stopping_) {
+            break;
+        }
+        wake_.wait_for(lock, DRAIN_INTERVAL, [this] { return wake_requested_ || stopping_; });
+        wake_requested_ = false;
+    }
+    // Whatever arrived while stopping
+    while (drain(batch) > 0) {
+    }
+}
+
+// One batch from the ring to the handler; returns its size
+size_t LogSink::drain(std::vector<LogEntry>& batch) {
+    size_t count = 0;
+    while (count < batch.size() && ring_.try_pop(batch[count])) {
+        count++;
+    }
+    if (count > 0) {
+        if (handler_) {
+            handler_(batch.data(), count);
+        }
+        batches_.fetch_add(1, std::memory_order_relaxed);
+        delivered_.fetch_add(count, std::memory_order_release);
+    }
+    return count;
+}
+
+SessionLog::SessionLog(std::shared_ptr<LogSink> sink, uint32_t level_mask)
+    : sink_(std::move(sink)), id_(next_log_id.fetch_add(1, std::memory_order_relaxed)) {
+    chiaki_log_init(&log_, level_mask, log_callback, this);
+}
+
+// chiaki reads level_mask without synchronisation before formatting each
+// message; an aligned 32-bit store is seen whole, at worst a message late
+void SessionLog::set_level_mask(uint32_t mask) {
+    __atomic_store_n(&log_.level_mask, mask, __ATOMIC_RELAXED);
+}
+
+uint32_t SessionLog::level_mask() const {
+    return __atomic_load_n(&log_.level_mask, __ATOMIC_RELAXED);
+}
+
+void SessionLog::log_callback(ChiakiLogLevel level, const char* msg, void* user) {
+    auto* log = static_cast<SessionLog*>(user);
+    if (log->sink_->push(level, log->id_, msg)) {
+        log->written_.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        log->dropped_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
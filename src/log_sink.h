@@ -0,0 +1,153 @@
+/**
+ * log_sink.h - Non-blocking chiaki log pipeline
+ *
+ * chiaki logs from its network, video and control threads. Instead of
+ * printing or calling Python there, each message is copied into a bounded
+ * lock-free MPSC ring (Vyukov-style, one sequence number per cell): a
+ * producer claims a cell with one CAS and never waits, and a full ring
+ * drops the message and counts it. A single drain thread empties the ring
+ * in batches and hands each batch to a handler, which for Python takes
+ * the GIL once per batch and feeds the `logging` module.
+ *
+ * Producers never touch a lock, so the drain thread polls on a short
+ * interval rather than being woken per message; flush() wakes it early.
+ */
+
+#pragma once
+
+#include <chiaki/log.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct LogEntry {
+    static constexpr size_t TEXT_SIZE = 480;
+
+    int64_t time_ns = 0;    // system clock, as time.time_ns()
+    uint32_t source = 0;    // SessionLog id
+    ChiakiLogLevel level = CHIAKI_LOG_INFO;
+    uint16_t length = 0;
+    bool truncated = false;
+    char text[TEXT_SIZE] = {};
+};
+
+class LogRing {
+public:
+    explicit LogRing(size_t capacity);
+
+    LogRing(const LogRing&) = delete;
+    LogRing& operator=(const LogRing&) = delete;
+
+    // Any thread; copies length bytes of msg, truncated to TEXT_SIZE - 1.
+    // Returns false without waiting when the ring is full.
+    bool try_push(ChiakiLogLevel level, uint32_t source, const char* msg, size_t length, int64_t time_ns);
+
+    // Single consumer
+    bool try_pop(LogEntry& out);
+
+    size_t capacity() const { return capacity_; }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence{0};
+        LogEntry entry;
+    };
+
+    const size_t capacity_;
+    const size_t mask_;
+    std::unique_ptr<Cell[]> cells_;
+    alignas(64) std::atomic<size_t> head_{0};
+    alignas(64) size_t tail_ = 0;
+};
+
+class LogSink {
+public:
+    // Called on the drain thread with each batch, oldest first
+    using Handler = std::function<void(const LogEntry* entries, size_t count)>;
+
+    static constexpr size_t DEFAULT_CAPACITY = 2048;
+    static constexpr size_t BATCH_SIZE = 256;
+    static constexpr std::chrono::milliseconds DRAIN_INTERVAL{10};
+
+    LogSink(Handler handler, size_t capacity = DEFAULT_CAPACITY);
+    ~LogSink();
+
+    LogSink(const LogSink&) = delete;
+    LogSink& operator=(const LogSink&) = delete;
+
+    // Producer side, safe from any thread and lock-free
+    bool push(ChiakiLogLevel level, uint32_t source, const char* msg);
+
+    // Waits until everything pushed before the call reached the handler
+    bool flush(std::chrono::nanoseconds timeout);
+
+    // Drains what is left and joins the drain thread; later pushes are
+    // counted as dropped once the ring fills
+    void stop();
+
+    struct Stats {
+        uint64_t written = 0;    // accepted into the ring
+        uint64_t dropped = 0;    // ring full
+        uint64_t truncated = 0;  // longer than TEXT_SIZE - 1
+        uint64_t delivered = 0;  // handed to the handler
+        uint64_t batches = 0;
+    };
+    Stats stats() const;
+
+private:
+    void run();
+    size_t drain(std::vector<LogEntry>& batch);
+
+    Handler handler_;
+    LogRing ring_;
+
+    std::atomic<uint64_t> written_{0};
+    std::atomic<uint64_t> dropped_{0};
+    std::atomic<uint64_t> truncated_{0};
+    std::atomic<uint64_t> delivered_{0};
+    std::atomic<uint64_t> batches_{0};
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable drained_;
+    bool wake_requested_ = false;
+    bool stopping_ = false;
+    std::thread thread_;
+};
+
+// The ChiakiLog of one session, feeding a shared LogSink. The level mask
+// can change while chiaki runs; chiaki checks it before formatting, so
+// masked-out levels cost nothing.
+class SessionLog {
+public:
+    SessionLog(std::shared_ptr<LogSink> sink, uint32_t level_mask);
+
+    SessionLog(const SessionLog&) = delete;
+    SessionLog& operator=(const SessionLog&) = delete;
+
+    ChiakiLog* get() { return &log_; }
+    uint32_t id() const { return id_; }
+
+    void set_level_mask(uint32_t mask);
+    uint32_t level_mask() const;
+
+    uint64_t written() const { return written_.load(std::memory_order_relaxed); }
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    static void log_callback(ChiakiLogLevel level, const char* msg, void* user);
+
+    ChiakiLog log_;
+    std::shared_ptr<LogSink> sink_;
+    const uint32_t id_;
+    std::atomic<uint64_t> written_{0};
+    std::atomic<uint64_t> dropped_{0};
+};
@@ -0,0 +1,538 @@
+/**
+ * media_recorder.cpp - Remux the encoded session stream into MKV/MP4/TS
+ */
+
+#include "media_recorder.h"
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavutil/channel_layout.h>
+#include <libavutil/mathematics.h>
+#include <libavutil/mem.h>
+}
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include "annexb.h"
+
+namespace {
+
+constexpr int IO_BUFFER_SIZE = 1 << 20;
+constexpr int OPUS_RATE = 48000;
+constexpr uint16_t OPUS_PRE_SKIP = 312;
+// Audio that falls this far behind its arrival time (lost packets) is
+// moved forward rather than left to drift out of sync
+constexpr int64_t AUDIO_RESYNC_SAMPLES = OPUS_RATE / 10;
+constexpr AVRational NS_TIME_BASE = {1, 1000000000};
+
+// SPS/PPS (and VPS) ahead of the first slice, with 4-byte start codes
+std::vector<uint8_t> parameter_sets(bool hevc, const uint8_t* buf, size_t size) {
+    static const uint8_t START_CODE[4] = {0, 0, 0, 1};
+    std::vector<uint8_t> sets;
+    size_t at = annexb::next_nal(buf, size, 0);
+    while (at < size) {
+        const int type = annexb::nal_type(hevc, buf[at]);
+        if (annexb::is_slice(hevc, type)) {
+            break;
+        }
+        const size_t next = annexb::next_nal(buf, size, at);
+        size_t end = next < size ? next - 3 : size;
+        while (end > at && buf[end - 1] == 0) {
+            end--; // A 4-byte start code's leading zero
+        }
+        if (hevc ? (type >= 32 && type <= 34) : (type == 7 || type == 8)) {
+            sets.insert(sets.end(), START_CODE, START_CODE + 4);
+            sets.insert(sets.end(), buf + at, buf + end);
+        }
+        at = next;
+    }
+    return sets;
+}
+
+// PCM samples at 48 kHz in an Opus packet, from its TOC byte (RFC 6716 3.1)
+int opus_packet_samples(const uint8_t* data, size_t size) {
+    static const int SILK_FRAME[4] = {480, 960, 1920, 2880};
+    if (size == 0) {
+        return 0;
+    }
+    const int config = data[0] >> 3;
+    int frame;
+    if (config < 12) {
+        frame = SILK_FRAME[config & 3];
+    } else if (config < 16) {
+        frame = (config & 1) ? 960 : 480;
+    } else {
+        frame = 120 << (config & 3);
+    }
+    switch (data[0] & 3) {
+    case 0:
+        return frame;
+    case 1:
+    case 2:
+        return frame * 2;
+    default:
+        return size < 2 ? 0 : frame * (data[1] & 0x3f);
+    }
+}
+
+// RFC 7845 identification header, as Matroska and MP4 want it
+std::vector<uint8_t> opus_head(int channels) {
+    std::vector<uint8_t> head = {'O', 'p', 'u', 's', 'H', 'e', 'a', 'd', 1, static_cast<uint8_t>(channels),
+                                 OPUS_PRE_SKIP & 0xff, OPUS_PRE_SKIP >> 8,
+                                 OPUS_RATE & 0xff, (OPUS_RATE >> 8) & 0xff, (OPUS_RATE >> 16) & 0xff, 0,
+                                 0, 0, 0};
+    return head;
+}
+
+bool set_extradata(AVCodecParameters* par, const uint8_t* data, size_t size) {
+    par->extradata = static_cast<uint8_t*>(av_mallocz(size + AV_INPUT_BUFFER_PADDING_SIZE));
+    if (!par->extradata) {
+        return false;
+    }
+    memcpy(par->extradata, data, size);
+    par->extradata_size = static_cast<int>(size);
+    return true;
+}
+
+std::string av_error_text(int error) {
+    char text[AV_ERROR_MAX_STRING_SIZE] = {};
+    av_strerror(error, text, sizeof(text));
+    return text;
+}
+
+std::string extension_of(const std::string& path) {
+    const size_t slash = path.find_last_of("/\\");
+    const size_t dot = path.find_last_of('.');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+        return std::string();
+    }
+    return path.substr(dot);
+}
+
+} // namespace
+
+bool is_media_recording_path(const std::string& path) {
+    std::string extension = extension_of(path);
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return extension == ".mkv" || extension == ".mp4" || extension == ".mov" || extension == ".ts";
+}
+
+MediaRecorder::MediaRecorder(const std::string& path, const MediaRecorderConfig& config)
+    : path_(path), config_(config), rotating_(config.segment_ns > 0 || config.segment_bytes > 0) {
+    const AVOutputFormat* format = av_guess_format(config.format.empty() ? nullptr : config.format.c_str(),
+                                                   path.c_str(), nullptr);
+    if (!format) {
+        throw std::invalid_argument("Unknown container for recording: " + path);
+    }
+    if (avformat_query_codec(format, config.hevc ? AV_CODEC_ID_HEVC : AV_CODEC_ID_H264,
+                             FF_COMPLIANCE_NORMAL) == 0) {
+        throw std::invalid_argument(std::string(format->name) + " can't hold " + (config.hevc ? "HEVC" : "H.264"));
+    }
+
+    const std::string first = segment_path(0);
+    file_ = std::fopen(first.c_str(), "wb");
+    if (!file_) {
+        throw std::runtime_error("Cannot create recording: " + first);
+    }
+    // The AVIO buffer already batches writes
+    std::setvbuf(file_, nullptr, _IONBF, 0);
+    packet_ = av_packet_alloc();
+    writer_ = std::thread([this] { run(); });
+}
+
+MediaRecorder::~MediaRecorder() {
+    stop();
+    av_packet_free(&packet_);
+}
+
+void MediaRecorder::write_video(const uint8_t* data, size_t size, int64_t timestamp_ns) {
+    enqueue(false, data, size, timestamp_ns);
+}
+
+void MediaRecorder::write_audio(const uint8_t* data, size_t size, int64_t timestamp_ns) {
+    if (config_.audio) {
+        enqueue(true, data, size, timestamp_ns);
+    }
+}
+
+void MediaRecorder::enqueue(bool audio, const uint8_t* data, size_t size, int64_t timestamp_ns) {
+    if (failed_.load(std::memory_order_relaxed)) {
+        return; // The writer would only discard it
+    }
+    const bool keyframe = !audio && annexb::is_keyframe(config_.hevc, data, size);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_) {
+            return;
+        }
+        // After a drop, video would reference the missing picture until
+        // the next keyframe, so skip to it
+        if (!audio && video_resync_ && !keyframe) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        if (queued_bytes_ + size > config_.queue_bytes) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            video_resync_ = video_resync_ || !audio;
+            return;
+        }
+        if (!audio) {
+            video_resync_ = false;
+        }
+        Packet packet;
+        packet.audio = audio;
+        packet.keyframe = keyframe;
+        packet.timestamp_ns = timestamp_ns;
+        if (!spare_.empty()) {
+            packet.data = std::move(spare_.back());
+            spare_.pop_back();
+        }
+        packet.data.assign(data, data + size);
+        queue_.push_back(std::move(packet));
+        queued_bytes_ += size;
+    }
+    cond_.notify_one();
+}
+
+void MediaRecorder::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    cond_.notify_all();
+    std::lock_guard<std::mutex> lock(stop_mutex_);
+    if (writer_.joinable()) {
+        writer_.join();
+    }
+}
+
+MediaRecorder::Stats MediaRecorder::stats() const {
+    Stats result;
+    result.video_packets = video_packets_.load(std::memory_order_relaxed);
+    result.audio_packets = audio_packets_.load(std::memory_order_relaxed);
+    result.bytes = bytes_.load(std::memory_order_relaxed);
+    result.dropped = dropped_.load(std::memory_order_relaxed);
+    result.waiting_keyframe = waiting_keyframe_.load(std::memory_order_relaxed);
+    result.segments = segment_count_.load(std::memory_order_relaxed);
+    result.errors = errors_.load(std::memory_order_relaxed);
+    return result;
+}
+
+std::vector<std::string> MediaRecorder::segments() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return segments_;
+}
+
+std::string MediaRecorder::last_error() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return error_;
+}
+
+std::string MediaRecorder::segment_path(uint32_t index) const {
+    if (!rotating_) {
+        return path_;
+    }
+    const std::string extension = extension_of(path_);
+    char number[16];
+    std::snprintf(number, sizeof(number), "-%03u", index);
+    return path_.substr(0, path_.size() - extension.size()) + number + extension;
+}
+
+void MediaRecorder::run() {
+    std::deque<Packet> batch;
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        cond_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+        if (queue_.empty()) {
+            break; // Stopping with nothing left to write
+        }
+        // The batch stays counted in queued_bytes_ until it is written, so
+        // queue_bytes bounds everything held, not just what waits
+        batch.swap(queue_);
+        lock.unlock();
+
+        size_t written = 0;
+        for (const Packet& packet : batch) {
+            write_packet(packet);
+            written += packet.data.size();
+        }
+
+        lock.lock();
+        queued_bytes_ -= written;
+        for (Packet& packet : batch) {
+            spare_.push_back(std::move(packet.data));
+        }
+        batch.clear();
+    }
+    lock.unlock();
+    finish_segment();
+}
+
+void MediaRecorder::write_packet(const Packet& packet) {
+    if (failed_.load(std::memory_order_relaxed)) {
+        return;
+    }
+    const uint8_t* data = packet.data.data();
+    const size_t size = packet.data.size();
+
+    if (!packet.audio) {
+        // Keep the latest parameter sets for the next file's header
+        std::vector<uint8_t> sets = parameter_sets(config_.hevc, data, size);
+        if (!sets.empty()) {
+            parameter_sets_.swap(sets);
+        }
+
+        if (!header_written_) {
+            if (!packet.keyframe) {
+                waiting_keyframe_.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            if (!open_segment(packet)) {
+                return;
+            }
+        } else if (packet.keyframe && rotating_ &&
+                   ((config_.segment_ns > 0 && packet.timestamp_ns - segment_start_ns_ >= config_.segment_ns) ||
+                    (config_.segment_bytes > 0 && segment_written_ >= config_.segment_bytes))) {
+            finish_segment();
+            segment_index_++;
+            if (!open_segment(packet)) {
+                return;
+            }
+        }
+
+        // Arrival time stands in for the capture clock; remote play has no
+        // B-frames, so decode order is presentation order
+        int64_t pts = av_rescale_q(packet.timestamp_ns - segment_start_ns_, NS_TIME_BASE, video_stream_->time_base);
+        pts = std::max(pts, last_video_pts_ + 1);
+        last_video_pts_ = pts;
+        packet_->data = const_cast<uint8_t*>(data);
+        packet_->size = static_cast<int>(size);
+        packet_->pts = pts;
+        packet_->dts = pts;
+        packet_->duration = 0;
+        packet_->stream_index = video_stream_->index;
+        packet_->flags = packet.keyframe ? AV_PKT_FLAG_KEY : 0;
+        const int ret = av_interleaved_write_frame(output_, packet_);
+        if (ret < 0) {
+            fail("Writing video failed: " + av_error_text(ret));
+            return;
+        }
+        video_packets_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    if (!header_written_) {
+        waiting_keyframe_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    const int samples = opus_packet_samples(data, size);
+    const int64_t arrival = av_rescale(packet.timestamp_ns - segment_start_ns_, OPUS_RATE, 1000000000);
+    if (!audio_stream_ || samples <= 0 || arrival < 0) {
+        return; // Malformed, or from before this file's first picture
+    }
+    // Audio runs on its own sample clock, only ever moved forward
+    if (audio_next_pts_ < 0 || arrival - audio_next_pts_ > AUDIO_RESYNC_SAMPLES) {
+        audio_next_pts_ = arrival;
+    }
+    const AVRational sample_time_base = {1, OPUS_RATE};
+    packet_->data = const_cast<uint8_t*>(data);
+    packet_->size = static_cast<int>(size);
+    packet_->pts = av_rescale_q(audio_next_pts_, sample_time_base, audio_stream_->time_base);
+    packet_->dts = packet_->pts;
+    packet_->duration = av_rescale_q(samples, sample_time_base, audio_stream_->time_base);
+    packet_->stream_index = audio_stream_->index;
+    packet_->flags = AV_PKT_FLAG_KEY;
+    audio_next_pts_ += samples;
+    const int ret = av_interleaved_write_frame(output_, packet_);
+    if (ret < 0) {
+        fail("Writing audio failed: " + av_error_text(ret));
+        return;
+    }
+    audio_packets_.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool MediaRecorder::open_segment(const Packet& keyframe) {
+    const std::string path = segment_path(segment_index_);
+    if (!file_) {
+        file_ = std::fopen(path.c_str(), "wb");
+        if (!file_) {
+            fail("Cannot create recording: " + path);
+            return false;
+        }
+        std::setvbuf(file_, nullptr, _IONBF, 0);
+    }
+
+    int ret = avformat_alloc_output_context2(&output_, nullptr, config_.format.empty() ? nullptr : config_.format.c_str(),
+                                             path.c_str());
+    if (ret < 0 || !output_) {
+        fail("Cannot set up the muxer: " + av_error_text(ret));
+        return false;
+    }
+    auto* buffer = static_cast<uint8_t*>(av_malloc(IO_BUFFER_SIZE));
+#if LIBAVFORMAT_VERSION_MAJOR >= 61
+    auto write = [](void* opaque, const uint8_t* buf, int buf_size) { return write_output(opaque, buf, buf_size); };
+#else
+    auto write = [](void* opaque, uint8_t* buf, int buf_size) { return write_output(opaque, buf, buf_size); };
+#endif
+    io_ = buffer ? avio_alloc_context(buffer, IO_BUFFER_SIZE, 1, this, nullptr, write, seek_output) : nullptr;
+    if (!io_) {
+        av_free(buffer);
+        fail("Out of memory for the recording buffer");
+        return false;
+    }
+    output_->pb = io_;
+    output_->flags |= AVFMT_FLAG_CUSTOM_IO;
+
+    video_stream_ = avformat_new_stream(output_, nullptr);
+    if (!video_stream_) {
+        fail("Cannot add the video stream");
+        return false;
+    }
+    video_stream_->time_base = {1, 1000000};
+    video_stream_->avg_frame_rate = {config_.fps, 1};
+    AVCodecParameters* video = video_stream_->codecpar;
+    video->codec_type = AVMEDIA_TYPE_VIDEO;
+    video->codec_id = config_.hevc ? AV_CODEC_ID_HEVC : AV_CODEC_ID_H264;
+    video->width = config_.width;
+    video->height = config_.height;
+    if (config_.hevc && config_.hdr) {
+        video->color_primaries = AVCOL_PRI_BT2020;
+        video->color_trc = AVCOL_TRC_SMPTE2084;
+        video->color_space = AVCOL_SPC_BT2020_NCL;
+        video->color_range = AVCOL_RANGE_MPEG;
+    }
+    // Annex B parameter sets; the MP4 and Matroska muxers turn them (and
+    // the samples) into avcC / hvcC form themselves
+    if (!parameter_sets_.empty() && !set_extradata(video, parameter_sets_.data(), parameter_sets_.size())) {
+        fail("Out of memory for the codec header");
+        return false;
+    }
+
+    if (config_.audio) {
+        audio_stream_ = avformat_new_stream(output_, nullptr);
+        if (!audio_stream_) {
+            fail("Cannot add the audio stream");
+            return false;
+        }
+        audio_stream_->time_base = {1, OPUS_RATE};
+        AVCodecParameters* audio = audio_stream_->codecpar;
+        audio->codec_type = AVMEDIA_TYPE_AUDIO;
+        audio->codec_id = AV_CODEC_ID_OPUS;
+        audio->sample_rate = OPUS_RATE;
+        audio->initial_padding = OPUS_PRE_SKIP;
+#if LIBAVUTIL_VERSION_INT >= AV_VERSION_INT(57, 28, 100)
+        av_channel_layout_default(&audio->ch_layout, config_.audio_channels);
+#else
+        audio->channels = config_.audio_channels;
+        audio->channel_layout = av_get_default_channel_layout(config_.audio_channels);
+#endif
+        const std::vector<uint8_t> head = opus_head(config_.audio_channels);
+        if (!set_extradata(audio, head.data(), head.size())) {
+            fail("Out of memory for the codec header");
+            return false;
+        }
+    }
+
+    AVDictionary* options = nullptr;
+    const std::string muxer = output_->oformat->name;
+    if (muxer == "mp4" || muxer == "mov") {
+        // Fragments instead of one moov at the end: a killed process
+        // still leaves a playable file
+        av_dict_set(&options, "movflags", "+frag_keyframe+empty_moov+default_base_moof", 0);
+    }
+    segment_written_ = 0;
+    ret = avformat_write_header(output_, &options);
+    av_dict_free(&options);
+    if (ret < 0) {
+        fail("Cannot write the container header: " + av_error_text(ret));
+        return false;
+    }
+    header_written_ = true;
+    segment_start_ns_ = keyframe.timestamp_ns;
+    last_video_pts_ = -1;
+    audio_next_pts_ = -1;
+    segment_count_.fetch_add(1, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(mutex_);
+    segments_.push_back(path);
+    return true;
+}
+
+void MediaRecorder::finish_segment() {
+    if (header_written_ && av_write_trailer(output_) < 0) {
+        errors_.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (io_) {
+        avio_flush(io_);
+        av_freep(&io_->buffer);
+        avio_context_free(&io_);
+    }
+    if (output_) {
+        avformat_free_context(output_);
+        output_ = nullptr;
+    }
+    video_stream_ = nullptr;
+    audio_stream_ = nullptr;
+    if (file_) {
+        std::fclose(file_);
+        file_ = nullptr;
+        if (!header_written_) {
+            // Never got a keyframe: nothing worth keeping
+            std::remove(segment_path(segment_index_).c_str());
+        }
+    }
+    header_written_ = false;
+}
+
+void MediaRecorder::fail(const std::string& message) {
+    failed_.store(true, std::memory_order_relaxed);
+    errors_.fetch_add(1, std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        error_ = message;
+        // Nothing queued will be written; let its memory go now
+        for (const Packet& packet : queue_) {
+            queued_bytes_ -= packet.data.size();
+        }
+        queue_.clear();
+    }
+    finish_segment();
+}
+
+int MediaRecorder::write_output(void* opaque, const uint8_t* buf, int size) {
+    auto* recorder = static_cast<MediaRecorder*>(opaque);
+    if (std::fwrite(buf, 1, static_cast<size_t>(size), recorder->file_) != static_cast<size_t>(size)) {
+        return AVERROR(EIO);
+    }
+    recorder->bytes_.fetch_add(static_cast<uint64_t>(size), std::memory_order_relaxed);
+    recorder->segment_written_ += static_cast<uint64_t>(size);
+    return size;
+}
+
+int64_t MediaRecorder::seek_output(void* opaque, int64_t offset, int whence) {
+    FILE* file = static_cast<MediaRecorder*>(opaque)->file_;
+#if defined(_WIN32)
+    auto seek = [file](int64_t to, int from) { return _fseeki64(file, to, from); };
+    auto tell = [file] { return static_cast<int64_t>(_ftelli64(file)); };
+#else
+    auto seek = [file](int64_t to, int from) { return fseeko(file, static_cast<off_t>(to), from); };
+    auto tell = [file] { return static_cast<int64_t>(ftello(file)); };
+#endif
+    if (whence & AVSEEK_SIZE) {
+        const int64_t position = tell();
+        if (seek(0, SEEK_END) != 0) {
+            return -1;
+        }
+        const int64_t size = tell();
+        seek(position, SEEK_SET);
+        return size;
+    }
+    if (seek(offset, whence & ~AVSEEK_FORCE) != 0) {
+        return -1;
+    }
+    return tell();
+}
@@ -0,0 +1,154 @@
+/**
+ * media_recorder.h - Remux the encoded session stream into MKV/MP4/TS
+ *
+ * Where StreamRecorder keeps chiaki's samples in our own PCNGREC1 file
+ * for ReplaySession, MediaRecorder writes them into a regular container
+ * any player or dataset tool opens, without transcoding: H.264/HEVC
+ * samples go in as they arrived and Opus packets, if audio is captured,
+ * ride along as a second stream.
+ *
+ * The video and audio threads only copy a packet into a bounded queue;
+ * a dedicated writer thread muxes with libavformat through a 1 MiB
+ * output buffer, so the disk sees large writes and a slow disk costs
+ * dropped packets (counted, and video resumes at the next keyframe)
+ * rather than a stalled stream. Each file starts on a keyframe, and
+ * with segment_ns / segment_bytes set the writer rotates to
+ * `<stem>-NNN<ext>` at the first keyframe past either limit. MP4 / MOV
+ * are written fragmented so a killed process leaves a playable file.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct AVFormatContext;
+struct AVIOContext;
+struct AVPacket;
+struct AVStream;
+
+struct MediaRecorderConfig {
+    bool hevc = false;
+    bool hdr = false;          // tag HEVC as BT.2020 / PQ
+    int width = 0;
+    int height = 0;
+    int fps = 60;
+
+    bool audio = false;        // add an Opus stream fed by write_audio()
+    int audio_channels = 2;
+
+    std::string format;        // libavformat muxer name; empty guesses from the path
+    int64_t segment_ns = 0;    // rotate after this much stream time; 0 never
+    uint64_t segment_bytes = 0;  // rotate after this many bytes; 0 never
+    size_t queue_bytes = 64u << 20;  // packets queued or being written; more are dropped
+};
+
+class MediaRecorder {
+public:
+    // Creates the first file up front; throws std::invalid_argument for
+    // a container libavformat doesn't know and std::runtime_error if the
+    // file can't be created
+    MediaRecorder(const std::string& path, const MediaRecorderConfig& config);
+    ~MediaRecorder();
+
+    MediaRecorder(const MediaRecorder&) = delete;
+    MediaRecorder& operator=(const MediaRecorder&) = delete;
+
+    // Copy a packet into the queue; never wait on the writer. Safe from
+    // any thread, and a no-op once stop() began or the recording failed.
+    void write_video(const uint8_t* data, size_t size, int64_t timestamp_ns);
+    void write_audio(const uint8_t* data, size_t size, int64_t timestamp_ns);
+
+    // Writes out what is queued, finishes the current file and joins the
+    // writer; idempotent
+    void stop();
+
+    struct Stats {
+        uint64_t video_packets = 0;   // muxed
+        uint64_t audio_packets = 0;   // muxed
+        uint64_t bytes = 0;           // written to disk, all segments
+        uint64_t dropped = 0;         // queue full, or video waiting to resync after that
+        uint64_t waiting_keyframe = 0;  // packets before the first keyframe
+        uint64_t segments = 0;
+        uint64_t errors = 0;          // failed opens and writes; the recording stops
+    };
+    Stats stats() const;
+
+    // Files written so far, in order
+    std::vector<std::string> segments() const;
+    std::string last_error() const;
+    // A write or open failed; nothing more is queued or written
+    bool failed() const { return failed_.load(std::memory_order_relaxed); }
+
+private:
+    struct Packet {
+        bool audio = false;
+        bool keyframe = false;
+        int64_t timestamp_ns = 0;
+        std::vector<uint8_t> data;
+    };
+
+    void enqueue(bool audio, const uint8_t* data, size_t size, int64_t timestamp_ns);
+    void run();
+
+    // Writer thread only
+    void write_packet(const Packet& packet);
+    bool open_segment(const Packet& keyframe);
+    void finish_segment();
+    void fail(const std::string& message);
+    std::string segment_path(uint32_t index) const;
+
+    static int write_output(void* opaque, const uint8_t* buf, int size);
+    static int64_t seek_output(void* opaque, int64_t offset, int whence);
+
+    const std::string path_;
+    const MediaRecorderConfig config_;
+    const bool rotating_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable cond_;
+    std::deque<Packet> queue_;
+    std::vector<std::vector<uint8_t>> spare_;  // recycled packet buffers
+    size_t queued_bytes_ = 0;
+    bool video_resync_ = false;
+    bool stopping_ = false;
+    std::mutex stop_mutex_;
+    std::vector<std::string> segments_;        // under mutex_
+    std::string error_;                        // under mutex_
+    std::thread writer_;
+
+    // Writer thread state
+    FILE* file_ = nullptr;
+    AVFormatContext* output_ = nullptr;
+    AVIOContext* io_ = nullptr;
+    AVStream* video_stream_ = nullptr;
+    AVStream* audio_stream_ = nullptr;
+    AVPacket* packet_ = nullptr;
+    std::atomic<bool> failed_{false};  // set by the writer, checked by enqueue()
+    bool header_written_ = false;  // the current file has its container header
+    uint32_t segment_index_ = 0;
+    int64_t segment_start_ns_ = 0;
+    uint64_t segment_written_ = 0;
+    int64_t last_video_pts_ = -1;
+    int64_t audio_next_pts_ = -1;   // in 1/48000, -1 until the segment's first audio packet
+    std::vector<uint8_t> parameter_sets_;  // latest SPS/PPS(/VPS), Annex B
+
+    std::atomic<uint64_t> video_packets_{0};
+    std::atomic<uint64_t> audio_packets_{0};
+    std::atomic<uint64_t> bytes_{0};
+    std::atomic<uint64_t> dropped_{0};
+    std::atomic<uint64_t> waiting_keyframe_{0};
+    std::atomic<uint64_t> segment_count_{0};
+    std::atomic<uint64_t> errors_{0};
+};
+
+// Container extensions start_recording() remuxes into instead of PCNGREC1
+bool is_media_recording_path(const std::string& path);
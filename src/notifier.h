@@ -0,0 +1,138 @@
+/**
+ * notifier.h - Wakeup primitive for consumers blocked on an SpscRing
+ *
+ * The producer only touches the mutex when a consumer is actually waiting,
+ * so the common case (nobody blocked in next_frame()) costs one fence and
+ * one atomic load per push.
+ *
+ * For event loops the notifier can also expose a file descriptor (eventfd
+ * on Linux, a pipe on other POSIX systems). A consumer arms it after
+ * finding the ring empty and the next notify() makes the fd readable once,
+ * so asyncio wakes up without polling or per-frame call_soon_threadsafe.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <condition_variable>
+#include <mutex>
+
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#include <unistd.h>
+#elif !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+class Notifier {
+public:
+    Notifier() = default;
+    Notifier(const Notifier&) = delete;
+    Notifier& operator=(const Notifier&) = delete;
+
+    ~Notifier() {
+#if !defined(_WIN32)
+        const int read_fd = read_fd_.load();
+        const int write_fd = write_fd_.load();
+        if (read_fd >= 0) {
+            close(read_fd);
+        }
+        if (write_fd >= 0 && write_fd != read_fd) {
+            close(write_fd);
+        }
+#endif
+    }
+
+    // Producer side, call after publishing new data
+    void notify() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiters_.load(std::memory_order_relaxed) > 0) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            cond_.notify_all();
+        }
+        if (armed_.load(std::memory_order_relaxed) && armed_.exchange(false)) {
+            signal_fd();
+        }
+    }
+
+    // Waits until ready() holds or the timeout expires; returns ready()
+    template <typename Predicate, typename Rep, typename Period>
+    bool wait_for(Predicate ready, const std::chrono::duration<Rep, Period>& timeout) {
+        if (ready()) {
+            return true;
+        }
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        waiters_.fetch_add(1, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const bool result = cond_.wait_for(lock, timeout, ready);
+        waiters_.fetch_sub(1, std::memory_order_relaxed);
+        return result;
+    }
+
+    // Readable end of the wakeup fd, created on first use; -1 if the
+    // platform has none
+    int fd() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (read_fd_ < 0) {
+            open_fd();
+        }
+        return read_fd_;
+    }
+
+    // Requests a single fd wakeup on the next notify(). Returns ready()
+    // re-checked after arming, so a caller seeing false can safely sleep.
+    template <typename Predicate>
+    bool arm(Predicate ready) {
+        armed_.store(true, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return ready();
+    }
+
+private:
+    void open_fd() {
+#if defined(__linux__)
+        const int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        write_fd_ = fd;
+        read_fd_ = fd;
+#elif !defined(_WIN32)
+        int fds[2];
+        if (pipe(fds) == 0) {
+            for (int fd : fds) {
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+                fcntl(fd, F_SETFD, FD_CLOEXEC);
+            }
+            write_fd_ = fds[1];
+            read_fd_ = fds[0];
+        }
+#endif
+    }
+
+    void signal_fd() {
+#if defined(__linux__)
+        const int fd = write_fd_.load();
+        if (fd >= 0) {
+            uint64_t one = 1;
+            ssize_t written = write(fd, &one, sizeof(one));
+            (void)written; // EAGAIN only if the counter is saturated, still readable
+        }
+#elif !defined(_WIN32)
+        const int fd = write_fd_.load();
+        if (fd >= 0) {
+            char one = 1;
+            ssize_t written = write(fd, &one, 1);
+            (void)written; // EAGAIN means the pipe is already readable
+        }
+#endif
+    }
+
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::atomic<int> waiters_{0};
+    std::atomic<bool> armed_{false};
+    std::atomic<int> read_fd_{-1};
+    std::atomic<int> write_fd_{-1};
+};
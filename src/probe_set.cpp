@@ -0,0 +1,358 @@
+/**
+ * probe_set.cpp - Per-frame pixel probes evaluated natively
+ */
+
+#include "probe_set.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+#if defined(__SSE2__) || defined(__x86_64__) || defined(_M_X64)
+#define PY_CHIAKI_NG_SSE2_KERNEL 1
+#include <emmintrin.h>
+#elif defined(__aarch64__)
+#define PY_CHIAKI_NG_NEON_KERNEL 1
+#include <arm_neon.h>
+#endif
+
+namespace {
+
+constexpr float NOT_AVAILABLE = std::numeric_limits<float>::quiet_NaN();
+
+uint8_t luma(int r, int g, int b) {
+    return static_cast<uint8_t>((77 * r + 150 * g + 29 * b + 128) >> 8);
+}
+
+// Sum and sum of squares of n bytes
+void span_moments(const uint8_t* p, int n, uint64_t& sum, uint64_t& sum_sq) {
+    int i = 0;
+#if defined(PY_CHIAKI_NG_SSE2_KERNEL)
+    const __m128i zero = _mm_setzero_si128();
+    __m128i sums = zero;
+    __m128i squares = zero;
+    for (; i + 16 <= n; i += 16) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        sums = _mm_add_epi64(sums, _mm_sad_epu8(v, zero));
+        const __m128i lo = _mm_unpacklo_epi8(v, zero);
+        const __m128i hi = _mm_unpackhi_epi8(v, zero);
+        squares = _mm_add_epi32(squares, _mm_add_epi32(_mm_madd_epi16(lo, lo), _mm_madd_epi16(hi, hi)));
+    }
+    alignas(16) uint32_t lanes[4];
+    _mm_store_si128(reinterpret_cast<__m128i*>(lanes), squares);
+    sum += static_cast<uint64_t>(_mm_cvtsi128_si32(sums)) +
+           static_cast<uint64_t>(_mm_cvtsi128_si32(_mm_unpackhi_epi64(sums, sums)));
+    sum_sq += static_cast<uint64_t>(lanes[0]) + lanes[1] + lanes[2] + lanes[3];
+#elif defined(PY_CHIAKI_NG_NEON_KERNEL)
+    uint32x4_t sums = vdupq_n_u32(0);
+    uint32x4_t squares = vdupq_n_u32(0);
+    for (; i + 16 <= n; i += 16) {
+        const uint8x16_t v = vld1q_u8(p + i);
+        sums = vpadalq_u16(sums, vpaddlq_u8(v));
+        squares = vpadalq_u16(squares, vmull_u8(vget_low_u8(v), vget_low_u8(v)));
+        squares = vpadalq_u16(squares, vmull_u8(vget_high_u8(v), vget_high_u8(v)));
+    }
+    sum += vaddvq_u32(sums);
+    sum_sq += vaddvq_u32(squares);
+#endif
+    for (; i < n; i++) {
+        sum += p[i];
+        sum_sq += static_cast<uint32_t>(p[i]) * p[i];
+    }
+}
+
+// Dot product of n bytes; n <= MAX_TEMPLATE_SIDE so it fits 32 bits
+uint32_t span_dot(const uint8_t* a, const uint8_t* b, int n) {
+    uint32_t total = 0;
+    int i = 0;
+#if defined(PY_CHIAKI_NG_SSE2_KERNEL)
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc = zero;
+    for (; i + 16 <= n; i += 16) {
+        const __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        const __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_unpacklo_epi8(va, zero), _mm_unpacklo_epi8(vb, zero)));
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_unpackhi_epi8(va, zero), _mm_unpackhi_epi8(vb, zero)));
+    }
+    alignas(16) uint32_t lanes[4];
+    _mm_store_si128(reinterpret_cast<__m128i*>(lanes), acc);
+    total = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#elif defined(PY_CHIAKI_NG_NEON_KERNEL)
+    uint32x4_t acc = vdupq_n_u32(0);
+    for (; i + 16 <= n; i += 16) {
+        const uint8x16_t va = vld1q_u8(a + i);
+        const uint8x16_t vb = vld1q_u8(b + i);
+        acc = vpadalq_u16(acc, vmull_u8(vget_low_u8(va), vget_low_u8(vb)));
+        acc = vpadalq_u16(acc, vmull_u8(vget_high_u8(va), vget_high_u8(vb)));
+    }
+    total = vaddvq_u32(acc);
+#endif
+    for (; i < n; i++) {
+        total += static_cast<uint32_t>(a[i]) * b[i];
+    }
+    return total;
+}
+
+// One row of a region as 8-bit values: luma (channel -1) or an RGB
+// channel, whatever the frame's layout
+const uint8_t* region_row(const VideoFrame& frame, int x, int y, int width, int channel,
+                          std::vector<uint8_t>& scratch) {
+    const int channels = frame.channels();
+    const uint8_t* row = frame.data() + (static_cast<size_t>(y) * frame.width() + x) * channels;
+    if (channels == 1) {
+        return row;
+    }
+    scratch.resize(static_cast<size_t>(width));
+    const bool bgr = frame.format() == PixelFormat::BGR;
+    const int r = bgr ? 2 : 0;
+    const int b = bgr ? 0 : 2;
+    if (channel < 0) {
+        for (int i = 0; i < width; i++) {
+            const uint8_t* px = row + i * 3;
+            scratch[i] = luma(px[r], px[1], px[b]);
+        }
+    } else {
+        const int offset = channel == 1 ? 1 : (channel == 0 ? r : b);
+        for (int i = 0; i < width; i++) {
+            scratch[i] = row[i * 3 + offset];
+        }
+    }
+    return scratch.data();
+}
+
+bool fits(const VideoFrame& frame, int x, int y, int width, int height) {
+    return x >= 0 && y >= 0 && x + width <= frame.width() && y + height <= frame.height();
+}
+
+void check_region(int x, int y, int width, int height) {
+    if (x < 0 || y < 0 || width <= 0 || height <= 0) {
+        throw std::invalid_argument("probe region must be non-negative with a positive size");
+    }
+}
+
+} // namespace
+
+const char* ProbeSet::kernel_name() {
+#if defined(PY_CHIAKI_NG_SSE2_KERNEL)
+    return "sse2";
+#elif defined(PY_CHIAKI_NG_NEON_KERNEL)
+    return "neon";
+#else
+    return "scalar";
+#endif
+}
+
+size_t ProbeSet::add_column(const std::string& name) {
+    if (name.empty() || std::find(columns_.begin(), columns_.end(), name) != columns_.end()) {
+        throw std::invalid_argument("probe names must be unique and non-empty: '" + name + "'");
+    }
+    columns_.push_back(name);
+    return columns_.size() - 1;
+}
+
+size_t ProbeSet::add_pixel(const std::string& name, int x, int y, const std::array<uint8_t, 3>& rgb,
+                           int tolerance, int radius) {
+    if (radius < 0 || tolerance < 0 || tolerance > 255) {
+        throw std::invalid_argument("radius must be >= 0 and tolerance 0-255");
+    }
+    check_region(x - radius, y - radius, 2 * radius + 1, 2 * radius + 1);
+    Probe probe;
+    probe.kind = Kind::PIXEL;
+    probe.x = x - radius;
+    probe.y = y - radius;
+    probe.width = probe.height = 2 * radius + 1;
+    probe.rgb = rgb;
+    probe.tolerance = tolerance;
+    probe.column = add_column(name);
+    probes_.push_back(std::move(probe));
+    return probes_.back().column;
+}
+
+size_t ProbeSet::add_region(const std::string& name, Kind kind, int x, int y, int width, int height,
+                            int channel) {
+    check_region(x, y, width, height);
+    if (channel < -1 || channel > 2) {
+        throw std::invalid_argument("channel must be -1 (luma) or 0-2 (R, G, B)");
+    }
+    Probe probe;
+    probe.kind = kind;
+    probe.x = x;
+    probe.y = y;
+    probe.width = width;
+    probe.height = height;
+    probe.channel = channel;
+    probe.column = add_column(name);
+    probes_.push_back(std::move(probe));
+    return probes_.back().column;
+}
+
+size_t ProbeSet::add_mean(const std::string& name, int x, int y, int width, int height, int channel) {
+    return add_region(name, Kind::MEAN, x, y, width, height, channel);
+}
+
+size_t ProbeSet::add_variance(const std::string& name, int x, int y, int width, int height, int channel) {
+    return add_region(name, Kind::VARIANCE, x, y, width, height, channel);
+}
+
+size_t ProbeSet::add_template(const std::string& name, const uint8_t* pixels, int width, int height,
+                              int x, int y, int search_width, int search_height, bool locate) {
+    if (width <= 0 || height <= 0 || width > MAX_TEMPLATE_SIDE || height > MAX_TEMPLATE_SIDE) {
+        throw std::invalid_argument("template sides must be 1-" + std::to_string(MAX_TEMPLATE_SIDE));
+    }
+    check_region(x, y, search_width, search_height);
+    if (search_width < width || search_height < height) {
+        throw std::invalid_argument("search region must be at least the template's size");
+    }
+    const size_t count = static_cast<size_t>(width) * height;
+    if (std::all_of(pixels, pixels + count, [pixels](uint8_t value) { return value == pixels[0]; })) {
+        throw std::invalid_argument("template must not be a flat colour");
+    }
+    // Validate every name before adding any column
+    if (locate && (std::find(columns_.begin(), columns_.end(), name + ".x") != columns_.end() ||
+                   std::find(columns_.begin(), columns_.end(), name + ".y") != columns_.end())) {
+        throw std::invalid_argument("probe names must be unique and non-empty: '" + name + "'");
+    }
+    Probe probe;
+    probe.kind = Kind::TEMPLATE;
+    probe.x = x;
+    probe.y = y;
+    probe.width = search_width;
+    probe.height = search_height;
+    probe.pixels.assign(pixels, pixels + count);
+    probe.template_width = width;
+    probe.template_height = height;
+    uint64_t sum_sq = 0;
+    span_moments(pixels, width * height, probe.template_sum, sum_sq);
+    probe.template_var = static_cast<double>(count) * static_cast<double>(sum_sq) -
+                         static_cast<double>(probe.template_sum) * static_cast<double>(probe.template_sum);
+    probe.locate = locate;
+    probe.column = add_column(name);
+    if (locate) {
+        add_column(name + ".x");
+        add_column(name + ".y");
+    }
+    probes_.push_back(std::move(probe));
+    return probes_.back().column;
+}
+
+bool ProbeSet::changed(const float* previous, const float* current) const {
+    for (size_t i = 0; i < columns_.size(); i++) {
+        const bool was_nan = std::isnan(previous[i]);
+        const bool is_nan = std::isnan(current[i]);
+        if (was_nan != is_nan || (!is_nan && std::fabs(current[i] - previous[i]) > change_tolerance)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ProbeSet::evaluate(const VideoFrame& frame, float* out) const {
+    std::fill(out, out + columns_.size(), NOT_AVAILABLE);
+    if (pixel_format_is_float(frame.format()) || frame.format() == PixelFormat::ENCODED) {
+        return false;
+    }
+
+    thread_local std::vector<uint8_t> row_scratch;
+    thread_local std::vector<uint8_t> area;
+    thread_local std::vector<uint64_t> integral;
+    thread_local std::vector<uint64_t> integral_sq;
+
+    for (const Probe& probe : probes_) {
+        if (!fits(frame, probe.x, probe.y, probe.width, probe.height)) {
+            continue;
+        }
+        const double count = static_cast<double>(probe.width) * probe.height;
+
+        if (probe.kind == Kind::PIXEL) {
+            bool match = true;
+            for (int c = 0; c < 3 && match; c++) {
+                uint64_t sum = 0, sum_sq = 0;
+                for (int y = 0; y < probe.height; y++) {
+                    span_moments(region_row(frame, probe.x, probe.y + y, probe.width, c, row_scratch),
+                                 probe.width, sum, sum_sq);
+                }
+                const double expected = frame.channels() == 1 ? luma(probe.rgb[0], probe.rgb[1], probe.rgb[2])
+                                                              : probe.rgb[c];
+                match = std::fabs(static_cast<double>(sum) / count - expected) <= probe.tolerance;
+                if (frame.channels() == 1) {
+                    break;
+                }
+            }
+            out[probe.column] = match ? 1.0f : 0.0f;
+            continue;
+        }
+
+        if (probe.kind == Kind::MEAN || probe.kind == Kind::VARIANCE) {
+            uint64_t sum = 0, sum_sq = 0;
+            for (int y = 0; y < probe.height; y++) {
+                span_moments(region_row(frame, probe.x, probe.y + y, probe.width, probe.channel, row_scratch),
+                             probe.width, sum, sum_sq);
+            }
+            const double mean = static_cast<double>(sum) / count;
+            out[probe.column] = static_cast<float>(
+                probe.kind == Kind::MEAN ? mean : std::max(static_cast<double>(sum_sq) / count - mean * mean, 0.0));
+            continue;
+        }
+
+        // Template: luma of the search area plus integral images of it and
+        // its squares, so each position's window sums are four lookups
+        const int w = probe.width;
+        const int h = probe.height;
+        area.resize(static_cast<size_t>(w) * h);
+        integral.assign(static_cast<size_t>(w + 1) * (h + 1), 0);
+        integral_sq.assign(integral.size(), 0);
+        for (int y = 0; y < h; y++) {
+            const uint8_t* row = region_row(frame, probe.x, probe.y + y, w, -1, row_scratch);
+            std::copy(row, row + w, area.begin() + static_cast<ptrdiff_t>(y) * w);
+            uint64_t line = 0, line_sq = 0;
+            for (int x = 0; x < w; x++) {
+                line += row[x];
+                line_sq += static_cast<uint32_t>(row[x]) * row[x];
+                const size_t at = static_cast<size_t>(y + 1) * (w + 1) + x + 1;
+                integral[at] = integral[at - (w + 1)] + line;
+                integral_sq[at] = integral_sq[at - (w + 1)] + line_sq;
+            }
+        }
+
+        const int tw = probe.template_width;
+        const int th = probe.template_height;
+        const double n = static_cast<double>(tw) * th;
+
+        auto window = [w](const std::vector<uint64_t>& table, int x, int y, int tw, int th) {
+            const size_t stride = static_cast<size_t>(w) + 1;
+            return table[(y + th) * stride + x + tw] - table[y * stride + x + tw] -
+                   table[(y + th) * stride + x] + table[y * stride + x];
+        };
+
+        double best = -2.0;
+        int best_x = 0, best_y = 0;
+        for (int y = 0; y + th <= h; y++) {
+            for (int x = 0; x + tw <= w; x++) {
+                const double i_sum = static_cast<double>(window(integral, x, y, tw, th));
+                const double i_var = n * static_cast<double>(window(integral_sq, x, y, tw, th)) - i_sum * i_sum;
+                double score = 0.0;
+                if (i_var > 0.0) {
+                    uint64_t cross = 0;
+                    for (int r = 0; r < th; r++) {
+                        cross += span_dot(area.data() + static_cast<size_t>(y + r) * w + x,
+                                          probe.pixels.data() + static_cast<size_t>(r) * tw, tw);
+                    }
+                    score = (n * static_cast<double>(cross) - i_sum * static_cast<double>(probe.template_sum)) /
+                            std::sqrt(i_var * probe.template_var);
+                }
+                if (score > best) {
+                    best = score;
+                    best_x = x;
+                    best_y = y;
+                }
+            }
+        }
+        out[probe.column] = static_cast<float>(std::min(best, 1.0));
+        if (probe.locate) {
+            out[probe.column + 1] = static_cast<float>(probe.x + best_x);
+            out[probe.column + 2] = static_cast<float>(probe.y + best_y);
+        }
+    }
+    return true;
+}
@@ -0,0 +1,97 @@
+/**
+ * probe_set.h - Per-frame pixel probes evaluated natively
+ *
+ * Most HUD checks ("is this pixel red", "is the pause icon up") read a
+ * handful of pixels; a ProbeSet batches them so they run on the decoded
+ * frame in C++ and Python only sees one small float32 vector. Probes:
+ *
+ *   pixel     1 if the mean colour of a (2r+1)^2 box is within tolerance
+ *             of an RGB colour on every channel, else 0
+ *   mean      mean of a region's luma or one RGB channel
+ *   variance  variance of the same
+ *   template  best normalized cross-correlation (-1..1) of a grayscale
+ *             template over a search region, optionally with its x, y
+ *
+ * Coordinates and colours are those of the frame Python would get from
+ * to_numpy(), in RGB order whatever the frame's channel order. A probe
+ * that doesn't fit the frame, or a float/encoded frame, yields NaN.
+ * Region sums and template correlation run on SSE2 or NEON.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "video_frame.h"
+
+class ProbeSet {
+public:
+    enum class Kind {
+        PIXEL,
+        MEAN,
+        VARIANCE,
+        TEMPLATE
+    };
+
+    // Largest template side; keeps the correlation sums in 32 bits
+    static constexpr int MAX_TEMPLATE_SIDE = 128;
+
+    // Each add_* appends result columns and returns the first one's index.
+    // All throw std::invalid_argument for empty regions, bad channels and
+    // duplicate names.
+    size_t add_pixel(const std::string& name, int x, int y, const std::array<uint8_t, 3>& rgb,
+                     int tolerance, int radius);
+    // channel: -1 luma, 0-2 R, G or B
+    size_t add_mean(const std::string& name, int x, int y, int width, int height, int channel);
+    size_t add_variance(const std::string& name, int x, int y, int width, int height, int channel);
+    // Grayscale template, row-major and tightly packed; `locate` adds
+    // name.x and name.y columns with the best match's top-left corner
+    size_t add_template(const std::string& name, const uint8_t* pixels, int width, int height,
+                        int x, int y, int search_width, int search_height, bool locate);
+
+    // Result columns, in order
+    const std::vector<std::string>& columns() const { return columns_; }
+    size_t size() const { return columns_.size(); }
+    bool empty() const { return probes_.empty(); }
+
+    // Fills size() floats; false (all NaN) for frames probes can't read
+    bool evaluate(const VideoFrame& frame, float* out) const;
+
+    // Only report results that moved by more than change_tolerance in
+    // some column (Session.set_probe_callback())
+    bool on_change = false;
+    float change_tolerance = 0.0f;
+
+    // True when any column differs by more than change_tolerance;
+    // NaN equals NaN
+    bool changed(const float* previous, const float* current) const;
+
+    // "sse2", "neon" or "scalar"
+    static const char* kernel_name();
+
+private:
+    struct Probe {
+        Kind kind;
+        size_t column;
+        int x, y, width, height;      // pixel box, region or search area
+        int channel = -1;
+        std::array<uint8_t, 3> rgb = {0, 0, 0};
+        int tolerance = 0;
+        std::vector<uint8_t> pixels;  // template
+        int template_width = 0;
+        int template_height = 0;
+        uint64_t template_sum = 0;
+        double template_var = 0.0;    // n * sum of squares - sum^2
+        bool locate = false;
+    };
+
+    size_t add_column(const std::string& name);
+    size_t add_region(const std::string& name, Kind kind, int x, int y, int width, int height, int channel);
+
+    std::vector<Probe> probes_;
+    std::vector<std::string> columns_;
+};
@@ -21,6 +21,8 @@ void init_session_binding(pybind11::module& m);
 void init_controller_binding(pybind11::module& m);
 void init_video_binding(pybind11::module& m);
 void init_events_binding(pybind11::module& m);
+void init_log_binding(pybind11::module& m);
+void init_audio_binding(pybind11::module& m);
 
 namespace py = pybind11;
 
@@ -30,12 +32,6 @@ PYBIND11_MODULE(py_chiaki_ng_core, m) {
     // Version info
     m.attr("__version__") = "0.1.0";
     
-    // Initialize all binding modules
-    init_session_binding(m);
-    init_controller_binding(m);
-    init_video_binding(m);
-    init_events_binding(m);
-    
     // Basic enums and constants
     py::enum_<ChiakiErrorCode>(m, "ErrorCode")
         .value("SUCCESS", CHIAKI_ERR_SUCCESS)
@@ -71,5 +67,15 @@ PYBIND11_MODULE(py_chiaki_ng_core, m) {
     py::enum_<ChiakiCodec>(m, "Codec")
         .value("H264", CHIAKI_CODEC_H264)
         .value("H265", CHIAKI_CODEC_H265)
+        .value("H265_HDR", CHIAKI_CODEC_H265_HDR)
         .export_values();
+    
+    // Initialize all binding modules (enums and video first: Session uses
+    // their types as default arguments)
+    init_video_binding(m);
+    init_log_binding(m);
+    init_audio_binding(m);
+    init_session_binding(m);
+    init_controller_binding(m);
+    init_events_binding(m);
 }
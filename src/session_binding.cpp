@@ -8,66 +8,266 @@
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
 #include <pybind11/functional.h>
+#include <pybind11/numpy.h>
 #include <chiaki/session.h>
 #include <chiaki/log.h>
+#include <chiaki/video.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
 #include <functional>
+#include <map>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "audio_decoder.h"
+#include "controller_layout.h"
+#include "flight_recorder.h"
+#include "input_scheduler.h"
+#include "latency_probe.h"
+#include "log_sink.h"
+#include "media_recorder.h"
+#include "notifier.h"
+#include "probe_set.h"
+#include "session_event.h"
+#include "session_metrics.h"
+#include "shared_frames.h"
+#include "spsc_ring.h"
+#include "stream_recording.h"
+#include "thread_pool.h"
+#include "triple_buffer.h"
+#include "video_decoder.h"
 
 namespace py = pybind11;
 
-// Logger wrapper to redirect chiaki logs to Python
-class PythonLogger {
-public:
-    PythonLogger(std::function<void(const std::string&, int)> callback) 
-        : python_callback(callback) {
-        chiaki_log_init(&log, CHIAKI_LOG_ALL, log_callback, this);
-    }
+// Typed Python event for a queued event (events_binding.cpp)
+py::object session_event_to_python(const SessionEvent& event);
+
+// Process-wide chiaki log pipeline (log_binding.cpp)
+std::shared_ptr<LogSink> shared_log_sink();
+uint32_t default_log_level_mask();
+
+// Counter values at the last Session.interval_stats() call
+struct IntervalSnapshot {
+    uint64_t samples = 0;
+    uint64_t sample_bytes = 0;
+    uint64_t frames_decoded = 0;
+    uint64_t frames_skipped = 0;
+    uint64_t nonref_dropped = 0;
+    uint64_t frames_lost = 0;
+    uint64_t frames_recovered = 0;
+    uint64_t controller_sends = 0;
+    int64_t time_ns = 0;
+};
+
+// What Session.initialize() asks the console for. Lower presets cut both
+// bandwidth and decode cost per session; bitrate 0 keeps the preset's.
+struct SessionConfig {
+    static constexpr unsigned int MIN_BITRATE_KBPS = 500;
+    static constexpr unsigned int MAX_BITRATE_KBPS = 100000;
+    
+    bool ps5 = true;
+    ChiakiCodec codec = CHIAKI_CODEC_H264;
+    ChiakiVideoResolutionPreset resolution = CHIAKI_VIDEO_RESOLUTION_PRESET_1080p;
+    ChiakiVideoFPSPreset fps = CHIAKI_VIDEO_FPS_PRESET_60;
+    unsigned int bitrate = 0;     // kbps
+    bool auto_downgrade = false;  // let chiaki lower the profile if the console rejects it
     
-    ~PythonLogger() {
-        chiaki_log_fini(&log);
+    // Throws std::invalid_argument for what the console can't stream
+    void validate() const {
+        if (codec != CHIAKI_CODEC_H264 && !ps5) {
+            throw std::invalid_argument("PS4 consoles only stream H.264");
+        }
+        if (bitrate != 0 && (bitrate < MIN_BITRATE_KBPS || bitrate > MAX_BITRATE_KBPS)) {
+            throw std::invalid_argument("bitrate must be 0 (preset) or " + std::to_string(MIN_BITRATE_KBPS) +
+                                        "-" + std::to_string(MAX_BITRATE_KBPS) + " kbps");
+        }
     }
     
-    ChiakiLog* get_log() { return &log; }
+    // The resolution/fps preset with codec and bitrate applied
+    ChiakiConnectVideoProfile video_profile() const {
+        ChiakiConnectVideoProfile profile;
+        memset(&profile, 0, sizeof(profile));
+        chiaki_connect_video_profile_preset(&profile, resolution, fps);
+        profile.codec = codec;
+        if (bitrate != 0) {
+            profile.bitrate = bitrate;
+        }
+        return profile;
+    }
+};
 
-private:
-    ChiakiLog log;
-    std::function<void(const std::string&, int)> python_callback;
+// Structured array columns understood by Session.schedule_inputs()
+struct InputColumn {
+    const char* name;
+    uint32_t field;
+};
+
+static const InputColumn INPUT_COLUMNS[] = {
+    {"buttons", INPUT_FIELD_BUTTONS},
+    {"l2_state", INPUT_FIELD_L2},
+    {"r2_state", INPUT_FIELD_R2},
+    {"left_x", INPUT_FIELD_LEFT_X},
+    {"left_y", INPUT_FIELD_LEFT_Y},
+    {"right_x", INPUT_FIELD_RIGHT_X},
+    {"right_y", INPUT_FIELD_RIGHT_Y},
+};
+
+// float32 columns that together make up INPUT_FIELD_MOTION
+struct MotionColumn {
+    const char* name;
+    float ChiakiControllerState::*member;
+};
+
+static const MotionColumn MOTION_COLUMNS[] = {
+    {"gyro_x", &ChiakiControllerState::gyro_x},
+    {"gyro_y", &ChiakiControllerState::gyro_y},
+    {"gyro_z", &ChiakiControllerState::gyro_z},
+    {"accel_x", &ChiakiControllerState::accel_x},
+    {"accel_y", &ChiakiControllerState::accel_y},
+    {"accel_z", &ChiakiControllerState::accel_z},
+    {"orient_x", &ChiakiControllerState::orient_x},
+    {"orient_y", &ChiakiControllerState::orient_y},
+    {"orient_z", &ChiakiControllerState::orient_z},
+    {"orient_w", &ChiakiControllerState::orient_w},
+};
+
+template <typename T>
+using InputArray = py::array_t<T, py::array::c_style | py::array::forcecast>;
+
+// Converts a 1-D structured array into scheduler events. "t" holds offsets
+// in seconds from start_ns; the other columns present are the fields each
+// row sets, optionally narrowed per row by an InputField "mask" column.
+static std::vector<InputEvent> input_events_from_array(const py::array& actions, int64_t start_ns) {
+    const py::object names_object = actions.dtype().attr("names");
+    if (names_object.is_none() || actions.ndim() != 1) {
+        throw std::invalid_argument("actions must be a 1-D structured array (see INPUT_DTYPE)");
+    }
+    const auto names = names_object.cast<std::vector<std::string>>();
+    auto has_column = [&names](const char* name) {
+        return std::find(names.begin(), names.end(), name) != names.end();
+    };
+    auto column = [&actions](const char* name) { return py::object(actions[py::str(name)]); };
+    if (!has_column("t")) {
+        throw std::invalid_argument("actions need a 't' column of offsets in seconds");
+    }
+    
+    const size_t count = static_cast<size_t>(actions.shape(0));
+    std::vector<InputEvent> events(count);
+    
+    const auto offsets = InputArray<double>::ensure(column("t"));
+    for (size_t i = 0; i < count; i++) {
+        events[i].deadline_ns = start_ns + static_cast<int64_t>(offsets.data()[i] * 1e9);
+    }
+    
+    uint32_t present = 0;
+    for (const InputColumn& input : INPUT_COLUMNS) {
+        if (!has_column(input.name)) {
+            continue;
+        }
+        present |= input.field;
+        if (input.field == INPUT_FIELD_BUTTONS) {
+            const auto values = InputArray<uint32_t>::ensure(column(input.name));
+            for (size_t i = 0; i < count; i++) {
+                events[i].values.buttons = values.data()[i];
+            }
+        } else if (input.field == INPUT_FIELD_L2 || input.field == INPUT_FIELD_R2) {
+            const auto values = InputArray<uint8_t>::ensure(column(input.name));
+            for (size_t i = 0; i < count; i++) {
+                (input.field == INPUT_FIELD_L2 ? events[i].values.l2_state : events[i].values.r2_state) =
+                    values.data()[i];
+            }
+        } else {
+            const auto values = InputArray<int16_t>::ensure(column(input.name));
+            for (size_t i = 0; i < count; i++) {
+                ChiakiControllerState& state = events[i].values;
+                int16_t* target = input.field == INPUT_FIELD_LEFT_X ? &state.left_x
+                                : input.field == INPUT_FIELD_LEFT_Y ? &state.left_y
+                                : input.field == INPUT_FIELD_RIGHT_X ? &state.right_x
+                                : &state.right_y;
+                *target = values.data()[i];
+            }
+        }
+    }
     
-    static void log_callback(ChiakiLogLevel level, const char* msg, void* user) {
-        auto* logger = static_cast<PythonLogger*>(user);
-        if (logger->python_callback) {
-            logger->python_callback(std::string(msg), static_cast<int>(level));
+    // Motion is applied as one field; columns left out keep their idle value
+    const bool has_motion = std::any_of(std::begin(MOTION_COLUMNS), std::end(MOTION_COLUMNS),
+                                        [&has_column](const MotionColumn& input) { return has_column(input.name); });
+    if (has_motion) {
+        present |= INPUT_FIELD_MOTION;
+        ChiakiControllerState idle;
+        chiaki_controller_state_set_idle(&idle);
+        for (const MotionColumn& input : MOTION_COLUMNS) {
+            if (!has_column(input.name)) {
+                for (size_t i = 0; i < count; i++) {
+                    events[i].values.*input.member = idle.*input.member;
+                }
+                continue;
+            }
+            const auto values = InputArray<float>::ensure(column(input.name));
+            for (size_t i = 0; i < count; i++) {
+                events[i].values.*input.member = values.data()[i];
+            }
         }
     }
-};
+    
+    if (has_column("mask")) {
+        const auto masks = InputArray<uint32_t>::ensure(column("mask"));
+        for (size_t i = 0; i < count; i++) {
+            events[i].fields = present & masks.data()[i];
+        }
+    } else {
+        for (InputEvent& event : events) {
+            event.fields = present;
+        }
+    }
+    return events;
+}
 
 // Session wrapper class
 class SessionWrapper {
 public:
-    SessionWrapper() : logger(nullptr) {
-        // Initialize with default logger for now
-        logger = std::make_unique<PythonLogger>([](const std::string& msg, int level) {
-            // Default: print to stdout (can be overridden)
-            printf("[ChiakiLog:%d] %s\n", level, msg.c_str());
-        });
+    // With a decode pool, decoding runs on a shared WorkStealingPool
+    // (see SessionPool) instead of the chiaki video thread
+    explicit SessionWrapper(std::shared_ptr<WorkStealingPool> decode_pool = nullptr)
+        : logger(std::make_unique<SessionLog>(shared_log_sink(), default_log_level_mask())) {
+        if (decode_pool) {
+            decode_strand = std::make_unique<Strand>(std::move(decode_pool));
+        }
     }
     
-    ~SessionWrapper() {
+    virtual ~SessionWrapper() {
+        input_scheduler.reset();
+        // A running decode task, or chiaki's video thread running the video
+        // callback, may be waiting for the GIL
+        if (PyGILState_Check()) {
+            py::gil_scoped_release release;
+            stop_threads();
+        } else {
+            stop_threads();
+        }
         if (session_initialized) {
-            stop();
             chiaki_session_fini(&session);
         }
     }
     
-    bool initialize(const std::string& host, const std::string& regist_key) {
+    virtual bool initialize(const std::string& host, const std::string& regist_key, const SessionConfig& config) {
         if (session_initialized) {
             return false; // Already initialized
         }
+        config.validate();
         
-        // Set up connect info
+        // Set up connect info; chiaki keeps the host pointer
         memset(&connect_info, 0, sizeof(connect_info));
-        connect_info.host = host.c_str();
-        connect_info.ps5 = true; // Default to PS5, can be made configurable
+        host_name = host;
+        connect_info.host = host_name.c_str();
+        connect_info.ps5 = config.ps5;
         
         // Copy registration key
         if (regist_key.length() >= CHIAKI_SESSION_AUTH_SIZE) {
@@ -79,31 +279,40 @@ public:
                    CHIAKI_SESSION_AUTH_SIZE - regist_key.length());
         }
         
-        // Set default video profile
-        chiaki_connect_video_profile_preset(&connect_info.video_profile, 
-                                           CHIAKI_VIDEO_RESOLUTION_PRESET_1080p,
-                                           CHIAKI_VIDEO_FPS_PRESET_60);
+        connect_info.video_profile = config.video_profile();
+        connect_info.video_profile_auto_downgrade = config.auto_downgrade;
+        session_config = config;
         
         // Initialize session
-        ChiakiErrorCode err = chiaki_session_init(&session, &connect_info, logger->get_log());
+        ChiakiErrorCode err = chiaki_session_init(&session, &connect_info, logger->get());
         if (err != CHIAKI_ERR_SUCCESS) {
             return false;
         }
         
+        // chiaki_session_init() clears the session, so callbacks are always
+        // routed through our trampolines and dispatched from there
+        chiaki_session_set_video_sample_cb(&session, video_sample_callback, this);
+        chiaki_session_set_event_cb(&session, event_callback_wrapper, this);
+        
         session_initialized = true;
         return true;
     }
     
-    bool start() {
+    virtual bool start() {
         if (!session_initialized) {
             return false;
         }
         
         ChiakiErrorCode err = chiaki_session_start(&session);
-        return err == CHIAKI_ERR_SUCCESS;
+        if (err != CHIAKI_ERR_SUCCESS) {
+            return false;
+        }
+        
+        session_started = true;
+        return true;
     }
     
-    bool stop() {
+    virtual bool stop() {
         if (!session_initialized) {
             return false;
         }
@@ -112,117 +321,2033 @@ public:
         return err == CHIAKI_ERR_SUCCESS;
     }
     
-    bool join() {
+    virtual bool join() {
         if (!session_initialized) {
             return false;
         }
+        if (session_joined) {
+            return true;
+        }
         
         ChiakiErrorCode err = chiaki_session_join(&session);
-        return err == CHIAKI_ERR_SUCCESS;
+        session_joined = err == CHIAKI_ERR_SUCCESS;
+        return session_joined;
     }
     
     void set_video_callback(std::function<bool(py::bytes, size_t, int32_t, bool)> callback) {
         video_callback = callback;
-        chiaki_session_set_video_sample_cb(&session, video_sample_callback, this);
     }
     
-    void set_event_callback(std::function<void(int, py::dict)> callback) {
+    // Called with one typed event object (RumbleEvent, QuitEvent, ...)
+    void set_event_callback(std::function<void(py::object)> callback) {
         event_callback = callback;
-        chiaki_session_set_event_cb(&session, event_callback_wrapper, this);
     }
     
-    bool send_controller_state(const ChiakiControllerState& state) {
-        if (!session_initialized) {
+    // Only events of these types reach Python (callback and queue); QUIT
+    // always does. Filtered events are dropped on the chiaki thread before
+    // anything is built for them. None delivers everything.
+    void set_event_filter(std::optional<std::vector<ChiakiEventType>> types) {
+        uint32_t mask = EVENT_MASK_ALL;
+        if (types) {
+            mask = event_type_bit(CHIAKI_EVENT_QUIT);
+            for (ChiakiEventType type : *types) {
+                mask |= event_type_bit(type);
+            }
+        }
+        event_mask.store(mask, std::memory_order_relaxed);
+    }
+    
+    std::optional<std::vector<ChiakiEventType>> event_filter() const {
+        const uint32_t mask = event_mask.load(std::memory_order_relaxed);
+        if (mask == EVENT_MASK_ALL) {
+            return std::nullopt;
+        }
+        std::vector<ChiakiEventType> types;
+        for (uint32_t type = 0; type < 32; type++) {
+            if (mask & (uint32_t{1} << type)) {
+                types.push_back(static_cast<ChiakiEventType>(type));
+            }
+        }
+        return types;
+    }
+    
+    void set_frame_callback(std::function<void(VideoFrame)> callback) {
+        frame_callback = callback;
+    }
+    
+    // Decode samples natively and deliver VideoFrame pictures to the frame
+    // callback instead of NAL bytes. Decoding runs on the chiaki video
+    // thread, or on the shared pool for sessions created by a SessionPool.
+    bool enable_decoding(PixelFormat format, size_t pool_size, DecodeProfile profile) {
+        OutputSpec spec;
+        spec.format = format;
+        return enable_decoding_spec(spec, pool_size, profile);
+    }
+    
+    // Same, cropped/resized/converted per spec before frames reach Python
+    bool enable_decoding_spec(const OutputSpec& spec, size_t pool_size, DecodeProfile profile) {
+        spec.validate();
+        if (!session_initialized || session_started) {
+            return false; // Codec comes from the connect info; decoder can't be swapped while streaming
+        }
+        
+        auto new_decoder = std::make_unique<VideoDecoder>(spec, [this](VideoFrame&& frame) {
+            deliver_frame(std::move(frame));
+        });
+        new_decoder->frame_pool().set_slab_count(pool_size);
+        new_decoder->set_taps(tap_specs);
+        new_decoder->set_policy(resolved_decode_policy());
+        new_decoder->set_change_detection(change_spec);
+        {
+            std::lock_guard<std::mutex> lock(latency_mutex);
+            new_decoder->set_latency_probe(latency_probe);
+        }
+        new_decoder->set_demand_probe([this] { return frames_wanted(); });
+        ChiakiErrorCode err = new_decoder->init(logger->get(), connect_info.video_profile.codec, profile);
+        if (err != CHIAKI_ERR_SUCCESS) {
             return false;
         }
         
-        ChiakiErrorCode err = chiaki_session_set_controller_state(&session, 
-                                                                const_cast<ChiakiControllerState*>(&state));
-        return err == CHIAKI_ERR_SUCCESS;
+        decoder = std::move(new_decoder);
+        return true;
     }
-
-private:
-    ChiakiSession session;
-    ChiakiConnectInfo connect_info;
-    std::unique_ptr<PythonLogger> logger;
-    bool session_initialized = false;
     
-    std::function<bool(py::bytes, size_t, int32_t, bool)> video_callback;
-    std::function<void(int, py::dict)> event_callback;
+    bool decoding_enabled() const { return decoder != nullptr; }
     
-    static bool video_sample_callback(uint8_t* buf, size_t buf_size, int32_t frames_lost, 
-                                     bool frame_recovered, void* user) {
-        auto* wrapper = static_cast<SessionWrapper*>(user);
-        if (wrapper->video_callback) {
-            py::bytes data(reinterpret_cast<char*>(buf), buf_size);
-            return wrapper->video_callback(data, buf_size, frames_lost, frame_recovered);
+    // Config and video profile requested in initialize(); None before
+    std::optional<SessionConfig> config() const {
+        return session_initialized ? std::optional<SessionConfig>(session_config) : std::nullopt;
+    }
+    
+    std::optional<ChiakiConnectVideoProfile> video_profile() const {
+        return session_initialized ? std::optional<ChiakiConnectVideoProfile>(connect_info.video_profile)
+                                   : std::nullopt;
+    }
+    
+    // Decode the session's Opus audio on chiaki's audio thread into a ring
+    // holding the last `seconds` of 48 kHz stereo PCM
+    bool enable_audio(double seconds) {
+        if (seconds <= 0) {
+            throw std::invalid_argument("seconds must be positive");
         }
-        return true; // Default: accept all frames
+        if (!session_initialized || session_started) {
+            return false; // chiaki reads the audio sink when the stream starts
+        }
+        auto ring = std::make_shared<AudioRing>(AudioDecoder::SAMPLE_RATE, AudioDecoder::CHANNELS,
+                                                static_cast<size_t>(seconds * AudioDecoder::SAMPLE_RATE));
+        audio_decoder = std::make_unique<AudioDecoder>(std::move(ring));
+        audio_decoder->set_packet_tap([this](const uint8_t* data, size_t size, int64_t arrival_ns) {
+            if (auto media = active_media_recorder()) {
+                media->write_audio(data, size, arrival_ns);
+            }
+        });
+        ChiakiAudioSink sink = audio_decoder->sink();
+        chiaki_session_set_audio_sink(&session, &sink);
+        return true;
     }
     
-    static void event_callback_wrapper(ChiakiEvent* event, void* user) {
-        auto* wrapper = static_cast<SessionWrapper*>(user);
-        if (wrapper->event_callback) {
-            py::dict event_data;
-            event_data["type"] = static_cast<int>(event->type);
-            
-            // Add type-specific data
-            switch (event->type) {
-                case CHIAKI_EVENT_QUIT:
-                    event_data["reason"] = static_cast<int>(event->quit.reason);
-                    if (event->quit.reason_str) {
-                        event_data["reason_str"] = std::string(event->quit.reason_str);
-                    }
-                    break;
-                default:
-                    // Add more event types as needed
-                    break;
+    std::shared_ptr<AudioRing> audio() const {
+        return audio_decoder ? audio_decoder->ring() : nullptr;
+    }
+    
+    // Keep the last `seconds` of encoded samples, events and controller
+    // states in a fixed `max_bytes` ring (see flight_recorder.h), dumped
+    // by dump_flight_recorder() and, with dump_on_error, to that path
+    // when the session quits with an error reason
+    bool enable_flight_recorder(double seconds, size_t max_bytes, const std::optional<std::string>& dump_on_error) {
+        if (seconds < 0) {
+            throw std::invalid_argument("seconds must not be negative");
+        }
+        if (!session_initialized || session_started) {
+            return false; // The chiaki threads read the recorder without a lock
+        }
+        flight_recorder = std::make_shared<FlightRecorder>(connect_info.video_profile.codec, max_bytes,
+                                                           static_cast<int64_t>(seconds * 1e9));
+        flight_dump_path = dump_on_error.value_or(std::string());
+        return true;
+    }
+    
+    // Write the flight recorder's contents as a recording for
+    // ReplaySession; returns the number of records
+    size_t dump_flight_recorder(const std::string& path) {
+        if (!flight_recorder) {
+            throw std::runtime_error("Flight recorder not enabled; call enable_flight_recorder() first");
+        }
+        py::gil_scoped_release release;
+        return flight_recorder->dump(path);
+    }
+    
+    // Also copy every delivered frame into a named shared-memory ring that
+    // other processes attach to with SharedFrameReader. slot_size 0 fits
+    // the decoder's output, or the stream resolution in bytes for encoded
+    // samples, so enable decoding first.
+    bool enable_shared_frames(const std::string& name, uint32_t slots, size_t slot_size) {
+        if (!session_initialized || session_started) {
+            return false; // The delivering threads read the writer without a lock
+        }
+        if (slot_size == 0) {
+            const int width = connect_info.video_profile.width;
+            const int height = connect_info.video_profile.height;
+            slot_size = static_cast<size_t>(width) * height;
+            if (decoder) {
+                const OutputSpec& spec = decoder->output_spec();
+                const FrameConverter::Geometry geometry = FrameConverter::resolve(spec, width, height);
+                slot_size = FrameConverter::output_size(spec.format, geometry.width, geometry.height);
             }
-            
-            wrapper->event_callback(static_cast<int>(event->type), event_data);
         }
+        shared_frames = std::make_shared<SharedFrameWriter>(name, slots, slot_size);
+        return true;
     }
-};
-
-void init_session_binding(py::module& m) {
-    // Connect info structure
-    py::class_<ChiakiConnectVideoProfile>(m, "VideoProfile")
-        .def(py::init<>())
-        .def_readwrite("width", &ChiakiConnectVideoProfile::width)
-        .def_readwrite("height", &ChiakiConnectVideoProfile::height)
-        .def_readwrite("max_fps", &ChiakiConnectVideoProfile::max_fps)
-        .def_readwrite("bitrate", &ChiakiConnectVideoProfile::bitrate);
     
-    // Session wrapper
-    py::class_<SessionWrapper>(m, "Session")
-        .def(py::init<>())
-        .def("initialize", &SessionWrapper::initialize,
-             "Initialize session with host and registration key",
-             py::arg("host"), py::arg("regist_key"))
-        .def("start", &SessionWrapper::start,
-             "Start the Remote Play session")
-        .def("stop", &SessionWrapper::stop,
-             "Stop the Remote Play session")
-        .def("join", &SessionWrapper::join,
-             "Wait for session to complete")
-        .def("set_video_callback", &SessionWrapper::set_video_callback,
-             "Set callback for video frame data")
-        .def("set_event_callback", &SessionWrapper::set_event_callback,
-             "Set callback for session events")
-        .def("send_controller_state", &SessionWrapper::send_controller_state,
-             "Send controller input to PlayStation");
+    std::shared_ptr<SharedFrameWriter> shared_frame_writer() const {
+        return shared_frames;
+    }
     
-    // Video resolution presets
-    py::enum_<ChiakiVideoResolutionPreset>(m, "VideoResolutionPreset")
-        .value("PRESET_360p", CHIAKI_VIDEO_RESOLUTION_PRESET_360p)
-        .value("PRESET_540p", CHIAKI_VIDEO_RESOLUTION_PRESET_540p) 
-        .value("PRESET_720p", CHIAKI_VIDEO_RESOLUTION_PRESET_720p)
-        .value("PRESET_1080p", CHIAKI_VIDEO_RESOLUTION_PRESET_1080p)
-        .export_values();
+    std::optional<OutputSpec> output_spec() const {
+        if (!decoder) {
+            return std::nullopt;
+        }
+        return decoder->output_spec();
+    }
+    
+    // Named ROI outputs produced from each decoded picture alongside the
+    // main frame and delivered with it (VideoFrame.taps / frame[name]).
+    // Like the decoder itself, taps can't change while streaming.
+    bool add_tap(const std::string& name, const OutputSpec& spec) {
+        spec.validate();
+        if (session_started) {
+            return false;
+        }
+        auto it = std::find_if(tap_specs.begin(), tap_specs.end(),
+                               [&name](const auto& tap) { return tap.first == name; });
+        if (it != tap_specs.end()) {
+            it->second = spec;
+        } else {
+            tap_specs.emplace_back(name, spec);
+        }
+        if (decoder) {
+            decoder->set_taps(tap_specs);
+        }
+        return true;
+    }
+    
+    bool remove_tap(const std::string& name) {
+        if (session_started) {
+            return false;
+        }
+        auto it = std::find_if(tap_specs.begin(), tap_specs.end(),
+                               [&name](const auto& tap) { return tap.first == name; });
+        if (it == tap_specs.end()) {
+            return false;
+        }
+        tap_specs.erase(it);
+        if (decoder) {
+            decoder->set_taps(tap_specs);
+        }
+        return true;
+    }
+    
+    py::dict taps() const {
+        py::dict result;
+        for (const auto& tap : tap_specs) {
+            result[py::str(tap.first)] = py::cast(tap.second);
+        }
+        return result;
+    }
+    
+    // Throttles decoding to what the consumers need. Unlike taps this can
+    // change while streaming. A source_fps of 0 means the negotiated
+    // max_fps; before initialize() the policy is only checked once
+    // decoding is enabled.
+    void set_decode_policy(const DecodePolicy& policy) {
+        const DecodePolicy previous = decode_policy;
+        decode_policy = policy;
+        try {
+            const DecodePolicy resolved = resolved_decode_policy();
+            if (decoder) {
+                decoder->set_policy(resolved);
+            } else if (session_initialized) {
+                resolved.validate();
+            }
+        } catch (...) {
+            decode_policy = previous;
+            throw;
+        }
+    }
+    
+    DecodePolicy get_decode_policy() const { return resolved_decode_policy(); }
+    
+    // Drops decoded pictures that barely differ from the last delivered
+    // one; None turns it off. Applies to the current and later decoders.
+    void set_change_detection(const std::optional<ChangeSpec>& spec) {
+        if (spec) {
+            spec->validate();
+        }
+        change_spec = spec;
+        if (decoder) {
+            decoder->set_change_detection(spec);
+        }
+    }
+    
+    std::optional<ChangeSpec> get_change_detection() const { return change_spec; }
+    
+    // Time controller sends to the first decoded picture whose `spec`
+    // region changes, into the input_to_photon latency (see
+    // latency_probe.h); None stops measuring. Needs enable_decoding().
+    void set_latency_probe(const std::optional<ChangeSpec>& spec, double timeout) {
+        if (!decoder) {
+            throw std::runtime_error("Latency probing needs enable_decoding() first");
+        }
+        auto probe = spec ? std::make_shared<LatencyProbe>(*spec, static_cast<int64_t>(timeout * 1e9),
+                                                           metrics.input_to_photon)
+                          : nullptr;
+        {
+            std::lock_guard<std::mutex> lock(latency_mutex);
+            latency_probe = probe;
+            latency_state_valid = false;
+        }
+        decoder->set_latency_probe(std::move(probe));
+    }
+    
+    std::optional<ChangeSpec> get_latency_probe() const {
+        std::lock_guard<std::mutex> lock(latency_mutex);
+        return latency_probe ? std::optional<ChangeSpec>(latency_probe->spec()) : std::nullopt;
+    }
+    
+    // Evaluate a copy of `probes` on every decoded frame; later edits to
+    // the ProbeSet need another set_probes(). None removes them.
+    void set_probes(std::shared_ptr<ProbeSet> probes) {
+        std::lock_guard<std::mutex> lock(probe_mutex);
+        probe_set = probes ? std::make_shared<const ProbeSet>(*probes) : nullptr;
+        probes_active.store(probe_set != nullptr, std::memory_order_relaxed);
+        latest_probe_results.reset();
+        fired_probe_results.clear();
+    }
+    
+    std::shared_ptr<ProbeSet> get_probes() const {
+        std::lock_guard<std::mutex> lock(probe_mutex);
+        return probe_set ? std::make_shared<ProbeSet>(*probe_set) : nullptr;
+    }
+    
+    // Called as (results, sequence, timestamp_ns) for every probed frame,
+    // or only when a result moves with ProbeSet.on_change
+    void set_probe_callback(std::function<void(py::array_t<float>, uint64_t, int64_t)> callback) {
+        probe_callback = callback;
+    }
+    
+    // (results, sequence, timestamp_ns) of the last probed frame, or None
+    py::object latest_probes() const {
+        std::shared_ptr<const std::vector<float>> results;
+        uint64_t sequence;
+        int64_t timestamp_ns;
+        {
+            std::lock_guard<std::mutex> lock(probe_mutex);
+            results = latest_probe_results;
+            sequence = latest_probe_sequence;
+            timestamp_ns = latest_probe_timestamp_ns;
+        }
+        if (!results) {
+            return py::none();
+        }
+        return py::make_tuple(py::array_t<float>(static_cast<py::ssize_t>(results->size()), results->data()),
+                              sequence, timestamp_ns);
+    }
+    
+    DecodePolicy resolved_decode_policy() const {
+        DecodePolicy resolved = decode_policy;
+        if (resolved.source_fps <= 0.0 && session_initialized) {
+            resolved.source_fps = connect_info.video_profile.max_fps;
+        }
+        return resolved;
+    }
+    
+    // Demand probe for DecodePolicy.skip_unconsumed: a frame is wanted
+    // unless the only consumer is a full queue that would drop it anyway
+    bool frames_wanted() const {
+        if (frame_callback || mailbox || probes_active.load(std::memory_order_relaxed)) {
+            return true;
+        }
+        if (!frame_queue) {
+            return false;
+        }
+        return frame_queue->policy() != OverflowPolicy::DROP_NEWEST ||
+               frame_queue->size() < frame_queue->capacity();
+    }
+    
+    // Pull-based delivery: chiaki threads push into lock-free rings without
+    // the GIL and Python drains them with next_frame()/next_event()
+    bool enable_frame_queue(size_t capacity, OverflowPolicy overflow) {
+        if (session_started || capacity == 0) {
+            return false;
+        }
+        frame_queue = std::make_unique<SpscRing<VideoFrame>>(capacity, overflow);
+        return true;
+    }
+    
+    bool enable_event_queue(size_t capacity, OverflowPolicy overflow) {
+        if (session_started || capacity == 0) {
+            return false;
+        }
+        event_queue = std::make_unique<SpscRing<SessionEvent>>(capacity, overflow);
+        return true;
+    }
+    
+    // Latest-frame-only delivery for consumers that can't keep up
+    bool enable_mailbox() {
+        if (session_started) {
+            return false;
+        }
+        mailbox = std::make_unique<TripleBuffer<VideoFrame>>();
+        return true;
+    }
+    
+    // Never waits and never copies pixels: the caller gets a new VideoFrame
+    // handle sharing the front slot's refcounted buffer. The slot itself
+    // can't be handed out, since a later update() gives it back to the
+    // producer.
+    std::optional<VideoFrame> latest_frame() {
+        if (!mailbox) {
+            throw std::runtime_error("Mailbox not enabled; call enable_mailbox() first");
+        }
+        if (mailbox->update()) {
+            record_queue_wait(mailbox->front());
+        }
+        if (!mailbox->has_value()) {
+            return std::nullopt;
+        }
+        return mailbox->front();
+    }
+    
+    std::optional<VideoFrame> next_frame(std::optional<double> timeout) {
+        if (!frame_queue) {
+            throw std::runtime_error("Frame queue not enabled; call enable_frame_queue() first");
+        }
+        VideoFrame frame;
+        if (!wait_pop(*frame_queue, frame_notifier, frame, timeout)) {
+            return std::nullopt;
+        }
+        record_queue_wait(frame);
+        return frame;
+    }
+    
+    py::object next_event(std::optional<double> timeout) {
+        if (!event_queue) {
+            throw std::runtime_error("Event queue not enabled; call enable_event_queue() first");
+        }
+        SessionEvent event;
+        if (!wait_pop(*event_queue, event_notifier, event, timeout)) {
+            return py::none();
+        }
+        return session_event_to_python(event);
+    }
+    
+    // asyncio integration: the fds become readable once per arm_*() call
+    // when new data lands (see py_chiaki_ng.aio)
+    int frame_notify_fd() { return frame_notifier.fd(); }
+    int event_notify_fd() { return event_notifier.fd(); }
+    
+    bool arm_frame_notify() {
+        return frame_notifier.arm([this] {
+            return (frame_queue && !frame_queue->empty()) || (mailbox && mailbox->has_update());
+        });
+    }
+    
+    bool arm_event_notify() {
+        return event_notifier.arm([this] { return event_queue && !event_queue->empty(); });
+    }
+    
+    py::dict queue_stats() const {
+        py::dict stats;
+        if (frame_queue) {
+            stats["frames"] = ring_stats(*frame_queue);
+        }
+        if (event_queue) {
+            stats["events"] = ring_stats(*event_queue);
+        }
+        return stats;
+    }
+    
+    py::dict frame_pool_info() const {
+        py::dict info;
+        if (decoder) {
+            FramePool& pool = decoder->frame_pool();
+            info["slab_count"] = pool.slab_count();
+            info["slab_size"] = pool.slab_size();
+            info["free"] = pool.free_count();
+            info["misses"] = pool.misses();
+            
+            py::dict tap_pools;
+            for (const auto& tap : tap_specs) {
+                if (FramePool* tap_pool = decoder->tap_pool(tap.first)) {
+                    py::dict tap_info;
+                    tap_info["slab_size"] = tap_pool->slab_size();
+                    tap_info["free"] = tap_pool->free_count();
+                    tap_info["misses"] = tap_pool->misses();
+                    tap_pools[py::str(tap.first)] = tap_info;
+                }
+            }
+            info["taps"] = tap_pools;
+        }
+        return info;
+    }
+    
+    // Everything stats(), stats_array() and prometheus_metrics() report
+    MetricsSnapshot metrics_snapshot() const {
+        MetricsSnapshot snapshot = metrics.snapshot();
+        const ChiakiConnectVideoProfile& profile = connect_info.video_profile;
+        snapshot.add_gauge("video_width", "Requested stream width", session_initialized ? profile.width : 0, true);
+        snapshot.add_gauge("video_height", "Requested stream height", session_initialized ? profile.height : 0, true);
+        snapshot.add_gauge("video_max_fps", "Requested stream frame rate",
+                           session_initialized ? profile.max_fps : 0, true);
+        snapshot.add_gauge("video_bitrate_kbps", "Requested stream bitrate",
+                           session_initialized ? profile.bitrate : 0, true);
+        snapshot.add_gauge("video_codec", "Requested Codec: 0 H.264, 1 H.265, 2 H.265 HDR",
+                           session_initialized ? static_cast<double>(profile.codec) : 0.0, true);
+        snapshot.add_gauge("decode_backlog", "Samples queued for decoding",
+                           decode_strand ? static_cast<double>(decode_strand->queued()) : 0.0, true);
+        snapshot.add_gauge("frame_queue_depth", "Frames waiting in the frame queue",
+                           frame_queue ? static_cast<double>(frame_queue->size()) : 0.0, true);
+        snapshot.add_gauge("event_queue_depth", "Events waiting in the event queue",
+                           event_queue ? static_cast<double>(event_queue->size()) : 0.0, true);
         
-    // Video FPS presets
-    py::enum_<ChiakiVideoFPSPreset>(m, "VideoFPSPreset")
-        .value("PRESET_30", CHIAKI_VIDEO_FPS_PRESET_30)
-        .value("PRESET_60", CHIAKI_VIDEO_FPS_PRESET_60)
-        .export_values();
+        const VideoDecoder::Stats decode = decoder ? decoder->stats() : VideoDecoder::Stats();
+        snapshot.add_counter("pictures", "Pictures produced by libavcodec", decode.pictures);
+        snapshot.add_counter("frames_skipped", "Pictures the decode policy left unconverted", decode.skipped);
+        snapshot.add_counter("nonref_dropped", "Non-reference samples the decode policy never decoded",
+                             decode.nonref_dropped);
+        snapshot.add_counter("decoder_flushes", "Low-latency decoder resets after loss", decode.flushes);
+        snapshot.add_counter("keyframe_wait_dropped", "Samples dropped waiting for a keyframe after loss",
+                             decode.keyframe_wait_dropped);
+        snapshot.add_counter("frames_unchanged", "Pictures change detection held back before conversion",
+                             decode.unchanged);
+        const AudioDecoder::Stats audio_stats = audio_decoder ? audio_decoder->stats() : AudioDecoder::Stats();
+        snapshot.add_counter("audio_packets", "Opus packets received", audio_stats.packets);
+        snapshot.add_counter("audio_decode_errors", "Opus packets that failed to decode", audio_stats.decode_errors);
+        snapshot.add_counter("audio_frames", "PCM frames written to the audio buffer", audio_stats.frames);
+        snapshot.add_counter("audio_overruns", "PCM frames overwritten before they were read",
+                             audio_decoder ? audio_decoder->ring()->overruns() : 0);
+        const SharedFrameWriter::Stats shared = shared_frames ? shared_frames->stats() : SharedFrameWriter::Stats();
+        snapshot.add_counter("shared_frames_published", "Frames copied into the shared-memory ring",
+                             shared.published);
+        snapshot.add_counter("shared_frames_oversize", "Frames too large for a shared-memory ring slot",
+                             shared.oversize);
+        const MediaRecorder::Stats recording = last_media_recorder_stats();
+        snapshot.add_counter("recording_packets", "Video and audio packets remuxed into the container recording",
+                             recording.video_packets + recording.audio_packets);
+        snapshot.add_counter("recording_bytes", "Bytes written to the container recording", recording.bytes);
+        snapshot.add_counter("recording_dropped", "Packets dropped because the recording writer fell behind",
+                             recording.dropped);
+        snapshot.add_counter("recording_segments", "Files the container recording opened", recording.segments);
+        snapshot.add_counter("recording_errors", "Container recording open and write failures", recording.errors);
+        const LatencyProbe::Stats latency = latency_probe_stats();
+        snapshot.add_counter("latency_probe_inputs", "Controller sends that started a latency measurement",
+                             latency.inputs);
+        snapshot.add_counter("latency_probe_matched", "Latency measurements ended by the region changing",
+                             latency.matched);
+        snapshot.add_counter("latency_probe_timeouts", "Latency measurements with no change before the timeout",
+                             latency.timeouts);
+        snapshot.add_counter("latency_probe_ignored", "Controller sends while a latency measurement ran",
+                             latency.ignored);
+        snapshot.add_counter("latency_probe_unprompted", "Region changes with no latency measurement running",
+                             latency.unprompted);
+        snapshot.add_gauge("latency_probe_last_ns", "Latest input-to-photon latency; 0 before any",
+                           static_cast<double>(latency.last_ns), true);
+        const FlightRecorder::Stats flight = flight_recorder ? flight_recorder->stats() : FlightRecorder::Stats();
+        snapshot.add_gauge("flight_recorder_bytes", "Bytes the flight recorder holds", static_cast<double>(flight.used),
+                           true);
+        snapshot.add_gauge("flight_recorder_seconds", "Stream time the flight recorder holds",
+                           static_cast<double>(flight.duration_ns) / 1e9);
+        snapshot.add_counter("flight_recorder_dropped", "Samples the flight recorder dropped waiting for a keyframe",
+                             flight.dropped);
+        snapshot.add_counter("flight_recorder_dumps", "Flight recorder dumps written", flight.dumps);
+        snapshot.add_counter("flight_recorder_dump_errors", "Flight recorder dumps on error quit that failed",
+                             flight_dump_errors.load(std::memory_order_relaxed));
+        snapshot.add_counter("log_messages", "chiaki log messages queued for Python logging", logger->written());
+        snapshot.add_counter("log_dropped", "chiaki log messages dropped because the log ring was full",
+                             logger->dropped());
+        return snapshot;
+    }
+    
+    // Snapshot while streaming: counters, rates and queue depths, plus
+    // per-stage latency percentiles under "latency"
+    py::dict stats() const {
+        const MetricsSnapshot snapshot = metrics_snapshot();
+        py::dict result;
+        for (const MetricValue& value : snapshot.values) {
+            if (value.integer) {
+                result[py::str(value.name)] = static_cast<uint64_t>(value.value);
+            } else {
+                result[py::str(value.name)] = value.value;
+            }
+        }
+        py::dict latency;
+        for (const auto& entry : snapshot.latencies) {
+            const LatencyHistogram::Snapshot& histogram = entry.second;
+            py::dict summary;
+            summary["count"] = histogram.count;
+            summary["mean_ns"] = histogram.mean_ns();
+            summary["p50_ns"] = histogram.percentile(0.5);
+            summary["p90_ns"] = histogram.percentile(0.9);
+            summary["p99_ns"] = histogram.percentile(0.99);
+            summary["p999_ns"] = histogram.percentile(0.999);
+            summary["max_ns"] = histogram.max_ns;
+            latency[entry.first] = summary;
+        }
+        result["latency"] = latency;
+        return result;
+    }
+    
+    // The same snapshot flattened into one float64 numpy record, e.g. to
+    // append to a preallocated log array; latencies become
+    // <stage>_count/_mean_ns/_p50_ns/_p90_ns/_p99_ns/_p999_ns/_max_ns
+    py::array stats_array() const {
+        const MetricsSnapshot snapshot = metrics_snapshot();
+        std::vector<std::pair<std::string, double>> fields;
+        for (const MetricValue& value : snapshot.values) {
+            fields.emplace_back(value.name, value.value);
+        }
+        for (const auto& entry : snapshot.latencies) {
+            const std::string stage = entry.first;
+            const LatencyHistogram::Snapshot& histogram = entry.second;
+            fields.emplace_back(stage + "_count", static_cast<double>(histogram.count));
+            fields.emplace_back(stage + "_mean_ns", histogram.mean_ns());
+            fields.emplace_back(stage + "_p50_ns", static_cast<double>(histogram.percentile(0.5)));
+            fields.emplace_back(stage + "_p90_ns", static_cast<double>(histogram.percentile(0.9)));
+            fields.emplace_back(stage + "_p99_ns", static_cast<double>(histogram.percentile(0.99)));
+            fields.emplace_back(stage + "_p999_ns", static_cast<double>(histogram.percentile(0.999)));
+            fields.emplace_back(stage + "_max_ns", static_cast<double>(histogram.max_ns));
+        }
+        
+        py::list descr;
+        for (const auto& field : fields) {
+            descr.append(py::make_tuple(field.first, "<f8"));
+        }
+        py::array result(py::dtype::from_args(descr), std::vector<py::ssize_t>{1});
+        auto* values = static_cast<double*>(result.mutable_data());
+        for (size_t i = 0; i < fields.size(); i++) {
+            values[i] = fields[i].second;
+        }
+        return result;
+    }
+    
+    // Prometheus text format for a scrape endpoint; labels are added to
+    // every sample, e.g. {"bot": "lobby-3"}
+    std::string prometheus_metrics(const std::map<std::string, std::string>& labels,
+                                   const std::string& prefix) const {
+        return prometheus_text(prefix, {{prometheus_labels(labels), metrics_snapshot()}});
+    }
+    
+    static std::string prometheus_labels(const std::map<std::string, std::string>& labels) {
+        std::string result;
+        for (const auto& label : labels) {
+            std::string value;
+            for (char c : label.second) {
+                if (c == '\\' || c == '"') {
+                    value += '\\';
+                    value += c;
+                } else if (c == '\n') {
+                    value += "\\n";
+                } else {
+                    value += c;
+                }
+            }
+            result += (result.empty() ? "" : ",") + label.first + "=\"" + value + "\"";
+        }
+        return result;
+    }
+    
+    // Levels outside the mask are dropped by chiaki before formatting
+    void set_log_level(uint32_t mask) {
+        logger->set_level_mask(mask & CHIAKI_LOG_ALL);
+    }
+    
+    uint32_t log_level() const { return logger->level_mask(); }
+    
+    uint32_t log_id() const { return logger->id(); }
+    
+    // Counter deltas since the previous call (or since the session was
+    // created), for per-interval loss and throttling reports
+    py::dict interval_stats() {
+        IntervalSnapshot now;
+        now.samples = metrics.samples.load(std::memory_order_relaxed);
+        now.sample_bytes = metrics.sample_bytes.load(std::memory_order_relaxed);
+        now.frames_decoded = metrics.frames_decoded.load(std::memory_order_relaxed);
+        now.frames_lost = metrics.frames_lost.load(std::memory_order_relaxed);
+        now.frames_recovered = metrics.frames_recovered.load(std::memory_order_relaxed);
+        now.controller_sends = metrics.controller_sends.load(std::memory_order_relaxed);
+        if (decoder) {
+            const VideoDecoder::Stats decode = decoder->stats();
+            now.frames_skipped = decode.skipped;
+            now.nonref_dropped = decode.nonref_dropped;
+        }
+        now.time_ns = steady_now_ns();
+        
+        // A re-enabled decoder restarts its counters
+        auto delta = [](uint64_t current, uint64_t last) { return current >= last ? current - last : current; };
+        const int64_t interval_ns = std::max<int64_t>(now.time_ns - interval.time_ns, 1);
+        const uint64_t bytes = delta(now.sample_bytes, interval.sample_bytes);
+        py::dict result;
+        result["samples"] = delta(now.samples, interval.samples);
+        result["sample_bytes"] = bytes;
+        result["bitrate_bps"] = static_cast<double>(bytes) * 8e9 / static_cast<double>(interval_ns);
+        result["frames_decoded"] = delta(now.frames_decoded, interval.frames_decoded);
+        result["frames_skipped"] = delta(now.frames_skipped, interval.frames_skipped);
+        result["nonref_dropped"] = delta(now.nonref_dropped, interval.nonref_dropped);
+        result["frames_lost"] = delta(now.frames_lost, interval.frames_lost);
+        result["frames_recovered"] = delta(now.frames_recovered, interval.frames_recovered);
+        result["controller_sends"] = delta(now.controller_sends, interval.controller_sends);
+        result["interval_ns"] = interval_ns;
+        interval = now;
+        return result;
+    }
+    
+    // Tee raw samples and events into a recording for ReplaySession, or,
+    // for a .mkv/.mp4/.mov/.ts path or an explicit container, remux the
+    // encoded stream (and captured audio) into that container on a writer
+    // thread. Replaces any recording already running.
+    void start_recording(const std::string& path, const std::optional<std::string>& container,
+                         double segment_seconds, uint64_t segment_bytes, bool audio, size_t queue_bytes) {
+        if (!session_initialized) {
+            throw std::runtime_error("Session not initialized; the recording needs its codec");
+        }
+        if (segment_seconds < 0) {
+            throw std::invalid_argument("segment_seconds must not be negative");
+        }
+        std::shared_ptr<StreamRecorder> new_recorder;
+        std::shared_ptr<MediaRecorder> new_media;
+        if (container || is_media_recording_path(path)) {
+            if (queue_bytes == 0) {
+                throw std::invalid_argument("queue_bytes must be positive");
+            }
+            const ChiakiConnectVideoProfile& profile = connect_info.video_profile;
+            MediaRecorderConfig config;
+            config.hevc = profile.codec != CHIAKI_CODEC_H264;
+            config.hdr = profile.codec == CHIAKI_CODEC_H265_HDR;
+            config.width = static_cast<int>(profile.width);
+            config.height = static_cast<int>(profile.height);
+            config.fps = profile.max_fps > 0 ? static_cast<int>(profile.max_fps) : 60;
+            config.audio = audio && audio_decoder != nullptr;
+            config.format = container.value_or(std::string());
+            config.segment_ns = static_cast<int64_t>(segment_seconds * 1e9);
+            config.segment_bytes = segment_bytes;
+            config.queue_bytes = queue_bytes;
+            new_media = std::make_shared<MediaRecorder>(path, config);
+        } else {
+            if (segment_seconds > 0 || segment_bytes > 0) {
+                throw std::invalid_argument("Segmenting needs a container recording (.mkv, .mp4, .mov or .ts)");
+            }
+            new_recorder = std::make_shared<StreamRecorder>(path, connect_info.video_profile.codec);
+        }
+        std::shared_ptr<MediaRecorder> previous_media;
+        {
+            std::lock_guard<std::mutex> lock(recorder_mutex);
+            recorder = std::move(new_recorder);
+            previous_media = std::move(media_recorder);
+            last_media_recorder = new_media;
+            media_recorder = std::move(new_media);
+        }
+        if (previous_media) {
+            py::gil_scoped_release release;
+            previous_media->stop();
+        }
+    }
+    
+    void stop_recording() {
+        std::shared_ptr<StreamRecorder> finished;
+        std::shared_ptr<MediaRecorder> finished_media;
+        {
+            std::lock_guard<std::mutex> lock(recorder_mutex);
+            finished = std::move(recorder);
+            finished_media = std::move(media_recorder);
+        }
+        // Flushed and closed here, or by the last callback still writing
+        if (finished_media) {
+            py::gil_scoped_release release;
+            finished_media->stop();
+        }
+    }
+    
+    LatencyProbe::Stats latency_probe_stats() const {
+        std::lock_guard<std::mutex> lock(latency_mutex);
+        return latency_probe ? latency_probe->stats() : LatencyProbe::Stats();
+    }
+    
+    MediaRecorder::Stats last_media_recorder_stats() const {
+        std::lock_guard<std::mutex> lock(recorder_mutex);
+        return last_media_recorder ? last_media_recorder->stats() : MediaRecorder::Stats();
+    }
+    
+    bool is_recording() const {
+        std::lock_guard<std::mutex> lock(recorder_mutex);
+        return recorder != nullptr || (media_recorder != nullptr && !media_recorder->failed());
+    }
+    
+    // Files of the container recording, in order; kept after
+    // stop_recording() until the next recording starts
+    std::vector<std::string> recording_segments() const {
+        std::lock_guard<std::mutex> lock(recorder_mutex);
+        return last_media_recorder ? last_media_recorder->segments() : std::vector<std::string>();
+    }
+    
+    // Why the container recording stopped writing, or None
+    std::optional<std::string> recording_error() const {
+        std::lock_guard<std::mutex> lock(recorder_mutex);
+        const std::string error = last_media_recorder ? last_media_recorder->last_error() : std::string();
+        return error.empty() ? std::nullopt : std::optional<std::string>(error);
+    }
+    
+    bool send_controller_state(const ChiakiControllerState& state) {
+        if (input_scheduler) {
+            // Scheduled deltas keep applying on top of what was sent directly
+            input_scheduler->set_current_state(state);
+        }
+        return dispatch_controller_state(state);
+    }
+    
+    // Timed controller playback: one call queues a whole macro, applied by
+    // the scheduler thread at monotonic deadlines (see input_scheduler.h)
+    size_t schedule_inputs(const py::array& actions, std::optional<double> start, bool replace) {
+        const int64_t start_ns = start ? static_cast<int64_t>(*start * 1e9) : InputScheduler::now_ns();
+        std::vector<InputEvent> events = input_events_from_array(actions, start_ns);
+        const size_t count = events.size();
+        ensure_input_scheduler().schedule(std::move(events), replace);
+        return count;
+    }
+    
+    // Same, for full states from an (N, 17) CONTROLLER_LAYOUT matrix with
+    // offsets in seconds, e.g. a policy's planned action sequence
+    size_t schedule_states(const py::array_t<double, py::array::c_style | py::array::forcecast>& times,
+                           const py::array_t<float, py::array::c_style | py::array::forcecast>& states,
+                           bool normalized, std::optional<double> start, bool replace) {
+        if (states.ndim() != 2 || states.shape(1) != static_cast<py::ssize_t>(CONTROLLER_LAYOUT_SIZE)) {
+            throw std::invalid_argument("states must be an (N, 17) controller layout matrix");
+        }
+        if (times.ndim() != 1 || times.shape(0) != states.shape(0)) {
+            throw std::invalid_argument("times must hold one offset per state row");
+        }
+        
+        const int64_t start_ns = start ? static_cast<int64_t>(*start * 1e9) : InputScheduler::now_ns();
+        const size_t count = static_cast<size_t>(states.shape(0));
+        std::vector<InputEvent> events(count);
+        for (size_t i = 0; i < count; i++) {
+            events[i].deadline_ns = start_ns + static_cast<int64_t>(times.data()[i] * 1e9);
+            events[i].fields = INPUT_FIELD_ALL;
+            chiaki_controller_state_set_idle(&events[i].values);
+            controller_state_from_layout(events[i].values, states.data() + i * CONTROLLER_LAYOUT_SIZE, normalized);
+        }
+        ensure_input_scheduler().schedule(std::move(events), replace);
+        return count;
+    }
+    
+    void cancel_inputs() {
+        if (input_scheduler) {
+            input_scheduler->cancel();
+        }
+    }
+    
+    // Blocks with the GIL released until scheduled inputs were all sent
+    bool wait_inputs(std::optional<double> timeout) {
+        if (!input_scheduler) {
+            return true;
+        }
+        using Clock = std::chrono::steady_clock;
+        const auto slice = std::chrono::milliseconds(50);
+        const bool forever = !timeout || *timeout < 0;
+        const auto deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>(forever ? 0.0 : *timeout));
+        
+        for (;;) {
+            const auto now = Clock::now();
+            const auto wait = forever ? slice : std::min<Clock::duration>(slice, deadline - now);
+            bool idle;
+            {
+                py::gil_scoped_release release;
+                idle = input_scheduler->wait_idle(std::max<Clock::duration>(wait, Clock::duration::zero()));
+            }
+            if (idle) {
+                return true;
+            }
+            if (PyErr_CheckSignals() != 0) {
+                throw py::error_already_set();
+            }
+            if (!forever && Clock::now() >= deadline) {
+                return false;
+            }
+        }
+    }
+    
+    void set_input_rate(double rate_hz) {
+        input_rate_hz = rate_hz;
+        if (input_scheduler) {
+            input_scheduler->set_rate(rate_hz);
+        }
+    }
+    
+    double get_input_rate() const { return input_rate_hz; }
+    
+    py::dict input_stats() const {
+        py::dict result;
+        const InputScheduler::Stats stats = input_scheduler ? input_scheduler->stats() : InputScheduler::Stats();
+        result["scheduled"] = stats.scheduled;
+        result["applied"] = stats.applied;
+        result["sends"] = stats.sends;
+        result["coalesced"] = stats.coalesced;
+        result["deferred"] = stats.deferred;
+        result["max_late_ns"] = stats.max_late_ns;
+        result["pending"] = stats.pending;
+        return result;
+    }
+
+protected:
+    // Hands a state to chiaki; the single exit for direct and scheduled input
+    virtual bool deliver_controller_state(const ChiakiControllerState& state) {
+        if (!session_initialized) {
+            return false;
+        }
+        
+        const int64_t start_ns = steady_now_ns();
+        ChiakiErrorCode err = chiaki_session_set_controller_state(&session, 
+                                                                const_cast<ChiakiControllerState*>(&state));
+        metrics.controller_send.record(steady_now_ns() - start_ns);
+        metrics.controller_sends.fetch_add(1, std::memory_order_relaxed);
+        if (err != CHIAKI_ERR_SUCCESS) {
+            metrics.controller_send_failures.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        return true;
+    }
+    
+    // Every send, direct or scheduled; states that differ from the last
+    // one are what a latency probe times, and the flight recorder keeps
+    // them all
+    bool dispatch_controller_state(const ChiakiControllerState& state) {
+        const int64_t sent_ns = steady_now_ns();
+        if (!deliver_controller_state(state)) {
+            return false;
+        }
+        if (flight_recorder) {
+            float layout[CONTROLLER_LAYOUT_SIZE];
+            controller_state_to_layout(state, layout, false);
+            flight_recorder->add_controller_state(layout, sent_ns);
+        }
+        std::lock_guard<std::mutex> lock(latency_mutex);
+        if (latency_probe) {
+            ChiakiControllerState sent = state;
+            if (!latency_state_valid || !chiaki_controller_state_equals(&latency_state, &sent)) {
+                latency_probe->on_input(sent_ns);
+            }
+            latency_state = sent;
+            latency_state_valid = true;
+        }
+        return true;
+    }
+    
+    // Teardown without the GIL: chiaki's threads may post samples to the
+    // decode strand and call into the decoder until they are joined, so
+    // they go first
+    void stop_threads() {
+        if (session_initialized && session_started) {
+            chiaki_session_stop(&session);
+            if (!session_joined) {
+                chiaki_session_join(&session);
+                session_joined = true;
+            }
+        }
+        if (decode_strand) {
+            decode_strand->shutdown();
+        }
+    }
+    
+    InputScheduler& ensure_input_scheduler() {
+        if (!input_scheduler) {
+            input_scheduler = std::make_unique<InputScheduler>(
+                [this](const ChiakiControllerState& state) { return dispatch_controller_state(state); },
+                input_rate_hz);
+        }
+        return *input_scheduler;
+    }
+    
+
+    ChiakiSession session;
+    ChiakiConnectInfo connect_info;
+    std::string host_name;
+    SessionConfig session_config;
+    std::unique_ptr<SessionLog> logger;
+    bool session_initialized = false;
+    bool session_started = false;
+    bool session_joined = false;  // chiaki's session thread has been joined
+    
+    std::unique_ptr<VideoDecoder> decoder;
+    std::unique_ptr<AudioDecoder> audio_decoder;
+    std::shared_ptr<FlightRecorder> flight_recorder;  // set before the session starts
+    std::string flight_dump_path;
+    std::atomic<uint64_t> flight_dump_errors{0};
+    std::shared_ptr<SharedFrameWriter> shared_frames;
+    VideoDecoder::TapSpecs tap_specs;
+    DecodePolicy decode_policy;
+    std::optional<ChangeSpec> change_spec;
+    
+    // set_latency_probe(); the decoder holds the same probe
+    mutable std::mutex latency_mutex;
+    std::shared_ptr<LatencyProbe> latency_probe;
+    ChiakiControllerState latency_state;  // last state sent while probing
+    bool latency_state_valid = false;
+    
+    // Probes from set_probes(); the set is replaced whole, never edited
+    mutable std::mutex probe_mutex;
+    std::shared_ptr<const ProbeSet> probe_set;
+    std::atomic<bool> probes_active{false};
+    std::shared_ptr<const std::vector<float>> latest_probe_results;
+    uint64_t latest_probe_sequence = 0;
+    int64_t latest_probe_timestamp_ns = 0;
+    std::vector<float> fired_probe_results;  // last results the callback saw
+    std::function<void(py::array_t<float>, uint64_t, int64_t)> probe_callback;  // GIL held
+    FramePool sample_pool{VideoDecoder::DEFAULT_POOL_SLABS};
+    std::unique_ptr<Strand> decode_strand;
+    std::atomic<bool> decode_recovery_wanted{false};  // set on the strand, reported by the video thread
+    int32_t decode_dropped_lost = 0;                  // video thread only; frames dropped before the strand
+    SessionMetrics metrics;
+    IntervalSnapshot interval{0, 0, 0, 0, 0, 0, 0, 0, steady_now_ns()};
+    
+    mutable std::mutex recorder_mutex;
+    std::shared_ptr<StreamRecorder> recorder;
+    std::shared_ptr<MediaRecorder> media_recorder;
+    std::shared_ptr<MediaRecorder> last_media_recorder;  // still reported after stop_recording()
+    
+    std::unique_ptr<InputScheduler> input_scheduler;
+    double input_rate_hz = InputScheduler::DEFAULT_RATE_HZ;
+    
+    std::unique_ptr<SpscRing<VideoFrame>> frame_queue;
+    std::unique_ptr<SpscRing<SessionEvent>> event_queue;
+    std::atomic<uint32_t> event_mask{EVENT_MASK_ALL};
+    Notifier frame_notifier;
+    Notifier event_notifier;
+    std::unique_ptr<TripleBuffer<VideoFrame>> mailbox;
+    
+    // Capture info of the sample currently on the video thread, and of the
+    // one currently being decoded (they differ when decoding on the pool)
+    uint64_t sample_sequence = 0;
+    int64_t sample_timestamp_ns = 0;
+    uint64_t decode_sequence = 0;
+    int64_t decode_timestamp_ns = 0;
+    int64_t decode_start_ns = 0;
+    
+    std::function<bool(py::bytes, size_t, int32_t, bool)> video_callback;
+    std::function<void(py::object)> event_callback;
+    std::function<void(VideoFrame)> frame_callback;
+    
+    static bool video_sample_callback(uint8_t* buf, size_t buf_size, int32_t frames_lost, 
+                                     bool frame_recovered, void* user) {
+        auto* wrapper = static_cast<SessionWrapper*>(user);
+        bool accepted = true; // Default: accept all frames
+        
+        wrapper->sample_sequence += 1 + static_cast<uint64_t>(std::max<int32_t>(frames_lost, 0));
+        wrapper->sample_timestamp_ns = steady_now_ns();
+        
+        SessionMetrics& metrics = wrapper->metrics;
+        metrics.samples.fetch_add(1, std::memory_order_relaxed);
+        metrics.sample_bytes.fetch_add(buf_size, std::memory_order_relaxed);
+        metrics.frames_lost.fetch_add(static_cast<uint64_t>(std::max<int32_t>(frames_lost, 0)),
+                                       std::memory_order_relaxed);
+        if (frame_recovered) {
+            metrics.frames_recovered.fetch_add(1, std::memory_order_relaxed);
+        }
+        
+        if (auto active = wrapper->active_recorder()) {
+            active->write_sample(buf, buf_size, frames_lost, frame_recovered, wrapper->sample_timestamp_ns);
+        }
+        if (auto media = wrapper->active_media_recorder()) {
+            media->write_video(buf, buf_size, wrapper->sample_timestamp_ns);
+        }
+        if (wrapper->flight_recorder) {
+            wrapper->flight_recorder->add_sample(buf, buf_size, frames_lost, frame_recovered,
+                                                 wrapper->sample_timestamp_ns);
+        }
+        
+        if (wrapper->shared_frames && !wrapper->decoder) {
+            SharedFrameInfo info = {};
+            info.sequence = wrapper->sample_sequence;
+            info.timestamp_ns = wrapper->sample_timestamp_ns;
+            info.size = buf_size;
+            info.pixel_format = static_cast<int32_t>(PixelFormat::ENCODED);
+            info.frames_lost = frames_lost;
+            info.frame_recovered = frame_recovered ? 1 : 0;
+            info.change_score = -1.0f;
+            wrapper->shared_frames->publish(buf, info);
+        }
+        
+        if ((wrapper->frame_queue || wrapper->mailbox) && !wrapper->decoder) {
+            // Not decoding: deliver the encoded sample itself
+            FrameBufferRef sample = wrapper->sample_pool.acquire(buf_size);
+            memcpy(sample.data(), buf, buf_size);
+            VideoFrame frame(std::move(sample), buf_size, 0, 0, PixelFormat::ENCODED);
+            frame.set_loss_info(frames_lost, frame_recovered);
+            frame.set_capture_info(wrapper->sample_sequence, wrapper->sample_timestamp_ns);
+            wrapper->publish_frame(std::move(frame));
+        }
+        
+        if (wrapper->video_callback) {
+            py::gil_scoped_acquire gil;
+            py::bytes data(reinterpret_cast<char*>(buf), buf_size);
+            try {
+                accepted = wrapper->video_callback(data, buf_size, frames_lost, frame_recovered);
+            } catch (py::error_already_set& e) {
+                // Never let a Python exception unwind into chiaki's C threads;
+                // treat the sample as lost so chiaki asks for a recovery frame
+                e.discard_as_unraisable("py_chiaki_ng video callback");
+                accepted = false;
+            }
+        }
+        
+        if (wrapper->decoder && wrapper->decode_strand) {
+            accepted = wrapper->post_sample(buf, buf_size, frames_lost, frame_recovered) && accepted;
+        } else if (wrapper->decoder) {
+            wrapper->decode_sequence = wrapper->sample_sequence;
+            wrapper->decode_timestamp_ns = wrapper->sample_timestamp_ns;
+            wrapper->decode_start_ns = steady_now_ns();
+            accepted = wrapper->decoder->push_sample(buf, buf_size, frames_lost, frame_recovered) && accepted;
+        }
+        return accepted;
+    }
+    
+    // Copies a sample and queues its decode on this session's strand. Once
+    // the backlog exceeds the frame pool the sample is dropped and false is
+    // returned, so chiaki asks the console for a recovery frame. The decoder
+    // only runs later, so when it rejects a sample (LOW_LATENCY waiting for
+    // a keyframe) the request goes out with the next sample instead.
+    bool post_sample(const uint8_t* buf, size_t buf_size, int32_t frames_lost, bool frame_recovered) {
+        const bool recovery_wanted = decode_recovery_wanted.exchange(false, std::memory_order_relaxed);
+        if (decode_strand->queued() >= decoder->frame_pool().slab_count()) {
+            metrics.decode_dropped.fetch_add(1, std::memory_order_relaxed);
+            // The decoder never sees this sample; report it with the next one
+            decode_dropped_lost += 1 + std::max<int32_t>(frames_lost, 0);
+            return false;
+        }
+        frames_lost = std::max<int32_t>(frames_lost, 0) + decode_dropped_lost;
+        decode_dropped_lost = 0;
+        
+        // FFmpeg's parser may read past the end, keep chiaki's zeroed padding
+        FrameBufferRef sample = sample_pool.acquire(buf_size + CHIAKI_VIDEO_BUFFER_PADDING_SIZE);
+        memcpy(sample.data(), buf, buf_size);
+        memset(sample.data() + buf_size, 0, CHIAKI_VIDEO_BUFFER_PADDING_SIZE);
+        
+        const uint64_t sequence = sample_sequence;
+        const int64_t timestamp_ns = sample_timestamp_ns;
+        decode_strand->post([this, sample, buf_size, frames_lost, frame_recovered, sequence, timestamp_ns] {
+            decode_sequence = sequence;
+            decode_timestamp_ns = timestamp_ns;
+            decode_start_ns = steady_now_ns();
+            metrics.decode_queue.record(decode_start_ns - timestamp_ns);
+            if (!decoder->push_sample(sample.data(), buf_size, frames_lost, frame_recovered)) {
+                decode_recovery_wanted.store(true, std::memory_order_relaxed);
+            }
+        });
+        return !recovery_wanted;
+    }
+    
+    // Runs on the decoding thread (chiaki video thread or pool worker) once
+    // a sample has been decoded
+    void deliver_frame(VideoFrame&& frame) {
+        metrics.frames_decoded.fetch_add(1, std::memory_order_relaxed);
+        frame.set_capture_info(decode_sequence, decode_timestamp_ns);
+        run_probes(frame);
+        if (shared_frames) {
+            shared_frames->publish(frame);
+        }
+        // With frame threading the picture may be from an earlier sample,
+        // so decode time then includes the codec's frame delay
+        metrics.decode.record(frame.decoded_ns() - decode_start_ns);
+        metrics.convert.record(frame.ready_ns() - frame.decoded_ns());
+        if (!frame_callback) {
+            publish_frame(std::move(frame));
+            return;
+        }
+        if (frame_queue || mailbox) {
+            publish_frame(VideoFrame(frame));
+        }
+        
+        const int64_t ready_ns = frame.ready_ns();
+        py::gil_scoped_acquire gil;
+        const int64_t entered_ns = steady_now_ns();
+        metrics.callback_wait.record(entered_ns - ready_ns);
+        metrics.frame_callbacks.fetch_add(1, std::memory_order_relaxed);
+        try {
+            frame_callback(std::move(frame));
+        } catch (py::error_already_set& e) {
+            // Never let a Python exception unwind into chiaki's C threads
+            e.discard_as_unraisable("py_chiaki_ng frame callback");
+        }
+        metrics.callback.record(steady_now_ns() - entered_ns);
+    }
+    
+    // Evaluates the probe set on the decode thread and attaches the
+    // results; Python only runs if the callback is due
+    void run_probes(VideoFrame& frame) {
+        std::shared_ptr<const ProbeSet> probes;
+        {
+            std::lock_guard<std::mutex> lock(probe_mutex);
+            probes = probe_set;
+        }
+        if (!probes) {
+            return;
+        }
+        const int64_t start_ns = steady_now_ns();
+        auto results = std::make_shared<std::vector<float>>(probes->size());
+        probes->evaluate(frame, results->data());
+        metrics.probe.record(steady_now_ns() - start_ns);
+        frame.set_probes(results);
+        
+        bool fire = false;
+        {
+            std::lock_guard<std::mutex> lock(probe_mutex);
+            if (probe_set != probes) {
+                return; // Replaced while evaluating
+            }
+            latest_probe_results = results;
+            latest_probe_sequence = frame.sequence();
+            latest_probe_timestamp_ns = frame.timestamp_ns();
+            if (probe_callback) {
+                fire = !probes->on_change || fired_probe_results.size() != results->size() ||
+                       probes->changed(fired_probe_results.data(), results->data());
+                if (fire && probes->on_change) {
+                    fired_probe_results = *results;
+                }
+            }
+        }
+        if (!fire) {
+            return;
+        }
+        py::gil_scoped_acquire gil;
+        metrics.probe_callbacks.fetch_add(1, std::memory_order_relaxed);
+        try {
+            probe_callback(py::array_t<float>(static_cast<py::ssize_t>(results->size()), results->data()),
+                           frame.sequence(), frame.timestamp_ns());
+        } catch (py::error_already_set& e) {
+            e.discard_as_unraisable("py_chiaki_ng probe callback");
+        }
+    }
+    
+    // Frames that were never decoded count from their arrival
+    void record_queue_wait(const VideoFrame& frame) {
+        const int64_t ready_ns = frame.ready_ns() ? frame.ready_ns() : frame.timestamp_ns();
+        metrics.queue_wait.record(steady_now_ns() - ready_ns);
+    }
+    
+    // Hands a frame to the GIL-free consumers (mailbox and/or queue)
+    void publish_frame(VideoFrame&& frame) {
+        if (mailbox) {
+            mailbox->publish(frame);
+        }
+        if (frame_queue) {
+            frame_queue->push(std::move(frame));
+        }
+        frame_notifier.notify();
+    }
+    
+    static void event_callback_wrapper(ChiakiEvent* event, void* user) {
+        auto* wrapper = static_cast<SessionWrapper*>(user);
+        
+        const int64_t timestamp_ns = steady_now_ns();
+        
+        // Recordings keep every event, whatever Python filters out
+        if (auto active = wrapper->active_recorder()) {
+            const bool quit = event->type == CHIAKI_EVENT_QUIT;
+            const char* reason_str = quit ? event->quit.reason_str : nullptr;
+            active->write_event(event->type, quit ? event->quit.reason : CHIAKI_QUIT_REASON_NONE,
+                                reason_str ? reason_str : "", timestamp_ns);
+        }
+        if (wrapper->flight_recorder) {
+            wrapper->flight_record_event(*event, timestamp_ns);
+        }
+        
+        if (event->type != CHIAKI_EVENT_QUIT &&
+            !(wrapper->event_mask.load(std::memory_order_relaxed) & event_type_bit(event->type))) {
+            wrapper->metrics.events_filtered.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        wrapper->metrics.events.fetch_add(1, std::memory_order_relaxed);
+        const SessionEvent record = SessionEvent::from_chiaki(*event, timestamp_ns);
+        
+        if (wrapper->event_queue) {
+            wrapper->event_queue->push(record);
+            wrapper->event_notifier.notify();
+        }
+        
+        if (wrapper->event_callback) {
+            py::gil_scoped_acquire gil;
+            try {
+                wrapper->event_callback(session_event_to_python(record));
+            } catch (py::error_already_set& e) {
+                e.discard_as_unraisable("py_chiaki_ng event callback");
+            }
+        }
+    }
+    
+    // Also dumps on an error quit, before Python hears of the QUIT
+    void flight_record_event(const ChiakiEvent& event, int64_t timestamp_ns) {
+        const bool quit = event.type == CHIAKI_EVENT_QUIT;
+        const char* reason_str = quit ? event.quit.reason_str : nullptr;
+        flight_recorder->add_event(event.type, quit ? event.quit.reason : CHIAKI_QUIT_REASON_NONE,
+                                   reason_str ? reason_str : "", timestamp_ns);
+        if (quit && !flight_dump_path.empty() && chiaki_quit_reason_is_error(event.quit.reason)) {
+            try {
+                flight_recorder->dump(flight_dump_path);
+            } catch (const std::exception&) {
+                flight_dump_errors.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    }
+    
+    std::shared_ptr<StreamRecorder> active_recorder() {
+        std::lock_guard<std::mutex> lock(recorder_mutex);
+        return recorder;
+    }
+    
+    std::shared_ptr<MediaRecorder> active_media_recorder() {
+        std::lock_guard<std::mutex> lock(recorder_mutex);
+        return media_recorder;
+    }
+    
+    // Same clock as Python's time.monotonic_ns()
+    static int64_t steady_now_ns() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+    
+    template <typename T>
+    static py::dict ring_stats(const SpscRing<T>& ring) {
+        py::dict stats;
+        stats["capacity"] = ring.capacity();
+        stats["size"] = ring.size();
+        stats["pushed"] = ring.pushed();
+        stats["dropped"] = ring.dropped();
+        stats["overflow"] = ring.policy();
+        return stats;
+    }
+    
+    // Pops from a ring, blocking up to timeout seconds (None: forever) with
+    // the GIL released. Wakes periodically so Ctrl-C still works.
+    template <typename T>
+    static bool wait_pop(SpscRing<T>& ring, Notifier& notifier, T& out, std::optional<double> timeout) {
+        using Clock = std::chrono::steady_clock;
+        const auto slice = std::chrono::milliseconds(50);
+        const bool forever = !timeout || *timeout < 0;
+        const auto deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>(forever ? 0.0 : *timeout));
+        
+        while (!ring.try_pop(out)) {
+            const auto now = Clock::now();
+            if (!forever && now >= deadline) {
+                return false;
+            }
+            {
+                py::gil_scoped_release release;
+                const auto wait = forever ? slice : std::min<Clock::duration>(slice, deadline - now);
+                notifier.wait_for([&ring] { return !ring.empty(); }, wait);
+            }
+            if (PyErr_CheckSignals() != 0) {
+                throw py::error_already_set();
+            }
+        }
+        return true;
+    }
+};
+
+// Plays a recording back through the same callback path as a live session,
+// so queues, decoding, recording and stats behave exactly as they would
+// with a console attached. Controller input is accepted and discarded.
+class ReplaySession : public SessionWrapper {
+public:
+    ReplaySession(const std::string& path, bool realtime, bool loop,
+                  std::shared_ptr<WorkStealingPool> decode_pool = nullptr)
+        : SessionWrapper(std::move(decode_pool)),
+          recording(std::make_unique<StreamRecording>(path)),
+          realtime(realtime), loop(loop) {}
+    
+    ~ReplaySession() override {
+        // Its sink calls our deliver_controller_state(), stop it while we exist
+        input_scheduler.reset();
+        if (PyGILState_Check()) {
+            py::gil_scoped_release release;
+            ReplaySession::stop();
+            ReplaySession::join();
+        } else {
+            ReplaySession::stop();
+            ReplaySession::join();
+        }
+        // There is no chiaki session for the base class to tear down
+        session_initialized = false;
+    }
+    
+    // host and regist_key are accepted for API compatibility and ignored;
+    // the codec always comes from the recording
+    bool initialize(const std::string&, const std::string&, const SessionConfig& config) override {
+        if (session_initialized) {
+            return false;
+        }
+        session_config = config;
+        session_config.codec = static_cast<ChiakiCodec>(recording->codec());
+        session_config.validate();
+        memset(&connect_info, 0, sizeof(connect_info));
+        connect_info.ps5 = session_config.ps5;
+        connect_info.video_profile = session_config.video_profile();
+        session_initialized = true;
+        return true;
+    }
+    
+    bool start() override {
+        if (!session_initialized || session_started) {
+            return false;
+        }
+        stop_requested = false;
+        replay_thread = std::thread(&ReplaySession::run, this);
+        session_started = true;
+        return true;
+    }
+    
+    bool stop() override {
+        if (!session_initialized) {
+            return false;
+        }
+        {
+            std::lock_guard<std::mutex> lock(pace_mutex);
+            stop_requested = true;
+        }
+        pace_cond.notify_all();
+        return true;
+    }
+    
+    bool join() override {
+        if (!session_initialized) {
+            return false;
+        }
+        if (replay_thread.joinable()) {
+            replay_thread.join();
+        }
+        return true;
+    }
+    
+    size_t sample_count() const { return recording->sample_count(); }
+    size_t event_count() const { return recording->event_count(); }
+    size_t controller_state_count() const { return recording->controller_state_count(); }
+    
+    // (timestamps_ns, states) of the controller states a flight recorder
+    // dump holds: int64 (N,) and float32 (N, 17) in CONTROLLER_LAYOUT raw units
+    py::tuple controller_states() const {
+        const auto count = static_cast<py::ssize_t>(recording->controller_state_count());
+        py::array_t<int64_t> timestamps(count);
+        py::array_t<float> states({count, static_cast<py::ssize_t>(CONTROLLER_LAYOUT_SIZE)});
+        int64_t* timestamp_out = timestamps.mutable_data();
+        float* state_out = states.mutable_data();
+        for (const RecordView& record : recording->records()) {
+            if (record.kind == RecordKind::CONTROLLER_STATE) {
+                *timestamp_out++ = record.timestamp_ns;
+                memcpy(state_out, record.payload, RECORDED_CONTROLLER_STATE_SIZE);
+                state_out += CONTROLLER_LAYOUT_SIZE;
+            }
+        }
+        return py::make_tuple(timestamps, states);
+    }
+    int64_t duration_ns() const { return recording->duration_ns(); }
+    bool is_realtime() const { return realtime; }
+    bool is_looping() const { return loop; }
+
+private:
+    using Clock = std::chrono::steady_clock;
+    
+    std::unique_ptr<StreamRecording> recording;
+    const bool realtime;
+    const bool loop;
+    
+    std::thread replay_thread;
+    std::mutex pace_mutex;
+    std::condition_variable pace_cond;
+    bool stop_requested = false;
+    
+    // Sleeps until the deadline; false if stop() came first
+    bool wait_until(Clock::time_point deadline) {
+        std::unique_lock<std::mutex> lock(pace_mutex);
+        return !pace_cond.wait_until(lock, deadline, [this] { return stop_requested; });
+    }
+    
+    bool stopping() {
+        std::lock_guard<std::mutex> lock(pace_mutex);
+        return stop_requested;
+    }
+    
+    void wait_for_stop() {
+        std::unique_lock<std::mutex> lock(pace_mutex);
+        pace_cond.wait(lock, [this] { return stop_requested; });
+    }
+    
+    bool deliver_controller_state(const ChiakiControllerState&) override {
+        if (session_initialized) {
+            metrics.controller_sends.fetch_add(1, std::memory_order_relaxed);
+        }
+        return session_initialized;
+    }
+    
+    void run() {
+        const auto& records = recording->records();
+        std::vector<uint8_t> sample;
+        bool quit_sent = false;
+        
+        // Looping a recording with nothing to play (empty, or only
+        // controller states) would spin a core; idle until stop() instead
+        if (loop && recording->sample_count() == 0 && recording->event_count() == 0) {
+            wait_for_stop();
+        }
+        
+        do {
+            const auto pass_start = Clock::now();
+            const int64_t first_ns = records.empty() ? 0 : records.front().timestamp_ns;
+            
+            for (const RecordView& record : records) {
+                if (realtime) {
+                    if (!wait_until(pass_start + std::chrono::nanoseconds(record.timestamp_ns - first_ns))) {
+                        break;
+                    }
+                } else if (stopping()) {
+                    break;
+                }
+                
+                if (record.kind == RecordKind::CONTROLLER_STATE) {
+                    continue; // Read with controller_states()
+                }
+                if (record.kind == RecordKind::VIDEO_SAMPLE) {
+                    // The decoder expects chiaki's zeroed padding after the sample
+                    sample.assign(record.payload, record.payload + record.size);
+                    sample.resize(record.size + CHIAKI_VIDEO_BUFFER_PADDING_SIZE, 0);
+                    video_sample_callback(sample.data(), record.size, record.frames_lost,
+                                          record.frame_recovered, this);
+                } else {
+                    RecordedEvent recorded;
+                    memcpy(&recorded, record.payload, sizeof(recorded));
+                    if (recorded.type == CHIAKI_EVENT_QUIT && loop) {
+                        continue; // Session only ends on stop() when looping
+                    }
+                    replay_event(recorded, record);
+                    quit_sent = quit_sent || recorded.type == CHIAKI_EVENT_QUIT;
+                }
+            }
+        } while (loop && !stopping());
+        
+        // A live session always ends with a QUIT event
+        if (!quit_sent) {
+            ChiakiEvent event;
+            memset(&event, 0, sizeof(event));
+            event.type = CHIAKI_EVENT_QUIT;
+            event.quit.reason = CHIAKI_QUIT_REASON_STOPPED;
+            event_callback_wrapper(&event, this);
+        }
+    }
+    
+    void replay_event(const RecordedEvent& recorded, const RecordView& record) {
+        const std::string reason_str(reinterpret_cast<const char*>(record.payload) + sizeof(recorded),
+                                     record.size - sizeof(recorded));
+        ChiakiEvent event;
+        memset(&event, 0, sizeof(event));
+        event.type = static_cast<ChiakiEventType>(recorded.type);
+        if (event.type == CHIAKI_EVENT_QUIT) {
+            event.quit.reason = static_cast<ChiakiQuitReason>(recorded.quit_reason);
+            event.quit.reason_str = reason_str.empty() ? nullptr : reason_str.c_str();
+        }
+        event_callback_wrapper(&event, this);
+    }
+};
+
+// Owns many sessions that share one decode pool sized to the machine, so
+// driving 8+ consoles doesn't mean 8+ sets of decoder threads
+class SessionPool {
+public:
+    explicit SessionPool(size_t threads)
+        : decode_pool(std::make_shared<WorkStealingPool>(threads)) {}
+    
+    SessionWrapper& create_session() {
+        sessions.push_back(std::make_unique<SessionWrapper>(decode_pool));
+        return *sessions.back();
+    }
+    
+    ReplaySession& create_replay_session(const std::string& path, bool realtime, bool loop) {
+        auto replay = std::make_unique<ReplaySession>(path, realtime, loop, decode_pool);
+        ReplaySession& result = *replay;
+        sessions.push_back(std::move(replay));
+        return result;
+    }
+    
+    size_t size() const { return sessions.size(); }
+    
+    SessionWrapper& get(size_t index) {
+        if (index >= sessions.size()) {
+            throw py::index_error("session index out of range");
+        }
+        return *sessions[index];
+    }
+    
+    void stop_all() {
+        for (auto& session : sessions) {
+            session->stop();
+        }
+    }
+    
+    void join_all() {
+        for (auto& session : sessions) {
+            session->join();
+        }
+    }
+    
+    py::dict stats() const {
+        py::dict result;
+        result["threads"] = decode_pool->thread_count();
+        result["pending"] = decode_pool->pending();
+        result["executed"] = decode_pool->executed();
+        result["steals"] = decode_pool->steals();
+        
+        py::list per_session;
+        for (const auto& session : sessions) {
+            per_session.append(session->stats());
+        }
+        result["sessions"] = per_session;
+        return result;
+    }
+    
+    // All sessions in one scrape, told apart by a session="<index>" label
+    std::string prometheus_metrics(const std::map<std::string, std::string>& labels,
+                                   const std::string& prefix) const {
+        std::vector<std::pair<std::string, MetricsSnapshot>> snapshots;
+        for (size_t i = 0; i < sessions.size(); i++) {
+            std::map<std::string, std::string> session_labels = labels;
+            session_labels["session"] = std::to_string(i);
+            snapshots.emplace_back(SessionWrapper::prometheus_labels(session_labels),
+                                   sessions[i]->metrics_snapshot());
+        }
+        return prometheus_text(prefix, snapshots);
+    }
+
+private:
+    // Declared first so the sessions (and their strands) go away before it
+    std::shared_ptr<WorkStealingPool> decode_pool;
+    std::vector<std::unique_ptr<SessionWrapper>> sessions;
+};
+
+void init_session_binding(py::module& m) {
+    // Video resolution presets
+    py::enum_<ChiakiVideoResolutionPreset>(m, "VideoResolutionPreset")
+        .value("PRESET_360p", CHIAKI_VIDEO_RESOLUTION_PRESET_360p)
+        .value("PRESET_540p", CHIAKI_VIDEO_RESOLUTION_PRESET_540p) 
+        .value("PRESET_720p", CHIAKI_VIDEO_RESOLUTION_PRESET_720p)
+        .value("PRESET_1080p", CHIAKI_VIDEO_RESOLUTION_PRESET_1080p)
+        .export_values();
+        
+    // Video FPS presets
+    py::enum_<ChiakiVideoFPSPreset>(m, "VideoFPSPreset")
+        .value("PRESET_30", CHIAKI_VIDEO_FPS_PRESET_30)
+        .value("PRESET_60", CHIAKI_VIDEO_FPS_PRESET_60)
+        .export_values();
+    
+    // Field masks for the optional "mask" column of schedule_inputs()
+    py::enum_<InputField>(m, "InputField", py::arithmetic())
+        .value("BUTTONS", INPUT_FIELD_BUTTONS)
+        .value("L2", INPUT_FIELD_L2)
+        .value("R2", INPUT_FIELD_R2)
+        .value("LEFT_X", INPUT_FIELD_LEFT_X)
+        .value("LEFT_Y", INPUT_FIELD_LEFT_Y)
+        .value("RIGHT_X", INPUT_FIELD_RIGHT_X)
+        .value("RIGHT_Y", INPUT_FIELD_RIGHT_Y)
+        .value("MOTION", INPUT_FIELD_MOTION)
+        .value("ALL", INPUT_FIELD_ALL);
+    
+    // Default structured dtype for schedule_inputs(); columns may be omitted.
+    // Motion columns (gyro_*, accel_*, orient_*, float32) are accepted too
+    // but left out here so zeroed rows don't send a null orientation.
+    py::list input_columns;
+    input_columns.append(py::make_tuple("t", "<f8"));
+    input_columns.append(py::make_tuple("buttons", "<u4"));
+    input_columns.append(py::make_tuple("l2_state", "u1"));
+    input_columns.append(py::make_tuple("r2_state", "u1"));
+    input_columns.append(py::make_tuple("left_x", "<i2"));
+    input_columns.append(py::make_tuple("left_y", "<i2"));
+    input_columns.append(py::make_tuple("right_x", "<i2"));
+    input_columns.append(py::make_tuple("right_y", "<i2"));
+    m.attr("INPUT_DTYPE") = py::module_::import("numpy").attr("dtype")(input_columns);
+    
+    // Queue overflow handling
+    py::enum_<OverflowPolicy>(m, "OverflowPolicy")
+        .value("DROP_OLDEST", OverflowPolicy::DROP_OLDEST)
+        .value("DROP_NEWEST", OverflowPolicy::DROP_NEWEST)
+        .export_values();
+    
+    // libavcodec setup for Session.enable_decoding()
+    py::enum_<DecodeProfile>(m, "DecodeProfile")
+        .value("DEFAULT", DecodeProfile::DEFAULT)
+        .value("LOW_LATENCY", DecodeProfile::LOW_LATENCY)
+        .value("THROUGHPUT", DecodeProfile::THROUGHPUT)
+        .export_values();
+    
+    // Decode throttling for Session.set_decode_policy()
+    py::class_<DecodePolicy>(m, "DecodePolicy")
+        .def(py::init([](double target_fps, double source_fps, bool skip_unconsumed, bool drop_nonref) {
+                 DecodePolicy policy;
+                 policy.target_fps = target_fps;
+                 policy.source_fps = source_fps;
+                 policy.skip_unconsumed = skip_unconsumed;
+                 policy.drop_nonref = drop_nonref;
+                 return policy;
+             }),
+             py::arg("target_fps") = 0.0, py::arg("source_fps") = 0.0,
+             py::arg("skip_unconsumed") = false, py::arg("drop_nonref") = false)
+        .def_readwrite("target_fps", &DecodePolicy::target_fps,
+                       "Frames converted per stream second; 0 converts every frame")
+        .def_readwrite("source_fps", &DecodePolicy::source_fps,
+                       "Stream frame rate; 0 uses the session's max_fps")
+        .def_readwrite("skip_unconsumed", &DecodePolicy::skip_unconsumed,
+                       "Skip conversion when no callback, mailbox or queue slot would take the frame")
+        .def_readwrite("drop_nonref", &DecodePolicy::drop_nonref,
+                       "Don't decode non-reference frames the target rate skips")
+        .def("__repr__", [](const DecodePolicy& policy) {
+            return "DecodePolicy(target_fps=" + std::to_string(policy.target_fps) +
+                   ", source_fps=" + std::to_string(policy.source_fps) +
+                   ", skip_unconsumed=" + (policy.skip_unconsumed ? "True" : "False") +
+                   ", drop_nonref=" + (policy.drop_nonref ? "True" : "False") + ")";
+        });
+    
+    // Unchanged-frame suppression for Session.set_change_detection()
+    py::class_<ChangeSpec>(m, "ChangeDetection",
+        "Drop decoded frames whose luma barely changed since the last delivered one")
+        .def(py::init([](double threshold, int cell_threshold, std::optional<std::array<int, 4>> roi,
+                         std::array<int, 2> grid, uint32_t max_skip) {
+                 ChangeSpec spec;
+                 spec.threshold = threshold;
+                 spec.cell_threshold = cell_threshold;
+                 if (roi) {
+                     spec.roi_x = (*roi)[0];
+                     spec.roi_y = (*roi)[1];
+                     spec.roi_width = (*roi)[2];
+                     spec.roi_height = (*roi)[3];
+                 }
+                 spec.grid_width = grid[0];
+                 spec.grid_height = grid[1];
+                 spec.max_skip = max_skip;
+                 spec.validate();
+                 return spec;
+             }),
+             py::arg("threshold") = 0.0, py::arg("cell_threshold") = 8, py::arg("roi") = py::none(),
+             py::arg("grid") = std::array<int, 2>{64, 36}, py::arg("max_skip") = 0)
+        .def_readwrite("threshold", &ChangeSpec::threshold,
+                       "% of cells that must change for a frame to be delivered; 0 passes any change")
+        .def_readwrite("cell_threshold", &ChangeSpec::cell_threshold,
+                       "Luma levels a cell's average must move by to count as changed")
+        .def_property("roi", [](const ChangeSpec& spec) {
+            return py::make_tuple(spec.roi_x, spec.roi_y, spec.roi_width, spec.roi_height);
+        }, [](ChangeSpec& spec, const std::array<int, 4>& roi) {
+            spec.roi_x = roi[0];
+            spec.roi_y = roi[1];
+            spec.roi_width = roi[2];
+            spec.roi_height = roi[3];
+        }, "(x, y, width, height) in source pixels compared; 0 extents reach the frame edge")
+        .def_property("grid", [](const ChangeSpec& spec) {
+            return py::make_tuple(spec.grid_width, spec.grid_height);
+        }, [](ChangeSpec& spec, const std::array<int, 2>& grid) {
+            spec.grid_width = grid[0];
+            spec.grid_height = grid[1];
+        }, "(columns, rows) of the luma thumbnail, 8-256 each")
+        .def_readwrite("max_skip", &ChangeSpec::max_skip,
+                       "Deliver a frame after this many unchanged ones anyway; 0 never does")
+        .def("validate", &ChangeSpec::validate, "Raise ValueError for out-of-range settings")
+        .def("__repr__", [](const ChangeSpec& spec) {
+            return "ChangeDetection(threshold=" + std::to_string(spec.threshold) +
+                   ", cell_threshold=" + std::to_string(spec.cell_threshold) +
+                   ", roi=(" + std::to_string(spec.roi_x) + ", " + std::to_string(spec.roi_y) + ", " +
+                   std::to_string(spec.roi_width) + ", " + std::to_string(spec.roi_height) +
+                   "), grid=(" + std::to_string(spec.grid_width) + ", " + std::to_string(spec.grid_height) +
+                   "), max_skip=" + std::to_string(spec.max_skip) + ")";
+        });
+    m.attr("CHANGE_DETECT_KERNEL") = ChangeDetector::kernel_name();
+    
+    // The detector itself, for tuning a ChangeDetection on captured frames
+    py::class_<ChangeDetector>(m, "ChangeDetector",
+        "Scores luma planes against the last changed one, as set_change_detection() does")
+        .def(py::init<>())
+        .def("measure", [](ChangeDetector& detector,
+                           const py::array_t<uint8_t, py::array::c_style | py::array::forcecast>& luma,
+                           const ChangeSpec& spec) {
+            if (luma.ndim() != 2) {
+                throw std::invalid_argument("luma must be a 2-D uint8 plane");
+            }
+            const int height = static_cast<int>(luma.shape(0));
+            const int width = static_cast<int>(luma.shape(1));
+            const ChangeDetector::Result result = detector.measure(luma.data(), width, width, height, spec);
+            return py::make_tuple(result.changed, result.score, result.hash);
+        }, py::arg("luma"), py::arg("spec"),
+           "Measure a (height, width) luma plane; returns (changed, score, hash)")
+        .def("reset", &ChangeDetector::reset, "Forget the reference; the next plane counts as changed");
+    
+    // Stream profile requested from the console (VideoProfile is the
+    // decoder-side one in video_binding.cpp)
+    py::class_<ChiakiConnectVideoProfile>(m, "ConnectVideoProfile")
+        .def(py::init<>())
+        .def_readwrite("width", &ChiakiConnectVideoProfile::width)
+        .def_readwrite("height", &ChiakiConnectVideoProfile::height)
+        .def_readwrite("max_fps", &ChiakiConnectVideoProfile::max_fps)
+        .def_readwrite("bitrate", &ChiakiConnectVideoProfile::bitrate, "kbps")
+        .def_readwrite("codec", &ChiakiConnectVideoProfile::codec)
+        .def("__repr__", [](const ChiakiConnectVideoProfile& profile) {
+            return "ConnectVideoProfile(" + std::to_string(profile.width) + "x" + std::to_string(profile.height) +
+                   "@" + std::to_string(profile.max_fps) + ", bitrate=" + std::to_string(profile.bitrate) +
+                   ", codec=" + std::to_string(static_cast<int>(profile.codec)) + ")";
+        });
+    
+    py::class_<SessionConfig>(m, "SessionConfig")
+        .def(py::init([](bool ps5, ChiakiCodec codec, ChiakiVideoResolutionPreset resolution,
+                         ChiakiVideoFPSPreset fps, unsigned int bitrate, bool auto_downgrade) {
+                 SessionConfig config;
+                 config.ps5 = ps5;
+                 config.codec = codec;
+                 config.resolution = resolution;
+                 config.fps = fps;
+                 config.bitrate = bitrate;
+                 config.auto_downgrade = auto_downgrade;
+                 config.validate();
+                 return config;
+             }),
+             py::arg("ps5") = true, py::arg("codec") = CHIAKI_CODEC_H264,
+             py::arg("resolution") = CHIAKI_VIDEO_RESOLUTION_PRESET_1080p,
+             py::arg("fps") = CHIAKI_VIDEO_FPS_PRESET_60, py::arg("bitrate") = 0,
+             py::arg("auto_downgrade") = false)
+        .def_readwrite("ps5", &SessionConfig::ps5, "PS5 target; PS4 consoles only stream H.264")
+        .def_readwrite("codec", &SessionConfig::codec)
+        .def_readwrite("resolution", &SessionConfig::resolution)
+        .def_readwrite("fps", &SessionConfig::fps)
+        .def_readwrite("bitrate", &SessionConfig::bitrate, "kbps; 0 keeps the resolution preset's")
+        .def_readwrite("auto_downgrade", &SessionConfig::auto_downgrade,
+                       "Let chiaki lower the profile if the console rejects it")
+        .def_property_readonly("video_profile", &SessionConfig::video_profile,
+                               "ConnectVideoProfile this config requests")
+        .def("validate", &SessionConfig::validate,
+             "Raise ValueError for a combination the console can't stream")
+        .def("__repr__", [](const SessionConfig& config) {
+            const ChiakiConnectVideoProfile profile = config.video_profile();
+            return "SessionConfig(ps5=" + std::string(config.ps5 ? "True" : "False") +
+                   ", codec=" + std::to_string(static_cast<int>(config.codec)) +
+                   ", " + std::to_string(profile.height) + "p" + std::to_string(profile.max_fps) +
+                   ", bitrate=" + std::to_string(profile.bitrate) + ")";
+        });
+    
+    // Session wrapper
+    py::class_<SessionWrapper>(m, "Session")
+        .def(py::init<>())
+        .def("initialize", &SessionWrapper::initialize,
+             "Initialize session with host, registration key and SessionConfig (target, codec, "
+             "resolution, fps, bitrate); raises ValueError for an invalid config",
+             py::arg("host"), py::arg("regist_key"), py::arg("config") = SessionConfig())
+        .def_property_readonly("config", &SessionWrapper::config,
+                               "SessionConfig passed to initialize(); None before")
+        .def_property_readonly("video_profile", &SessionWrapper::video_profile,
+                               "ConnectVideoProfile requested from the console; None before initialize()")
+        .def("start", &SessionWrapper::start,
+             "Start the Remote Play session")
+        .def("stop", &SessionWrapper::stop,
+             "Stop the Remote Play session")
+        .def("join", &SessionWrapper::join,
+             "Wait for session to complete",
+             py::call_guard<py::gil_scoped_release>())
+        .def("set_video_callback", &SessionWrapper::set_video_callback,
+             "Set callback for video frame data")
+        .def("set_event_callback", &SessionWrapper::set_event_callback,
+             "Set callback for session events; called with one typed event object")
+        .def("set_event_filter", &SessionWrapper::set_event_filter,
+             "Deliver only these EventTypes to Python (QUIT always passes); None for all",
+             py::arg("types"))
+        .def_property_readonly("event_filter", &SessionWrapper::event_filter,
+                               "EventTypes delivered to Python, or None for all")
+        .def("set_frame_callback", &SessionWrapper::set_frame_callback,
+             "Set callback for decoded VideoFrame objects")
+        .def("enable_decoding", &SessionWrapper::enable_decoding,
+             "Decode video natively and deliver frames in the given pixel format",
+             py::arg("pixel_format") = PixelFormat::BGR,
+             py::arg("pool_size") = VideoDecoder::DEFAULT_POOL_SLABS,
+             py::arg("profile") = DecodeProfile::DEFAULT)
+        .def("enable_decoding", &SessionWrapper::enable_decoding_spec,
+             "Decode video natively and deliver frames cropped/resized/converted per an OutputSpec",
+             py::arg("output"),
+             py::arg("pool_size") = VideoDecoder::DEFAULT_POOL_SLABS,
+             py::arg("profile") = DecodeProfile::DEFAULT)
+        .def("enable_frame_queue", &SessionWrapper::enable_frame_queue,
+             "Queue frames in a bounded lock-free ring for next_frame()",
+             py::arg("capacity") = 8, py::arg("overflow") = OverflowPolicy::DROP_OLDEST)
+        .def("enable_event_queue", &SessionWrapper::enable_event_queue,
+             "Queue events in a bounded lock-free ring for next_event()",
+             py::arg("capacity") = 64, py::arg("overflow") = OverflowPolicy::DROP_OLDEST)
+        .def("enable_mailbox", &SessionWrapper::enable_mailbox,
+             "Keep only the newest frame for latest_frame()")
+        .def("latest_frame", &SessionWrapper::latest_frame,
+             "Get the freshest VideoFrame without blocking; None before the first frame. Each call "
+             "allocates one small frame object that shares the pixels, which are never copied")
+        .def("next_frame", &SessionWrapper::next_frame,
+             "Wait for the next queued VideoFrame; None on timeout",
+             py::arg("timeout") = py::none())
+        .def("next_event", &SessionWrapper::next_event,
+             "Wait for the next queued typed event; None on timeout",
+             py::arg("timeout") = py::none())
+        .def("frame_notify_fd", &SessionWrapper::frame_notify_fd,
+             "File descriptor signalled when an armed frame wait can proceed; -1 if unsupported")
+        .def("event_notify_fd", &SessionWrapper::event_notify_fd,
+             "File descriptor signalled when an armed event wait can proceed; -1 if unsupported")
+        .def("arm_frame_notify", &SessionWrapper::arm_frame_notify,
+             "Arm the frame fd; returns True if a frame is already available")
+        .def("arm_event_notify", &SessionWrapper::arm_event_notify,
+             "Arm the event fd; returns True if an event is already available")
+        .def("queue_stats", &SessionWrapper::queue_stats,
+             "Get frame/event queue depth and drop counters as dict")
+        .def("frame_pool_info", &SessionWrapper::frame_pool_info,
+             "Get decoded frame pool usage as dict")
+        .def("stats", &SessionWrapper::stats,
+             "Get counters, rates, queue depths and per-stage latency percentiles as dict")
+        .def("stats_array", &SessionWrapper::stats_array,
+             "Get the stats() snapshot as a one-record float64 numpy structured array")
+        .def("prometheus_metrics", &SessionWrapper::prometheus_metrics,
+             "Get stats() in Prometheus text exposition format",
+             py::arg("labels") = std::map<std::string, std::string>(),
+             py::arg("prefix") = "py_chiaki_ng")
+        .def("start_recording", &SessionWrapper::start_recording,
+             "Record raw video samples and events to a file for ReplaySession; a .mkv/.mp4/.mov/.ts path "
+             "or a container name remuxes the encoded stream (and enable_audio() audio) without "
+             "transcoding, rotating files after segment_seconds or segment_bytes",
+             py::arg("path"), py::arg("container") = py::none(), py::arg("segment_seconds") = 0.0,
+             py::arg("segment_bytes") = 0, py::arg("audio") = true, py::arg("queue_bytes") = size_t{64} << 20)
+        .def("stop_recording", &SessionWrapper::stop_recording,
+             "Stop recording, write out what is queued and close the file")
+        .def_property_readonly("recording", &SessionWrapper::is_recording)
+        .def_property_readonly("recording_segments", &SessionWrapper::recording_segments,
+                               "Files the last container recording wrote, in order")
+        .def_property_readonly("recording_error", &SessionWrapper::recording_error,
+                               "Why the last container recording stopped writing, or None")
+        .def_property_readonly("decoding_enabled", &SessionWrapper::decoding_enabled)
+        .def("enable_audio", &SessionWrapper::enable_audio,
+             "Decode audio natively into an AudioBuffer holding the last `seconds` of 48 kHz stereo PCM",
+             py::arg("seconds") = 10.0)
+        .def_property_readonly("audio", &SessionWrapper::audio,
+                               "AudioBuffer audio is decoded into; None until enable_audio()")
+        .def("enable_flight_recorder", &SessionWrapper::enable_flight_recorder,
+             "Keep the last `seconds` of encoded video, events and controller states in a fixed "
+             "`max_bytes` ring; dump_on_error names a file written when the session quits with an error",
+             py::arg("seconds") = 30.0, py::arg("max_bytes") = size_t{64} << 20,
+             py::arg("dump_on_error") = py::none())
+        .def("dump_flight_recorder", &SessionWrapper::dump_flight_recorder,
+             "Write the flight recorder to a recording for ReplaySession; returns the record count",
+             py::arg("path"))
+        .def("enable_shared_frames", &SessionWrapper::enable_shared_frames,
+             "Also publish every frame into a named shared-memory ring for SharedFrameReader; "
+             "slot_size 0 fits the decoder's output, so call after enable_decoding()",
+             py::arg("name"), py::arg("slots") = 4, py::arg("slot_size") = 0)
+        .def_property_readonly("shared_frames", &SessionWrapper::shared_frame_writer,
+                               "SharedFrameWriter frames are published to; None until enable_shared_frames()")
+        .def_property_readonly("output_spec", &SessionWrapper::output_spec,
+                               "OutputSpec decoded frames are produced with; None without decoding")
+        .def("add_tap", &SessionWrapper::add_tap,
+             "Add (or replace) a named ROI output decoded alongside every frame",
+             py::arg("name"), py::arg("spec"))
+        .def("remove_tap", &SessionWrapper::remove_tap,
+             "Remove a named ROI output", py::arg("name"))
+        .def_property_readonly("taps", &SessionWrapper::taps,
+                               "Registered ROI taps as a dict of OutputSpec")
+        .def("set_decode_policy", &SessionWrapper::set_decode_policy,
+             "Throttle decoding: target rate, skip unconsumed frames, drop non-reference frames",
+             py::arg("policy"))
+        .def_property_readonly("decode_policy", &SessionWrapper::get_decode_policy,
+                               "Active DecodePolicy, source_fps resolved from the stream")
+        .def("set_probes", &SessionWrapper::set_probes,
+             "Evaluate a copy of a ProbeSet natively on every decoded frame; None removes it",
+             py::arg("probes"))
+        .def_property_readonly("probes", &SessionWrapper::get_probes, "Copy of the active ProbeSet, or None")
+        .def("set_probe_callback", &SessionWrapper::set_probe_callback,
+             "Call fn(results, sequence, timestamp_ns) per probed frame, or only when a result changes "
+             "if ProbeSet.on_change is set",
+             py::arg("callback"))
+        .def("latest_probes", &SessionWrapper::latest_probes,
+             "(results, sequence, timestamp_ns) of the last probed frame, or None")
+        .def("set_change_detection", &SessionWrapper::set_change_detection,
+             "Only deliver decoded frames that differ from the last delivered one per ChangeDetection; "
+             "None turns it off",
+             py::arg("spec"))
+        .def_property_readonly("change_detection", &SessionWrapper::get_change_detection,
+                               "Active ChangeDetection, or None")
+        .def("set_latency_probe", &SessionWrapper::set_latency_probe,
+             "Time controller sends to the first decoded frame whose ChangeDetection region changes, "
+             "into stats()['latency']['input_to_photon']; None stops. Needs enable_decoding()",
+             py::arg("spec"), py::arg("timeout") = 1.0)
+        .def_property_readonly("latency_probe", &SessionWrapper::get_latency_probe,
+                               "ChangeDetection region the latency probe watches, or None")
+        .def("interval_stats", &SessionWrapper::interval_stats,
+             "Get sample/decode/skip/loss counter deltas since the previous call as dict")
+        .def("set_log_level", &SessionWrapper::set_log_level,
+             "Set the LogLevel mask of messages chiaki logs for this session; applies immediately",
+             py::arg("mask"))
+        .def_property_readonly("log_level", &SessionWrapper::log_level, "Current LogLevel mask")
+        .def_property_readonly("log_id", &SessionWrapper::log_id,
+                               "chiaki_session attribute of this session's log records")
+        .def("send_controller_state", &SessionWrapper::send_controller_state,
+             "Send controller input to PlayStation")
+        .def("schedule_inputs", &SessionWrapper::schedule_inputs,
+             "Apply a structured array of timed controller deltas (see INPUT_DTYPE) at "
+             "deadlines 't' seconds after start (time.monotonic(), default now); "
+             "returns the number of entries queued",
+             py::arg("actions"), py::arg("start") = py::none(), py::arg("replace") = false)
+        .def("schedule_states", &SessionWrapper::schedule_states,
+             "Apply full controller states from an (N, 17) CONTROLLER_LAYOUT matrix at "
+             "offsets 'times' (seconds) after start; returns the number queued",
+             py::arg("times"), py::arg("states"), py::arg("normalized") = false,
+             py::arg("start") = py::none(), py::arg("replace") = false)
+        .def("cancel_inputs", &SessionWrapper::cancel_inputs,
+             "Drop scheduled inputs that were not sent yet")
+        .def("wait_inputs", &SessionWrapper::wait_inputs,
+             "Wait until all scheduled inputs were sent; False on timeout",
+             py::arg("timeout") = py::none())
+        .def_property("input_rate", &SessionWrapper::get_input_rate, &SessionWrapper::set_input_rate,
+                      "Maximum controller sends per second for scheduled input (0: unlimited)")
+        .def("input_stats", &SessionWrapper::input_stats,
+             "Get input scheduler counters and timing as dict");
+    
+    // Recording playback with the Session API
+    py::class_<ReplaySession, SessionWrapper>(m, "ReplaySession")
+        .def(py::init<const std::string&, bool, bool>(),
+             "Open a recording made with Session.start_recording()",
+             py::arg("path"), py::arg("realtime") = true, py::arg("loop") = false)
+        .def("initialize", &ReplaySession::initialize,
+             "Prepare playback; host and regist_key are ignored and the codec comes from the recording",
+             py::arg("host") = "", py::arg("regist_key") = "", py::arg("config") = SessionConfig())
+        .def_property_readonly("sample_count", &ReplaySession::sample_count)
+        .def_property_readonly("event_count", &ReplaySession::event_count)
+        .def_property_readonly("controller_state_count", &ReplaySession::controller_state_count)
+        .def("controller_states", &ReplaySession::controller_states,
+             "Controller states in the recording (flight recorder dumps) as (timestamps_ns, (N, 17) float32)")
+        .def_property_readonly("duration_ns", &ReplaySession::duration_ns)
+        .def_property_readonly("realtime", &ReplaySession::is_realtime)
+        .def_property_readonly("loop", &ReplaySession::is_looping);
+    
+    // Many sessions sharing one decode thread pool
+    py::class_<SessionPool>(m, "SessionPool")
+        .def(py::init<size_t>(), py::arg("threads") = 0,
+             "Create a pool; threads=0 uses one decode thread per core")
+        .def("create_session", &SessionPool::create_session,
+             "Create a Session owned by the pool that decodes on the shared threads",
+             py::return_value_policy::reference_internal)
+        .def("create_replay_session", &SessionPool::create_replay_session,
+             "Create a ReplaySession owned by the pool",
+             py::arg("path"), py::arg("realtime") = true, py::arg("loop") = false,
+             py::return_value_policy::reference_internal)
+        .def("__len__", &SessionPool::size)
+        .def("__getitem__", &SessionPool::get,
+             py::return_value_policy::reference_internal)
+        .def("stop_all", &SessionPool::stop_all,
+             "Stop every session in the pool")
+        .def("join_all", &SessionPool::join_all,
+             "Wait for every session to complete",
+             py::call_guard<py::gil_scoped_release>())
+        .def("stats", &SessionPool::stats,
+             "Get decode pool counters and per-session stats as dict")
+        .def("prometheus_metrics", &SessionPool::prometheus_metrics,
+             "Get every session's stats in Prometheus text format, labelled session=<index>",
+             py::arg("labels") = std::map<std::string, std::string>(),
+             py::arg("prefix") = "py_chiaki_ng");
 }
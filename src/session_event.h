@@ -0,0 +1,86 @@
+/**
+ * session_event.h - Fixed-size copy of a ChiakiEvent
+ *
+ * chiaki's events point into memory that is only valid during the
+ * callback. SessionEvent copies the payload into inline storage (strings
+ * truncated), so the event ring can hold events without allocating and
+ * Python sees typed event objects built straight from it.
+ */
+
+#pragma once
+
+#include <chiaki/session.h>
+
+#include <cstdint>
+#include <cstring>
+
+// Bit per ChiakiEventType for Session.set_event_filter()
+constexpr uint32_t event_type_bit(ChiakiEventType type) {
+    return uint32_t{1} << static_cast<uint32_t>(type);
+}
+
+constexpr uint32_t EVENT_MASK_ALL = ~uint32_t{0};
+
+struct SessionEvent {
+    static constexpr size_t TEXT_SIZE = 256;
+
+    ChiakiEventType type = CHIAKI_EVENT_CONNECTED;
+    int64_t timestamp_ns = 0;  // steady clock, when chiaki raised it
+
+    ChiakiQuitReason quit_reason = CHIAKI_QUIT_REASON_NONE;  // QUIT
+    uint8_t rumble_left = 0;                                  // RUMBLE
+    uint8_t rumble_right = 0;
+    ChiakiTriggerEffectsEvent trigger_effects = {};           // TRIGGER_EFFECTS
+    uint8_t led_color[3] = {0, 0, 0};                         // LED_COLOR
+    uint8_t player_index = 0;                                 // PLAYER_INDEX
+    uint8_t intensity = 0;                                    // HAPTIC/TRIGGER_INTENSITY
+    bool pin_incorrect = false;                               // LOGIN_PIN_REQUEST
+    char text[TEXT_SIZE] = {};  // QUIT reason_str or KEYBOARD_TEXT_CHANGE text
+
+    static SessionEvent from_chiaki(const ChiakiEvent& event, int64_t timestamp_ns) {
+        SessionEvent result;
+        result.type = event.type;
+        result.timestamp_ns = timestamp_ns;
+        switch (event.type) {
+            case CHIAKI_EVENT_QUIT:
+                result.quit_reason = event.quit.reason;
+                result.set_text(event.quit.reason_str);
+                break;
+            case CHIAKI_EVENT_KEYBOARD_TEXT_CHANGE:
+                result.set_text(event.keyboard.text_str);
+                break;
+            case CHIAKI_EVENT_RUMBLE:
+                result.rumble_left = event.rumble.left;
+                result.rumble_right = event.rumble.right;
+                break;
+            case CHIAKI_EVENT_TRIGGER_EFFECTS:
+                result.trigger_effects = event.trigger_effects;
+                break;
+            case CHIAKI_EVENT_LED_COLOR:
+                memcpy(result.led_color, event.led_state, sizeof(result.led_color));
+                break;
+            case CHIAKI_EVENT_PLAYER_INDEX:
+                result.player_index = event.player_index;
+                break;
+            case CHIAKI_EVENT_HAPTIC_INTENSITY:
+            case CHIAKI_EVENT_TRIGGER_INTENSITY:
+                result.intensity = static_cast<uint8_t>(event.intensity);
+                break;
+            case CHIAKI_EVENT_LOGIN_PIN_REQUEST:
+                result.pin_incorrect = event.login_pin_request.pin_incorrect;
+                break;
+            default:
+                break;
+        }
+        return result;
+    }
+
+    void set_text(const char* value) {
+        if (value) {
+            strncpy(text, value, TEXT_SIZE - 1);
+            text[TEXT_SIZE - 1] = '\0';
+        } else {
+            text[0] = '\0';
+        }
+    }
+};
@@ -0,0 +1,223 @@
+/**
+ * session_metrics.cpp - Lock-free per-session counters and latency histograms
+ */
+
+#include "session_metrics.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+
+namespace {
+
+struct LatencyInfo {
+    const char* name;
+    const char* help;
+};
+
+const LatencyInfo LATENCIES[] = {
+    {"decode_queue", "Sample received to its decode starting"},
+    {"decode", "Decode start to picture out of libavcodec"},
+    {"convert", "Decoded picture to converted frame ready"},
+    {"callback_wait", "Frame ready to the Python frame callback running"},
+    {"callback", "Time spent in the Python frame callback"},
+    {"probe", "Time to evaluate the probe set on a frame"},
+    {"queue_wait", "Frame ready to being taken from the queue or mailbox"},
+    {"controller_send", "Time to hand a controller state to chiaki"},
+    {"input_to_photon", "Controller state sent to the latency probe's region changing on screen"},
+};
+
+const double QUANTILES[] = {0.5, 0.9, 0.99, 0.999};
+
+std::string format_value(double value, bool integer) {
+    char text[32];
+    if (integer) {
+        snprintf(text, sizeof(text), "%" PRIu64, static_cast<uint64_t>(value));
+    } else {
+        snprintf(text, sizeof(text), "%.9g", value);
+    }
+    return text;
+}
+
+// `{labels,extra}` with either part optional
+std::string label_set(const std::string& labels, const std::string& extra = std::string()) {
+    if (labels.empty() && extra.empty()) {
+        return std::string();
+    }
+    if (labels.empty() || extra.empty()) {
+        return "{" + labels + extra + "}";
+    }
+    return "{" + labels + "," + extra + "}";
+}
+
+} // namespace
+
+size_t LatencyHistogram::bucket_index(int64_t value) {
+    if (value < SUB_BUCKETS) {
+        return static_cast<size_t>(std::max<int64_t>(value, 0));
+    }
+    const uint64_t clamped = std::min<uint64_t>(static_cast<uint64_t>(value), (uint64_t{1} << MAX_BITS) - 1);
+    const int msb = 63 - __builtin_clzll(clamped);
+    const size_t octave = static_cast<size_t>(msb - SUB_BUCKET_BITS + 1);
+    const size_t sub = (clamped >> (msb - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+    return octave * SUB_BUCKETS + sub;
+}
+
+int64_t LatencyHistogram::bucket_lower(size_t index) {
+    const size_t octave = index / SUB_BUCKETS;
+    const int64_t sub = static_cast<int64_t>(index % SUB_BUCKETS);
+    return octave == 0 ? sub : (SUB_BUCKETS + sub) << (octave - 1);
+}
+
+int64_t LatencyHistogram::bucket_width(size_t index) {
+    const size_t octave = index / SUB_BUCKETS;
+    return octave == 0 ? 1 : int64_t{1} << (octave - 1);
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::snapshot() const {
+    Snapshot result;
+    for (size_t i = 0; i < BUCKETS; i++) {
+        result.counts[i] = counts_[i].load(std::memory_order_relaxed);
+        result.count += result.counts[i];
+    }
+    result.sum_ns = sum_.load(std::memory_order_relaxed);
+    result.max_ns = max_.load(std::memory_order_relaxed);
+    return result;
+}
+
+// Highest value the bucket holding the q-th value could stand for,
+// capped at the real maximum
+int64_t LatencyHistogram::Snapshot::percentile(double q) const {
+    if (count == 0) {
+        return 0;
+    }
+    const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(q * count)));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; i++) {
+        seen += counts[i];
+        if (seen >= rank) {
+            return std::min(bucket_lower(i) + bucket_width(i) - 1, max_ns);
+        }
+    }
+    return max_ns;
+}
+
+void MetricsSnapshot::add_counter(std::string name, const char* help, uint64_t value) {
+    values.push_back({std::move(name), help, MetricValue::Kind::COUNTER, static_cast<double>(value), true});
+}
+
+void MetricsSnapshot::add_gauge(std::string name, const char* help, double value, bool integer) {
+    values.push_back({std::move(name), help, MetricValue::Kind::GAUGE, value, integer});
+}
+
+const char* latency_help(const char* name) {
+    for (const LatencyInfo& info : LATENCIES) {
+        if (strcmp(info.name, name) == 0) {
+            return info.help;
+        }
+    }
+    return "";
+}
+
+SessionMetrics::SessionMetrics() : start_ns(now_ns()) {}
+
+int64_t SessionMetrics::now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+MetricsSnapshot SessionMetrics::snapshot() const {
+    MetricsSnapshot result;
+    const uint64_t bytes = sample_bytes.load(std::memory_order_relaxed);
+    const uint64_t sends = controller_sends.load(std::memory_order_relaxed);
+    result.add_counter("samples", "Encoded video samples received", samples.load(std::memory_order_relaxed));
+    result.add_counter("sample_bytes", "Encoded video bytes received", bytes);
+    result.add_counter("frames_lost", "Frames chiaki reported lost", frames_lost.load(std::memory_order_relaxed));
+    result.add_counter("frames_recovered", "Frames chiaki recovered through FEC",
+                       frames_recovered.load(std::memory_order_relaxed));
+    result.add_counter("frames_decoded", "Frames decoded and delivered",
+                       frames_decoded.load(std::memory_order_relaxed));
+    result.add_counter("decode_dropped", "Samples dropped because the decode backlog was full",
+                       decode_dropped.load(std::memory_order_relaxed));
+    result.add_counter("frame_callbacks", "Python frame callback invocations",
+                       frame_callbacks.load(std::memory_order_relaxed));
+    result.add_counter("probe_callbacks", "Python probe callback invocations",
+                       probe_callbacks.load(std::memory_order_relaxed));
+    result.add_counter("events", "Events delivered to Python", events.load(std::memory_order_relaxed));
+    result.add_counter("events_filtered", "Events dropped by the event filter",
+                       events_filtered.load(std::memory_order_relaxed));
+    result.add_counter("controller_sends", "Controller states sent", sends);
+    result.add_counter("controller_send_failures", "Controller states chiaki rejected",
+                       controller_send_failures.load(std::memory_order_relaxed));
+
+    const int64_t uptime_ns = std::max<int64_t>(now_ns() - start_ns, 1);
+    const double seconds = static_cast<double>(uptime_ns) / 1e9;
+    result.add_gauge("uptime_ns", "Nanoseconds since the session was created", static_cast<double>(uptime_ns), true);
+    result.add_gauge("bitrate_bps", "Average received video bitrate", static_cast<double>(bytes) * 8.0 / seconds);
+    result.add_gauge("controller_send_rate", "Average controller sends per second",
+                     static_cast<double>(sends) / seconds);
+
+    const LatencyHistogram* histograms[] = {
+        &decode_queue, &decode, &convert, &callback_wait, &callback, &probe, &queue_wait, &controller_send,
+        &input_to_photon,
+    };
+    for (size_t i = 0; i < std::size(LATENCIES); i++) {
+        result.latencies.emplace_back(LATENCIES[i].name, histograms[i]->snapshot());
+    }
+    return result;
+}
+
+std::string prometheus_text(const std::string& prefix,
+                            const std::vector<std::pair<std::string, MetricsSnapshot>>& sessions) {
+    std::string out;
+    if (sessions.empty()) {
+        return out;
+    }
+
+    // One family per value, every session's sample under it
+    const MetricsSnapshot& first = sessions.front().second;
+    for (size_t i = 0; i < first.values.size(); i++) {
+        const MetricValue& family = first.values[i];
+        const bool counter = family.kind == MetricValue::Kind::COUNTER;
+        const std::string name = prefix + "_" + family.name + (counter ? "_total" : "");
+        out += "# HELP " + name + " " + family.help + "\n";
+        out += "# TYPE " + name + (counter ? " counter\n" : " gauge\n");
+        for (const auto& session : sessions) {
+            for (const MetricValue& value : session.second.values) {
+                if (value.name == family.name) {
+                    out += name + label_set(session.first) + " " + format_value(value.value, value.integer) + "\n";
+                    break;
+                }
+            }
+        }
+    }
+
+    for (size_t i = 0; i < first.latencies.size(); i++) {
+        const char* family = first.latencies[i].first;
+        const std::string name = prefix + "_" + family + "_seconds";
+        out += "# HELP " + name + " " + latency_help(family) + "\n";
+        out += "# TYPE " + name + " summary\n";
+        for (const auto& session : sessions) {
+            for (const auto& latency : session.second.latencies) {
+                if (strcmp(latency.first, family) != 0) {
+                    continue;
+                }
+                const LatencyHistogram::Snapshot& histogram = latency.second;
+                for (double q : QUANTILES) {
+                    out += name + label_set(session.first, "quantile=\"" + format_value(q, false) + "\"") + " " +
+                           format_value(static_cast<double>(histogram.percentile(q)) / 1e9, false) + "\n";
+                }
+                out += name + "_sum" + label_set(session.first) + " " +
+                       format_value(static_cast<double>(histogram.sum_ns) / 1e9, false) + "\n";
+                out += name + "_count" + label_set(session.first) + " " +
+                       format_value(static_cast<double>(histogram.count), true) + "\n";
+                break;
+            }
+        }
+    }
+    return out;
+}
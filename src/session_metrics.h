@@ -0,0 +1,127 @@
+/**
+ * session_metrics.h - Lock-free per-session counters and latency histograms
+ *
+ * Every chiaki, decode and Python thread that touches a session bumps
+ * plain atomics here with relaxed ordering, so reading stats() never
+ * stops the stream. Latencies go into HDR-style log-linear histograms:
+ * 16 linear sub-buckets per power of two keep every bucket within ~6% of
+ * its value from 1 ns to ~68 s, in a few KB per histogram.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+class LatencyHistogram {
+public:
+    static constexpr int SUB_BUCKET_BITS = 4;
+    static constexpr int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    static constexpr int MAX_BITS = 36;  // values clamp to ~68.7 s
+    static constexpr size_t BUCKETS = (MAX_BITS - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+    // Safe from any thread; negative values count as 0
+    void record(int64_t value_ns) {
+        const int64_t value = value_ns > 0 ? value_ns : 0;
+        counts_[bucket_index(value)].fetch_add(1, std::memory_order_relaxed);
+        sum_.fetch_add(value, std::memory_order_relaxed);
+        int64_t max = max_.load(std::memory_order_relaxed);
+        while (value > max && !max_.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+        }
+    }
+
+    struct Snapshot {
+        uint64_t count = 0;
+        int64_t sum_ns = 0;
+        int64_t max_ns = 0;
+        std::array<uint64_t, BUCKETS> counts = {};
+
+        double mean_ns() const { return count ? static_cast<double>(sum_ns) / count : 0.0; }
+        // Value at quantile q in [0, 1], to bucket resolution; 0 when empty
+        int64_t percentile(double q) const;
+    };
+
+    // Buckets are read one by one while writers carry on, so a snapshot
+    // taken mid-stream may be off by the few values recorded meanwhile
+    Snapshot snapshot() const;
+
+    static size_t bucket_index(int64_t value);
+    // Smallest value and width of a bucket
+    static int64_t bucket_lower(size_t index);
+    static int64_t bucket_width(size_t index);
+
+private:
+    std::array<std::atomic<uint64_t>, BUCKETS> counts_{};
+    std::atomic<int64_t> sum_{0};
+    std::atomic<int64_t> max_{0};
+};
+
+// One value of a metrics snapshot, named as in Session.stats()
+struct MetricValue {
+    enum class Kind {
+        COUNTER,  // only ever grows
+        GAUGE,
+    };
+
+    std::string name;
+    const char* help;
+    Kind kind;
+    double value;
+    bool integer;  // reported as int in Python
+};
+
+struct MetricsSnapshot {
+    std::vector<MetricValue> values;
+    std::vector<std::pair<const char*, LatencyHistogram::Snapshot>> latencies;
+
+    void add_counter(std::string name, const char* help, uint64_t value);
+    void add_gauge(std::string name, const char* help, double value, bool integer = false);
+};
+
+// Help text for a latency histogram in SessionMetrics
+const char* latency_help(const char* name);
+
+// Counters and latencies of one session
+struct SessionMetrics {
+    SessionMetrics();
+
+    std::atomic<uint64_t> samples{0};
+    std::atomic<uint64_t> sample_bytes{0};
+    std::atomic<uint64_t> frames_lost{0};
+    std::atomic<uint64_t> frames_recovered{0};
+    std::atomic<uint64_t> frames_decoded{0};
+    std::atomic<uint64_t> decode_dropped{0};
+    std::atomic<uint64_t> frame_callbacks{0};
+    std::atomic<uint64_t> probe_callbacks{0};
+    std::atomic<uint64_t> events{0};
+    std::atomic<uint64_t> events_filtered{0};
+    std::atomic<uint64_t> controller_sends{0};
+    std::atomic<uint64_t> controller_send_failures{0};
+    const int64_t start_ns;
+
+    LatencyHistogram decode_queue;     // sample received -> its decode started (strand backlog)
+    LatencyHistogram decode;           // decode started -> picture out of libavcodec
+    LatencyHistogram convert;          // picture -> converted frame ready
+    LatencyHistogram callback_wait;    // frame ready -> Python frame callback entered (GIL wait)
+    LatencyHistogram callback;         // time spent in the Python frame callback
+    LatencyHistogram probe;            // time to evaluate the probe set on a frame
+    LatencyHistogram queue_wait;       // frame ready -> taken by next_frame()/latest_frame()
+    LatencyHistogram controller_send;  // time in chiaki_session_set_controller_state()
+    LatencyHistogram input_to_photon; // controller state sent -> watched region changed (LatencyProbe)
+
+    // Counters, send rates and bitrate since start_ns, and every histogram
+    MetricsSnapshot snapshot() const;
+
+    static int64_t now_ns();
+};
+
+// Prometheus text exposition format. Each entry is one session's
+// snapshot with its label set (e.g. `session="0"`, may be empty); the
+// names are prefixed and latencies become summaries in seconds.
+std::string prometheus_text(const std::string& prefix,
+                            const std::vector<std::pair<std::string, MetricsSnapshot>>& sessions);
@@ -0,0 +1,328 @@
+/**
+ * shared_frames.cpp - Cross-process frame ring in POSIX shared memory
+ */
+
+#include "shared_frames.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <thread>
+
+#if !defined(_WIN32)
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#endif
+
+namespace {
+
+constexpr size_t SLOT_ALIGN = 64;
+// A reader gives up on a slot the writer keeps rewriting after this many tries
+constexpr int READ_ATTEMPTS = 64;
+
+std::string shm_name(const std::string& name) {
+    if (name.empty() || name == "/") {
+        throw std::invalid_argument("shared frame ring needs a name");
+    }
+    return name[0] == '/' ? name : "/" + name;
+}
+
+size_t slot_stride(size_t slot_size) {
+    const size_t bytes = sizeof(SharedFrameSlot) + slot_size;
+    return (bytes + SLOT_ALIGN - 1) / SLOT_ALIGN * SLOT_ALIGN;
+}
+
+SharedFrameSlot* slot_at(uint8_t* base, const SharedFramesHeader* header, uint64_t index) {
+    return reinterpret_cast<SharedFrameSlot*>(base + header->header_size +
+                                              (index % header->slot_count) * header->slot_stride);
+}
+
+#if defined(__linux__)
+// Process-shared futex calls on the 32-bit notify word
+void futex_wake_all(std::atomic<uint32_t>* word) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+void futex_wait(std::atomic<uint32_t>* word, uint32_t expected, std::chrono::nanoseconds timeout) {
+    timespec ts;
+    ts.tv_sec = static_cast<time_t>(timeout.count() / 1000000000);
+    ts.tv_nsec = static_cast<long>(timeout.count() % 1000000000);
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT, expected, &ts, nullptr, 0);
+}
+#endif
+
+} // namespace
+
+SharedFrameInfo shared_frame_info(const VideoFrame& frame) {
+    SharedFrameInfo info = {};
+    info.sequence = frame.sequence();
+    info.timestamp_ns = frame.timestamp_ns();
+    info.decoded_ns = frame.decoded_ns();
+    info.ready_ns = frame.ready_ns();
+    info.size = frame.size();
+    info.pixel_format = static_cast<int32_t>(frame.format());
+    info.width = frame.width();
+    info.height = frame.height();
+    info.frames_lost = frame.frames_lost();
+    info.frame_recovered = frame.frame_recovered() ? 1 : 0;
+    info.change_score = frame.change_score();
+    info.luma_hash = frame.luma_hash();
+    return info;
+}
+
+#if !defined(_WIN32)
+
+SharedFrameWriter::SharedFrameWriter(const std::string& name, uint32_t slot_count, size_t slot_size)
+    : name_(shm_name(name)) {
+    if (slot_count == 0 || slot_size == 0) {
+        throw std::invalid_argument("slot_count and slot_size must be positive");
+    }
+    const size_t stride = slot_stride(slot_size);
+    mapped_size_ = sizeof(SharedFramesHeader) + stride * slot_count;
+
+    shm_unlink(name_.c_str());
+    const int fd = shm_open(name_.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot create shared memory " + name_ + ": " + strerror(errno));
+    }
+    if (ftruncate(fd, static_cast<off_t>(mapped_size_)) != 0) {
+        const int error = errno;
+        ::close(fd);
+        shm_unlink(name_.c_str());
+        throw std::runtime_error("Cannot size shared memory " + name_ + ": " + strerror(error));
+    }
+    void* mapped = mmap(nullptr, mapped_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED) {
+        shm_unlink(name_.c_str());
+        throw std::runtime_error("Cannot map shared memory " + name_);
+    }
+
+    // ftruncate zero-filled the object, so every slot starts at sequence 0
+    base_ = static_cast<uint8_t*>(mapped);
+    header_ = new (base_) SharedFramesHeader();
+    header_->version = SHARED_FRAMES_VERSION;
+    header_->header_size = sizeof(SharedFramesHeader);
+    header_->slot_count = slot_count;
+    header_->slot_header_size = sizeof(SharedFrameSlot);
+    header_->slot_size = slot_size;
+    header_->slot_stride = stride;
+    header_->writer_pid = static_cast<int32_t>(getpid());
+    for (uint32_t i = 0; i < slot_count; i++) {
+        new (slot_at(base_, header_, i)) SharedFrameSlot();
+    }
+    // Readers check the magic last
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(header_->magic, SHARED_FRAMES_MAGIC, sizeof(header_->magic));
+}
+
+SharedFrameWriter::~SharedFrameWriter() {
+    close();
+    munmap(base_, mapped_size_);
+}
+
+bool SharedFrameWriter::publish(const VideoFrame& frame) {
+    return publish(frame.data(), shared_frame_info(frame));
+}
+
+bool SharedFrameWriter::publish(const uint8_t* data, const SharedFrameInfo& info) {
+    if (info.size > header_->slot_size) {
+        oversize_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    const uint64_t index = header_->write_index.load(std::memory_order_relaxed);
+    SharedFrameSlot* slot = slot_at(base_, header_, index);
+
+    const uint32_t seq = slot->seq.load(std::memory_order_relaxed);
+    slot->seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot->info = info;
+    slot->info.index = index;
+    memcpy(reinterpret_cast<uint8_t*>(slot) + sizeof(SharedFrameSlot), data, info.size);
+    slot->seq.store(seq + 2, std::memory_order_release);
+
+    header_->write_index.store(index + 1, std::memory_order_release);
+    header_->notify_seq.fetch_add(1);
+#if defined(__linux__)
+    if (header_->waiters.load() > 0) {
+        futex_wake_all(&header_->notify_seq);
+    }
+#endif
+    published_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void SharedFrameWriter::close() {
+    if (closed_) {
+        return;
+    }
+    closed_ = true;
+    header_->closed.store(1, std::memory_order_release);
+    header_->notify_seq.fetch_add(1);
+#if defined(__linux__)
+    futex_wake_all(&header_->notify_seq);
+#endif
+    shm_unlink(name_.c_str());
+}
+
+SharedFrameWriter::Stats SharedFrameWriter::stats() const {
+    Stats result;
+    result.published = published_.load(std::memory_order_relaxed);
+    result.oversize = oversize_.load(std::memory_order_relaxed);
+    return result;
+}
+
+// Mapped writable only so waiting readers can register in the header;
+// nothing else in the ring is written from this side
+SharedFrameReader::SharedFrameReader(const std::string& name) : name_(shm_name(name)) {
+    const int fd = shm_open(name_.c_str(), O_RDWR | O_CLOEXEC, 0);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open shared memory " + name_ + ": " + strerror(errno));
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(SharedFramesHeader)) {
+        ::close(fd);
+        throw std::runtime_error("Not a shared frame ring: " + name_);
+    }
+    mapped_size_ = static_cast<size_t>(st.st_size);
+    void* mapped = mmap(nullptr, mapped_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED) {
+        throw std::runtime_error("Cannot map shared memory " + name_);
+    }
+    base_ = static_cast<uint8_t*>(mapped);
+    header_ = reinterpret_cast<SharedFramesHeader*>(base_);
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const bool valid = memcmp(header_->magic, SHARED_FRAMES_MAGIC, sizeof(header_->magic)) == 0 &&
+                       header_->version == SHARED_FRAMES_VERSION &&
+                       header_->slot_count > 0 &&
+                       header_->slot_header_size == sizeof(SharedFrameSlot) &&
+                       header_->slot_stride >= sizeof(SharedFrameSlot) + header_->slot_size &&
+                       header_->header_size + header_->slot_stride * header_->slot_count <= mapped_size_;
+    if (!valid) {
+        munmap(base_, mapped_size_);
+        throw std::runtime_error("Not a shared frame ring (or another version): " + name_);
+    }
+}
+
+SharedFrameReader::~SharedFrameReader() {
+    munmap(base_, mapped_size_);
+}
+
+SharedFrameSlot* SharedFrameReader::slot(uint64_t index) const {
+    return slot_at(base_, header_, index);
+}
+
+const uint8_t* SharedFrameReader::payload(uint64_t index) const {
+    return reinterpret_cast<const uint8_t*>(slot(index)) + sizeof(SharedFrameSlot);
+}
+
+bool SharedFrameReader::info(uint64_t index, SharedFrameInfo& out, uint32_t& seq) const {
+    if (index >= write_index()) {
+        return false;
+    }
+    const SharedFrameSlot* target = slot(index);
+    for (int attempt = 0; attempt < READ_ATTEMPTS; attempt++) {
+        const uint32_t before = target->seq.load(std::memory_order_acquire);
+        if (before & 1) {
+            std::this_thread::yield();
+            continue;
+        }
+        memcpy(&out, &target->info, sizeof(out));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (before == target->seq.load(std::memory_order_relaxed)) {
+            seq = before;
+            return out.index == index && out.size <= header_->slot_size;
+        }
+    }
+    return false;
+}
+
+bool SharedFrameReader::unchanged(uint64_t index, uint32_t seq) const {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot(index)->seq.load(std::memory_order_relaxed) == seq;
+}
+
+bool SharedFrameReader::copy(uint64_t index, SharedFrameInfo& info, uint8_t* dst, size_t capacity) const {
+    for (int attempt = 0; attempt < READ_ATTEMPTS; attempt++) {
+        uint32_t seq;
+        if (!this->info(index, info, seq) || info.size > capacity) {
+            return false;
+        }
+        memcpy(dst, payload(index), info.size);
+        if (unchanged(index, seq)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool SharedFrameReader::wait(uint64_t index, std::chrono::nanoseconds timeout) const {
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+    for (;;) {
+        if (write_index() > index) {
+            return true;
+        }
+        if (closed()) {
+            return false;
+        }
+        const auto left = deadline - std::chrono::steady_clock::now();
+        if (left <= std::chrono::nanoseconds::zero()) {
+            return false;
+        }
+#if defined(__linux__)
+        // Registering first means a publish after the check below either
+        // sees us waiting or changes notify_seq before we sleep on it
+        header_->waiters.fetch_add(1);
+        const uint32_t seen = header_->notify_seq.load();
+        if (write_index() <= index && !closed()) {
+            futex_wait(&header_->notify_seq, seen,
+                       std::chrono::duration_cast<std::chrono::nanoseconds>(left));
+        }
+        header_->waiters.fetch_sub(1);
+#else
+        std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(
+            left, std::chrono::milliseconds(1)));
+#endif
+    }
+}
+
+#else
+
+SharedFrameWriter::SharedFrameWriter(const std::string&, uint32_t, size_t) {
+    throw std::runtime_error("Shared frame rings are not supported on Windows");
+}
+
+SharedFrameWriter::~SharedFrameWriter() = default;
+
+bool SharedFrameWriter::publish(const VideoFrame&) { return false; }
+bool SharedFrameWriter::publish(const uint8_t*, const SharedFrameInfo&) { return false; }
+void SharedFrameWriter::close() {}
+SharedFrameWriter::Stats SharedFrameWriter::stats() const { return Stats(); }
+
+SharedFrameReader::SharedFrameReader(const std::string&) {
+    throw std::runtime_error("Shared frame rings are not supported on Windows");
+}
+
+SharedFrameReader::~SharedFrameReader() = default;
+
+SharedFrameSlot* SharedFrameReader::slot(uint64_t) const { return nullptr; }
+const uint8_t* SharedFrameReader::payload(uint64_t) const { return nullptr; }
+bool SharedFrameReader::info(uint64_t, SharedFrameInfo&, uint32_t&) const { return false; }
+bool SharedFrameReader::unchanged(uint64_t, uint32_t) const { return false; }
+bool SharedFrameReader::copy(uint64_t, SharedFrameInfo&, uint8_t*, size_t) const { return false; }
+bool SharedFrameReader::wait(uint64_t, std::chrono::nanoseconds) const { return false; }
+
+#endif
@@ -0,0 +1,171 @@
+/**
+ * shared_frames.h - Cross-process frame ring in POSIX shared memory
+ *
+ * A Session can publish every frame it delivers into a named shm object
+ * (shm_open) that other processes map, so a multiprocessing consumer
+ * gets pixels without pickling or a socket copy. Layout, native
+ * (little) endian:
+ *
+ *   SharedFramesHeader                        128 bytes, magic "PCNGSHM1"
+ *   { SharedFrameSlot, payload }              slot_count times, slot_stride apart
+ *
+ * Each slot carries the VideoFrame layout (format, size, stream position
+ * and timings) in a seqlock: its sequence is odd while the writer fills
+ * the slot, and a reader that sees the same even value before and after
+ * reading knows it got an untorn frame. The writer never waits on
+ * readers; a reader that falls a whole ring behind just finds newer
+ * frames in the slots.
+ *
+ * Readers sleep on the header's notify word: a futex on Linux, short
+ * polls elsewhere. Not available on Windows.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "video_frame.h"
+
+constexpr char SHARED_FRAMES_MAGIC[8] = {'P', 'C', 'N', 'G', 'S', 'H', 'M', '1'};
+constexpr uint32_t SHARED_FRAMES_VERSION = 1;
+
+struct SharedFramesHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;       // bytes before slot 0
+    uint32_t slot_count;
+    uint32_t slot_header_size;  // bytes before a slot's payload
+    uint64_t slot_size;         // payload capacity of a slot
+    uint64_t slot_stride;       // slot header + payload, 64-byte multiple
+    int32_t writer_pid;
+    uint32_t reserved0;
+    std::atomic<uint64_t> write_index;  // frames published so far
+    std::atomic<uint32_t> notify_seq;   // futex word, bumped per frame and on close
+    std::atomic<uint32_t> waiters;      // readers sleeping on notify_seq
+    std::atomic<uint32_t> closed;       // the writer is gone
+    uint32_t reserved1;
+    uint8_t reserved[56];
+};
+
+// What a slot holds; copied as a whole under the slot's seqlock
+struct SharedFrameInfo {
+    uint64_t index;         // write_index the frame was published at
+    uint64_t sequence;      // VideoFrame::sequence()
+    int64_t timestamp_ns;
+    int64_t decoded_ns;
+    int64_t ready_ns;
+    uint64_t size;          // payload bytes
+    int32_t pixel_format;   // PixelFormat
+    int32_t width;
+    int32_t height;
+    int32_t frames_lost;
+    uint8_t frame_recovered;
+    uint8_t reserved[3];
+    float change_score;     // VideoFrame::change_score(), -1 if not measured
+    uint64_t luma_hash;
+};
+
+struct SharedFrameSlot {
+    std::atomic<uint32_t> seq;  // odd while the writer fills the slot
+    uint32_t reserved0;
+    SharedFrameInfo info;
+    uint8_t reserved[40];
+};
+
+static_assert(sizeof(SharedFramesHeader) == 128, "SharedFramesHeader layout");
+static_assert(sizeof(SharedFrameInfo) == 80, "SharedFrameInfo layout");
+static_assert(sizeof(SharedFrameSlot) == 128, "SharedFrameSlot layout");
+static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free,
+              "shared memory atomics must be address-free");
+
+// Creates the ring and publishes frames into it; one producer thread
+class SharedFrameWriter {
+public:
+    // `name` is an shm name with or without the leading '/'; a stale
+    // object of that name is replaced
+    SharedFrameWriter(const std::string& name, uint32_t slot_count, size_t slot_size);
+    ~SharedFrameWriter();
+
+    SharedFrameWriter(const SharedFrameWriter&) = delete;
+    SharedFrameWriter& operator=(const SharedFrameWriter&) = delete;
+
+    // Copies the frame into the next slot; false (and counted) when it
+    // does not fit. Taps are not exported.
+    bool publish(const VideoFrame& frame);
+    bool publish(const uint8_t* data, const SharedFrameInfo& info);
+
+    // Marks the ring closed, wakes readers and unlinks the name; readers
+    // already attached keep their mapping
+    void close();
+
+    const std::string& name() const { return name_; }
+    uint32_t slot_count() const { return header_->slot_count; }
+    size_t slot_size() const { return static_cast<size_t>(header_->slot_size); }
+
+    struct Stats {
+        uint64_t published = 0;
+        uint64_t oversize = 0;   // frames larger than a slot, not published
+    };
+    Stats stats() const;
+
+private:
+    std::string name_;
+    uint8_t* base_ = nullptr;
+    size_t mapped_size_ = 0;
+    SharedFramesHeader* header_ = nullptr;
+    bool closed_ = false;
+    std::atomic<uint64_t> published_{0};
+    std::atomic<uint64_t> oversize_{0};
+};
+
+// Attaches to a ring created by a SharedFrameWriter, possibly in another
+// process. Every method is safe from any thread.
+class SharedFrameReader {
+public:
+    explicit SharedFrameReader(const std::string& name);
+    ~SharedFrameReader();
+
+    SharedFrameReader(const SharedFrameReader&) = delete;
+    SharedFrameReader& operator=(const SharedFrameReader&) = delete;
+
+    const std::string& name() const { return name_; }
+    uint32_t slot_count() const { return header_->slot_count; }
+    size_t slot_size() const { return static_cast<size_t>(header_->slot_size); }
+    int32_t writer_pid() const { return header_->writer_pid; }
+    uint64_t write_index() const { return header_->write_index.load(std::memory_order_acquire); }
+    bool closed() const { return header_->closed.load(std::memory_order_acquire) != 0; }
+
+    // Metadata of the frame published at `index`, and the slot sequence it
+    // was read under; false once the slot holds another frame (or none yet)
+    bool info(uint64_t index, SharedFrameInfo& out, uint32_t& seq) const;
+
+    // True while the slot still holds what info() saw under `seq`, i.e.
+    // everything read from payload() since then is untorn
+    bool unchanged(uint64_t index, uint32_t seq) const;
+
+    // Start of the slot for `index`; only meaningful with info()/unchanged()
+    const uint8_t* payload(uint64_t index) const;
+
+    // Copies the frame at `index` out of the ring, retrying if the writer
+    // was mid-update; false if it was overwritten
+    bool copy(uint64_t index, SharedFrameInfo& info, uint8_t* dst, size_t capacity) const;
+
+    // Sleeps until the frame at `index` is published, the writer closes or
+    // the timeout passes; returns whether it was published
+    bool wait(uint64_t index, std::chrono::nanoseconds timeout) const;
+
+private:
+    SharedFrameSlot* slot(uint64_t index) const;
+
+    std::string name_;
+    uint8_t* base_ = nullptr;
+    size_t mapped_size_ = 0;
+    SharedFramesHeader* header_ = nullptr;
+};
+
+// Info for a VideoFrame as the writer stores it
+SharedFrameInfo shared_frame_info(const VideoFrame& frame);
@@ -0,0 +1,120 @@
+/**
+ * spsc_ring.h - Bounded lock-free ring between a chiaki thread and Python
+ *
+ * One producer (a chiaki callback thread) pushes, one consumer (the Python
+ * thread calling next_frame()/next_event()) pops. Neither side takes a lock
+ * or the GIL. Cells carry a sequence number (Vyukov-style), which lets the
+ * producer evict the oldest entry itself when the ring is full and the
+ * overflow policy is DROP_OLDEST.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+enum class OverflowPolicy {
+    DROP_OLDEST,
+    DROP_NEWEST
+};
+
+template <typename T>
+class SpscRing {
+public:
+    SpscRing(size_t capacity, OverflowPolicy policy)
+        : capacity_(round_up_pow2(capacity)), mask_(capacity_ - 1), policy_(policy),
+          cells_(new Cell[capacity_]) {
+        for (size_t i = 0; i < capacity_; i++) {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    // Producer side. Returns false if the new value itself was dropped.
+    bool push(T value) {
+        const size_t pos = head_.load(std::memory_order_relaxed);
+        Cell& cell = cells_[pos & mask_];
+
+        while (cell.sequence.load(std::memory_order_acquire) != pos) {
+            if (policy_ == OverflowPolicy::DROP_NEWEST) {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            // Full: make room by discarding the oldest entry
+            T evicted;
+            if (try_pop(evicted)) {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        cell.value = std::move(value);
+        cell.sequence.store(pos + 1, std::memory_order_release);
+        head_.store(pos + 1, std::memory_order_release);
+        pushed_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // Consumer side (and the producer when evicting)
+    bool try_pop(T& out) {
+        size_t pos = tail_.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = cells_[pos & mask_];
+            const size_t seq = cell.sequence.load(std::memory_order_acquire);
+            const intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    out = std::move(cell.value);
+                    cell.value = T();
+                    cell.sequence.store(pos + capacity_, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false; // Empty
+            } else {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool empty() const { return size() == 0; }
+
+    size_t size() const {
+        const size_t head = head_.load(std::memory_order_acquire);
+        const size_t tail = tail_.load(std::memory_order_acquire);
+        return head > tail ? head - tail : 0;
+    }
+
+    size_t capacity() const { return capacity_; }
+    OverflowPolicy policy() const { return policy_; }
+    uint64_t pushed() const { return pushed_.load(std::memory_order_relaxed); }
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    static size_t round_up_pow2(size_t value) {
+        size_t result = 1;
+        while (result < value) {
+            result <<= 1;
+        }
+        return result;
+    }
+
+    const size_t capacity_;
+    const size_t mask_;
+    const OverflowPolicy policy_;
+    std::unique_ptr<Cell[]> cells_;
+
+    alignas(64) std::atomic<size_t> head_{0};
+    alignas(64) std::atomic<size_t> tail_{0};
+    alignas(64) std::atomic<uint64_t> pushed_{0};
+    std::atomic<uint64_t> dropped_{0};
+};
@@ -0,0 +1,202 @@
+/**
+ * stream_recording.cpp - Raw session capture container
+ *
+ * The recorder writes through a large stdio buffer so the chiaki threads
+ * only pay for a memcpy per sample in the common case. The reader maps
+ * the whole file and indexes the records once up front.
+ */
+
+#include "stream_recording.h"
+
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+constexpr size_t WRITE_BUFFER_SIZE = 1 << 20;
+}
+
+StreamRecorder::StreamRecorder(const std::string& path, uint32_t codec) {
+    file_ = std::fopen(path.c_str(), "wb");
+    if (!file_) {
+        throw std::runtime_error("Cannot create recording: " + path);
+    }
+    std::setvbuf(file_, nullptr, _IOFBF, WRITE_BUFFER_SIZE);
+
+    RecordingHeader header = {};
+    memcpy(header.magic, RECORDING_MAGIC, sizeof(header.magic));
+    header.version = RECORDING_VERSION;
+    header.codec = codec;
+    std::fwrite(&header, sizeof(header), 1, file_);
+    bytes_ = sizeof(header);
+}
+
+StreamRecorder::~StreamRecorder() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::fclose(file_);
+}
+
+void StreamRecorder::write_sample(const uint8_t* buf, size_t buf_size, int32_t frames_lost,
+                                  bool frame_recovered, int64_t timestamp_ns) {
+    RecordHeader header = {};
+    header.kind = static_cast<uint32_t>(RecordKind::VIDEO_SAMPLE);
+    header.size = static_cast<uint32_t>(buf_size);
+    header.timestamp_ns = timestamp_ns;
+    header.frames_lost = frames_lost;
+    header.frame_recovered = frame_recovered ? 1 : 0;
+    write_record(header, buf, buf_size, nullptr, 0);
+}
+
+void StreamRecorder::write_event(uint32_t type, uint32_t quit_reason, const std::string& reason_str,
+                                 int64_t timestamp_ns) {
+    RecordedEvent event = {type, quit_reason};
+
+    RecordHeader header = {};
+    header.kind = static_cast<uint32_t>(RecordKind::EVENT);
+    header.size = static_cast<uint32_t>(sizeof(event) + reason_str.size());
+    header.timestamp_ns = timestamp_ns;
+    write_record(header, &event, sizeof(event), reason_str.data(), reason_str.size());
+}
+
+void StreamRecorder::write_record(const RecordHeader& header, const void* head, size_t head_size,
+                                  const void* tail, size_t tail_size) {
+    static const uint8_t zeros[RECORD_ALIGN] = {};
+    const size_t padding = record_padding(head_size + tail_size);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::fwrite(&header, sizeof(header), 1, file_);
+    if (head_size > 0) {
+        std::fwrite(head, 1, head_size, file_);
+    }
+    if (tail_size > 0) {
+        std::fwrite(tail, 1, tail_size, file_);
+    }
+    if (padding > 0) {
+        std::fwrite(zeros, 1, padding, file_);
+    }
+    records_++;
+    bytes_ += sizeof(header) + head_size + tail_size + padding;
+}
+
+uint64_t StreamRecorder::records() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return records_;
+}
+
+uint64_t StreamRecorder::bytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return bytes_;
+}
+
+StreamRecording::StreamRecording(const std::string& path) {
+#if !defined(_WIN32)
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open recording: " + path);
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void* mapping = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED) {
+            data_ = static_cast<const uint8_t*>(mapping);
+            size_ = static_cast<size_t>(st.st_size);
+            mapped_ = true;
+            madvise(mapping, size_, MADV_SEQUENTIAL);
+        }
+    }
+    close(fd);
+#endif
+
+    if (!mapped_) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file) {
+            throw std::runtime_error("Cannot open recording: " + path);
+        }
+        fallback_.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        data_ = fallback_.data();
+        size_ = fallback_.size();
+    }
+
+    try {
+        index(path);
+    } catch (...) {
+#if !defined(_WIN32)
+        if (mapped_) {
+            munmap(const_cast<uint8_t*>(data_), size_);
+        }
+#endif
+        throw;
+    }
+}
+
+StreamRecording::~StreamRecording() {
+#if !defined(_WIN32)
+    if (mapped_) {
+        munmap(const_cast<uint8_t*>(data_), size_);
+    }
+#endif
+}
+
+void StreamRecording::index(const std::string& path) {
+    RecordingHeader header;
+    if (size_ < sizeof(header)) {
+        throw std::runtime_error("Not a recording (too short): " + path);
+    }
+    memcpy(&header, data_, sizeof(header));
+    if (memcmp(header.magic, RECORDING_MAGIC, sizeof(header.magic)) != 0) {
+        throw std::runtime_error("Not a recording (bad magic): " + path);
+    }
+    if (header.version != RECORDING_VERSION && header.version != RECORDING_VERSION_CONTROLLER) {
+        throw std::runtime_error("Unsupported recording version: " + std::to_string(header.version));
+    }
+    codec_ = header.codec;
+
+    size_t offset = sizeof(header);
+    while (offset + sizeof(RecordHeader) <= size_) {
+        RecordHeader record;
+        memcpy(&record, data_ + offset, sizeof(record));
+        offset += sizeof(record);
+
+        // A partial trailing record means the writer was killed mid-write;
+        // keep everything before it
+        if (record.size > size_ - offset) {
+            break;
+        }
+
+        const RecordKind kind = static_cast<RecordKind>(record.kind);
+        if (kind != RecordKind::VIDEO_SAMPLE && kind != RecordKind::EVENT &&
+            (kind != RecordKind::CONTROLLER_STATE || header.version < RECORDING_VERSION_CONTROLLER)) {
+            throw std::runtime_error("Corrupt recording (unknown record kind): " + path);
+        }
+        if (kind == RecordKind::EVENT && record.size < sizeof(RecordedEvent)) {
+            throw std::runtime_error("Corrupt recording (short event): " + path);
+        }
+        if (kind == RecordKind::CONTROLLER_STATE && record.size != RECORDED_CONTROLLER_STATE_SIZE) {
+            throw std::runtime_error("Corrupt recording (bad controller state): " + path);
+        }
+
+        records_.push_back({kind, data_ + offset, record.size, record.timestamp_ns,
+                            record.frames_lost, record.frame_recovered != 0});
+        if (kind == RecordKind::VIDEO_SAMPLE) {
+            sample_count_++;
+        } else if (kind == RecordKind::EVENT) {
+            event_count_++;
+        }
+        offset += record.size + record_padding(record.size);
+    }
+}
+
+int64_t StreamRecording::duration_ns() const {
+    if (records_.empty()) {
+        return 0;
+    }
+    return records_.back().timestamp_ns - records_.front().timestamp_ns;
+}
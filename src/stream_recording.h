@@ -0,0 +1,142 @@
+/**
+ * stream_recording.h - Raw session capture container
+ *
+ * Tees what arrives in the session callbacks (encoded video samples with
+ * their loss flags, and events) into a flat file that can be mmap'd and
+ * played back without a console. Layout, native (little) endian:
+ *
+ *   RecordingHeader                       24 bytes, magic "PCNGREC1"
+ *   { RecordHeader, payload, pad to 8 }   repeated until EOF
+ *
+ * Every record header is 8-byte aligned, so a mapped file can be walked
+ * in place. Video payloads are the NAL bytes chiaki handed us; event
+ * payloads are a RecordedEvent followed by the reason string; controller
+ * state payloads are CONTROLLER_LAYOUT_SIZE float32 in raw units, see
+ * controller_layout.h.
+ *
+ * Version 1 files hold samples and events only. Files with controller
+ * states (flight recorder dumps) are version 2, so readers that predate
+ * them refuse the file by version rather than as corrupt.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "controller_layout.h"
+
+enum class RecordKind : uint32_t {
+    VIDEO_SAMPLE = 1,
+    EVENT = 2,
+    CONTROLLER_STATE = 3,  // version 2 and up
+};
+
+#pragma pack(push, 1)
+struct RecordingHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t codec;   // ChiakiCodec of the recorded stream
+    uint64_t reserved;
+};
+
+struct RecordHeader {
+    uint32_t kind;    // RecordKind
+    uint32_t size;    // payload bytes, excluding padding
+    int64_t timestamp_ns;
+    int32_t frames_lost;
+    uint8_t frame_recovered;
+    uint8_t reserved[3];
+};
+
+struct RecordedEvent {
+    uint32_t type;         // ChiakiEventType
+    uint32_t quit_reason;  // ChiakiQuitReason, QUIT events only
+};
+#pragma pack(pop)
+
+static_assert(sizeof(RecordingHeader) == 24, "RecordingHeader layout");
+static_assert(sizeof(RecordHeader) == 24, "RecordHeader layout");
+
+constexpr char RECORDING_MAGIC[8] = {'P', 'C', 'N', 'G', 'R', 'E', 'C', '1'};
+constexpr uint32_t RECORDING_VERSION = 1;              // samples and events
+constexpr uint32_t RECORDING_VERSION_CONTROLLER = 2;   // plus controller states
+constexpr size_t RECORD_ALIGN = 8;
+constexpr size_t RECORDED_CONTROLLER_STATE_SIZE = CONTROLLER_LAYOUT_SIZE * sizeof(float);
+
+inline size_t record_padding(size_t size) {
+    return (RECORD_ALIGN - size % RECORD_ALIGN) % RECORD_ALIGN;
+}
+
+// Appends records to a recording; safe to call from the video and event threads
+class StreamRecorder {
+public:
+    // Throws std::runtime_error if the file can't be created
+    StreamRecorder(const std::string& path, uint32_t codec);
+    ~StreamRecorder();
+
+    StreamRecorder(const StreamRecorder&) = delete;
+    StreamRecorder& operator=(const StreamRecorder&) = delete;
+
+    void write_sample(const uint8_t* buf, size_t buf_size, int32_t frames_lost,
+                      bool frame_recovered, int64_t timestamp_ns);
+    void write_event(uint32_t type, uint32_t quit_reason, const std::string& reason_str,
+                     int64_t timestamp_ns);
+
+    uint64_t records() const;
+    uint64_t bytes() const;
+
+private:
+    void write_record(const RecordHeader& header, const void* head, size_t head_size,
+                      const void* tail, size_t tail_size);
+
+    mutable std::mutex mutex_;
+    FILE* file_ = nullptr;
+    uint64_t records_ = 0;
+    uint64_t bytes_ = 0;
+};
+
+// One record of a mapped recording; payload points into the mapping
+struct RecordView {
+    RecordKind kind;
+    const uint8_t* payload;
+    uint32_t size;
+    int64_t timestamp_ns;
+    int32_t frames_lost;
+    bool frame_recovered;
+};
+
+// Read-only view of a recording file, memory mapped where supported
+class StreamRecording {
+public:
+    // Throws std::runtime_error on I/O errors, bad magic or truncation
+    explicit StreamRecording(const std::string& path);
+    ~StreamRecording();
+
+    StreamRecording(const StreamRecording&) = delete;
+    StreamRecording& operator=(const StreamRecording&) = delete;
+
+    uint32_t codec() const { return codec_; }
+    const std::vector<RecordView>& records() const { return records_; }
+    size_t sample_count() const { return sample_count_; }
+    size_t event_count() const { return event_count_; }
+    size_t controller_state_count() const { return records_.size() - sample_count_ - event_count_; }
+    int64_t duration_ns() const;
+
+private:
+    void index(const std::string& path);
+
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+    bool mapped_ = false;
+    std::vector<uint8_t> fallback_;
+
+    uint32_t codec_ = 0;
+    size_t sample_count_ = 0;
+    size_t event_count_ = 0;
+    std::vector<RecordView> records_;
+};
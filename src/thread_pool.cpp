@@ -0,0 +1,202 @@
+/**
+ * thread_pool.cpp - Shared work-stealing pool for decode/convert work
+ *
+ * Each worker owns a deque. Tasks submitted from a worker go to the front
+ * of its own deque (hot caches, LIFO); tasks from outside (chiaki's video
+ * threads) are spread round-robin. Idle workers steal from the back of
+ * their neighbours' deques before going to sleep.
+ */
+
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace {
+// Index of the pool worker running on this thread, if any
+thread_local const WorkStealingPool* current_pool = nullptr;
+thread_local size_t current_worker = 0;
+
+// Tasks a strand runs before yielding its worker to other strands
+constexpr size_t STRAND_BATCH = 4;
+}
+
+WorkStealingPool::WorkStealingPool(size_t threads) {
+    if (threads == 0) {
+        threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+    }
+
+    workers_.reserve(threads);
+    for (size_t i = 0; i < threads; i++) {
+        workers_.push_back(std::make_unique<Worker>());
+    }
+
+    threads_.reserve(threads);
+    for (size_t i = 0; i < threads; i++) {
+        threads_.emplace_back(&WorkStealingPool::run, this, i);
+    }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        stopping_ = true;
+    }
+    sleep_cond_.notify_all();
+
+    for (auto& thread : threads_) {
+        thread.join();
+    }
+}
+
+void WorkStealingPool::submit(Task task) {
+    const bool local = current_pool == this;
+    const size_t index = local
+        ? current_worker
+        : next_worker_.fetch_add(1, std::memory_order_relaxed) % workers_.size();
+
+    // Count before queueing so a fast thief can never drive pending_ below zero
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        pending_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    {
+        Worker& worker = *workers_[index];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        if (local) {
+            worker.tasks.push_front(std::move(task));
+        } else {
+            worker.tasks.push_back(std::move(task));
+        }
+    }
+    sleep_cond_.notify_one();
+}
+
+bool WorkStealingPool::pop_local(size_t index, Task& task) {
+    Worker& worker = *workers_[index];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    if (worker.tasks.empty()) {
+        return false;
+    }
+    task = std::move(worker.tasks.front());
+    worker.tasks.pop_front();
+    return true;
+}
+
+bool WorkStealingPool::steal(size_t index, Task& task) {
+    for (size_t offset = 1; offset < workers_.size(); offset++) {
+        Worker& victim = *workers_[(index + offset) % workers_.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.back());
+            victim.tasks.pop_back();
+            steals_.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkStealingPool::run(size_t index) {
+    current_pool = this;
+    current_worker = index;
+
+    for (;;) {
+        Task task;
+        if (pop_local(index, task) || steal(index, task)) {
+            pending_.fetch_sub(1, std::memory_order_relaxed);
+            task();
+            executed_.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleep_mutex_);
+        sleep_cond_.wait(lock, [this] {
+            return stopping_ || pending_.load(std::memory_order_relaxed) > 0;
+        });
+        if (stopping_ && pending_.load(std::memory_order_relaxed) == 0) {
+            return;
+        }
+    }
+}
+
+// Queued drain tasks keep the state alive but not the pool: the last pool
+// reference must never be dropped on one of its own workers
+struct Strand::State {
+    WorkStealingPool* pool = nullptr;
+    mutable std::mutex mutex;
+    std::condition_variable idle;
+    std::deque<WorkStealingPool::Task> tasks;
+    bool scheduled = false;
+    bool running = false;
+    bool closed = false;
+};
+
+Strand::Strand(std::shared_ptr<WorkStealingPool> pool)
+    : pool_(std::move(pool)), state_(std::make_shared<State>()) {
+    state_->pool = pool_.get();
+}
+
+Strand::~Strand() {
+    shutdown();
+}
+
+void Strand::post(WorkStealingPool::Task task) {
+    bool schedule = false;
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        if (state_->closed) {
+            return;
+        }
+        state_->tasks.push_back(std::move(task));
+        if (!state_->scheduled) {
+            state_->scheduled = true;
+            schedule = true;
+        }
+    }
+
+    if (schedule) {
+        auto state = state_;
+        state->pool->submit([state] { drain(state); });
+    }
+}
+
+void Strand::drain(const std::shared_ptr<State>& state) {
+    for (size_t i = 0; i < STRAND_BATCH; i++) {
+        WorkStealingPool::Task task;
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            if (state->tasks.empty()) {
+                state->scheduled = false;
+                return;
+            }
+            task = std::move(state->tasks.front());
+            state->tasks.pop_front();
+            state->running = true;
+        }
+
+        task();
+
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            state->running = false;
+        }
+        state->idle.notify_all();
+    }
+
+    // Batch used up: requeue behind other strands instead of hogging the worker
+    state->pool->submit([state] { drain(state); });
+}
+
+void Strand::shutdown() {
+    std::unique_lock<std::mutex> lock(state_->mutex);
+    state_->closed = true;
+    state_->tasks.clear();
+    state_->idle.wait(lock, [this] { return !state_->running; });
+}
+
+size_t Strand::queued() const {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    return state_->tasks.size();
+}
@@ -0,0 +1,86 @@
+/**
+ * thread_pool.h - Shared work-stealing pool for decode/convert work
+ *
+ * One pool is sized to the machine and shared by every session in a
+ * SessionPool, instead of each session spinning up its own decoder
+ * threads. Work for a single stream must stay in order (H.264/H.265
+ * decoding is sequential), so sessions post through a Strand, which runs
+ * its tasks one at a time on whichever worker picks it up.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class WorkStealingPool {
+public:
+    using Task = std::function<void()>;
+
+    // threads == 0 sizes the pool to the hardware concurrency
+    explicit WorkStealingPool(size_t threads = 0);
+    ~WorkStealingPool();
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    void submit(Task task);
+
+    size_t thread_count() const { return workers_.size(); }
+    size_t pending() const { return pending_.load(std::memory_order_relaxed); }
+    uint64_t executed() const { return executed_.load(std::memory_order_relaxed); }
+    uint64_t steals() const { return steals_.load(std::memory_order_relaxed); }
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void run(size_t index);
+    bool pop_local(size_t index, Task& task);
+    bool steal(size_t index, Task& task);
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<std::thread> threads_;
+
+    std::mutex sleep_mutex_;
+    std::condition_variable sleep_cond_;
+    std::atomic<size_t> pending_{0};
+    std::atomic<size_t> next_worker_{0};
+    std::atomic<uint64_t> executed_{0};
+    std::atomic<uint64_t> steals_{0};
+    bool stopping_ = false;
+};
+
+// Serial executor on top of a WorkStealingPool
+class Strand {
+public:
+    explicit Strand(std::shared_ptr<WorkStealingPool> pool);
+    ~Strand();
+
+    Strand(const Strand&) = delete;
+    Strand& operator=(const Strand&) = delete;
+
+    void post(WorkStealingPool::Task task);
+
+    // Drops queued tasks and waits for the running one; later posts are ignored
+    void shutdown();
+
+    size_t queued() const;
+
+private:
+    struct State;
+
+    static void drain(const std::shared_ptr<State>& state);
+
+    std::shared_ptr<WorkStealingPool> pool_;
+    std::shared_ptr<State> state_;
+};
@@ -0,0 +1,56 @@
+/**
+ * triple_buffer.h - Single-slot "mailbox" between a producer and a reader
+ *
+ * The producer always has a private back slot to write into and publishes
+ * it by swapping with the shared middle slot; the reader swaps the middle
+ * slot with its front slot when something new was published. Neither side
+ * ever waits for the other and stale values are simply overwritten.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <utility>
+
+template <typename T>
+class TripleBuffer {
+public:
+    // Producer side
+    void publish(T value) {
+        slots_[back_] = std::move(value);
+        const uint8_t previous = middle_.exchange(static_cast<uint8_t>(back_ | DIRTY),
+                                                  std::memory_order_acq_rel);
+        back_ = previous & INDEX_MASK;
+    }
+
+    // Reader side: adopts the latest published value, if any. Returns
+    // false when nothing was published since the last call.
+    bool update() {
+        if (!(middle_.load(std::memory_order_relaxed) & DIRTY)) {
+            return false;
+        }
+        const uint8_t previous = middle_.exchange(front_, std::memory_order_acq_rel);
+        front_ = previous & INDEX_MASK;
+        has_value_ = true;
+        return true;
+    }
+
+    // True when update() would adopt a new value; safe from any thread
+    bool has_update() const {
+        return (middle_.load(std::memory_order_acquire) & DIRTY) != 0;
+    }
+
+    bool has_value() const { return has_value_; }
+    const T& front() const { return slots_[front_]; }
+
+private:
+    static constexpr uint8_t INDEX_MASK = 0x3;
+    static constexpr uint8_t DIRTY = 0x4;
+
+    T slots_[3];
+    uint8_t back_ = 0;
+    uint8_t front_ = 2;
+    bool has_value_ = false;
+    alignas(64) std::atomic<uint8_t> middle_{1};
+};
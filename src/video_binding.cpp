@@ -11,42 +11,288 @@
 #include <chiaki/video.h>
 #include <chiaki/ffmpegdecoder.h>
 
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <string>
+
+#include "color_convert.h"
+#include "probe_set.h"
+#include "shared_frames.h"
+#include "video_frame.h"
+
 namespace py = pybind11;
 
-// Video frame wrapper for easy Python/OpenCV integration
-class VideoFrame {
-public:
-    VideoFrame(uint8_t* data, size_t size, int width, int height) 
-        : width_(width), height_(height), size_(size) {
-        // Copy the data
-        data_.resize(size);
-        memcpy(data_.data(), data, size);
+// Shape/strides of a frame's pixels: (H, W) for GRAY, (H, W, C) for
+// BGR/RGB, float32 (C, H, W) for the *_F32_CHW tensors and a flat byte
+// vector for ENCODED samples
+static py::buffer_info pixel_buffer_info(uint8_t* data, size_t size, int frame_width, int frame_height,
+                                         PixelFormat format, bool readonly = false) {
+    if (format == PixelFormat::ENCODED) {
+        return py::buffer_info(data, static_cast<py::ssize_t>(size), readonly);
     }
     
-    py::array_t<uint8_t> to_numpy() {
-        // Return as numpy array that can be used with OpenCV
-        return py::array_t<uint8_t>(
-            {height_, width_, 3}, // shape (H, W, C) for BGR
-            {sizeof(uint8_t) * width_ * 3, sizeof(uint8_t) * 3, sizeof(uint8_t)}, // strides
-            data_.data()
-        );
+    const py::ssize_t height = frame_height;
+    const py::ssize_t width = frame_width;
+    const py::ssize_t channels = pixel_format_channels(format);
+    if (pixel_format_is_float(format)) {
+        const py::ssize_t item = sizeof(float);
+        return py::buffer_info(data, item,
+                               py::format_descriptor<float>::format(), 3,
+                               {channels, height, width},
+                               {height * width * item, width * item, item}, readonly);
     }
-    
-    py::bytes get_raw_data() {
-        return py::bytes(reinterpret_cast<char*>(data_.data()), size_);
+    if (channels == 1) {
+        return py::buffer_info(data, sizeof(uint8_t),
+                               py::format_descriptor<uint8_t>::format(), 2,
+                               {height, width},
+                               {width, static_cast<py::ssize_t>(1)}, readonly);
+    }
+    return py::buffer_info(data, sizeof(uint8_t),
+                           py::format_descriptor<uint8_t>::format(), 3,
+                           {height, width, channels},
+                           {width * channels, channels, static_cast<py::ssize_t>(1)}, readonly);
+}
+
+// ProbeSet results as a fresh float32 vector
+static py::array_t<float> probe_results_to_numpy(const std::vector<float>& results) {
+    return py::array_t<float>(static_cast<py::ssize_t>(results.size()), results.data());
+}
+
+static size_t add_template_probe(ProbeSet& probes, const std::string& name,
+                                 py::array_t<uint8_t, py::array::c_style | py::array::forcecast> pixels,
+                                 const std::array<int, 4>& region, bool locate) {
+    if (pixels.ndim() != 2) {
+        throw std::invalid_argument("template must be a 2-D grayscale uint8 array");
+    }
+    return probes.add_template(name, pixels.data(), static_cast<int>(pixels.shape(1)),
+                               static_cast<int>(pixels.shape(0)), region[0], region[1], region[2], region[3],
+                               locate);
+}
+
+static py::buffer_info video_frame_buffer_info(VideoFrame& frame) {
+    return pixel_buffer_info(frame.data(), frame.size(), frame.width(), frame.height(), frame.format());
+}
+
+// Zero-copy numpy view; the VideoFrame is the array's base, so the pooled
+// slab stays alive exactly as long as any view of it does
+py::array video_frame_to_numpy(py::object self) {
+    auto& frame = self.cast<VideoFrame&>();
+    py::buffer_info info = video_frame_buffer_info(frame);
+    return py::array(py::dtype(info.format), info.shape, info.strides, info.ptr, self);
+}
+
+// Tap frames share their slabs with the bundle, so this copies no pixels
+static py::dict video_frame_taps(const VideoFrame& frame) {
+    py::dict taps;
+    if (frame.taps()) {
+        for (const auto& tap : *frame.taps()) {
+            taps[py::str(tap.first)] = py::cast(tap.second);
+        }
+    }
+    return taps;
+}
+
+static py::tuple output_spec_roi(const OutputSpec& spec) {
+    return py::make_tuple(spec.roi_x, spec.roi_y, spec.roi_width, spec.roi_height);
+}
+
+static void set_output_spec_roi(OutputSpec& spec, const std::array<int, 4>& roi) {
+    spec.roi_x = roi[0];
+    spec.roi_y = roi[1];
+    spec.roi_width = roi[2];
+    spec.roi_height = roi[3];
+}
+
+static OutputSpec make_output_spec(int width, int height, std::optional<std::array<int, 4>> roi,
+                                   PixelFormat format, Resample resample,
+                                   std::array<float, 3> mean, std::array<float, 3> std) {
+    OutputSpec spec;
+    spec.width = width;
+    spec.height = height;
+    if (roi) {
+        set_output_spec_roi(spec, *roi);
+    }
+    spec.format = format;
+    spec.resample = resample;
+    spec.mean = mean;
+    spec.stddev = std;
+    spec.validate();
+    return spec;
+}
+
+// Converts a packed I420 or NV12 buffer (Y plane, then U and V or UV)
+// exactly like the decode path does
+static VideoFrame convert_yuv420(py::buffer data, int width, int height, const OutputSpec& spec,
+                                 bool nv12, bool full_range, ColorMatrix matrix) {
+    spec.validate();
+    if (width <= 0 || height <= 0) {
+        throw std::invalid_argument("width and height must be positive");
+    }
+    py::buffer_info info = data.request();
+    if (!PyBuffer_IsContiguous(info.view(), 'C')) {
+        throw std::invalid_argument("convert_yuv420 needs a C-contiguous buffer");
+    }
+    const size_t luma_size = static_cast<size_t>(width) * height;
+    const int chroma_width = (width + 1) / 2;
+    const size_t chroma_size = static_cast<size_t>(chroma_width) * ((height + 1) / 2);
+    if (static_cast<size_t>(info.size * info.itemsize) < luma_size + 2 * chroma_size) {
+        throw std::invalid_argument("buffer is smaller than a 4:2:0 picture of that size");
+    }
+
+    const auto* bytes = static_cast<const uint8_t*>(info.ptr);
+    YuvPicture picture;
+    picture.width = width;
+    picture.height = height;
+    picture.nv12 = nv12;
+    picture.full_range = full_range;
+    picture.matrix = matrix;
+    picture.planes[0] = bytes;
+    picture.strides[0] = width;
+    picture.planes[1] = bytes + luma_size;
+    picture.strides[1] = nv12 ? 2 * chroma_width : chroma_width;
+    picture.planes[2] = nv12 ? nullptr : bytes + luma_size + chroma_size;
+    picture.strides[2] = nv12 ? 0 : chroma_width;
+
+    const FrameConverter::Geometry geometry = FrameConverter::resolve(spec, width, height);
+    if (geometry.empty()) {
+        throw std::invalid_argument("roi lies outside the picture");
     }
+    const size_t size = FrameConverter::output_size(spec.format, geometry.width, geometry.height);
+    FrameBufferRef pixels = FrameBufferRef::allocate(size);
+    {
+        py::gil_scoped_release release;
+        FrameConverter().convert(picture, spec, geometry, pixels.data());
+    }
+    return VideoFrame(std::move(pixels), size, geometry.width, geometry.height, spec.format);
+}
+
+// A frame in a shared ring: its metadata as read under the slot's
+// seqlock and the sequence that read saw
+struct SharedFrame {
+    std::shared_ptr<SharedFrameReader> reader;
+    SharedFrameInfo info;
+    uint32_t seq = 0;
     
-    int width() const { return width_; }
-    int height() const { return height_; }
-    size_t size() const { return size_; }
+    bool valid() const { return reader->unchanged(info.index, seq); }
+    PixelFormat format() const { return static_cast<PixelFormat>(info.pixel_format); }
+};
 
-private:
-    std::vector<uint8_t> data_;
-    int width_;
-    int height_;
-    size_t size_;
+// Reader plus the consumer's position for next(); one consumer per object
+struct SharedFrameSource {
+    std::shared_ptr<SharedFrameReader> reader;
+    uint64_t next_index = 0;
+    uint64_t skipped = 0;
 };
 
+static std::optional<SharedFrame> read_shared_frame(const std::shared_ptr<SharedFrameReader>& reader,
+                                                    uint64_t index) {
+    SharedFrame frame;
+    frame.reader = reader;
+    if (!reader->info(index, frame.info, frame.seq)) {
+        return std::nullopt;
+    }
+    return frame;
+}
+
+// Read-only view of the slot, with the SharedFrame as its base so the
+// mapping outlives it. The writer reuses the slot slot_count frames later;
+// valid() tells whether it has yet.
+static py::array shared_frame_to_numpy(py::object self) {
+    auto& frame = self.cast<SharedFrame&>();
+    auto* data = const_cast<uint8_t*>(frame.reader->payload(frame.info.index));
+    py::buffer_info info = pixel_buffer_info(data, frame.info.size, frame.info.width, frame.info.height,
+                                             frame.format(), true);
+    py::array view(py::dtype(info.format), info.shape, info.strides, info.ptr, self);
+    view.attr("flags").attr("writeable") = false;
+    return view;
+}
+
+// Standalone VideoFrame copy; None if the slot was overwritten first
+static std::optional<VideoFrame> shared_frame_copy(const SharedFrame& frame) {
+    FrameBufferRef pixels = FrameBufferRef::allocate(frame.info.size);
+    SharedFrameInfo info;
+    bool copied;
+    {
+        py::gil_scoped_release release;
+        copied = frame.reader->copy(frame.info.index, info, pixels.data(), frame.info.size);
+    }
+    if (!copied) {
+        return std::nullopt;
+    }
+    VideoFrame result(std::move(pixels), info.size, info.width, info.height,
+                      static_cast<PixelFormat>(info.pixel_format));
+    result.set_loss_info(info.frames_lost, info.frame_recovered != 0);
+    result.set_capture_info(info.sequence, info.timestamp_ns);
+    result.set_decode_info(info.decoded_ns, info.ready_ns);
+    result.set_change_info(info.change_score, info.luma_hash);
+    return result;
+}
+
+// Waits (GIL released, Ctrl-C honoured) for the frame at `index`; None
+// waits until the writer closes
+static bool wait_shared_frame(const SharedFrameReader& reader, uint64_t index, std::optional<double> timeout) {
+    using Clock = std::chrono::steady_clock;
+    const auto slice = std::chrono::milliseconds(50);
+    const bool forever = !timeout || *timeout < 0;
+    const auto deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(forever ? 0.0 : *timeout));
+    
+    while (reader.write_index() <= index && !reader.closed()) {
+        const auto now = Clock::now();
+        if (!forever && now >= deadline) {
+            return false;
+        }
+        {
+            py::gil_scoped_release release;
+            const auto wait = forever ? slice : std::min<Clock::duration>(slice, deadline - now);
+            reader.wait(index, std::chrono::duration_cast<std::chrono::nanoseconds>(wait));
+        }
+        if (PyErr_CheckSignals() != 0) {
+            throw py::error_already_set();
+        }
+    }
+    return reader.write_index() > index;
+}
+
+static bool wait_shared_frame_index(const SharedFrameSource& source, uint64_t index, std::optional<double> timeout) {
+    return wait_shared_frame(*source.reader, index, timeout);
+}
+
+// The oldest frame after the last one next() returned, skipping any the
+// writer lapped
+static std::optional<SharedFrame> next_shared_frame(SharedFrameSource& source, std::optional<double> timeout) {
+    SharedFrameReader& reader = *source.reader;
+    for (;;) {
+        const uint64_t written = reader.write_index();
+        if (written > source.next_index + reader.slot_count()) {
+            source.skipped += written - reader.slot_count() - source.next_index;
+            source.next_index = written - reader.slot_count();
+        }
+        if (written > source.next_index) {
+            std::optional<SharedFrame> frame = read_shared_frame(source.reader, source.next_index++);
+            if (frame) {
+                return frame;
+            }
+            source.skipped++;
+            continue;
+        }
+        if (!wait_shared_frame(reader, source.next_index, timeout)) {
+            return std::nullopt;
+        }
+    }
+}
+
+static py::dict shared_frame_writer_stats(const SharedFrameWriter& writer) {
+    const SharedFrameWriter::Stats stats = writer.stats();
+    py::dict result;
+    result["published"] = stats.published;
+    result["oversize"] = stats.oversize;
+    return result;
+}
+
 // Video profile helper functions
 py::dict get_video_profile_info(const ChiakiVideoProfile& profile) {
     py::dict info;
@@ -57,6 +303,47 @@ py::dict get_video_profile_info(const ChiakiVideoProfile& profile) {
 }
 
 void init_video_binding(py::module& m) {
+    // Decoded pixel formats
+    py::enum_<PixelFormat>(m, "PixelFormat")
+        .value("BGR", PixelFormat::BGR)
+        .value("RGB", PixelFormat::RGB)
+        .value("GRAY", PixelFormat::GRAY)
+        .value("ENCODED", PixelFormat::ENCODED)
+        .value("RGB_F32_CHW", PixelFormat::RGB_F32_CHW)
+        .value("BGR_F32_CHW", PixelFormat::BGR_F32_CHW)
+        .export_values();
+    
+    py::enum_<Resample>(m, "Resample")
+        .value("NEAREST", Resample::NEAREST)
+        .value("BOX", Resample::BOX);
+    
+    py::enum_<ColorMatrix>(m, "ColorMatrix")
+        .value("BT601", ColorMatrix::BT601)
+        .value("BT709", ColorMatrix::BT709)
+        .value("BT2020", ColorMatrix::BT2020);
+    
+    // Crop/resize/format applied natively before frames reach Python
+    py::class_<OutputSpec>(m, "OutputSpec")
+        .def(py::init(&make_output_spec),
+             py::arg("width") = 0, py::arg("height") = 0, py::arg("roi") = py::none(),
+             py::arg("pixel_format") = PixelFormat::BGR, py::arg("resample") = Resample::NEAREST,
+             py::arg("mean") = std::array<float, 3>{0.0f, 0.0f, 0.0f},
+             py::arg("std") = std::array<float, 3>{1.0f, 1.0f, 1.0f})
+        .def_readwrite("width", &OutputSpec::width)
+        .def_readwrite("height", &OutputSpec::height)
+        .def_property("roi", &output_spec_roi, &set_output_spec_roi,
+                      "(x, y, width, height) in source pixels; 0 extents reach the frame edge")
+        .def_readwrite("pixel_format", &OutputSpec::format)
+        .def_readwrite("resample", &OutputSpec::resample)
+        .def_readwrite("mean", &OutputSpec::mean)
+        .def_readwrite("std", &OutputSpec::stddev)
+        .def("__repr__", [](const OutputSpec& spec) {
+            return "OutputSpec(width=" + std::to_string(spec.width) +
+                   ", height=" + std::to_string(spec.height) +
+                   ", roi=(" + std::to_string(spec.roi_x) + ", " + std::to_string(spec.roi_y) + ", " +
+                   std::to_string(spec.roi_width) + ", " + std::to_string(spec.roi_height) + "))";
+        });
+    
     // Video profile
     py::class_<ChiakiVideoProfile>(m, "VideoProfile")
         .def(py::init<>())
@@ -66,20 +353,197 @@ void init_video_binding(py::module& m) {
         .def("get_info", &get_video_profile_info, "Get video profile information as dict");
     
     // Video frame wrapper
-    py::class_<VideoFrame>(m, "VideoFrame")
+    py::class_<VideoFrame>(m, "VideoFrame", py::buffer_protocol())
+        .def_buffer(&video_frame_buffer_info)
         .def_property_readonly("width", &VideoFrame::width)
         .def_property_readonly("height", &VideoFrame::height)
         .def_property_readonly("size", &VideoFrame::size)
-        .def("to_numpy", &VideoFrame::to_numpy, "Convert to numpy array for OpenCV")
-        .def("get_raw_data", &VideoFrame::get_raw_data, "Get raw frame data as bytes");
+        .def_property_readonly("pixel_format", &VideoFrame::format)
+        .def_property_readonly("channels", &VideoFrame::channels)
+        .def_property_readonly("frames_lost", &VideoFrame::frames_lost)
+        .def_property_readonly("frame_recovered", &VideoFrame::frame_recovered)
+        .def_property_readonly("sequence", &VideoFrame::sequence)
+        .def_property_readonly("timestamp_ns", &VideoFrame::timestamp_ns,
+                               "Sample arrival time on the monotonic clock (time.monotonic_ns())")
+        .def_property_readonly("decoded_ns", &VideoFrame::decoded_ns,
+                               "When libavcodec returned the picture, same clock; 0 if not decoded")
+        .def_property_readonly("ready_ns", &VideoFrame::ready_ns,
+                               "When conversion finished and the frame was handed on, same clock")
+        .def_property_readonly("change_score", &VideoFrame::change_score,
+                               "% of luma cells changed since the last delivered frame; -1 without "
+                               "change detection")
+        .def_property_readonly("luma_hash", &VideoFrame::luma_hash,
+                               "64-bit average hash of the luma thumbnail; 0 without change detection")
+        .def_property_readonly("probes", [](const VideoFrame& self) -> std::optional<py::array_t<float>> {
+            if (!self.probes()) {
+                return std::nullopt;
+            }
+            return probe_results_to_numpy(*self.probes());
+        }, "float32 results of the session's ProbeSet for this frame, or None")
+        .def("to_numpy", &video_frame_to_numpy, "Zero-copy numpy view for OpenCV")
+        .def_property_readonly("taps", &video_frame_taps,
+                               "Named ROI taps decoded from the same picture, as a dict of VideoFrame")
+        .def("__getitem__", [](const VideoFrame& self, const std::string& name) {
+            const VideoFrame* tap = self.tap(name);
+            if (!tap) {
+                throw py::key_error(name);
+            }
+            return *tap;
+        }, "Get a tap by name")
+        .def("__contains__", [](const VideoFrame& self, const std::string& name) {
+            return self.tap(name) != nullptr;
+        })
+        .def("get_raw_data", [](VideoFrame& self) {
+            return py::bytes(reinterpret_cast<const char*>(self.data()), self.size());
+        }, "Get raw frame data as bytes");
+    
+    // Cross-process frame ring (Session.enable_shared_frames() creates one)
+    py::class_<SharedFrameWriter, std::shared_ptr<SharedFrameWriter>>(m, "SharedFrameWriter",
+        "Publishes VideoFrames into a named POSIX shared-memory ring")
+        .def(py::init([](const std::string& name, size_t slot_size, uint32_t slots) {
+                 return std::make_shared<SharedFrameWriter>(name, slots, slot_size);
+             }),
+             "Create the named ring with room for slots frames of up to slot_size bytes each",
+             py::arg("name"), py::arg("slot_size"), py::arg("slots") = 4)
+        .def("publish", [](SharedFrameWriter& writer, const VideoFrame& frame) { return writer.publish(frame); },
+             "Copy a frame into the next slot; False if it is larger than slot_size",
+             py::arg("frame"), py::call_guard<py::gil_scoped_release>())
+        .def("close", &SharedFrameWriter::close,
+             "Mark the ring closed and unlink its name; attached readers keep their mapping")
+        .def_property_readonly("name", &SharedFrameWriter::name)
+        .def_property_readonly("slot_count", &SharedFrameWriter::slot_count)
+        .def_property_readonly("slot_size", &SharedFrameWriter::slot_size)
+        .def("stats", &shared_frame_writer_stats, "Frames published and frames too large for a slot");
+    
+    py::class_<SharedFrame>(m, "SharedFrame", "A frame in a SharedFrameReader's ring")
+        .def_property_readonly("index", [](const SharedFrame& f) { return f.info.index; },
+                               "Position in the ring's publish order")
+        .def_property_readonly("width", [](const SharedFrame& f) { return f.info.width; })
+        .def_property_readonly("height", [](const SharedFrame& f) { return f.info.height; })
+        .def_property_readonly("size", [](const SharedFrame& f) { return f.info.size; })
+        .def_property_readonly("pixel_format", &SharedFrame::format)
+        .def_property_readonly("channels", [](const SharedFrame& f) { return pixel_format_channels(f.format()); })
+        .def_property_readonly("frames_lost", [](const SharedFrame& f) { return f.info.frames_lost; })
+        .def_property_readonly("frame_recovered", [](const SharedFrame& f) { return f.info.frame_recovered != 0; })
+        .def_property_readonly("sequence", [](const SharedFrame& f) { return f.info.sequence; })
+        .def_property_readonly("timestamp_ns", [](const SharedFrame& f) { return f.info.timestamp_ns; },
+                               "As VideoFrame.timestamp_ns; time.monotonic_ns() is the same clock "
+                               "in every process on the host")
+        .def_property_readonly("decoded_ns", [](const SharedFrame& f) { return f.info.decoded_ns; })
+        .def_property_readonly("ready_ns", [](const SharedFrame& f) { return f.info.ready_ns; })
+        .def_property_readonly("change_score", [](const SharedFrame& f) { return f.info.change_score; })
+        .def_property_readonly("luma_hash", [](const SharedFrame& f) { return f.info.luma_hash; })
+        .def("valid", &SharedFrame::valid,
+             "True while the slot still holds this frame; check after using to_numpy() data")
+        .def("to_numpy", &shared_frame_to_numpy,
+             "Read-only zero-copy view of the slot; the writer reuses it slot_count frames later")
+        .def("to_video_frame", &shared_frame_copy,
+             "Untorn standalone copy as a VideoFrame, or None if the slot was already reused");
+    
+    py::class_<SharedFrameSource>(m, "SharedFrameReader",
+        "Attaches to a shared frame ring by name, from this or another process")
+        .def(py::init([](const std::string& name) {
+            SharedFrameSource source;
+            source.reader = std::make_shared<SharedFrameReader>(name);
+            return source;
+        }), py::arg("name"))
+        .def_property_readonly("name", [](const SharedFrameSource& s) { return s.reader->name(); })
+        .def_property_readonly("slot_count", [](const SharedFrameSource& s) { return s.reader->slot_count(); })
+        .def_property_readonly("slot_size", [](const SharedFrameSource& s) { return s.reader->slot_size(); })
+        .def_property_readonly("writer_pid", [](const SharedFrameSource& s) { return s.reader->writer_pid(); })
+        .def_property_readonly("write_index", [](const SharedFrameSource& s) { return s.reader->write_index(); },
+                               "Frames published so far")
+        .def_property_readonly("closed", [](const SharedFrameSource& s) { return s.reader->closed(); },
+                               "True once the writer closed the ring")
+        .def_property_readonly("skipped", [](const SharedFrameSource& s) { return s.skipped; },
+                               "Frames next() never returned because the writer lapped them")
+        .def("read", [](const SharedFrameSource& s, uint64_t index) { return read_shared_frame(s.reader, index); },
+             "The frame published at index, or None if it is not (or no longer) in the ring",
+             py::arg("index"))
+        .def("latest", [](const SharedFrameSource& s) -> std::optional<SharedFrame> {
+            const uint64_t written = s.reader->write_index();
+            return written ? read_shared_frame(s.reader, written - 1) : std::nullopt;
+        }, "The most recently published frame, or None")
+        .def("next", &next_shared_frame,
+             "The next frame in publish order, waiting up to timeout (None waits until the writer "
+             "closes); None on timeout or close",
+             py::arg("timeout") = py::none())
+        .def("wait", &wait_shared_frame_index,
+             "Wait until the frame at index is published; False on timeout or close",
+             py::arg("index"), py::arg("timeout") = py::none());
+    
+    // HUD checks evaluated natively on every decoded frame
+    // (Session.set_probes()); each probe adds result columns
+    py::class_<ProbeSet, std::shared_ptr<ProbeSet>>(m, "ProbeSet",
+        "Batch of pixel, region and template probes evaluated in C++ into one float32 vector")
+        .def(py::init([](bool on_change, float tolerance) {
+            auto probes = std::make_shared<ProbeSet>();
+            probes->on_change = on_change;
+            probes->change_tolerance = tolerance;
+            return probes;
+        }), py::arg("on_change") = false, py::arg("tolerance") = 0.0f)
+        .def("add_pixel", &ProbeSet::add_pixel,
+             "1 when the mean colour of the (2*radius+1)^2 box at (x, y) is within tolerance of "
+             "color (R, G, B) on every channel, else 0; returns the column",
+             py::arg("name"), py::arg("x"), py::arg("y"), py::arg("color"),
+             py::arg("tolerance") = 16, py::arg("radius") = 0)
+        .def("add_mean", [](ProbeSet& probes, const std::string& name, const std::array<int, 4>& region,
+                            std::optional<int> channel) {
+            return probes.add_mean(name, region[0], region[1], region[2], region[3], channel.value_or(-1));
+        }, "Mean of region (x, y, width, height) in luma, or channel 0-2 (R, G, B); returns the column",
+           py::arg("name"), py::arg("region"), py::arg("channel") = py::none())
+        .def("add_variance", [](ProbeSet& probes, const std::string& name, const std::array<int, 4>& region,
+                                std::optional<int> channel) {
+            return probes.add_variance(name, region[0], region[1], region[2], region[3], channel.value_or(-1));
+        }, "Variance of region (x, y, width, height) in luma, or channel 0-2 (R, G, B); returns the column",
+           py::arg("name"), py::arg("region"), py::arg("channel") = py::none())
+        .def("add_template", &add_template_probe,
+             "Best normalized cross-correlation (-1..1) of a grayscale uint8 template (up to 128x128) "
+             "within region (x, y, width, height); locate adds name.x and name.y columns",
+             py::arg("name"), py::arg("template"), py::arg("region"), py::arg("locate") = false)
+        .def_property_readonly("columns", &ProbeSet::columns, "Result column names, in order")
+        .def("__len__", &ProbeSet::size)
+        .def_readwrite("on_change", &ProbeSet::on_change,
+                       "Only call the session's probe callback when a result moves")
+        .def_readwrite("tolerance", &ProbeSet::change_tolerance,
+                       "How far a result must move to count as a change")
+        .def("evaluate", [](const ProbeSet& probes, const VideoFrame& frame) {
+            std::vector<float> results(probes.size());
+            {
+                py::gil_scoped_release release;
+                probes.evaluate(frame, results.data());
+            }
+            return probe_results_to_numpy(results);
+        }, "Evaluate on one frame; NaN where a probe doesn't fit it", py::arg("frame"))
+        .def("__repr__", [](const ProbeSet& probes) {
+            return "ProbeSet(columns=" + std::to_string(probes.size()) +
+                   ", on_change=" + (probes.on_change ? "True" : "False") + ")";
+        });
+    m.attr("PROBE_KERNEL") = ProbeSet::kernel_name();
     
     // Video buffer padding constant
     m.attr("VIDEO_BUFFER_PADDING_SIZE") = CHIAKI_VIDEO_BUFFER_PADDING_SIZE;
     
     // Helper functions for video processing
-    m.def("create_video_frame", [](py::bytes data, int width, int height) {
-        std::string str_data = data;
-        return VideoFrame(reinterpret_cast<uint8_t*>(const_cast<char*>(str_data.data())), 
-                         str_data.size(), width, height);
-    }, "Create VideoFrame from raw bytes", py::arg("data"), py::arg("width"), py::arg("height"));
+    m.def("create_video_frame", [](py::buffer data, int width, int height, PixelFormat format) {
+        py::buffer_info info = data.request();
+        if (!PyBuffer_IsContiguous(info.view(), 'C')) {
+            throw std::invalid_argument("create_video_frame needs a C-contiguous buffer");
+        }
+        const size_t size = static_cast<size_t>(info.size * info.itemsize);
+        if (format != PixelFormat::ENCODED && size < FrameConverter::output_size(format, width, height)) {
+            throw std::invalid_argument("buffer is smaller than width x height in that pixel format");
+        }
+        return VideoFrame(static_cast<const uint8_t*>(info.ptr), size, width, height, format);
+    }, "Create VideoFrame from raw bytes or any contiguous buffer", py::arg("data"), py::arg("width"), py::arg("height"),
+       py::arg("pixel_format") = PixelFormat::BGR);
+    
+    m.def("convert_yuv420", &convert_yuv420,
+          "Crop/resize/convert a packed I420 or NV12 picture per an OutputSpec",
+          py::arg("data"), py::arg("width"), py::arg("height"), py::arg("spec"),
+          py::arg("nv12") = false, py::arg("full_range") = false,
+          py::arg("matrix") = ColorMatrix::BT601);
+    
+    // Which colour conversion kernel this CPU runs: avx2, neon or scalar
+    m.attr("COLOR_CONVERT_KERNEL") = FrameConverter::kernel_name();
 }
@@ -0,0 +1,463 @@
+/**
+ * video_decoder.cpp - Native H.264/H.265 decode pipeline
+ *
+ * Samples are pushed into ChiakiFfmpegDecoder, which calls back into
+ * frame_available() on the same thread once libavcodec has a picture.
+ * The picture is then converted by FrameConverter straight into a pooled
+ * slab in the OutputSpec's layout and handed to the sink.
+ */
+
+#include "video_decoder.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+
+// Same clock as Python's time.monotonic_ns() and VideoFrame.timestamp_ns
+static int64_t steady_now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static OutputSpec full_frame_spec(PixelFormat format) {
+    OutputSpec spec;
+    spec.format = format;
+    return spec;
+}
+
+// Untagged streams follow the usual convention: BT.709 from 720p up
+static ColorMatrix color_matrix(const AVFrame* frame) {
+    switch (frame->colorspace) {
+        case AVCOL_SPC_BT709:
+            return ColorMatrix::BT709;
+        case AVCOL_SPC_BT2020_NCL:
+        case AVCOL_SPC_BT2020_CL:
+            return ColorMatrix::BT2020;
+        case AVCOL_SPC_UNSPECIFIED:
+            return frame->height >= 720 ? ColorMatrix::BT709 : ColorMatrix::BT601;
+        default:
+            return ColorMatrix::BT601;
+    }
+}
+
+VideoDecoder::VideoDecoder(PixelFormat format, FrameSink sink)
+    : VideoDecoder(full_frame_spec(format), std::move(sink)) {}
+
+VideoDecoder::VideoDecoder(const OutputSpec& spec, FrameSink sink)
+    : spec_(spec), sink_(std::move(sink)) {
+    spec_.validate();
+}
+
+VideoDecoder::~VideoDecoder() {
+    if (decoder_initialized) {
+        chiaki_ffmpeg_decoder_fini(&decoder);
+    }
+    sws_freeContext(sws_context);
+    av_frame_free(&scratch_frame);
+}
+
+ChiakiErrorCode VideoDecoder::init(ChiakiLog* log, ChiakiCodec codec, DecodeProfile profile) {
+    if (decoder_initialized) {
+        return CHIAKI_ERR_SUCCESS;
+    }
+
+    // Software decode only: frames have to end up in system memory anyway
+    ChiakiErrorCode err = chiaki_ffmpeg_decoder_init(&decoder, log, codec,
+                                                     nullptr, nullptr,
+                                                     frame_available, this);
+    if (err != CHIAKI_ERR_SUCCESS) {
+        return err;
+    }
+    err = apply_profile(profile);
+    if (err != CHIAKI_ERR_SUCCESS) {
+        chiaki_ffmpeg_decoder_fini(&decoder);
+        return err;
+    }
+
+    this->codec = codec;
+    profile_ = profile;
+    decoder_initialized = true;
+    return CHIAKI_ERR_SUCCESS;
+}
+
+// Threading can't change on an open context, so the profile gets a fresh
+// one. chiaki only keeps the pointer and frees it in fini.
+ChiakiErrorCode VideoDecoder::apply_profile(DecodeProfile profile) {
+    if (profile == DecodeProfile::DEFAULT) {
+        return CHIAKI_ERR_SUCCESS;
+    }
+
+    AVCodecContext* context = avcodec_alloc_context3(decoder.av_codec);
+    if (!context) {
+        return CHIAKI_ERR_MEMORY;
+    }
+    context->thread_count = 0; // One per core
+    if (profile == DecodeProfile::LOW_LATENCY) {
+        context->thread_type = FF_THREAD_SLICE;
+        context->flags |= AV_CODEC_FLAG_LOW_DELAY;
+        context->flags2 |= AV_CODEC_FLAG2_FAST;
+    } else {
+        context->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+    }
+    if (avcodec_open2(context, decoder.av_codec, nullptr) < 0) {
+        avcodec_free_context(&context);
+        return CHIAKI_ERR_UNKNOWN;
+    }
+
+    avcodec_free_context(&decoder.codec_context);
+    decoder.codec_context = context;
+    return CHIAKI_ERR_SUCCESS;
+}
+
+void DecodePolicy::validate() const {
+    if (target_fps < 0.0 || source_fps < 0.0) {
+        throw std::invalid_argument("frame rates must not be negative");
+    }
+    if (target_fps > 0.0 && source_fps <= 0.0) {
+        throw std::invalid_argument("target_fps needs the stream's source_fps");
+    }
+}
+
+void VideoDecoder::set_policy(const DecodePolicy& policy) {
+    policy.validate();
+    std::lock_guard<std::mutex> lock(policy_mutex);
+    policy_ = policy;
+}
+
+DecodePolicy VideoDecoder::policy() const {
+    std::lock_guard<std::mutex> lock(policy_mutex);
+    return policy_;
+}
+
+void VideoDecoder::set_change_detection(const std::optional<ChangeSpec>& spec) {
+    if (spec) {
+        spec->validate();
+    }
+    std::lock_guard<std::mutex> lock(policy_mutex);
+    change_spec_ = spec;
+    change_spec_changed_ = true;
+}
+
+std::optional<ChangeSpec> VideoDecoder::change_detection() const {
+    std::lock_guard<std::mutex> lock(policy_mutex);
+    return change_spec_;
+}
+
+void VideoDecoder::set_latency_probe(std::shared_ptr<LatencyProbe> probe) {
+    std::lock_guard<std::mutex> lock(policy_mutex);
+    latency_probe_ = std::move(probe);
+}
+
+std::shared_ptr<LatencyProbe> VideoDecoder::latency_probe() const {
+    std::lock_guard<std::mutex> lock(policy_mutex);
+    return latency_probe_;
+}
+
+VideoDecoder::Stats VideoDecoder::stats() const {
+    Stats result;
+    result.samples = samples_.load(std::memory_order_relaxed);
+    result.pictures = pictures_.load(std::memory_order_relaxed);
+    result.converted = converted_.load(std::memory_order_relaxed);
+    result.skipped = skipped_.load(std::memory_order_relaxed);
+    result.nonref_dropped = nonref_dropped_.load(std::memory_order_relaxed);
+    result.flushes = flushes_.load(std::memory_order_relaxed);
+    result.keyframe_wait_dropped = keyframe_wait_dropped_.load(std::memory_order_relaxed);
+    result.unchanged = unchanged_.load(std::memory_order_relaxed);
+    return result;
+}
+
+// Decimates on stream position rather than arrival time, so a replay
+// running faster than realtime is thinned the same way as a live stream
+bool VideoDecoder::advance_schedule(const DecodePolicy& policy, int32_t frames_lost) {
+    if (policy.target_fps <= 0.0 || policy.target_fps >= policy.source_fps) {
+        schedule_phase = 1.0;
+        return true;
+    }
+    const double step = policy.target_fps / policy.source_fps;
+    schedule_phase += std::max<int32_t>(frames_lost, 0) * step;
+    const bool due = schedule_phase >= 1.0;
+    if (due) {
+        // Frames lost in a burst don't earn a catch-up run of conversions
+        schedule_phase -= std::floor(schedule_phase);
+    }
+    schedule_phase += step;
+    return due;
+}
+
+const uint8_t* VideoDecoder::first_slice(const uint8_t* buf, size_t buf_size) const {
+    const bool hevc = codec != CHIAKI_CODEC_H264;
+    for (size_t i = 0; i + 3 < buf_size; i++) {
+        if (buf[i] != 0 || buf[i + 1] != 0 || buf[i + 2] != 1) {
+            continue;
+        }
+        const uint8_t header = buf[i + 3];
+        if (!hevc) {
+            const int type = header & 0x1f;
+            if (type >= 1 && type <= 5) {
+                return buf + i + 3;
+            }
+        } else if (((header >> 1) & 0x3f) < 32 && i + 4 < buf_size) {
+            return buf + i + 3; // Skips parameter sets, SEI and friends
+        }
+    }
+    return nullptr;
+}
+
+// H.264 slices with nal_ref_idc 0 are never referenced. HEVC sub-layer
+// non-reference pictures are only safe to drop while the stream has a
+// single temporal sub-layer, since a higher sub-layer may reference them.
+bool VideoDecoder::is_nonref_sample(const uint8_t* buf, size_t buf_size) {
+    const uint8_t* slice = first_slice(buf, buf_size);
+    if (!slice) {
+        return false;
+    }
+    if (codec == CHIAKI_CODEC_H264) {
+        return (slice[0] & 0x1f) != 5 && (slice[0] >> 5) == 0;
+    }
+    const int type = (slice[0] >> 1) & 0x3f;
+    const int temporal_id = (slice[1] & 0x07) - 1;
+    max_temporal_id = std::max(max_temporal_id, temporal_id);
+    return max_temporal_id == 0 && type <= 14 && type % 2 == 0;
+}
+
+// IDR for H.264; any IRAP picture (BLA, IDR, CRA) for HEVC
+bool VideoDecoder::is_keyframe_sample(const uint8_t* buf, size_t buf_size) const {
+    const uint8_t* slice = first_slice(buf, buf_size);
+    if (!slice) {
+        return false;
+    }
+    if (codec == CHIAKI_CODEC_H264) {
+        return (slice[0] & 0x1f) == 5;
+    }
+    const int type = (slice[0] >> 1) & 0x3f;
+    return type >= 16 && type <= 23;
+}
+
+bool VideoDecoder::push_sample(uint8_t* buf, size_t buf_size, int32_t frames_lost,
+                               bool frame_recovered) {
+    if (!decoder_initialized) {
+        return false;
+    }
+    samples_.fetch_add(1, std::memory_order_relaxed);
+
+    // LOW_LATENCY: references are gone, so rather than decode smeared
+    // pictures, reset and hold off until the console sends a keyframe.
+    // Returning false makes chiaki report the loss and ask for one.
+    if (profile_ == DecodeProfile::LOW_LATENCY) {
+        const bool keyframe = is_keyframe_sample(buf, buf_size);
+        if (frames_lost > 0 && !keyframe) {
+            avcodec_flush_buffers(decoder.codec_context);
+            flushes_.fetch_add(1, std::memory_order_relaxed);
+            keyframe_wait_dropped_.fetch_add(1, std::memory_order_relaxed);
+            keyframe_wait = KEYFRAME_WAIT_SAMPLES;
+            return false;
+        }
+        if (keyframe_wait > 0 && !keyframe) {
+            keyframe_wait--;
+            keyframe_wait_dropped_.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+        keyframe_wait = 0;
+    }
+
+    const DecodePolicy current = policy();
+    sample_due = advance_schedule(current, frames_lost);
+    // Never drop around loss: the decoder is about to resynchronise
+    if (!sample_due && current.drop_nonref && frames_lost == 0 && !frame_recovered &&
+        is_nonref_sample(buf, buf_size)) {
+        nonref_dropped_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    this->frame_recovered = frame_recovered;
+    return chiaki_ffmpeg_decoder_video_sample_cb(buf, buf_size, frames_lost,
+                                                 frame_recovered, &decoder);
+}
+
+void VideoDecoder::frame_available(ChiakiFfmpegDecoder* decoder, void* user) {
+    auto* self = static_cast<VideoDecoder*>(user);
+
+    int32_t frames_lost = 0;
+    AVFrame* frame = chiaki_ffmpeg_decoder_pull_frame(decoder, &frames_lost);
+    if (!frame) {
+        return;
+    }
+    const int64_t decoded_ns = steady_now_ns();
+    self->pictures_.fetch_add(1, std::memory_order_relaxed);
+
+    bool wanted = self->sample_due;
+    if (wanted && self->demand_probe && self->policy().skip_unconsumed) {
+        wanted = self->demand_probe();
+    }
+    if (wanted) {
+        self->convert_frame(frame, frames_lost, decoded_ns);
+    } else {
+        self->skipped_.fetch_add(1, std::memory_order_relaxed);
+        // A latency measurement still needs to see the picture
+        if (auto probe = self->latency_probe()) {
+            YuvPicture picture;
+            if (frame->width > 0 && frame->height > 0 && self->yuv_picture(frame, picture)) {
+                probe->on_picture(picture.planes[0], picture.strides[0], picture.width, picture.height,
+                                  decoded_ns);
+            }
+        }
+    }
+    av_frame_free(&frame);
+}
+
+void VideoDecoder::set_taps(const TapSpecs& taps) {
+    std::vector<Tap> replacement;
+    replacement.reserve(taps.size());
+    for (const auto& tap : taps) {
+        tap.second.validate();
+        replacement.emplace_back(tap.first, tap.second, frame_pool_.slab_count());
+    }
+    // Each tap reads its own ROI from the shared planes; in ROI order,
+    // taps over nearby rows run back to back while those rows are cached
+    std::stable_sort(replacement.begin(), replacement.end(), [](const Tap& a, const Tap& b) {
+        return a.spec.roi_y < b.spec.roi_y;
+    });
+    taps_ = std::move(replacement);
+}
+
+VideoDecoder::TapSpecs VideoDecoder::taps() const {
+    TapSpecs result;
+    for (const Tap& tap : taps_) {
+        result.emplace_back(tap.name, tap.spec);
+    }
+    return result;
+}
+
+FramePool* VideoDecoder::tap_pool(const std::string& name) {
+    for (Tap& tap : taps_) {
+        if (tap.name == name) {
+            return &tap.pool;
+        }
+    }
+    return nullptr;
+}
+
+bool VideoDecoder::yuv_picture(AVFrame* frame, YuvPicture& picture) {
+    const auto format = static_cast<AVPixelFormat>(frame->format);
+    picture.width = frame->width;
+    picture.height = frame->height;
+    picture.matrix = color_matrix(frame);
+    picture.full_range = frame->color_range == AVCOL_RANGE_JPEG || format == AV_PIX_FMT_YUVJ420P;
+
+    AVFrame* source = frame;
+    if (format == AV_PIX_FMT_NV12) {
+        picture.nv12 = true;
+    } else if (format != AV_PIX_FMT_YUV420P && format != AV_PIX_FMT_YUVJ420P) {
+        // 10-bit (HDR) and other layouts: one swscale pass down to YUV420P
+        if (!scratch_frame) {
+            scratch_frame = av_frame_alloc();
+            if (!scratch_frame) {
+                return false;
+            }
+        }
+        const AVPixelFormat scratch_format = picture.full_range ? AV_PIX_FMT_YUVJ420P : AV_PIX_FMT_YUV420P;
+        if (scratch_frame->width != frame->width || scratch_frame->height != frame->height ||
+            scratch_frame->format != scratch_format) {
+            av_frame_unref(scratch_frame);
+            scratch_frame->format = scratch_format;
+            scratch_frame->width = frame->width;
+            scratch_frame->height = frame->height;
+            if (av_frame_get_buffer(scratch_frame, 64) < 0) {
+                av_frame_unref(scratch_frame);
+                return false;
+            }
+        }
+        sws_context = sws_getCachedContext(sws_context,
+                                           frame->width, frame->height, format,
+                                           frame->width, frame->height,
+                                           static_cast<AVPixelFormat>(scratch_frame->format),
+                                           SWS_POINT, nullptr, nullptr, nullptr);
+        if (!sws_context) {
+            return false;
+        }
+        sws_scale(sws_context, frame->data, frame->linesize, 0, frame->height,
+                  scratch_frame->data, scratch_frame->linesize);
+        source = scratch_frame;
+    }
+
+    for (int plane = 0; plane < 3; plane++) {
+        picture.planes[plane] = source->data[plane];
+        picture.strides[plane] = source->linesize[plane];
+    }
+    return true;
+}
+
+void VideoDecoder::convert_frame(AVFrame* frame, int32_t frames_lost, int64_t decoded_ns) {
+    if (frame->width <= 0 || frame->height <= 0) {
+        return;
+    }
+
+    const FrameConverter::Geometry geometry = FrameConverter::resolve(spec_, frame->width, frame->height);
+    YuvPicture picture;
+    if (geometry.empty() || !yuv_picture(frame, picture)) {
+        return;
+    }
+
+    // Unchanged pictures stop here, before any conversion work
+    std::optional<ChangeSpec> change_spec;
+    std::shared_ptr<LatencyProbe> latency_probe;
+    {
+        std::lock_guard<std::mutex> lock(policy_mutex);
+        change_spec = change_spec_;
+        if (change_spec_changed_) {
+            change_detector_.reset();
+            change_spec_changed_ = false;
+        }
+        latency_probe = latency_probe_;
+    }
+    if (latency_probe) {
+        latency_probe->on_picture(picture.planes[0], picture.strides[0], picture.width, picture.height,
+                                  decoded_ns > 0 ? decoded_ns : steady_now_ns());
+    }
+    ChangeDetector::Result change;
+    change.score = -1.0f;
+    if (change_spec) {
+        change = change_detector_.measure(picture.planes[0], picture.strides[0], picture.width,
+                                          picture.height, *change_spec);
+        if (!change.changed) {
+            unchanged_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    }
+
+    // Convert straight into a pooled slab; the VideoFrame adopts it as is
+    const size_t size = FrameConverter::output_size(spec_.format, geometry.width, geometry.height);
+    FrameBufferRef pixels = frame_pool_.acquire(size);
+    converter.convert(picture, spec_, geometry, pixels.data());
+    VideoFrame decoded(std::move(pixels), size, geometry.width, geometry.height, spec_.format);
+
+    // Taps reuse the same picture; one whose ROI is off this frame is skipped
+    if (!taps_.empty()) {
+        auto taps = std::make_shared<VideoFrame::Taps>();
+        taps->reserve(taps_.size());
+        for (Tap& tap : taps_) {
+            const FrameConverter::Geometry tap_geometry =
+                FrameConverter::resolve(tap.spec, frame->width, frame->height);
+            if (tap_geometry.empty()) {
+                continue;
+            }
+            const size_t tap_size = FrameConverter::output_size(tap.spec.format, tap_geometry.width,
+                                                                tap_geometry.height);
+            FrameBufferRef tap_pixels = tap.pool.acquire(tap_size);
+            tap.converter.convert(picture, tap.spec, tap_geometry, tap_pixels.data());
+            taps->emplace_back(tap.name, VideoFrame(std::move(tap_pixels), tap_size, tap_geometry.width,
+                                                    tap_geometry.height, tap.spec.format));
+        }
+        decoded.set_taps(std::move(taps));
+    }
+
+    converted_.fetch_add(1, std::memory_order_relaxed);
+    if (sink_) {
+        const int64_t ready_ns = steady_now_ns();
+        decoded.set_decode_info(decoded_ns > 0 ? decoded_ns : ready_ns, ready_ns);
+        decoded.set_loss_info(frames_lost, frame_recovered);
+        decoded.set_change_info(change.score, change.hash);
+        sink_(std::move(decoded));
+    }
+}
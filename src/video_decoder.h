@@ -0,0 +1,197 @@
+/**
+ * video_decoder.h - Native H.264/H.265 decode pipeline
+ *
+ * Wraps ChiakiFfmpegDecoder so encoded samples coming out of the
+ * session's video callback are turned into VideoFrame pictures on the
+ * chiaki video thread. Pictures are cropped, resized and colour converted
+ * per the decoder's OutputSpec by FrameConverter; libswscale is only used
+ * to bring other decoder output formats down to 8-bit YUV 4:2:0 first.
+ */
+
+#pragma once
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+}
+
+#include <chiaki/ffmpegdecoder.h>
+#include <chiaki/log.h>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "change_detector.h"
+#include "color_convert.h"
+#include "frame_pool.h"
+#include "latency_probe.h"
+#include "video_frame.h"
+
+// What the decoder may leave out when consumers need fewer frames than
+// the stream carries. Reference frames are always decoded, so the codec
+// state stays valid whatever is skipped.
+struct DecodePolicy {
+    double target_fps = 0.0;       // convert at most this many frames per stream second; 0 = all
+    double source_fps = 0.0;       // stream frame rate the target is taken from
+    bool skip_unconsumed = false;  // don't convert pictures no consumer would receive
+    bool drop_nonref = false;      // don't even decode non-reference frames that aren't due
+
+    // Throws std::invalid_argument for negative rates or a target without a source
+    void validate() const;
+};
+
+// How libavcodec is set up. DEFAULT keeps chiaki-ng's own settings.
+enum class DecodeProfile {
+    DEFAULT,
+    // Slice threads only and AV_CODEC_FLAG_LOW_DELAY, so every sample
+    // comes back as a picture at once. On loss the decoder is flushed and
+    // samples are dropped until a keyframe rather than decoded into smears.
+    LOW_LATENCY,
+    // Frame threads: more pictures per second at a few frames of delay,
+    // for recording and offline workloads
+    THROUGHPUT,
+};
+
+class VideoDecoder {
+public:
+    using FrameSink = std::function<void(VideoFrame&&)>;
+    using DemandProbe = std::function<bool()>;
+
+    VideoDecoder(PixelFormat format, FrameSink sink);
+    VideoDecoder(const OutputSpec& spec, FrameSink sink);
+    ~VideoDecoder();
+
+    VideoDecoder(const VideoDecoder&) = delete;
+    VideoDecoder& operator=(const VideoDecoder&) = delete;
+
+    ChiakiErrorCode init(ChiakiLog* log, ChiakiCodec codec,
+                         DecodeProfile profile = DecodeProfile::DEFAULT);
+    DecodeProfile profile() const { return profile_; }
+
+    // Feed one encoded sample; returns false if the decoder rejected it or
+    // (LOW_LATENCY) the sample reports loss and a keyframe is needed.
+    // Samples dropped by the DecodePolicy count as accepted.
+    bool push_sample(uint8_t* buf, size_t buf_size, int32_t frames_lost, bool frame_recovered);
+
+    // Safe to change while samples flow
+    void set_policy(const DecodePolicy& policy);
+    DecodePolicy policy() const;
+
+    // Pictures whose luma barely differs from the last delivered one are
+    // dropped before conversion; nullopt turns detection off. Safe to
+    // change while samples flow; a change starts from a fresh reference.
+    void set_change_detection(const std::optional<ChangeSpec>& spec);
+    std::optional<ChangeSpec> change_detection() const;
+
+    // Shown the luma of every decoded picture, converted or skipped;
+    // nullptr detaches it. Safe to change while samples flow.
+    void set_latency_probe(std::shared_ptr<LatencyProbe> probe);
+    std::shared_ptr<LatencyProbe> latency_probe() const;
+
+    // Asked before converting when skip_unconsumed is set; false means
+    // nothing would receive the frame. Set before samples flow.
+    void set_demand_probe(DemandProbe probe) { demand_probe = std::move(probe); }
+
+    struct Stats {
+        uint64_t samples = 0;         // samples handed to push_sample
+        uint64_t pictures = 0;        // pictures libavcodec produced
+        uint64_t converted = 0;       // pictures converted and handed to the sink
+        uint64_t skipped = 0;         // pictures decoded but not converted
+        uint64_t nonref_dropped = 0;  // non-reference samples never decoded
+        uint64_t flushes = 0;         // LOW_LATENCY resets after loss
+        uint64_t keyframe_wait_dropped = 0;  // samples dropped waiting for a keyframe after one
+        uint64_t unchanged = 0;       // pictures change detection held back
+    };
+    Stats stats() const;
+
+    // Convert a decoded picture per the OutputSpec and hand it to the
+    // sink. Called from frame_available(); public so benchmarks can drive
+    // it directly. decoded_ns is when libavcodec returned the picture
+    // (0 = now).
+    void convert_frame(AVFrame* frame, int32_t frames_lost, int64_t decoded_ns = 0);
+
+    PixelFormat format() const { return spec_.format; }
+    const OutputSpec& output_spec() const { return spec_; }
+
+    // Named ROI outputs converted from every picture alongside the main
+    // one and attached to its VideoFrame. Not thread safe: set before
+    // samples flow.
+    using TapSpecs = std::vector<std::pair<std::string, OutputSpec>>;
+    void set_taps(const TapSpecs& taps);
+    TapSpecs taps() const;
+    FramePool* tap_pool(const std::string& name);
+    FramePool& frame_pool() { return frame_pool_; }
+
+    static constexpr size_t DEFAULT_POOL_SLABS = 8;
+    // LOW_LATENCY gives up on a keyframe after this many samples and
+    // decodes through, in case the console recovers without an IDR
+    static constexpr int KEYFRAME_WAIT_SAMPLES = 60;
+
+private:
+    static void frame_available(ChiakiFfmpegDecoder* decoder, void* user);
+
+    // Replaces the codec context chiaki opened with one set up per profile
+    ChiakiErrorCode apply_profile(DecodeProfile profile);
+
+    // Views frame as 8-bit 4:2:0, via swscale into scratch_frame if needed
+    bool yuv_picture(AVFrame* frame, YuvPicture& picture);
+
+    // Advances the target_fps schedule by one sample; true if it's due
+    bool advance_schedule(const DecodePolicy& policy, int32_t frames_lost);
+    bool is_nonref_sample(const uint8_t* buf, size_t buf_size);
+    bool is_keyframe_sample(const uint8_t* buf, size_t buf_size) const;
+    // NAL header of the first slice in an Annex B sample, or nullptr
+    const uint8_t* first_slice(const uint8_t* buf, size_t buf_size) const;
+
+    // Each tap converts into its own pool of equally sized slabs
+    struct Tap {
+        std::string name;
+        OutputSpec spec;
+        FrameConverter converter;
+        FramePool pool;
+
+        Tap(std::string name, const OutputSpec& spec, size_t slab_count)
+            : name(std::move(name)), spec(spec), pool(slab_count) {}
+    };
+
+    ChiakiFfmpegDecoder decoder;
+    bool decoder_initialized = false;
+    ChiakiCodec codec = CHIAKI_CODEC_H264;
+    int max_temporal_id = 0;  // HEVC: highest sub-layer seen so far
+    DecodeProfile profile_ = DecodeProfile::DEFAULT;
+    int keyframe_wait = 0;  // samples left to drop while waiting for a keyframe
+
+    mutable std::mutex policy_mutex;
+    DecodePolicy policy_;
+    double schedule_phase = 1.0;  // first sample is always due
+    bool sample_due = true;
+    DemandProbe demand_probe;
+    std::optional<ChangeSpec> change_spec_;  // under policy_mutex
+    bool change_spec_changed_ = false;       // under policy_mutex
+    ChangeDetector change_detector_;
+    std::shared_ptr<LatencyProbe> latency_probe_;  // under policy_mutex
+
+    std::atomic<uint64_t> samples_{0};
+    std::atomic<uint64_t> pictures_{0};
+    std::atomic<uint64_t> converted_{0};
+    std::atomic<uint64_t> skipped_{0};
+    std::atomic<uint64_t> nonref_dropped_{0};
+    std::atomic<uint64_t> flushes_{0};
+    std::atomic<uint64_t> keyframe_wait_dropped_{0};
+    std::atomic<uint64_t> unchanged_{0};
+
+    SwsContext* sws_context = nullptr;
+    AVFrame* scratch_frame = nullptr;
+    FrameConverter converter;
+    bool frame_recovered = false;
+    FramePool frame_pool_{DEFAULT_POOL_SLABS};
+    OutputSpec spec_;
+    std::vector<Tap> taps_;  // ordered top to bottom by ROI
+    FrameSink sink_;
+};
@@ -0,0 +1,172 @@
+/**
+ * video_frame.h - Decoded video frame container
+ *
+ * VideoFrame is shared between the session and video bindings so the
+ * native decode path in SessionWrapper can hand finished pictures to
+ * Python without going through raw bytes. Pixels live in a refcounted
+ * FrameBuffer slab, so copying a VideoFrame never copies pixel data.
+ *
+ * A decoded frame can also be a bundle: named ROI taps converted from the
+ * same picture ride along with it and share its stream position.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "frame_pool.h"
+
+// Pixel layouts a decoded frame can be delivered in. ENCODED frames carry
+// an undecoded H.264/H.265 sample as a flat byte buffer. The *_F32_CHW
+// formats are planar float32 (C, H, W) tensors, normalized per OutputSpec.
+enum class PixelFormat {
+    BGR,
+    RGB,
+    GRAY,
+    ENCODED,
+    RGB_F32_CHW,
+    BGR_F32_CHW
+};
+
+inline int pixel_format_channels(PixelFormat format) {
+    return (format == PixelFormat::GRAY || format == PixelFormat::ENCODED) ? 1 : 3;
+}
+
+inline bool pixel_format_is_float(PixelFormat format) {
+    return format == PixelFormat::RGB_F32_CHW || format == PixelFormat::BGR_F32_CHW;
+}
+
+// Bytes per channel value
+inline int pixel_format_sample_size(PixelFormat format) {
+    return pixel_format_is_float(format) ? static_cast<int>(sizeof(float)) : 1;
+}
+
+// Video frame wrapper for easy Python/OpenCV integration
+class VideoFrame {
+public:
+    using Taps = std::vector<std::pair<std::string, VideoFrame>>;
+
+    VideoFrame() = default;
+
+    // Copies the pixels into a standalone slab
+    VideoFrame(const uint8_t* data, size_t size, int width, int height,
+               PixelFormat format = PixelFormat::BGR)
+        : buffer_(FrameBufferRef::allocate(size)), size_(size),
+          width_(width), height_(height), format_(format) {
+        memcpy(buffer_.data(), data, size);
+    }
+
+    // Adopts a slab the pixels were already written into
+    VideoFrame(FrameBufferRef buffer, size_t size, int width, int height, PixelFormat format)
+        : buffer_(std::move(buffer)), size_(size),
+          width_(width), height_(height), format_(format) {}
+
+    uint8_t* data() { return buffer_.data(); }
+    const uint8_t* data() const { return buffer_.data(); }
+
+    int width() const { return width_; }
+    int height() const { return height_; }
+    size_t size() const { return size_; }
+    PixelFormat format() const { return format_; }
+    int channels() const { return pixel_format_channels(format_); }
+
+    // Stream health as reported by chiaki for the sample this frame came from
+    int32_t frames_lost() const { return frames_lost_; }
+    bool frame_recovered() const { return frame_recovered_; }
+    void set_loss_info(int32_t frames_lost, bool frame_recovered) {
+        frames_lost_ = frames_lost;
+        frame_recovered_ = frame_recovered;
+        if (taps_) {
+            for (auto& entry : *taps_) {
+                entry.second.set_loss_info(frames_lost, frame_recovered);
+            }
+        }
+    }
+
+    // Stream position (advances by 1 + frames_lost per sample, so gaps
+    // show both network loss and frames the consumer skipped) and the
+    // steady-clock time the encoded sample arrived
+    uint64_t sequence() const { return sequence_; }
+    int64_t timestamp_ns() const { return timestamp_ns_; }
+    void set_capture_info(uint64_t sequence, int64_t timestamp_ns) {
+        sequence_ = sequence;
+        timestamp_ns_ = timestamp_ns;
+        if (taps_) {
+            for (auto& entry : *taps_) {
+                entry.second.set_capture_info(sequence, timestamp_ns);
+            }
+        }
+    }
+
+    // Steady-clock times libavcodec returned the picture and conversion
+    // finished; with timestamp_ns they split receive -> ready latency
+    int64_t decoded_ns() const { return decoded_ns_; }
+    int64_t ready_ns() const { return ready_ns_; }
+    void set_decode_info(int64_t decoded_ns, int64_t ready_ns) {
+        decoded_ns_ = decoded_ns;
+        ready_ns_ = ready_ns;
+        if (taps_) {
+            for (auto& entry : *taps_) {
+                entry.second.set_decode_info(decoded_ns, ready_ns);
+            }
+        }
+    }
+
+    // Change detection result for the picture (see ChangeDetector): % of
+    // luma cells changed since the last delivered frame, -1 when not
+    // measured, and its 64-bit average hash
+    float change_score() const { return change_score_; }
+    uint64_t luma_hash() const { return luma_hash_; }
+    void set_change_info(float change_score, uint64_t luma_hash) {
+        change_score_ = change_score;
+        luma_hash_ = luma_hash;
+        if (taps_) {
+            for (auto& entry : *taps_) {
+                entry.second.set_change_info(change_score, luma_hash);
+            }
+        }
+    }
+
+    // ProbeSet results for this frame (see probe_set.h); null when the
+    // session has no probes. Shared by copies.
+    const std::shared_ptr<const std::vector<float>>& probes() const { return probes_; }
+    void set_probes(std::shared_ptr<const std::vector<float>> probes) { probes_ = std::move(probes); }
+
+    // Named ROI taps produced from the same decoded picture; shared by
+    // copies, so only the decoder fills them in before publishing
+    const Taps* taps() const { return taps_.get(); }
+    void set_taps(std::shared_ptr<Taps> taps) { taps_ = std::move(taps); }
+
+    const VideoFrame* tap(const std::string& name) const {
+        if (taps_) {
+            for (const auto& entry : *taps_) {
+                if (entry.first == name) {
+                    return &entry.second;
+                }
+            }
+        }
+        return nullptr;
+    }
+
+private:
+    FrameBufferRef buffer_;
+    size_t size_ = 0;
+    int width_ = 0;
+    int height_ = 0;
+    PixelFormat format_ = PixelFormat::BGR;
+    int32_t frames_lost_ = 0;
+    bool frame_recovered_ = false;
+    uint64_t sequence_ = 0;
+    int64_t timestamp_ns_ = 0;
+    int64_t decoded_ns_ = 0;
+    int64_t ready_ns_ = 0;
+    float change_score_ = -1.0f;
+    uint64_t luma_hash_ = 0;
+    std::shared_ptr<const std::vector<float>> probes_;
+    std::shared_ptr<Taps> taps_;
+};
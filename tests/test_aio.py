@@ -0,0 +1,40 @@
+"""
+Tests for the asyncio integration in py_chiaki_ng.aio
+"""
+
+import asyncio
+import sys
+
+import pytest
+import py_chiaki_ng
+from py_chiaki_ng.aio import AsyncSession
+
+
+pytestmark = pytest.mark.skipif(
+    not hasattr(py_chiaki_ng, 'OverflowPolicy'),
+    reason="C++ bindings not built"
+)
+
+
+@pytest.mark.skipif(sys.platform == "win32", reason="No wakeup fd on Windows")
+def test_notify_fds_available():
+    """Test that the session exposes pollable wakeup fds"""
+    session = py_chiaki_ng.Session()
+    assert session.frame_notify_fd() >= 0
+    assert session.event_notify_fd() >= 0
+    # Stable across calls
+    assert session.frame_notify_fd() == session.frame_notify_fd()
+
+
+def test_next_event_waits_without_stream():
+    """Test that awaiting an empty queue suspends instead of spinning"""
+    session = py_chiaki_ng.Session()
+    assert session.enable_event_queue()
+    assert session.arm_event_notify() is False
+    
+    async def wait_briefly():
+        asession = AsyncSession(session)
+        with pytest.raises(asyncio.TimeoutError):
+            await asyncio.wait_for(asession.next_event(), timeout=0.05)
+    
+    asyncio.run(wait_briefly())
@@ -78,3 +78,1238 @@ def test_controller_state_basic():
     # Test idle state
     controller.set_idle()
     assert controller.cross == False
+
+
+@pytest.mark.skipif(
+    not hasattr(py_chiaki_ng, 'create_video_frame'),
+    reason="C++ bindings not built"
+)
+def test_video_frame_numpy_view():
+    """Test that VideoFrame exposes its pixels without copying"""
+    np = pytest.importorskip("numpy")
+    
+    pixels = np.arange(4 * 2 * 3, dtype=np.uint8)
+    frame = py_chiaki_ng.create_video_frame(pixels.tobytes(), 4, 2)
+    
+    view = frame.to_numpy()
+    assert view.shape == (2, 4, 3)
+    assert view.base is frame
+    assert np.array_equal(view.ravel(), pixels)
+    
+    # Buffer protocol and to_numpy share the same slab
+    view[0, 0, 0] = 255
+    assert memoryview(frame)[0, 0, 0] == 255
+    
+    gray = py_chiaki_ng.create_video_frame(
+        bytes(8), 4, 2, py_chiaki_ng.PixelFormat.GRAY)
+    assert gray.to_numpy().shape == (2, 4)
+
+
+@pytest.mark.skipif(
+    not hasattr(py_chiaki_ng, 'OverflowPolicy'),
+    reason="C++ bindings not built"
+)
+def test_session_queues_without_stream():
+    """Test pull-based queues on a session that never started"""
+    session = py_chiaki_ng.Session()
+    
+    with pytest.raises(RuntimeError):
+        session.next_frame(timeout=0)
+    
+    assert session.enable_frame_queue(4, py_chiaki_ng.OverflowPolicy.DROP_NEWEST)
+    assert session.enable_event_queue(16)
+    assert session.next_frame(timeout=0) is None
+    assert session.next_event(timeout=0.01) is None
+    
+    stats = session.queue_stats()
+    assert stats["frames"]["capacity"] == 4
+    assert stats["frames"]["dropped"] == 0
+    assert stats["events"]["overflow"] == py_chiaki_ng.OverflowPolicy.DROP_OLDEST
+
+
+@pytest.mark.skipif(
+    not hasattr(py_chiaki_ng, 'SessionPool'),
+    reason="C++ bindings not built"
+)
+def test_session_pool_owns_sessions():
+    """Test SessionPool bookkeeping without connecting to a console"""
+    pool = py_chiaki_ng.SessionPool(threads=2)
+    sessions = [pool.create_session() for _ in range(3)]
+    
+    assert len(pool) == 3
+    assert pool[1] is not None
+    with pytest.raises(IndexError):
+        pool[3]
+    
+    stats = pool.stats()
+    assert stats["threads"] == 2
+    assert len(stats["sessions"]) == 3
+    assert stats["sessions"][0]["samples"] == 0
+    assert sessions[2].stats()["decode_backlog"] == 0
+
+
+# ChiakiCodec values for recording headers
+_CODEC_H264 = 0
+_CODEC_H265 = 1
+
+
+def _write_recording(path, samples, codec=_CODEC_H264, frames_lost=None):
+    """Write a minimal PCNGREC1 recording of encoded samples (see stream_recording.h)
+    
+    codec is the ChiakiCodec the payloads are in; frames_lost optionally
+    gives each sample's loss count.
+    """
+    import struct
+    
+    with open(path, "wb") as f:
+        f.write(b"PCNGREC1" + struct.pack("<IIQ", 1, codec, 0))
+        for i, payload in enumerate(samples):
+            lost = frames_lost[i] if frames_lost else 0
+            f.write(struct.pack("<IIqiB3x", 1, len(payload), i * 1_000_000, lost, 0))
+            f.write(payload + bytes(-len(payload) % 8))
+
+
+class _BitWriter:
+    """MSB-first bit writer with Exp-Golomb codes (H.264 7.2, 9.1)"""
+    
+    def __init__(self):
+        self.data = bytearray()
+        self.acc = 0
+        self.bits = 0
+    
+    def u(self, count, value):
+        for shift in reversed(range(count)):
+            self.acc = (self.acc << 1) | ((value >> shift) & 1)
+            self.bits += 1
+            if self.bits == 8:
+                self.data.append(self.acc)
+                self.acc = self.bits = 0
+    
+    def ue(self, value):
+        value += 1
+        self.u(value.bit_length() - 1, 0)
+        self.u(value.bit_length(), value)
+    
+    def se(self, value):
+        self.ue(2 * value - 1 if value > 0 else -2 * value)
+    
+    def align(self):
+        while self.bits:
+            self.u(1, 0)
+    
+    def trailing(self):
+        self.u(1, 1)
+        self.align()
+
+
+def _nal(header, rbsp):
+    """Annex B NAL unit with emulation prevention bytes"""
+    out = bytearray(b"\x00\x00\x00\x01" + bytes([header]))
+    zeros = 0
+    for byte in rbsp:
+        if zeros >= 2 and byte <= 3:
+            out.append(3)
+            zeros = 0
+        out.append(byte)
+        zeros = zeros + 1 if byte == 0 else 0
+    return bytes(out)
+
+
+def _h264_samples(pictures, idr=(0,), nonref=()):
+    """Encode luma planes into real H.264 samples for decode tests.
+    
+    pictures holds (height, width) uint8 planes, sizes a multiple of 16,
+    or None to repeat the previous picture. Planes are coded losslessly
+    as I_PCM macroblocks: IDR (with SPS/PPS) at the indices in idr, plain
+    I pictures elsewhere. None becomes a P picture of skipped macroblocks.
+    Pictures at the indices in nonref have nal_ref_idc 0. Chroma is grey.
+    """
+    height, width = pictures[0].shape
+    mbs_x, mbs_y = width // 16, height // 16
+    
+    sps = _BitWriter()
+    sps.u(8, 66)                      # profile_idc: Baseline
+    sps.u(8, 0)                       # constraint flags
+    sps.u(8, 30)                      # level_idc
+    sps.ue(0)                         # seq_parameter_set_id
+    sps.ue(0)                         # log2_max_frame_num_minus4
+    sps.ue(2)                         # pic_order_cnt_type: output order is decode order
+    sps.ue(1)                         # max_num_ref_frames
+    sps.u(1, 0)                       # gaps_in_frame_num_value_allowed_flag
+    sps.ue(mbs_x - 1)
+    sps.ue(mbs_y - 1)
+    sps.u(1, 1)                       # frame_mbs_only_flag
+    sps.u(1, 1)                       # direct_8x8_inference_flag
+    sps.u(1, 0)                       # frame_cropping_flag
+    sps.u(1, 0)                       # vui_parameters_present_flag
+    sps.trailing()
+    
+    pps = _BitWriter()
+    pps.ue(0)                         # pic_parameter_set_id
+    pps.ue(0)                         # seq_parameter_set_id
+    pps.u(1, 0)                       # entropy_coding_mode_flag: CAVLC
+    pps.u(1, 0)                       # bottom_field_pic_order_in_frame_present_flag
+    pps.ue(0)                         # num_slice_groups_minus1
+    pps.ue(0)                         # num_ref_idx_l0_default_active_minus1
+    pps.ue(0)                         # num_ref_idx_l1_default_active_minus1
+    pps.u(1, 0)                       # weighted_pred_flag
+    pps.u(2, 0)                       # weighted_bipred_idc
+    pps.se(0)                         # pic_init_qp_minus26
+    pps.se(0)                         # pic_init_qs_minus26
+    pps.se(0)                         # chroma_qp_index_offset
+    pps.u(1, 1)                       # deblocking_filter_control_present_flag
+    pps.u(1, 0)                       # constrained_intra_pred_flag
+    pps.u(1, 0)                       # redundant_pic_cnt_present_flag
+    pps.trailing()
+    parameter_sets = _nal(0x67, sps.data) + _nal(0x68, pps.data)
+    
+    samples = []
+    frame_num = 0
+    idr_count = 0
+    for index, plane in enumerate(pictures):
+        keyframe = index in idr
+        reference = index not in nonref
+        if keyframe:
+            frame_num = 0
+        slice_ = _BitWriter()
+        slice_.ue(0)                                  # first_mb_in_slice
+        slice_.ue(7 if plane is not None else 5)      # slice_type: I or P, whole picture
+        slice_.ue(0)                                  # pic_parameter_set_id
+        slice_.u(4, frame_num)
+        if keyframe:
+            slice_.ue(idr_count)                      # idr_pic_id
+            idr_count += 1
+        if plane is None:
+            slice_.u(1, 0)                            # num_ref_idx_active_override_flag
+            slice_.u(1, 0)                            # ref_pic_list_modification_flag_l0
+        if reference:
+            slice_.u(1, 0)                            # no_output_of_prior_pics / adaptive marking
+            if keyframe:
+                slice_.u(1, 0)                        # long_term_reference_flag
+        slice_.se(0)                                  # slice_qp_delta
+        slice_.ue(1)                                  # disable_deblocking_filter_idc
+        if plane is None:
+            slice_.ue(mbs_x * mbs_y)                  # mb_skip_run over the whole picture
+        else:
+            for mb_y in range(mbs_y):
+                for mb_x in range(mbs_x):
+                    slice_.ue(25)                     # mb_type: I_PCM
+                    slice_.align()
+                    block = plane[mb_y * 16:(mb_y + 1) * 16, mb_x * 16:(mb_x + 1) * 16]
+                    slice_.data += bytes(block.tobytes()) + bytes([128]) * 128
+        slice_.trailing()
+        
+        header = (0x60 if reference else 0) | (5 if keyframe else 1)
+        samples.append((parameter_sets if keyframe else b"") + _nal(header, slice_.data))
+        if reference:
+            frame_num = (frame_num + 1) % 16
+    return samples
+
+
+def _test_pictures(np):
+    """A flat 64x48 luma plane, and the same with a bright 16x16 square at (16, 16)"""
+    flat = np.full((48, 64), 60, dtype=np.uint8)
+    square = flat.copy()
+    square[16:32, 16:32] = 200
+    return flat, square
+
+
+@pytest.mark.skipif(
+    not hasattr(py_chiaki_ng, 'ReplaySession'),
+    reason="C++ bindings not built"
+)
+def test_replay_session_plays_recording(tmp_path):
+    """Test that a recording replays through the frame and event queues"""
+    path = str(tmp_path / "stream.pcngrec")
+    _write_recording(path, [b"\x00\x00\x00\x01\x65", b"\x00\x00\x00\x01\x41\x9a"])
+    
+    replay = py_chiaki_ng.ReplaySession(path, realtime=False)
+    assert replay.sample_count == 2
+    assert replay.duration_ns == 1_000_000
+    
+    assert replay.initialize()
+    assert replay.enable_frame_queue(8)
+    assert replay.enable_event_queue(8)
+    assert replay.start()
+    assert replay.join()
+    
+    frames = [replay.next_frame(timeout=1), replay.next_frame(timeout=1)]
+    assert [f.pixel_format for f in frames] == [py_chiaki_ng.PixelFormat.ENCODED] * 2
+    assert bytes(frames[1].to_numpy()) == b"\x00\x00\x00\x01\x41\x9a"
+    assert frames[1].sequence == frames[0].sequence + 1
+    
+    quit_event = replay.next_event(timeout=1)
+    assert isinstance(quit_event, py_chiaki_ng.QuitEvent)
+    assert quit_event.type == py_chiaki_ng.EventType.QUIT
+    assert quit_event.to_dict()["type"] == int(py_chiaki_ng.EventType.QUIT)
+    assert replay.stats()["samples"] == 2
+
+
+@pytest.mark.skipif(
+    not hasattr(py_chiaki_ng, 'ReplaySession'),
+    reason="C++ bindings not built"
+)
+def test_video_callback_exception(tmp_path, monkeypatch):
+    """Test that a raising video callback is reported instead of killing the process"""
+    import sys
+    
+    path = str(tmp_path / "stream.pcngrec")
+    _write_recording(path, [b"\x00\x00\x00\x01\x65", b"\x00\x00\x00\x01\x41\x9a"])
+    unraisable = []
+    monkeypatch.setattr(sys, "unraisablehook", lambda info: unraisable.append(info.exc_type))
+    
+    calls = []
+    
+    def on_sample(data, size, frames_lost, frame_recovered):
+        calls.append(size)
+        raise RuntimeError("boom")
+    
+    replay = py_chiaki_ng.ReplaySession(path, realtime=False)
+    assert replay.initialize()
+    replay.set_video_callback(on_sample)
+    assert replay.start()
+    assert replay.join()
+    
+    assert calls == [5, 6]
+    assert unraisable == [RuntimeError, RuntimeError]
+    assert replay.stats()["samples"] == 2
+
+
+@pytest.mark.skipif(
+    not hasattr(py_chiaki_ng, 'ReplaySession'),
+    reason="C++ bindings not built"
+)
+def test_replay_session_rejects_garbage(tmp_path):
+    """Test that a file without the recording magic is refused"""
+    path = tmp_path / "garbage.pcngrec"
+    path.write_bytes(b"not a recording at all")
+    with pytest.raises(RuntimeError):
+        py_chiaki_ng.ReplaySession(str(path))
+
+
+@pytest.mark.skipif(
+    not hasattr(py_chiaki_ng, 'ReplaySession'),
+    reason="C++ bindings not built"
+)
+def test_replay_session_loops_empty_recording(tmp_path):
+    """Test that looping an empty recording idles until stop() instead of spinning"""
+    import time
+    
+    path = str(tmp_path / "empty.pcngrec")
+    _write_recording(path, [])
+    replay = py_chiaki_ng.ReplaySession(path, realtime=False, loop=True)
+    assert replay.sample_count == 0
+    assert replay.initialize()
+    assert replay.enable_event_queue(8)
+    
+    assert replay.start()
+    cpu_start = time.process_time()
+    time.sleep(0.3)
+    assert time.process_time() - cpu_start < 0.15
+    
+    assert replay.stop()
+    assert replay.join()
+    assert isinstance(replay.next_event(timeout=1), py_chiaki_ng.QuitEvent)
+
+
+@pytest.mark.skipif(
+    not hasattr(py_chiaki_ng, 'INPUT_DTYPE'),
+    reason="C++ bindings not built"
+)
+def test_schedule_inputs_on_replay(tmp_path):
+    """Test that a scheduled macro is applied in order and waited for"""
+    np = pytest.importorskip("numpy")
+    
+    path = str(tmp_path / "empty.pcngrec")
+    _write_recording(path, [])
+    replay = py_chiaki_ng.ReplaySession(path)
+    assert replay.initialize()
+    
+    cross = int(py_chiaki_ng.ControllerButton.CROSS)
+    actions = np.zeros(3, dtype=py_chiaki_ng.INPUT_DTYPE)
+    actions["t"] = [0.0, 0.002, 0.004]
+    actions["buttons"] = [cross, 0, cross]
+    actions["left_x"] = [0, 0, 32767]
+    
+    replay.input_rate = 0
+    assert replay.schedule_inputs(actions) == 3
+    assert replay.wait_inputs(timeout=1)
+    
+    stats = replay.input_stats()
+    assert stats["applied"] == 3
+    assert stats["pending"] == 0
+    
+    # Every other column is optional, but the offsets are not
+    with pytest.raises(ValueError):
+        replay.schedule_inputs(np.zeros(2, dtype=[("buttons", "<u4")]))
+
+
+@pytest.mark.skipif(
+    not hasattr(py_chiaki_ng, 'INPUT_DTYPE'),
+    reason="C++ bindings not built"
+)
+def test_schedule_motion_inputs(tmp_path):
+    """Test that motion columns are applied together under InputField.MOTION"""
+    np = pytest.importorskip("numpy")
+    
+    path = str(tmp_path / "empty.pcngrec")
+    _write_recording(path, [])
+    replay = py_chiaki_ng.ReplaySession(path)
+    assert replay.initialize()
+    assert replay.enable_flight_recorder(max_bytes=1 << 20)
+    
+    actions = np.zeros(2, dtype=[("t", "<f8"), ("buttons", "<u4"), ("gyro_x", "<f4"),
+                                 ("orient_z", "<f4"), ("mask", "<u4")])
+    actions["t"] = [0.0, 0.002]
+    actions["buttons"] = [0, int(py_chiaki_ng.ControllerButton.CROSS)]
+    actions["gyro_x"] = [0.5, -0.5]
+    actions["mask"] = [int(py_chiaki_ng.InputField.ALL), int(py_chiaki_ng.InputField.BUTTONS)]
+    
+    replay.input_rate = 0
+    assert replay.schedule_inputs(actions) == 2
+    assert replay.wait_inputs(timeout=1)
+    
+    dump = tmp_path / "inputs.pcngrec"
+    replay.dump_flight_recorder(str(dump))
+    _, states = py_chiaki_ng.ReplaySession(str(dump), realtime=False).controller_states()
+    gyro_x = py_chiaki_ng.CONTROLLER_LAYOUT.index("gyro_x")
+    orient_w = py_chiaki_ng.CONTROLLER_LAYOUT.index("orient_w")
+    assert len(states) == 2
+    # The second row only sets buttons, so motion carries over
+    assert states[0, gyro_x] == states[1, gyro_x] == 0.5
+    # Motion columns left out keep their idle value
+    assert states[1, orient_w] == 1.0
+
+
+@pytest.mark.skipif(
+    not hasattr(py_chiaki_ng, 'CONTROLLER_LAYOUT'),
+    reason="C++ bindings not built"
+)
+def test_controller_state_array_layout():
+    """Test the packed controller layout round trip and batch form"""
+    np = pytest.importorskip("numpy")
+    layout = py_chiaki_ng.CONTROLLER_LAYOUT
+    assert len(layout) == 17
+    
+    state = py_chiaki_ng.ControllerState()
+    state.cross = True
+    state.l2_state = 255
+    state.left_x = -32768
+    values = state.to_array(normalized=True)
+    assert values.dtype == np.float32
+    assert values[layout.index("l2_state")] == 1.0
+    
+    restored = py_chiaki_ng.ControllerState.from_array(values, normalized=True)
+    assert restored.cross and restored.l2_state == 255 and restored.left_x == -32768
+    
+    action = np.zeros(17)
+    action[layout.index("right_y")] = 2.0  # Clamped
+    restored.apply(action, normalized=True)
+    assert restored.right_y == 32767 and not restored.cross
+    
+    batch = np.stack([values, action.astype(np.float32)])
+    states = py_chiaki_ng.ControllerState.from_batch(batch, normalized=True)
+    assert len(states) == 2
+    assert py_chiaki_ng.ControllerState.to_batch(states).shape == (2, 17)
+    
+    with pytest.raises(ValueError):
+        py_chiaki_ng.ControllerState.from_array(np.zeros(16))
+
+
+@pytest.mark.skipif(
+    not hasattr(py_chiaki_ng, 'OutputSpec'),
+    reason="C++ bindings not built"
+)
+def test_convert_yuv420_output_spec():
+    """Test crop/resize/tensor output of the native colour conversion"""
+    np = pytest.importorskip("numpy")
+    
+    width, height = 64, 32
+    luma = np.tile(np.arange(width, dtype=np.uint8), (height, 1))
+    chroma = np.full((height // 2, width // 2), 128, dtype=np.uint8)
+    i420 = np.concatenate([luma.ravel(), chroma.ravel(), chroma.ravel()])
+    
+    # Neutral chroma in full range: every channel equals luma
+    frame = py_chiaki_ng.convert_yuv420(i420, width, height, py_chiaki_ng.OutputSpec(), full_range=True)
+    pixels = frame.to_numpy()
+    assert pixels.shape == (height, width, 3)
+    assert np.array_equal(pixels[..., 0], luma) and np.array_equal(pixels[..., 2], luma)
+    
+    spec = py_chiaki_ng.OutputSpec(
+        width=8, height=4, roi=(16, 8, 32, 16),
+        pixel_format=py_chiaki_ng.PixelFormat.RGB_F32_CHW,
+        mean=(0.5, 0.5, 0.5), std=(0.5, 0.5, 0.5))
+    tensor = py_chiaki_ng.convert_yuv420(i420, width, height, spec, full_range=True).to_numpy()
+    assert tensor.dtype == np.float32 and tensor.shape == (3, 4, 8)
+    expected = (luma[10:24:4, 18:48:4] / 255.0 - 0.5) / 0.5
+    assert np.allclose(tensor[0], expected, atol=1e-5)
+    
+    # NV12 input gives the same picture
+    nv12 = np.concatenate([luma.ravel(), np.full(chroma.size * 2, 128, dtype=np.uint8)])
+    same = py_chiaki_ng.convert_yuv420(nv12, width, height, spec, nv12=True, full_range=True)
+    assert np.array_equal(same.to_numpy(), tensor)
+    
+    assert py_chiaki_ng.COLOR_CONVERT_KERNEL in ("avx2", "neon", "scalar")
+    with pytest.raises(ValueError):
+        py_chiaki_ng.OutputSpec(std=(1.0, 0.0, 1.0))
+    with pytest.raises(ValueError):
+        py_chiaki_ng.convert_yuv420(i420[:100], width, height, spec)
+
+
+@pytest.mark.skipif(
+    not hasattr(py_chiaki_ng, 'ReplaySession'),
+    reason="C++ bindings not built"
+)
+def test_session_roi_taps(tmp_path):
+    """Test that named ROI taps arrive with each decoded frame, cut from the picture"""
+    np = pytest.importorskip("numpy")
+    
+    flat, square = _test_pictures(np)
+    path = str(tmp_path / "stream.pcngrec")
+    _write_recording(path, _h264_samples([square, flat]))
+    
+    replay = py_chiaki_ng.ReplaySession(path, realtime=False)
+    assert replay.initialize()
+    
+    minimap = py_chiaki_ng.OutputSpec(width=8, height=8, roi=(16, 16, 16, 16))
+    strip = py_chiaki_ng.OutputSpec(roi=(0, 40, 64, 8), pixel_format=py_chiaki_ng.PixelFormat.GRAY)
+    outside = py_chiaki_ng.OutputSpec(roi=(100, 0, 8, 8), pixel_format=py_chiaki_ng.PixelFormat.GRAY)
+    assert replay.add_tap("minimap", minimap)
+    assert replay.add_tap("strip", strip)
+    assert replay.add_tap("outside", outside)
+    assert replay.add_tap("health", strip)
+    assert set(replay.taps) == {"minimap", "strip", "outside", "health"}
+    assert replay.taps["minimap"].roi == (16, 16, 16, 16)
+    
+    # LOW_LATENCY decodes without frame threads, so each sample yields its picture at once
+    assert replay.enable_decoding(py_chiaki_ng.PixelFormat.GRAY,
+                                  profile=py_chiaki_ng.DecodeProfile.LOW_LATENCY)
+    assert set(replay.frame_pool_info()["taps"]) == {"minimap", "strip", "outside", "health"}
+    
+    assert replay.remove_tap("health")
+    assert not replay.remove_tap("health")
+    assert set(replay.frame_pool_info()["taps"]) == {"minimap", "strip", "outside"}
+    
+    bundles = []
+    
+    def on_frame(frame):
+        bundle = {name: tap.to_numpy().copy() for name, tap in frame.taps.items()}
+        bundle["frame"] = frame.to_numpy().copy()
+        bundles.append(bundle)
+    
+    replay.set_frame_callback(on_frame)
+    assert replay.start()
+    assert replay.join()
+    
+    assert len(bundles) == 2
+    first, second = bundles
+    # A tap whose ROI lies off the picture is left out of the bundle
+    assert set(first) == {"frame", "minimap", "strip"}
+    assert first["frame"].shape == (48, 64)
+    assert first["minimap"].shape == (8, 8, 3)
+    assert first["strip"].shape == (8, 64)
+    # The minimap covers the square, which only the first picture has
+    assert first["minimap"].min() > second["minimap"].max() + 100
+    np.testing.assert_array_equal(first["strip"], second["strip"])
+    np.testing.assert_array_equal(first["strip"], first["frame"][40:48])
+    
+    # Frames without taps behave like an empty bundle
+    frame = py_chiaki_ng.create_video_frame(bytes(8), 4, 2, py_chiaki_ng.PixelFormat.GRAY)
+    assert frame.taps == {}
+    assert "minimap" not in frame
+    with pytest.raises(KeyError):
+        frame["minimap"]
+
+
+@pytest.mark.skipif(
+    not hasattr(py_chiaki_ng, 'DecodePolicy'),
+    reason="C++ bindings not built"
+)
+def test_session_decode_policy(tmp_path):
+    """Test that decode throttling skips conversions and drops non-reference samples"""
+    np = pytest.importorskip("numpy")
+    
+    _, square = _test_pictures(np)
+    # 12 pictures at 60 fps: an IDR, then P pictures alternating
+    # non-reference (odd) and reference (even)
+    pictures = [square] + [None] * 11
+    path = str(tmp_path / "stream.pcngrec")
+    _write_recording(path, _h264_samples(pictures, nonref=range(1, 12, 2)))
+    
+    replay = py_chiaki_ng.ReplaySession(path, realtime=False)
+    assert replay.initialize()
+    with pytest.raises(ValueError):
+        replay.set_decode_policy(py_chiaki_ng.DecodePolicy(target_fps=-1))
+    assert replay.decode_policy.target_fps == 0
+    
+    replay.set_decode_policy(py_chiaki_ng.DecodePolicy(target_fps=15, drop_nonref=True))
+    policy = replay.decode_policy
+    assert policy.target_fps == 15
+    assert policy.source_fps == 60  # from the session's video profile
+    assert policy.drop_nonref
+    
+    assert replay.enable_decoding(py_chiaki_ng.PixelFormat.GRAY,
+                                  profile=py_chiaki_ng.DecodeProfile.LOW_LATENCY)
+    stats = replay.stats()
+    assert stats["frames_skipped"] == 0
+    assert stats["nonref_dropped"] == 0
+    
+    frames = []
+    replay.set_frame_callback(lambda frame: frames.append(frame.to_numpy().copy()))
+    assert replay.start()
+    assert replay.join()
+    
+    # Every fourth sample (0, 4, 8) is due and converted. The other
+    # reference pictures (2, 6, 10) are decoded but not converted, and the
+    # non-reference ones are never decoded.
+    assert len(frames) == 3
+    for frame in frames:
+        np.testing.assert_array_equal(frame, frames[0])
+    assert frames[0][16:32, 16:32].min() > frames[0][:16].max()
+    stats = replay.stats()
+    assert stats["pictures"] == 6
+    assert stats["frames_decoded"] == 3
+    assert stats["frames_skipped"] == 3
+    assert stats["nonref_dropped"] == 6
+    
+    interval = replay.interval_stats()
+    assert set(interval) >= {"samples", "frames_decoded", "frames_skipped", "nonref_dropped",
+                             "frames_lost", "frames_recovered", "interval_ns"}
+    assert interval["samples"] == 12
+    assert interval["frames_skipped"] == 3
+    assert interval["nonref_dropped"] == 6
+    assert interval["interval_ns"] > 0
+    assert replay.interval_stats()["samples"] == 0
+
+
+@pytest.mark.skipif(
+    not hasattr(py_chiaki_ng, 'DecodeProfile'),
+    reason="C++ bindings not built"
+)
+def test_session_decode_profile(tmp_path):
+    """Test that LOW_LATENCY flushes on loss and drops samples until a keyframe"""
+    np = pytest.importorskip("numpy")
+    
+    flat, square = _test_pictures(np)
+    # The third sample arrives after a lost one; the next keyframe is the sixth
+    path = str(tmp_path / "stream.pcngrec")
+    _write_recording(path, _h264_samples([square, None, None, None, None, flat, None], idr=(0, 5)),
+                     frames_lost=[0, 0, 1, 0, 0, 0, 0])
+    
+    replay = py_chiaki_ng.ReplaySession(path, realtime=False)
+    assert replay.initialize()
+    assert replay.enable_decoding(py_chiaki_ng.PixelFormat.GRAY,
+                                  profile=py_chiaki_ng.DecodeProfile.LOW_LATENCY)
+    stats = replay.stats()
+    assert stats["decoder_flushes"] == 0
+    assert stats["keyframe_wait_dropped"] == 0
+    
+    frames = []
+    
+    def on_frame(frame):
+        frames.append((frame.to_numpy().copy(), frame.timestamp_ns, frame.decoded_ns, frame.ready_ns))
+    
+    replay.set_frame_callback(on_frame)
+    assert replay.start()
+    assert replay.join()
+    
+    # The lossy sample and the two after it are dropped; decoding resumes
+    # at the keyframe with the new picture
+    stats = replay.stats()
+    assert stats["decoder_flushes"] == 1
+    assert stats["keyframe_wait_dropped"] == 3
+    assert len(frames) == 4
+    pixels = [picture[20, 20] for picture, _, _, _ in frames]
+    assert pixels[0] == pixels[1] > pixels[2] == pixels[3]
+    for _, timestamp_ns, decoded_ns, ready_ns in frames:
+        assert 0 < timestamp_ns <= decoded_ns <= ready_ns
+    
+    # Frames built in Python were never decoded
+    frame = py_chiaki_ng.create_video_frame(bytes(8), 4, 2, py_chiaki_ng.PixelFormat.GRAY)
+    assert frame.decoded_ns == 0
+    assert frame.ready_ns == 0
+
+
+@pytest.mark.skipif(
+    not hasattr(py_chiaki_ng, 'ReplaySession'),
+    reason="C++ bindings not built"
+)
+def test_session_metrics(tmp_path):
+    """Test the stats snapshot, its numpy form and the Prometheus dump"""
+    path = str(tmp_path / "stream.pcngrec")
+    _write_recording(path, [b"\x00\x00\x00\x01\x65", b"\x00\x00\x00\x01\x41\x9a"])
+    
+    replay = py_chiaki_ng.ReplaySession(path, realtime=False)
+    assert replay.initialize()
+    assert replay.enable_frame_queue(8)
+    assert replay.start()
+    assert replay.join()
+    assert replay.next_frame(timeout=1) is not None
+    assert replay.send_controller_state(py_chiaki_ng.ControllerState())
+    
+    stats = replay.stats()
+    assert stats["samples"] == 2
+    assert stats["sample_bytes"] == 11
+    assert stats["controller_sends"] == 1
+    assert stats["frame_queue_depth"] == 1
+    assert stats["bitrate_bps"] > 0
+    assert stats["latency"]["queue_wait"]["count"] == 1
+    assert stats["latency"]["queue_wait"]["p50_ns"] <= stats["latency"]["queue_wait"]["max_ns"]
+    
+    record = replay.stats_array()
+    assert record.shape == (1,)
+    assert record["samples"][0] == 2
+    assert record["queue_wait_count"][0] == 1
+    
+    text = replay.prometheus_metrics(labels={"bot": "test"})
+    assert "# TYPE py_chiaki_ng_samples_total counter" in text
+    assert 'py_chiaki_ng_samples_total{bot="test"} 2' in text
+    assert 'py_chiaki_ng_queue_wait_seconds_count{bot="test"} 1' in text
+
+
+@pytest.mark.skipif(
+    not hasattr(py_chiaki_ng, 'ReplaySession'),
+    reason="C++ bindings not built"
+)
+def test_session_typed_events(tmp_path):
+    """Test typed event delivery and the event type filter"""
+    path = str(tmp_path / "stream.pcngrec")
+    _write_recording(path, [b"\x00\x00\x00\x01\x65"])
+    
+    replay = py_chiaki_ng.ReplaySession(path, realtime=False)
+    assert replay.event_filter is None
+    replay.set_event_filter([py_chiaki_ng.EventType.RUMBLE])
+    assert set(replay.event_filter) == {py_chiaki_ng.EventType.RUMBLE, py_chiaki_ng.EventType.QUIT}
+    
+    received = []
+    replay.set_event_callback(received.append)
+    assert replay.initialize()
+    assert replay.start()
+    assert replay.join()
+    
+    assert len(received) == 1
+    quit_event = received[0]
+    assert isinstance(quit_event, py_chiaki_ng.Event)
+    assert isinstance(quit_event, py_chiaki_ng.QuitEvent)
+    assert quit_event.reason == py_chiaki_ng.QuitReason.STOPPED
+    assert quit_event.timestamp_ns > 0
+    assert replay.stats()["events"] == 1
+    
+    replay.set_event_filter(None)
+    assert replay.event_filter is None
+
+
+@pytest.mark.skipif(
+    not hasattr(py_chiaki_ng, 'ReplaySession'),
+    reason="C++ bindings not built"
+)
+def test_log_pipeline(tmp_path):
+    """Test the runtime log level mask and the log pipeline counters"""
+    import logging
+    
+    py_chiaki_ng.configure_logging(logging.getLogger("test.chiaki"))
+    path = str(tmp_path / "stream.pcngrec")
+    _write_recording(path, [b"\x00\x00\x00\x01\x65"])
+    
+    replay = py_chiaki_ng.ReplaySession(path, realtime=False)
+    assert replay.log_level == py_chiaki_ng.LOG_ALL
+    replay.set_log_level(py_chiaki_ng.LogLevel.WARNING | py_chiaki_ng.LogLevel.ERROR)
+    assert replay.log_level == int(py_chiaki_ng.LogLevel.WARNING) | int(py_chiaki_ng.LogLevel.ERROR)
+    assert replay.log_id > 0
+    
+    assert replay.initialize()
+    assert replay.start()
+    assert replay.join()
+    assert py_chiaki_ng.flush_logs(timeout=1)
+    
+    stats = py_chiaki_ng.log_stats()
+    assert stats["delivered"] == stats["written"]
+    assert replay.stats()["log_dropped"] == 0
+    py_chiaki_ng.configure_logging("py_chiaki_ng.chiaki")
+
+
+@pytest.mark.skipif(
+    not hasattr(py_chiaki_ng, 'AudioBuffer'),
+    reason="C++ bindings not built"
+)
+def test_audio_buffer_windows(tmp_path):
+    """Test zero-copy audio windows, timestamps and the session audio sink"""
+    import numpy as np
+    
+    audio = py_chiaki_ng.AudioBuffer(sample_rate=1000, channels=2, seconds=0.1)
+    assert audio.capacity == 100
+    assert audio.read(10, timeout=0) is None
+    
+    pcm = np.stack([np.arange(80, dtype=np.float32), -np.arange(80, dtype=np.float32)], axis=1)
+    audio.write(pcm, timestamp_ns=1_000_000_000)
+    audio.write(pcm, timestamp_ns=1_080_000_000)
+    assert audio.position == 160
+    assert audio.available == 100
+    
+    window, timestamp_ns = audio.read(50, timeout=0)
+    assert audio.overruns == 60
+    assert window.shape == (50, 2)
+    assert not window.flags.writeable
+    assert timestamp_ns == 1_060_000_000
+    # Crosses the ring's wrap point and is still one contiguous view
+    assert window[0, 0] == 60 and window[19, 0] == 79 and window[20, 0] == 0
+    
+    latest, latest_ns = audio.latest(10, copy=True)
+    assert latest.flags.writeable
+    assert latest[-1, 1] == -79
+    assert latest_ns == audio.timestamp_at(150)
+    
+    path = str(tmp_path / "stream.pcngrec")
+    _write_recording(path, [b"\x00\x00\x00\x01\x65"])
+    replay = py_chiaki_ng.ReplaySession(path, realtime=False)
+    assert replay.audio is None
+    assert not replay.enable_audio()
+    assert replay.initialize()
+    assert replay.enable_audio(seconds=2.0)
+    assert replay.audio.capacity == 96000
+    assert replay.stats()["audio_packets"] == 0
+
+
+@pytest.mark.skipif(
+    not hasattr(py_chiaki_ng, 'SharedFrameReader'),
+    reason="C++ bindings not built"
+)
+def test_shared_frame_ring(tmp_path):
+    """Test publishing frames into shared memory and attaching to them by name"""
+    import os
+    import numpy as np
+    
+    name = f"py_chiaki_ng_test_{os.getpid()}"
+    writer = py_chiaki_ng.SharedFrameWriter(name, 64, slots=2)
+    reader = py_chiaki_ng.SharedFrameReader(name)
+    assert reader.slot_count == 2
+    assert reader.writer_pid == os.getpid()
+    assert reader.latest() is None
+    assert reader.next(timeout=0) is None
+    
+    pixels = np.arange(48, dtype=np.uint8).reshape(4, 4, 3)
+    frame = py_chiaki_ng.create_video_frame(pixels, 4, 4, py_chiaki_ng.PixelFormat.BGR)
+    assert writer.publish(frame)
+    shared = reader.next(timeout=1.0)
+    assert shared.index == 0 and shared.valid()
+    view = shared.to_numpy()
+    assert view.shape == (4, 4, 3)
+    assert not view.flags.writeable
+    np.testing.assert_array_equal(view, pixels)
+    
+    # Lapping the ring reuses the slot under the old frame
+    assert writer.publish(frame) and writer.publish(frame)
+    assert not shared.valid()
+    assert shared.to_video_frame() is None
+    assert reader.read(0) is None
+    assert reader.next(timeout=0).index == 1
+    latest = reader.latest().to_video_frame()
+    np.testing.assert_array_equal(latest.to_numpy(), pixels)
+    
+    large = py_chiaki_ng.create_video_frame(np.zeros((8, 8, 3), dtype=np.uint8), 8, 8)
+    assert not writer.publish(large)
+    assert writer.stats() == {"published": 3, "oversize": 1}
+    writer.close()
+    assert reader.closed
+    assert reader.next(timeout=0).index == 2
+    assert reader.next() is None
+    
+    path = str(tmp_path / "stream.pcngrec")
+    samples = [b"\x00\x00\x00\x01\x65", b"\x00\x00\x00\x01\x41\x9a"]
+    _write_recording(path, samples)
+    replay = py_chiaki_ng.ReplaySession(path, realtime=False)
+    assert not replay.enable_shared_frames(name)
+    assert replay.initialize()
+    assert replay.enable_shared_frames(name, slots=4)
+    assert replay.shared_frames.slot_size == 1920 * 1080
+    session_reader = py_chiaki_ng.SharedFrameReader(name)
+    assert replay.start()
+    assert replay.join()
+    assert session_reader.write_index == 2
+    sample = session_reader.read(1)
+    assert sample.pixel_format == py_chiaki_ng.PixelFormat.ENCODED
+    assert sample.to_numpy().tobytes() == samples[1]
+    assert replay.stats()["shared_frames_published"] == 2
+
+
+@pytest.mark.skipif(
+    not hasattr(py_chiaki_ng, 'SessionConfig'),
+    reason="C++ bindings not built"
+)
+def test_session_config(tmp_path):
+    """Test SessionConfig validation and how the requested profile is reported"""
+    config = py_chiaki_ng.SessionConfig(
+        codec=py_chiaki_ng.Codec.H265,
+        resolution=py_chiaki_ng.VideoResolutionPreset.PRESET_540p,
+        fps=py_chiaki_ng.VideoFPSPreset.PRESET_30,
+    )
+    profile = config.video_profile
+    assert (profile.width, profile.height, profile.max_fps) == (960, 540, 30)
+    assert profile.codec == py_chiaki_ng.Codec.H265
+    assert py_chiaki_ng.SessionConfig(bitrate=3000).video_profile.bitrate == 3000
+    
+    with pytest.raises(ValueError):
+        py_chiaki_ng.SessionConfig(ps5=False, codec=py_chiaki_ng.Codec.H265)
+    with pytest.raises(ValueError):
+        py_chiaki_ng.SessionConfig(bitrate=100)
+    
+    assert py_chiaki_ng.Session().config is None
+    
+    path = str(tmp_path / "stream.pcngrec")
+    _write_recording(path, [b"\x00\x00\x01\x26\x01\xaf"], codec=_CODEC_H265)
+    replay = py_chiaki_ng.ReplaySession(path, realtime=False)
+    assert replay.video_profile is None
+    assert replay.initialize(config=py_chiaki_ng.SessionConfig(
+        resolution=py_chiaki_ng.VideoResolutionPreset.PRESET_720p,
+        fps=py_chiaki_ng.VideoFPSPreset.PRESET_30,
+        bitrate=4000,
+    ))
+    assert replay.video_profile.height == 720
+    # The recording's codec wins over the config's
+    assert replay.config.codec == py_chiaki_ng.Codec.H265
+    stats = replay.stats()
+    assert stats["video_width"] == 1280 and stats["video_height"] == 720
+    assert stats["video_max_fps"] == 30
+    assert stats["video_bitrate_kbps"] == 4000
+    assert stats["video_codec"] == int(py_chiaki_ng.Codec.H265)
+
+
+@pytest.mark.skipif(
+    not hasattr(py_chiaki_ng, 'ChangeDetection'),
+    reason="C++ bindings not built"
+)
+def test_change_detection(tmp_path):
+    """Test ChangeDetection validation and unchanged-frame suppression on a decoded stream"""
+    spec = py_chiaki_ng.ChangeDetection(threshold=0.5, roi=(0, 0, 640, 360), max_skip=30)
+    assert spec.grid == (64, 36)
+    assert spec.roi == (0, 0, 640, 360)
+    assert "threshold=0.5" in repr(spec)
+    assert py_chiaki_ng.CHANGE_DETECT_KERNEL in ("sse2", "neon", "scalar")
+    
+    with pytest.raises(ValueError):
+        py_chiaki_ng.ChangeDetection(threshold=100)
+    with pytest.raises(ValueError):
+        py_chiaki_ng.ChangeDetection(grid=(4, 36))
+    with pytest.raises(ValueError):
+        py_chiaki_ng.ChangeDetection(roi=(-1, 0, 0, 0))
+    
+    np = pytest.importorskip("numpy")
+    flat, square = _test_pictures(np)
+    path = str(tmp_path / "stream.pcngrec")
+    _write_recording(path, _h264_samples([flat, None, None, square, None, flat]))
+    replay = py_chiaki_ng.ReplaySession(path, realtime=False)
+    assert replay.initialize()
+    assert replay.change_detection is None
+    replay.set_change_detection(spec)
+    assert replay.change_detection.max_skip == 30
+    replay.set_change_detection(None)
+    assert replay.change_detection is None
+    assert replay.stats()["frames_unchanged"] == 0
+    
+    replay.set_change_detection(py_chiaki_ng.ChangeDetection(threshold=1.0, grid=(8, 8)))
+    assert replay.enable_decoding(py_chiaki_ng.PixelFormat.GRAY,
+                                  profile=py_chiaki_ng.DecodeProfile.LOW_LATENCY)
+    frames = []
+    replay.set_frame_callback(lambda frame: frames.append((frame.change_score, frame.luma_hash)))
+    assert replay.start()
+    assert replay.join()
+    
+    # The repeats of each picture are dropped; the square and its removal
+    # each move 8 of the 64 cells
+    assert replay.stats()["frames_unchanged"] == 3
+    assert len(frames) == 3
+    assert frames[0][0] == 100.0
+    assert frames[1][0] == 12.5
+    assert frames[2][0] == 12.5
+    assert frames[0][1] == frames[2][1] != frames[1][1]
+
+
+@pytest.mark.skipif(
+    not hasattr(py_chiaki_ng, 'ChangeDetector'),
+    reason="C++ bindings not built"
+)
+def test_change_detector_planes():
+    """Test scores, hashes, row sampling and max_skip on synthetic luma planes"""
+    np = pytest.importorskip("numpy")
+    
+    black = np.zeros((64, 64), dtype=np.uint8)
+    corner = black.copy()
+    corner[0:8, 0:8] = 255  # exactly one cell of an 8x8 grid
+    spec = py_chiaki_ng.ChangeDetection(threshold=1.0, grid=(8, 8))
+    
+    detector = py_chiaki_ng.ChangeDetector()
+    assert detector.measure(black, spec) == (True, 100.0, 0)
+    assert detector.measure(black, spec) == (False, 0.0, 0)
+    changed, score, luma_hash = detector.measure(corner, spec)
+    assert changed and score == pytest.approx(100 / 64)
+    assert luma_hash == 1
+    # A single changed cell stays under a higher threshold
+    detector.reset()
+    detector.measure(black, spec)
+    assert not detector.measure(corner, py_chiaki_ng.ChangeDetection(threshold=2.0, grid=(8, 8)))[0]
+    
+    # 8-row cells are read on rows 1, 3, 5 and 7: a line on row 0 is missed
+    line = black.copy()
+    line[0, :] = 255
+    detector.reset()
+    detector.measure(black, spec)
+    assert detector.measure(line, spec)[1] == 0.0
+    # With 4-row cells every row is read
+    fine = py_chiaki_ng.ChangeDetection(threshold=1.0, grid=(8, 16))
+    detector.reset()
+    detector.measure(black, fine)
+    assert detector.measure(line, fine)[1] == pytest.approx(100 / 16)
+    
+    # max_skip lets a frame through after that many unchanged ones
+    skipping = py_chiaki_ng.ChangeDetection(threshold=1.0, grid=(8, 8), max_skip=2)
+    detector.reset()
+    assert [detector.measure(black, skipping)[0] for _ in range(4)] == [True, False, False, True]
+    
+    with pytest.raises(ValueError):
+        detector.measure(np.zeros(64, dtype=np.uint8), spec)
+
+
+@pytest.mark.skipif(
+    not hasattr(py_chiaki_ng, 'ReplaySession'),
+    reason="C++ bindings not built"
+)
+def test_latency_probe(tmp_path):
+    """Test that a controller send is timed to the picture whose region changes"""
+    np = pytest.importorskip("numpy")
+    
+    flat, square = _test_pictures(np)
+    path = str(tmp_path / "stream.pcngrec")
+    _write_recording(path, _h264_samples([flat, square, flat]))
+    replay = py_chiaki_ng.ReplaySession(path, realtime=False)
+    spec = py_chiaki_ng.ChangeDetection(threshold=1.0, roi=(16, 16, 16, 16), grid=(8, 8))
+    with pytest.raises(RuntimeError):
+        replay.set_latency_probe(spec)
+    
+    assert replay.initialize()
+    assert replay.enable_decoding(py_chiaki_ng.PixelFormat.GRAY,
+                                  profile=py_chiaki_ng.DecodeProfile.LOW_LATENCY)
+    with pytest.raises(ValueError):
+        replay.set_latency_probe(spec, timeout=0)
+    assert replay.latency_probe is None
+    replay.set_latency_probe(spec, timeout=5.0)
+    assert replay.latency_probe.roi == (16, 16, 16, 16)
+    
+    state = py_chiaki_ng.ControllerState()
+    state.cross = True
+    assert replay.send_controller_state(state)
+    assert replay.send_controller_state(state)  # unchanged: not an input
+    state.cross = False
+    assert replay.send_controller_state(state)
+    stats = replay.stats()
+    assert stats["latency_probe_inputs"] == 1
+    assert stats["latency_probe_ignored"] == 1
+    assert stats["latency"]["input_to_photon"]["count"] == 0
+    
+    # The first picture is the reference, the square ends the measurement
+    # and its removal has no send to answer
+    assert replay.start()
+    assert replay.join()
+    stats = replay.stats()
+    assert stats["latency_probe_matched"] == 1
+    assert stats["latency_probe_unprompted"] == 1
+    assert stats["latency_probe_timeouts"] == 0
+    assert stats["latency"]["input_to_photon"]["count"] == 1
+    assert 0 < stats["latency_probe_last_ns"] < 5_000_000_000
+    
+    replay.set_latency_probe(None)
+    assert replay.latency_probe is None
+
+
+@pytest.mark.skipif(
+    not hasattr(py_chiaki_ng, 'ProbeSet'),
+    reason="C++ bindings not built"
+)
+def test_probe_set(tmp_path):
+    """Test native probes on a synthetic frame and on every frame a session decodes"""
+    np = pytest.importorskip("numpy")
+    
+    pixels = np.full((120, 160, 3), 20, dtype=np.uint8)
+    pixels[10:20, 10:20] = (0, 0, 250)  # BGR red
+    icon = ((np.indices((12, 16)).sum(axis=0) // 3) % 2 * 200 + 30).astype(np.uint8)
+    pixels[70:82, 100:116] = icon[:, :, None]
+    frame = py_chiaki_ng.create_video_frame(pixels, 160, 120, py_chiaki_ng.PixelFormat.BGR)
+    
+    probes = py_chiaki_ng.ProbeSet()
+    assert probes.add_pixel("red", 15, 15, (250, 0, 0), tolerance=10, radius=2) == 0
+    probes.add_pixel("blue", 15, 15, (0, 0, 250))
+    probes.add_mean("red_mean", (10, 10, 10, 10), channel=0)
+    probes.add_variance("flat", (30, 30, 20, 20))
+    probes.add_template("icon", icon, (80, 50, 60, 50), locate=True)
+    probes.add_mean("outside", (150, 110, 20, 20))
+    assert probes.columns == ["red", "blue", "red_mean", "flat", "icon", "icon.x", "icon.y", "outside"]
+    assert py_chiaki_ng.PROBE_KERNEL in ("sse2", "neon", "scalar")
+    
+    results = probes.evaluate(frame)
+    assert results.dtype == np.float32 and len(results) == len(probes)
+    assert results[0] == 1.0 and results[1] == 0.0
+    assert results[2] == pytest.approx(250.0)
+    assert results[3] == 0.0
+    assert results[4] == pytest.approx(1.0, abs=1e-4)
+    assert (results[5], results[6]) == (100.0, 70.0)
+    assert np.isnan(results[7])
+    assert frame.probes is None
+    
+    with pytest.raises(ValueError):
+        probes.add_mean("red", (0, 0, 4, 4))
+    with pytest.raises(ValueError):
+        probes.add_template("flat_icon", np.zeros((8, 8), dtype=np.uint8), (0, 0, 16, 16))
+    
+    flat, square = _test_pictures(np)
+    path = str(tmp_path / "stream.pcngrec")
+    _write_recording(path, _h264_samples([square, None, flat, square]))
+    replay = py_chiaki_ng.ReplaySession(path, realtime=False)
+    assert replay.probes is None and replay.latest_probes() is None
+    replay.set_probes(py_chiaki_ng.ProbeSet(on_change=True))
+    assert replay.probes.on_change
+    replay.set_probe_callback(lambda results, sequence, timestamp_ns: None)
+    replay.set_probes(None)
+    assert replay.stats()["probe_callbacks"] == 0
+    
+    # Decoded limited-range luma 200 is 214 in the full-range BGR frame
+    probes = py_chiaki_ng.ProbeSet(on_change=True)
+    probes.add_pixel("square", 24, 24, (214, 214, 214), tolerance=8, radius=1)
+    probes.add_mean("square_mean", (16, 16, 16, 16))
+    probes.add_template("square_icon", square[8:40, 8:40], (0, 0, 64, 48), locate=True)
+    assert replay.initialize()
+    assert replay.enable_decoding(py_chiaki_ng.PixelFormat.BGR,
+                                  profile=py_chiaki_ng.DecodeProfile.LOW_LATENCY)
+    replay.set_probes(probes)
+    
+    frames = []
+    callbacks = []
+    replay.set_frame_callback(lambda frame: frames.append((np.array(frame.probes), frame.sequence)))
+    replay.set_probe_callback(lambda results, sequence, timestamp_ns: callbacks.append(sequence))
+    assert replay.start()
+    assert replay.join()
+    
+    assert len(frames) == 4
+    for results, _ in frames[:2] + frames[3:]:
+        assert results[0] == 1.0
+        assert results[1] == pytest.approx(214.0, abs=3)
+        assert results[2] > 0.99
+        assert (results[3], results[4]) == (8.0, 8.0)
+    results = frames[2][0]
+    assert results[0] == 0.0
+    assert results[1] == pytest.approx(51.0, abs=3)
+    assert results[2] == 0.0  # nothing to correlate with on a flat picture
+    
+    # on_change: the repeated picture doesn't call back
+    assert callbacks == [frames[0][1], frames[2][1], frames[3][1]]
+    assert replay.stats()["probe_callbacks"] == 3
+    latest, sequence, timestamp_ns = replay.latest_probes()
+    np.testing.assert_array_equal(latest, frames[3][0])
+    assert sequence == frames[3][1] and timestamp_ns > 0
+
+
+@pytest.mark.skipif(
+    not hasattr(py_chiaki_ng, 'ReplaySession'),
+    reason="C++ bindings not built"
+)
+def test_container_recording(tmp_path):
+    """Test remuxing a replayed stream into Matroska"""
+    np = pytest.importorskip("numpy")
+    
+    flat, square = _test_pictures(np)
+    path = str(tmp_path / "stream.pcngrec")
+    # A plain I picture ahead of the IDR, which carries the SPS and PPS
+    _write_recording(path, _h264_samples([square, square, None, flat, None], idr=(1,)))
+    replay = py_chiaki_ng.ReplaySession(path, realtime=False)
+    with pytest.raises(RuntimeError):
+        replay.start_recording(str(tmp_path / "early.mkv"))
+    
+    assert replay.initialize()
+    with pytest.raises(ValueError):
+        replay.start_recording(str(tmp_path / "raw.pcngrec"), segment_seconds=60)
+    with pytest.raises(ValueError):
+        replay.start_recording(str(tmp_path / "out.xyz"), container="no-such-muxer")
+    
+    out = tmp_path / "out.mkv"
+    replay.start_recording(str(out), segment_seconds=60)
+    assert replay.recording
+    assert replay.start()
+    assert replay.join()
+    replay.stop_recording()
+    assert not replay.recording
+    
+    assert replay.recording_error is None
+    stats = replay.stats()
+    assert stats["recording_dropped"] == 0
+    # The picture ahead of the keyframe is left out
+    segment = tmp_path / "out-000.mkv"
+    assert replay.recording_segments == [str(segment)]
+    assert stats["recording_segments"] == 1 and stats["recording_packets"] == 4
+    assert segment.stat().st_size == stats["recording_bytes"]
+    assert segment.read_bytes()[:4] == b"\x1a\x45\xdf\xa3"  # EBML header
+    
+    try:
+        import av
+    except ImportError:
+        return
+    with av.open(str(segment)) as container:
+        pictures = [frame.to_ndarray(format="gray") for frame in container.decode(video=0)]
+    assert len(pictures) == 4
+    assert pictures[0].shape == (48, 64)
+    assert pictures[1][20, 20] > pictures[2][20, 20]
+
+
+@pytest.mark.skipif(
+    not hasattr(py_chiaki_ng, 'ReplaySession'),
+    reason="C++ bindings not built"
+)
+def test_flight_recorder(tmp_path):
+    """Test that the flight recorder dumps on an error quit and on demand"""
+    import struct
+    
+    path = str(tmp_path / "stream.pcngrec")
+    # HEVC: TRAIL_R, IDR_W_RADL, TRAIL_R
+    _write_recording(path, [b"\x00\x00\x00\x01\x02\x01\xd0", b"\x00\x00\x00\x01\x26\x01\xaf",
+                            b"\x00\x00\x00\x01\x02\x01\xd0"], codec=_CODEC_H265)
+    # Append a QUIT event with an error reason
+    reason = int(py_chiaki_ng.QuitReason.STREAM_CONNECTION_UNKNOWN)
+    assert py_chiaki_ng.quit_reason_is_error(py_chiaki_ng.QuitReason.STREAM_CONNECTION_UNKNOWN)
+    with open(path, "ab") as f:
+        f.write(struct.pack("<IIqiB3x", 2, 8, 3_000_000, 0, 0))
+        f.write(struct.pack("<II", int(py_chiaki_ng.EventType.QUIT), reason))
+    
+    replay = py_chiaki_ng.ReplaySession(path, realtime=False)
+    assert not replay.enable_flight_recorder()
+    assert replay.initialize()
+    with pytest.raises(RuntimeError):
+        replay.dump_flight_recorder(str(tmp_path / "none.pcngrec"))
+    with pytest.raises(ValueError):
+        replay.enable_flight_recorder(max_bytes=1024)
+    crash = tmp_path / "crash.pcngrec"
+    assert replay.enable_flight_recorder(seconds=5.0, max_bytes=1 << 20, dump_on_error=str(crash))
+    
+    state = py_chiaki_ng.ControllerState()
+    state.cross = True
+    assert replay.send_controller_state(state)
+    assert replay.start()
+    assert replay.join()
+    
+    stats = replay.stats()
+    assert stats["flight_recorder_dumps"] == 1
+    assert stats["flight_recorder_dropped"] == 1  # the sample ahead of the keyframe
+    assert 0 < stats["flight_recorder_bytes"] <= 1 << 20
+    
+    dump = py_chiaki_ng.ReplaySession(str(crash), realtime=False)
+    assert (dump.sample_count, dump.event_count, dump.controller_state_count) == (2, 1, 1)
+    timestamps, states = dump.controller_states()
+    assert states.shape == (1, 17) and len(timestamps) == 1
+    assert states[0, 0] == state.to_array()[0]
+    
+    assert replay.dump_flight_recorder(str(tmp_path / "manual.pcngrec")) == 4
+    
+    # Controller states need version 2; a version 1 file holding one is corrupt
+    data = bytearray(crash.read_bytes())
+    assert struct.unpack_from("<I", data, 8)[0] == 2
+    struct.pack_into("<I", data, 8, 1)
+    downgraded = tmp_path / "v1.pcngrec"
+    downgraded.write_bytes(bytes(data))
+    with pytest.raises(RuntimeError):
+        py_chiaki_ng.ReplaySession(str(downgraded))